@@ -82,9 +82,20 @@ void Application::Initialize() {
     audio_service_.Initialize(codec);
     audio_service_.Start();
 
+    // Uplink audio has its own task, so work on the main loop never delays it
+    if (xTaskCreate([](void* arg) {
+            Application* app = static_cast<Application*>(arg);
+            app->AudioSendTask();
+            vTaskDelete(NULL);
+        }, "audio_send", 4096, this, 5, &audio_send_task_handle_) != pdPASS) {
+        // Nothing else sends the microphone audio, and the send queue callback notifies this task
+        ESP_LOGE(TAG, "Failed to create the audio send task");
+        abort();
+    }
+
     AudioServiceCallbacks callbacks;
     callbacks.on_send_queue_available = [this]() {
-        xEventGroupSetBits(event_group_, MAIN_EVENT_SEND_AUDIO);
+        xTaskNotifyGive(audio_send_task_handle_);
     };
     callbacks.on_wake_word_detected = [this](const std::string& wake_word) {
         xEventGroupSetBits(event_group_, MAIN_EVENT_WAKE_WORD_DETECTED);
@@ -175,7 +186,6 @@ void Application::Initialize() {
 void Application::Run() {
     const EventBits_t ALL_EVENTS = 
         MAIN_EVENT_SCHEDULE |
-        MAIN_EVENT_SEND_AUDIO |
         MAIN_EVENT_WAKE_WORD_DETECTED |
         MAIN_EVENT_VAD_CHANGE |
         MAIN_EVENT_CLOCK_TICK |
@@ -224,23 +234,6 @@ void Application::Run() {
             HandleStopListeningEvent();
         }
 
-        if (bits & MAIN_EVENT_SEND_AUDIO) {
-            while (auto packet = audio_service_.PopPacketFromSendQueue()) {
-#ifdef CONFIG_LSPLATFORM
-                auto duration = packet->frame_duration;
-                if (protocol_ && protocol_->SendAudio(std::move(packet))) {
-                    uplink_watchdog_.Feed(duration);
-                } else {
-                    break;
-                }
-#else // !CONFIG_LSPLATFORM
-                if (protocol_ && !protocol_->SendAudio(std::move(packet))) {
-                    break;
-                }
-#endif // CONFIG_LSPLATFORM
-            }
-        }
-
         if (bits & MAIN_EVENT_WAKE_WORD_DETECTED) {
             HandleWakeWordDetectedEvent();
         }
@@ -269,6 +262,9 @@ void Application::Run() {
             // Print debug info every 10 seconds
             if (clock_ticks_ % 10 == 0) {
                 SystemInfo::PrintHeapStats();
+#if CONFIG_AUDIO_PIPELINE_STATISTICS
+                audio_service_.PrintDebugStatistics();
+#endif
             }
             
 #if CONFIG_LSPLATFORM_BANNERS
@@ -515,13 +511,27 @@ void Application::InitializeProtocol() {
 
     display->SetStatus(Lang::Strings::LOADING_PROTOCOL);
 
-    if (ota_->HasMqttConfig()) {
-        protocol_ = std::make_unique<MqttProtocol>();
-    } else if (ota_->HasWebsocketConfig()) {
-        protocol_ = std::make_unique<WebsocketProtocol>();
-    } else {
-        ESP_LOGW(TAG, "No protocol specified in the OTA config, using MQTT");
-        protocol_ = std::make_unique<MqttProtocol>();
+    {
+        std::lock_guard<std::mutex> lock(audio_send_mutex_);
+        if (ota_->HasMqttConfig()) {
+            protocol_ = std::make_unique<MqttProtocol>();
+        } else if (ota_->HasWebsocketConfig()) {
+            protocol_ = std::make_unique<WebsocketProtocol>();
+        } else {
+            ESP_LOGW(TAG, "No protocol specified in the OTA config, using MQTT");
+            protocol_ = std::make_unique<MqttProtocol>();
+        }
+    }
+
+    {
+        // Longer frames save bandwidth and packet overhead on the cellular modem
+        Settings settings("audio", false);
+        auto profile = AudioService::FindAudioProfile(settings.GetString("profile"));
+        if (profile == kAudioProfileCount) {
+            profile = board.GetBoardType() == "ml307" ? kAudioProfileLowBandwidth : kAudioProfileDefault;
+        }
+        audio_service_.SetAudioProfile(profile);
+        protocol_->SetClientFrameDuration(audio_service_.frame_duration());
     }
 
 #ifdef CONFIG_LSPLATFORM
@@ -545,12 +555,21 @@ void Application::InitializeProtocol() {
         xEventGroupSetBits(event_group_, MAIN_EVENT_ERROR);
     });
     
+    protocol_->SetAudioPacketAllocator([this]() {
+        return audio_service_.AcquireDecodePacket();
+    });
+    protocol_->SetAudioPacketRecycler([this](std::unique_ptr<AudioStreamPacket> packet) {
+        audio_service_.RecycleDecodePacket(std::move(packet));
+    });
+
     protocol_->OnIncomingAudio([this](std::unique_ptr<AudioStreamPacket> packet) {
 #ifdef CONFIG_LSPLATFORM
         downlink_watchdog_.Feed(packet->frame_duration);
 #endif // CONFIG_LSPLATFORM
         if (GetDeviceState() == kDeviceStateSpeaking) {
             audio_service_.PushPacketToDecodeQueue(std::move(packet));
+        } else {
+            audio_service_.RecycleDecodePacket(std::move(packet));
         }
     });
     
@@ -560,6 +579,11 @@ void Application::InitializeProtocol() {
             ESP_LOGW(TAG, "Server sample rate %d does not match device output sample rate %d, resampling may cause distortion",
                 protocol_->server_sample_rate(), codec->output_sample_rate());
         }
+        if (protocol_->client_frame_duration() != audio_service_.frame_duration()) {
+            ESP_LOGI(TAG, "Server requested %dms uplink frames", protocol_->client_frame_duration());
+            audio_service_.SetFrameDuration(protocol_->client_frame_duration());
+        }
+        audio_service_.EnableSendHeadroom(protocol_->uplink_header_size() > 0);
     });
     
     protocol_->OnAudioChannelClosed([this, &board]() {
@@ -571,12 +595,12 @@ void Application::InitializeProtocol() {
         });
     });
     
-    protocol_->OnIncomingJson([this, display](const cJSON* root) {
-        // Parse JSON data
-        auto type = cJSON_GetObjectItem(root, "type");
-        if (strcmp(type->valuestring, "tts") == 0) {
-            auto state = cJSON_GetObjectItem(root, "state");
-            if (strcmp(state->valuestring, "start") == 0) {
+    protocol_->OnIncomingJson([this, display](const JsonMessage& message) {
+        // Dispatch on the message type, only the fields a handler needs are read
+        switch (message.type()) {
+        case kJsonWordTts: {
+            auto state = message.GetWord("state");
+            if (state == kJsonWordStart) {
                 Schedule([this]() {
                     aborted_ = false;
                     SetDeviceState(kDeviceStateSpeaking);
@@ -584,7 +608,7 @@ void Application::InitializeProtocol() {
                         downlink_watchdog_.Start();
 #endif // CONFIG_LSPLATFORM
                 });
-            } else if (strcmp(state->valuestring, "stop") == 0) {
+            } else if (state == kJsonWordStop) {
                 Schedule([this]() {
                     if (GetDeviceState() == kDeviceStateSpeaking) {
                         if (listening_mode_ == kListeningModeManualStop) {
@@ -597,20 +621,22 @@ void Application::InitializeProtocol() {
 #endif // CONFIG_LSPLATFORM
                     }
                 });
-            } else if (strcmp(state->valuestring, "sentence_start") == 0) {
-                auto text = cJSON_GetObjectItem(root, "text");
-                if (cJSON_IsString(text)) {
-                    ESP_LOGI(TAG, "<< %s", text->valuestring);
-                    Schedule([this, display, message = std::string(text->valuestring)]() {
+            } else if (state == kJsonWordSentenceStart) {
+                std::string text;
+                if (message.GetString("text", text)) {
+                    ESP_LOGI(TAG, "<< %s", text.c_str());
+                    Schedule([this, display, message = std::move(text)]() {
                         display->SetChatMessage("assistant", message.c_str());
                     });
                 }
             }
-        } else if (strcmp(type->valuestring, "stt") == 0) {
-            auto text = cJSON_GetObjectItem(root, "text");
-            if (cJSON_IsString(text)) {
-                ESP_LOGI(TAG, ">> %s", text->valuestring);
-                Schedule([this, display, message = std::string(text->valuestring)]() {
+            break;
+        }
+        case kJsonWordStt: {
+            std::string text;
+            if (message.GetString("text", text)) {
+                ESP_LOGI(TAG, ">> %s", text.c_str());
+                Schedule([this, display, message = std::move(text)]() {
 #ifdef CONFIG_LSPLATFORM
                     display->DismissImage();
                     display->DismissActivation();
@@ -618,54 +644,72 @@ void Application::InitializeProtocol() {
                     display->SetChatMessage("user", message.c_str());
                 });
             }
-        } else if (strcmp(type->valuestring, "llm") == 0) {
-            auto emotion = cJSON_GetObjectItem(root, "emotion");
-            if (cJSON_IsString(emotion)) {
-                Schedule([this, display, emotion_str = std::string(emotion->valuestring)]() {
+            break;
+        }
+        case kJsonWordLlm: {
+            std::string emotion;
+            if (message.GetString("emotion", emotion)) {
+                Schedule([this, display, emotion_str = std::move(emotion)]() {
                     display->SetEmotion(emotion_str.c_str());
                 });
             }
-        } else if (strcmp(type->valuestring, "mcp") == 0) {
-            auto payload = cJSON_GetObjectItem(root, "payload");
-            if (cJSON_IsObject(payload)) {
+            break;
+        }
+        case kJsonWordMcp: {
+            // Only the MCP payload is parsed into a cJSON tree
+            auto payload = message.ParseObject("payload");
+            if (payload != nullptr) {
                 McpServer::GetInstance().ParseMessage(payload);
+                cJSON_Delete(payload);
             }
-        } else if (strcmp(type->valuestring, "system") == 0) {
-            auto command = cJSON_GetObjectItem(root, "command");
-            if (cJSON_IsString(command)) {
-                ESP_LOGI(TAG, "System command: %s", command->valuestring);
-                if (strcmp(command->valuestring, "reboot") == 0) {
+            break;
+        }
+        case kJsonWordSystem: {
+            std::string command;
+            if (message.GetString("command", command)) {
+                ESP_LOGI(TAG, "System command: %s", command.c_str());
+                if (command == "reboot") {
                     // Do a reboot if user requests a OTA update
                     Schedule([this]() {
                         Reboot();
                     });
                 } else {
-                    ESP_LOGW(TAG, "Unknown system command: %s", command->valuestring);
+                    ESP_LOGW(TAG, "Unknown system command: %s", command.c_str());
                 }
             }
-        } else if (strcmp(type->valuestring, "alert") == 0) {
-            auto status = cJSON_GetObjectItem(root, "status");
-            auto message = cJSON_GetObjectItem(root, "message");
-            auto emotion = cJSON_GetObjectItem(root, "emotion");
-            if (cJSON_IsString(status) && cJSON_IsString(message) && cJSON_IsString(emotion)) {
-                Alert(status->valuestring, message->valuestring, emotion->valuestring, Lang::Sounds::OGG_VIBRATION);
+            break;
+        }
+        case kJsonWordAlert: {
+            std::string status, alert_message, emotion;
+            if (message.GetString("status", status) && message.GetString("message", alert_message) &&
+                message.GetString("emotion", emotion)) {
+                Alert(status.c_str(), alert_message.c_str(), emotion.c_str(), Lang::Sounds::OGG_VIBRATION);
             } else {
                 ESP_LOGW(TAG, "Alert command requires status, message and emotion");
             }
+            break;
+        }
 #if CONFIG_RECEIVE_CUSTOM_MESSAGE
-        } else if (strcmp(type->valuestring, "custom") == 0) {
-            auto payload = cJSON_GetObjectItem(root, "payload");
-            ESP_LOGI(TAG, "Received custom message: %s", cJSON_PrintUnformatted(root));
-            if (cJSON_IsObject(payload)) {
-                Schedule([this, display, payload_str = std::string(cJSON_PrintUnformatted(payload))]() {
+        case kJsonWordCustom: {
+            auto text = message.text();
+            ESP_LOGI(TAG, "Received custom message: %.*s", (int)text.size(), text.data());
+            auto payload = message.GetRaw("payload");
+            if (!payload.empty() && payload.front() == '{') {
+                Schedule([this, display, payload_str = std::string(payload)]() {
                     display->SetChatMessage("system", payload_str.c_str());
                 });
             } else {
                 ESP_LOGW(TAG, "Invalid custom message format: missing payload");
             }
+            break;
+        }
 #endif
-        } else {
-            ESP_LOGW(TAG, "Unknown message type: %s", type->valuestring);
+        default: {
+            std::string type;
+            message.GetString("type", type);
+            ESP_LOGW(TAG, "Unknown message type: %s", type.c_str());
+            break;
+        }
         }
     });
     
@@ -836,12 +880,49 @@ void Application::HandleStopListeningEvent() {
         return;
     } else if (state == kDeviceStateListening) {
         if (protocol_) {
+            // The tail of the utterance, including a partial batch, goes out before the stop message
+            std::lock_guard<std::mutex> lock(audio_send_mutex_);
+            SendQueuedAudio(true);
             protocol_->SendStopListening();
         }
         SetDeviceState(kDeviceStateIdle);
     }
 }
 
+void Application::AudioSendTask() {
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        std::lock_guard<std::mutex> lock(audio_send_mutex_);
+        // Partial batches wait for more frames only while the microphone is still encoding,
+        // disabling the audio processor wakes this task to flush them
+        SendQueuedAudio(!audio_service_.IsAudioProcessorRunning());
+    }
+}
+
+void Application::SendQueuedAudio(bool flush) {
+    /* Frames are coalesced into batches of the size the server asked for, a flush sends the rest */
+    std::unique_ptr<AudioStreamPacket> batch[AUDIO_BATCH_MAX_PACKETS];
+    size_t batch_size = protocol_ ? protocol_->uplink_batch_size() : 1;
+    while (size_t count = audio_service_.PopPacketsFromSendQueue(batch, batch_size, flush ? 1 : batch_size)) {
+#ifdef CONFIG_LSPLATFORM
+        bool sent = protocol_ && protocol_->SendAudioBatch(batch, count);
+        if (sent) {
+            for (size_t i = 0; i < count; i++) {
+                uplink_watchdog_.Feed(batch[i]->frame_duration);
+            }
+        }
+#else // !CONFIG_LSPLATFORM
+        bool sent = protocol_ && protocol_->SendAudioBatch(batch, count);
+#endif // CONFIG_LSPLATFORM
+        for (size_t i = 0; i < count; i++) {
+            audio_service_.RecycleSendPacket(std::move(batch[i]), sent);
+        }
+        if (!sent) {
+            break;
+        }
+    }
+}
+
 void Application::HandleWakeWordDetectedEvent() {
     if (!protocol_) {
         return;
@@ -850,7 +931,7 @@ void Application::HandleWakeWordDetectedEvent() {
     auto state = GetDeviceState();
     
     if (state == kDeviceStateIdle) {
-        audio_service_.EncodeWakeWord();
+        wake_word_time_ = esp_timer_get_time();
 
         if (!protocol_->IsAudioChannelOpened()) {
             SetDeviceState(kDeviceStateConnecting);
@@ -863,12 +944,8 @@ void Application::HandleWakeWordDetectedEvent() {
         auto wake_word = audio_service_.GetLastWakeWord();
         ESP_LOGI(TAG, "Wake word detected: %s", wake_word.c_str());
 #if CONFIG_SEND_WAKE_WORD_DATA
-        // Encode and send the wake word data to the server
-        while (auto packet = audio_service_.PopWakeWordPacket()) {
-            protocol_->SendAudio(std::move(packet));
-        }
-        // Set the chat state to wake word detected
-        protocol_->SendWakeWordDetected(wake_word);
+        // Send the audio before the wake word, then the live audio follows
+        SendWakeWordData(wake_word);
         SetListeningMode(aec_mode_ == kAecOff ? kListeningModeAutoStop : kListeningModeRealtime);
 #else
         // Set flag to play popup sound after state changes to listening
@@ -884,6 +961,20 @@ void Application::HandleWakeWordDetectedEvent() {
     }
 }
 
+void Application::SendWakeWordData(const std::string& wake_word) {
+    /* The send task waits, so the live audio goes out after the pre-roll and the wake word message */
+    std::lock_guard<std::mutex> lock(audio_send_mutex_);
+    size_t packets = audio_service_.FlushWakeWordPackets();
+    std::unique_ptr<AudioStreamPacket> packet;
+    for (size_t i = 0; i < packets && audio_service_.PopPacketsFromSendQueue(&packet, 1, 1); i++) {
+        bool sent = protocol_->SendAudio(*packet);
+        audio_service_.RecycleSendPacket(std::move(packet), sent);
+    }
+    ESP_LOGI(TAG, "Sent %u wake word pre-roll packets", (unsigned)packets);
+    // Set the chat state to wake word detected
+    protocol_->SendWakeWordDetected(wake_word);
+}
+
 void Application::AbortSpeaking(AbortReason reason) {
     ESP_LOGI(TAG, "Abort speaking");
     aborted_ = true;
@@ -975,6 +1066,11 @@ void Application::HandleStateChangedEvent() {
 #endif // CONFIG_LSPLATFORM
             }
 
+            if (wake_word_time_ != 0) {
+                ESP_LOGI(TAG, "Wake word to listening: %lld ms", (esp_timer_get_time() - wake_word_time_) / 1000);
+                wake_word_time_ = 0;
+            }
+
             // Play popup sound after ResetDecoder (in EnableVoiceProcessing) has been called
             if (play_popup_on_listening_) {
                 play_popup_on_listening_ = false;
@@ -1019,7 +1115,11 @@ void Application::Reboot() {
     if (protocol_ && protocol_->IsAudioChannelOpened()) {
         protocol_->CloseAudioChannel();
     }
-    protocol_.reset();
+    {
+        // The audio send task may be using the protocol
+        std::lock_guard<std::mutex> lock(audio_send_mutex_);
+        protocol_.reset();
+    }
     audio_service_.Stop();
 
     vTaskDelay(pdMS_TO_TICKS(1000));
@@ -1086,7 +1186,6 @@ void Application::WakeWordInvoke(const std::string& wake_word) {
     auto state = GetDeviceState();
     
     if (state == kDeviceStateIdle) {
-        audio_service_.EncodeWakeWord();
 
         if (!protocol_->IsAudioChannelOpened()) {
             SetDeviceState(kDeviceStateConnecting);
@@ -1097,13 +1196,9 @@ void Application::WakeWordInvoke(const std::string& wake_word) {
         }
 
         ESP_LOGI(TAG, "Wake word detected: %s", wake_word.c_str());
-#if CONFIG_USE_AFE_WAKE_WORD || CONFIG_USE_CUSTOM_WAKE_WORD
-        // Encode and send the wake word data to the server
-        while (auto packet = audio_service_.PopWakeWordPacket()) {
-            protocol_->SendAudio(std::move(packet));
-        }
-        // Set the chat state to wake word detected
-        protocol_->SendWakeWordDetected(wake_word);
+#if CONFIG_SEND_WAKE_WORD_DATA
+        // Send the audio before the wake word, then the live audio follows
+        SendWakeWordData(wake_word);
         SetListeningMode(aec_mode_ == kAecOff ? kListeningModeAutoStop : kListeningModeRealtime);
 #else
         // Set flag to play popup sound after state changes to listening
@@ -1177,10 +1272,30 @@ void Application::SetAecMode(AecMode mode) {
     });
 }
 
+void Application::SetAudioProfile(AudioProfileType profile) {
+    Schedule([this, profile]() {
+        // Opus packets describe their own frame duration, so the open channel keeps running
+        audio_service_.SetAudioProfile(profile);
+        if (protocol_) {
+            protocol_->SetClientFrameDuration(audio_service_.frame_duration());
+        }
+    });
+}
+
 void Application::PlaySound(const std::string_view& sound) {
     audio_service_.PlaySound(sound);
 }
 
+bool Application::GetAudioLinkStatistics(AudioLinkStatistics& statistics) {
+    std::lock_guard<std::mutex> lock(audio_send_mutex_);
+    auto link = protocol_ ? protocol_->GetLinkStatistics() : nullptr;
+    if (link == nullptr) {
+        return false;
+    }
+    statistics = *link;
+    return true;
+}
+
 void Application::ResetProtocol() {
     Schedule([this]() {
         // Close audio channel if opened
@@ -1188,6 +1303,7 @@ void Application::ResetProtocol() {
             protocol_->CloseAudioChannel();
         }
         // Reset protocol
+        std::lock_guard<std::mutex> lock(audio_send_mutex_);
         protocol_.reset();
     });
 }
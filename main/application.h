@@ -20,7 +20,6 @@
 
 // Main event bits
 #define MAIN_EVENT_SCHEDULE             (1 << 0)
-#define MAIN_EVENT_SEND_AUDIO           (1 << 1)
 #define MAIN_EVENT_WAKE_WORD_DETECTED   (1 << 2)
 #define MAIN_EVENT_VAD_CHANGE           (1 << 3)
 #define MAIN_EVENT_ERROR                (1 << 4)
@@ -111,8 +110,11 @@ public:
     void SendMcpMessage(const std::string& payload);
     void SetAecMode(AecMode mode);
     AecMode GetAecMode() const { return aec_mode_; }
+    void SetAudioProfile(AudioProfileType profile);
     void PlaySound(const std::string_view& sound);
     AudioService& GetAudioService() { return audio_service_; }
+    // Copies the receive statistics of the audio transport, false if it keeps none
+    bool GetAudioLinkStatistics(AudioLinkStatistics& statistics);
     
     /**
      * Reset protocol resources (thread-safe)
@@ -147,8 +149,12 @@ private:
     bool aborted_ = false;
     bool assets_version_checked_ = false;
     bool play_popup_on_listening_ = false;  // Flag to play popup sound after state changes to listening
+    int64_t wake_word_time_ = 0;            // Wake word detection, to log how long it takes to start listening
     int clock_ticks_ = 0;
     TaskHandle_t activation_task_handle_ = nullptr;
+    TaskHandle_t audio_send_task_handle_ = nullptr;
+    // Held by the audio send task while it uses protocol_, and while protocol_ is replaced
+    std::mutex audio_send_mutex_;
 
 
     // Event handlers
@@ -160,6 +166,9 @@ private:
     void HandleNetworkDisconnectedEvent();
     void HandleActivationDoneEvent();
     void HandleWakeWordDetectedEvent();
+    void SendWakeWordData(const std::string& wake_word);
+    void AudioSendTask();
+    void SendQueuedAudio(bool flush);
 
     // Activation task (runs in background)
     void ActivationTask();
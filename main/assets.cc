@@ -4,6 +4,9 @@
 #include "application.h"
 #include "lvgl_theme.h"
 #include "emote_display.h"
+#include "download_pipeline.h"
+#include "image_inflater.h"
+#include "assets_layout.h"
 #ifdef HAVE_LVGL
 #include "display/lcd_display.h"
 #endif
@@ -11,17 +14,31 @@
 #include <esp_log.h>
 #include <spi_flash_mmap.h>
 #include <esp_timer.h>
+#include <esp_rom_crc.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 #include <cbin_font.h>
+#include <algorithm>
+#include <cstring>
 
 
 #define TAG "Assets"
 
-struct mmap_assets_table {
-    char asset_name[32];          /*!< Name of the asset */
-    uint32_t asset_size;          /*!< Size of the asset */
-    uint32_t asset_offset;        /*!< Offset of the asset */
-    uint16_t asset_width;         /*!< Width of the asset */
-    uint16_t asset_height;        /*!< Height of the asset */
+// The new directory is read with Range requests, up to this size, to plan a delta download
+#define ASSETS_DIRECTORY_PROBE_SIZE 8192
+#define ASSETS_DIRECTORY_MAX_SIZE (64 * 1024)
+// The HTTP reader fills one buffer while the writer task erases and writes the other
+#ifdef CONFIG_SPIRAM
+#define ASSETS_DOWNLOAD_BUFFER_SIZE (32 * 1024)
+#else
+#define ASSETS_DOWNLOAD_BUFFER_SIZE (8 * 1024)
+#endif
+#define ASSETS_DOWNLOAD_BUFFER_COUNT 2
+
+enum AssetState : uint8_t {
+    kAssetStateUnchecked,
+    kAssetStateValid,
+    kAssetStateCorrupt,
 };
 
 
@@ -31,23 +48,80 @@ Assets::Assets() {
 }
 
 Assets::~Assets() {
+    StopVerification();
     if (mmap_handle_ != 0) {
         esp_partition_munmap(mmap_handle_);
     }
 }
 
-uint32_t Assets::CalculateChecksum(const char* data, uint32_t length) {
-    uint32_t checksum = 0;
-    for (uint32_t i = 0; i < length; i++) {
-        checksum += data[i];
+bool Assets::VerifyAsset(uint32_t index, const char* data, size_t size, uint32_t crc32) {
+    if (asset_states_ == nullptr) {
+        return true;
+    }
+    auto& state = asset_states_[index];
+    uint8_t current = state.load(std::memory_order_acquire);
+    if (current == kAssetStateUnchecked) {
+        // Two tasks may check the same asset at once, they reach the same result
+        auto start_time = esp_timer_get_time();
+        bool valid = esp_rom_crc32_le(0, (const uint8_t*)data, size) == crc32;
+        current = valid ? kAssetStateValid : kAssetStateCorrupt;
+        state.store(current, std::memory_order_release);
+        ESP_LOGD(TAG, "Asset %lu (%u bytes) checked in %d us", index, size, int(esp_timer_get_time() - start_time));
+    }
+    return current == kAssetStateValid;
+}
+
+bool Assets::StartVerification(std::vector<uint32_t> indices) {
+    verify_indices_ = std::move(indices);
+    verify_stop_ = false;
+    verify_running_ = true;
+    if (xTaskCreate([](void* arg) {
+        auto assets = static_cast<Assets*>(arg);
+        assets->VerifyTask();
+        assets->verify_running_ = false;
+        vTaskDelete(NULL);
+    }, "assets_verify", 3072, this, 1, nullptr) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create the assets verification task");
+        verify_running_ = false;
+        return false;
+    }
+    return true;
+}
+
+void Assets::StopVerification() {
+    verify_stop_ = true;
+    while (verify_running_) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+}
+
+void Assets::VerifyTask() {
+    auto entries = EntriesV2(directory_, bucket_count_);
+    uint32_t corrupt = 0;
+    size_t total_size = 0;
+    auto start_time = esp_timer_get_time();
+    // All the assets, or the ones in use that were not checked when they were applied
+    uint32_t count = verify_indices_.empty() ? file_count_ : verify_indices_.size();
+    for (uint32_t n = 0; n < count && !verify_stop_; n++) {
+        uint32_t i = verify_indices_.empty() ? n : verify_indices_[n];
+        auto entry = &entries[i];
+        if (entry->offset > partition_->size || entry->size > partition_->size - entry->offset ||
+            !VerifyAsset(i, mmap_root_ + entry->offset, entry->size, entry->crc32)) {
+            ESP_LOGE(TAG, "The asset %lu is corrupt", i);
+            corrupt++;
+        }
+        total_size += entry->size;
     }
-    return checksum & 0xFFFF;
+    ESP_LOGI(TAG, "Verified %u KB of assets in %d ms, %lu corrupt%s", total_size / 1024,
+        int((esp_timer_get_time() - start_time) / 1000), corrupt, verify_stop_ ? " (stopped)" : "");
 }
 
 bool Assets::InitializePartition() {
     partition_valid_ = false;
     checksum_valid_ = false;
-    assets_.clear();
+    layout_version_ = 0;
+    file_count_ = 0;
+    asset_states_.reset();
 
     partition_ = esp_partition_find_first(ESP_PARTITION_TYPE_ANY, ESP_PARTITION_SUBTYPE_ANY, "assets");
     if (partition_ == nullptr) {
@@ -72,39 +146,123 @@ bool Assets::InitializePartition() {
 
     partition_valid_ = true;
 
-    uint32_t stored_files = *(uint32_t*)(mmap_root_ + 0);
     uint32_t stored_chksum = *(uint32_t*)(mmap_root_ + 4);
     uint32_t stored_len = *(uint32_t*)(mmap_root_ + 8);
-
-    if (stored_len > partition_->size - 12) {
-        ESP_LOGD(TAG, "The stored_len (0x%lx) is greater than the partition size (0x%lx) - 12", stored_len, partition_->size);
+    uint32_t header_size = 12;
+    bool has_crc32 = false;
+    layout_version_ = 1;
+    if (stored_len == ASSETS_V2_MAGIC) {
+        auto header = (const assets_header_v2*)mmap_root_;
+        layout_version_ = 2;
+        header_size = sizeof(assets_header_v2);
+        stored_len = header->length;
+        has_crc32 = (header->flags & ASSETS_V2_FLAG_CRC32) != 0;
+    }
+
+    if (stored_len > partition_->size - header_size) {
+        ESP_LOGD(TAG, "The stored_len (0x%lx) is greater than the partition size (0x%lx) - %lu", stored_len, partition_->size, header_size);
         return false;
     }
 
+    uint32_t checked_len = stored_len;
+    if (has_crc32) {
+        // The assets are checked one by one when they are used
+        checked_len = AssetsChecksumEndV2(mmap_root_, partition_->size) - header_size;
+    }
+
     auto start_time = esp_timer_get_time();
-    uint32_t calculated_checksum = CalculateChecksum(mmap_root_ + 12, stored_len);
+    uint32_t calculated_checksum = AssetsChecksum(mmap_root_ + header_size, checked_len);
     auto end_time = esp_timer_get_time();
-    ESP_LOGI(TAG, "The checksum calculation time is %d ms", int((end_time - start_time) / 1000));
+    ESP_LOGI(TAG, "The checksum calculation time is %d ms (%lu KB)", int((end_time - start_time) / 1000), checked_len / 1024);
 
     if (calculated_checksum != stored_chksum) {
         ESP_LOGE(TAG, "The calculated checksum (0x%lx) does not match the stored checksum (0x%lx)", calculated_checksum, stored_chksum);
         return false;
     }
 
+    if (!InitializeDirectory()) {
+        return false;
+    }
+    if (has_crc32) {
+        asset_states_.reset(new std::atomic<uint8_t>[file_count_]());
+    }
     checksum_valid_ = true;
 
-    for (uint32_t i = 0; i < stored_files; i++) {
-        auto item = (const mmap_assets_table*)(mmap_root_ + 12 + i * sizeof(mmap_assets_table));
-        auto asset = Asset{
-            .size = static_cast<size_t>(item->asset_size),
-            .offset = static_cast<size_t>(12 + sizeof(mmap_assets_table) * stored_files + item->asset_offset)
-        };
-        assets_[item->asset_name] = asset;
+    start_time = esp_timer_get_time();
+    void* ptr;
+    size_t size;
+    bool found = GetAssetData("index.json", ptr, size);
+    end_time = esp_timer_get_time();
+    ESP_LOGI(TAG, "%lu assets, layout v%d, index.json %s in %d us", file_count_, layout_version_,
+        found ? "found" : "not found", int(end_time - start_time));
+
+#if CONFIG_ASSETS_BACKGROUND_VERIFY
+    if (asset_states_ != nullptr) {
+        StartVerification();
     }
+#endif
     return checksum_valid_;
 }
 
+bool Assets::InitializeDirectory() {
+    uint32_t file_count = *(const uint32_t*)mmap_root_;
+    if (layout_version_ == 1) {
+        if (file_count > (partition_->size - 12) / sizeof(mmap_assets_table)) {
+            ESP_LOGE(TAG, "The asset table (%lu files) exceeds the partition", file_count);
+            return false;
+        }
+        directory_ = mmap_root_ + 12;
+    } else {
+        auto header = (const assets_header_v2*)mmap_root_;
+        uint32_t bucket_count = header->bucket_count;
+        if (bucket_count == 0 || (bucket_count & (bucket_count - 1)) != 0 ||
+            bucket_count > header->length / sizeof(uint32_t) ||
+            file_count > header->length / sizeof(assets_entry_v2) ||
+            (bucket_count + 1) * sizeof(uint32_t) + file_count * sizeof(assets_entry_v2) > header->length) {
+            ESP_LOGE(TAG, "The asset directory is not valid (%lu files, %lu buckets)", file_count, bucket_count);
+            return false;
+        }
+        directory_ = mmap_root_ + sizeof(assets_header_v2);
+        bucket_count_ = bucket_count;
+    }
+    file_count_ = file_count;
+    return true;
+}
+
+const char* Assets::FindAssetV1(std::string_view name, size_t& size) const {
+    return FindAssetDataV1(mmap_root_, partition_->size, name, size);
+}
+
+int Assets::FindEntryV2(std::string_view name) const {
+    return FindAssetEntryV2(mmap_root_, partition_->size, name);
+}
+
+const char* Assets::FindAssetV2(std::string_view name, size_t& size) {
+    int index = FindEntryV2(name);
+    if (index < 0) {
+        return nullptr;
+    }
+    auto entry = &EntriesV2(directory_, bucket_count_)[index];
+    if (!VerifyAsset(index, mmap_root_ + entry->offset, entry->size, entry->crc32)) {
+        ESP_LOGE(TAG, "The asset %.*s is corrupt, CRC32 mismatch", (int)name.size(), name.data());
+        return nullptr;
+    }
+    size = entry->size;
+    return mmap_root_ + entry->offset;
+}
+
 bool Assets::Apply() {
+    deferred_assets_.clear();
+    bool applied = ApplyIndex();
+    // The large assets were used unchecked, a full verification that is running covers them
+    if (!deferred_assets_.empty() && !verify_running_) {
+        StartVerification(std::move(deferred_assets_));
+    }
+    deferred_assets_.clear();
+    return applied;
+}
+
+bool Assets::ApplyIndex() {
     void* ptr = nullptr;
     size_t size = 0;
     if (!GetAssetData("index.json", ptr, size)) {
@@ -143,7 +301,7 @@ bool Assets::Apply() {
     cJSON* srmodels = cJSON_GetObjectItem(root, "srmodels");
     if (cJSON_IsString(srmodels)) {
         std::string srmodels_file = srmodels->valuestring;
-        if (GetAssetData(srmodels_file, ptr, size)) {
+        if (GetAssetDataDeferred(srmodels_file, ptr, size)) {
             if (models_list_ != nullptr) {
                 esp_srmodel_deinit(models_list_);
                 models_list_ = nullptr;
@@ -169,7 +327,7 @@ bool Assets::Apply() {
     cJSON* font = cJSON_GetObjectItem(root, "text_font");
     if (cJSON_IsString(font)) {
         std::string fonts_text_file = font->valuestring;
-        if (GetAssetData(fonts_text_file, ptr, size)) {
+        if (GetAssetDataDeferred(fonts_text_file, ptr, size)) {
             auto text_font = std::make_shared<LvglCBinFont>(ptr);
             if (text_font->font() == nullptr) {
                 ESP_LOGE(TAG, "Failed to load fonts.bin");
@@ -286,7 +444,7 @@ bool Assets::Apply() {
     cJSON* font = cJSON_GetObjectItem(root, "text_font");
     if (cJSON_IsString(font)) {
         std::string fonts_text_file = font->valuestring;
-        if (GetAssetData(fonts_text_file, ptr, size)) {
+        if (GetAssetDataDeferred(fonts_text_file, ptr, size)) {
             auto text_font = std::make_shared<LvglCBinFont>(ptr);
             if (text_font->font() == nullptr) {
                 ESP_LOGE(TAG, "Failed to load fonts.bin");
@@ -397,129 +555,250 @@ bool Assets::Apply() {
     return true;
 }
 
-bool Assets::Download(std::string url, std::function<void(int progress, size_t speed)> progress_callback) {
-    ESP_LOGI(TAG, "Downloading new version of assets from %s", url.c_str());
-    
-    // 取消当前资源分区的内存映射
-    if (mmap_handle_ != 0) {
-        esp_partition_munmap(mmap_handle_);
-        mmap_handle_ = 0;
-        mmap_root_ = nullptr;
+bool Assets::PlanDelta(const std::string& url, size_t sector_size, std::vector<std::pair<size_t, size_t>>& runs, size_t& image_size,
+    std::string& validator) {
+    image_size = 0;
+    validator.clear();
+    std::string directory;
+    if (!DownloadPipeline::FetchRange(url, 0, ASSETS_DIRECTORY_PROBE_SIZE, directory, &validator) || directory.size() < 12) {
+        ESP_LOGI(TAG, "No range support, the whole image is downloaded");
+        return false;
     }
-    checksum_valid_ = false;
-    assets_.clear();
+    // A compressed image is inflated as a whole
+    if (size_t original_size = ImageInflater::GetOriginalSize(directory.data(), directory.size())) {
+        image_size = original_size;
+        return false;
+    }
+    uint32_t stored_len = *(const uint32_t*)(directory.data() + 8);
+    if (stored_len != ASSETS_V2_MAGIC) {
+        image_size = std::min<uint64_t>(12ULL + stored_len, SIZE_MAX);
+        return false;
+    }
+    if (directory.size() < sizeof(assets_header_v2)) {
+        return false;
+    }
+    assets_header_v2 header = *(const assets_header_v2*)directory.data();
+    image_size = std::min<uint64_t>(sizeof(assets_header_v2) + (uint64_t)header.length, SIZE_MAX);
 
-    // 下载新的资源文件
-    auto network = Board::GetInstance().GetNetwork();
-    auto http = network->CreateHttp(0);
-    
-    if (!http->Open("GET", url)) {
-        ESP_LOGE(TAG, "Failed to open HTTP connection");
+    /* The unchanged assets are found by name in the mapped directory, and their CRC32 proves the data */
+    if (layout_version_ != 2 || asset_states_ == nullptr || (header.flags & ASSETS_V2_FLAG_CRC32) == 0 ||
+        image_size > partition_->size) {
         return false;
     }
+    if (header.bucket_count == 0 || header.bucket_count > ASSETS_DIRECTORY_MAX_SIZE / sizeof(uint32_t) ||
+        header.file_count > ASSETS_DIRECTORY_MAX_SIZE / sizeof(assets_entry_v2)) {
+        return false;
+    }
+    size_t entries_end = sizeof(assets_header_v2) + (header.bucket_count + 1) * sizeof(uint32_t) +
+        header.file_count * sizeof(assets_entry_v2);
+    if (entries_end > ASSETS_DIRECTORY_MAX_SIZE || entries_end > image_size) {
+        return false;
+    }
+    std::string more;
+    if (directory.size() < entries_end) {
+        if (!DownloadPipeline::FetchRange(url, directory.size(), entries_end - directory.size(), more, &validator)) {
+            return false;
+        }
+        directory += more;
+    }
 
-    if (http->GetStatusCode() != 200) {
-        ESP_LOGE(TAG, "Failed to get assets, status code: %d", http->GetStatusCode());
+    auto entries = EntriesV2(directory.data() + sizeof(assets_header_v2), header.bucket_count);
+    size_t names_end = entries_end;
+    for (uint32_t i = 0; i < header.file_count; i++) {
+        auto& entry = entries[i];
+        if (entry.offset > image_size || entry.size > image_size - entry.offset) {
+            return false;
+        }
+        names_end = std::max<size_t>(names_end, (size_t)entry.name_offset + entry.name_length);
+    }
+    if (names_end > ASSETS_DIRECTORY_MAX_SIZE || names_end > image_size) {
         return false;
     }
+    if (directory.size() < names_end) {
+        if (!DownloadPipeline::FetchRange(url, directory.size(), names_end - directory.size(), more, &validator)) {
+            return false;
+        }
+        directory += more;
+        entries = EntriesV2(directory.data() + sizeof(assets_header_v2), header.bucket_count);
+    }
+    if (directory.size() < names_end) {
+        return false;
+    }
+
+    /* A sector is rewritten if it holds a part of the directory or of a changed asset */
+    std::vector<bool> dirty((image_size + sector_size - 1) / sector_size, false);
+    auto mark = [&](size_t start, size_t end) {
+        for (size_t sector = start / sector_size; sector * sector_size < end; sector++) {
+            dirty[sector] = true;
+        }
+    };
+    mark(0, names_end);
+    auto old_entries = EntriesV2(directory_, bucket_count_);
+    uint32_t unchanged = 0;
+    for (uint32_t i = 0; i < header.file_count; i++) {
+        auto& entry = entries[i];
+        int old = FindEntryV2(std::string_view(directory.data() + entry.name_offset, entry.name_length));
+        if (old >= 0 && old_entries[old].offset == entry.offset && old_entries[old].size == entry.size &&
+            old_entries[old].crc32 == entry.crc32 &&
+            VerifyAsset(old, mmap_root_ + entry.offset, entry.size, entry.crc32)) {
+            unchanged++;
+            continue;
+        }
+        mark(entry.offset, entry.offset + entry.size);
+    }
+
+    runs.clear();
+    size_t fetch_size = 0;
+    for (size_t sector = 0; sector < dirty.size(); sector++) {
+        if (!dirty[sector]) {
+            continue;
+        }
+        size_t start = sector * sector_size;
+        size_t end = std::min((sector + 1) * sector_size, image_size);
+        if (!runs.empty() && runs.back().second == start) {
+            runs.back().second = end;
+        } else {
+            runs.emplace_back(start, end);
+        }
+        fetch_size += end - start;
+    }
+    ESP_LOGI(TAG, "Delta: %lu of %lu assets unchanged, %u of %u KB in %u ranges to download", unchanged,
+        header.file_count, fetch_size / 1024, image_size / 1024, runs.size());
+    return true;
+}
 
-    size_t content_length = http->GetBodyLength();
-    if (content_length == 0) {
-        ESP_LOGE(TAG, "Failed to get content length");
+bool Assets::Download(std::string url, std::function<void(int progress, size_t speed)> progress_callback) {
+    ESP_LOGI(TAG, "Downloading new version of assets from %s", url.c_str());
+    
+    // The verification reads the mapped partition
+    StopVerification();
+
+    /* The delta is planned while the current assets are still mapped */
+    const size_t sector_size = esp_partition_get_main_flash_sector_size();
+    std::vector<std::pair<size_t, size_t>> runs;
+    size_t image_size = 0;
+    std::string validator;
+    bool delta = PlanDelta(url, sector_size, runs, image_size, validator);
+    if (image_size > partition_->size) {
+        ESP_LOGE(TAG, "Assets file size (%u) is larger than partition size (%lu)", image_size, partition_->size);
         return false;
     }
+    if (!delta) {
+        // The whole file
+        runs.clear();
+        runs.emplace_back(0, 0);
+    }
+    size_t total_bytes = 0;
+    for (auto& run : runs) {
+        total_bytes += run.second - run.first;
+    }
 
-    if (content_length > partition_->size) {
-        ESP_LOGE(TAG, "Assets file size (%u) is larger than partition size (%lu)", content_length, partition_->size);
+    // 取消当前资源分区的内存映射
+    if (mmap_handle_ != 0) {
+        esp_partition_munmap(mmap_handle_);
+        mmap_handle_ = 0;
+        mmap_root_ = nullptr;
+    }
+    checksum_valid_ = false;
+    file_count_ = 0;
+    asset_states_.reset();
+
+    /*
+     * The first sector holds the header. It is erased before anything else and written after
+     * everything else, so an interrupted download leaves a partition that fails its checksum.
+     */
+    esp_err_t err = esp_partition_erase_range(partition_, 0, sector_size);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to erase the first sector: %s", esp_err_to_name(err));
         return false;
     }
+    std::vector<char> first_sector(sector_size);
+    size_t first_sector_size = 0;
+    size_t erased_end = sector_size;
+    size_t sectors_erased = 1;
 
-    // 定义扇区大小为4KB（ESP32的标准扇区大小）
-    const size_t SECTOR_SIZE = esp_partition_get_main_flash_sector_size();
-    
-    // 计算需要擦除的扇区数量
-    size_t sectors_to_erase = (content_length + SECTOR_SIZE - 1) / SECTOR_SIZE; // 向上取整
-    size_t total_erase_size = sectors_to_erase * SECTOR_SIZE;
-    
-    ESP_LOGI(TAG, "Sector size: %u, content length: %u, sectors to erase: %u, total erase size: %u", 
-             SECTOR_SIZE, content_length, sectors_to_erase, total_erase_size);
-    
-    // 写入新的资源文件到分区，一边erase一边写入
-    char buffer[512];
-    size_t total_written = 0;
-    size_t recent_written = 0;
-    size_t current_sector = 0;
-    auto last_calc_time = esp_timer_get_time();
-    
-    while (true) {
-        int ret = http->Read(buffer, sizeof(buffer));
-        if (ret < 0) {
-            ESP_LOGE(TAG, "Failed to read HTTP data: %s", esp_err_to_name(ret));
+    // The sink runs on the writer task, behind the inflater, the runs come in ascending order
+    ImageInflater inflater([&](const char* data, size_t size, size_t offset) {
+        if (offset + size > partition_->size) {
+            ESP_LOGE(TAG, "Write at %u (%u bytes) exceeds partition size (%lu)", offset, size, partition_->size);
             return false;
         }
-
-        if (ret == 0) {
-            break;
+        if (offset < sector_size) {
+            size_t head = std::min(size, sector_size - offset);
+            memcpy(first_sector.data() + offset, data, head);
+            first_sector_size = std::max(first_sector_size, offset + head);
+            data += head;
+            offset += head;
+            size -= head;
+            if (size == 0) {
+                return true;
+            }
         }
 
-        // 检查是否需要擦除新的扇区
-        size_t write_end_offset = total_written + ret;
-        size_t needed_sectors = (write_end_offset + SECTOR_SIZE - 1) / SECTOR_SIZE;
-        
-        // 擦除需要的新扇区
-        while (current_sector < needed_sectors) {
-            size_t sector_start = current_sector * SECTOR_SIZE;
-            size_t sector_end = (current_sector + 1) * SECTOR_SIZE;
-            
-            // 确保擦除范围不超过分区大小
-            if (sector_end > partition_->size) {
-                ESP_LOGE(TAG, "Sector end (%u) exceeds partition size (%lu)", sector_end, partition_->size);
-                return false;
-            }
-            
-            ESP_LOGD(TAG, "Erasing sector %u (offset: %u, size: %u)", current_sector, sector_start, SECTOR_SIZE);
-            esp_err_t err = esp_partition_erase_range(partition_, sector_start, SECTOR_SIZE);
+        // Erase ahead of the write, the skipped sectors keep the unchanged assets
+        if (offset > erased_end) {
+            erased_end = offset / sector_size * sector_size;
+        }
+        if (offset + size > erased_end) {
+            size_t erase_size = (offset + size - erased_end + sector_size - 1) / sector_size * sector_size;
+            esp_err_t err = esp_partition_erase_range(partition_, erased_end, erase_size);
             if (err != ESP_OK) {
-                ESP_LOGE(TAG, "Failed to erase sector %u at offset %u: %s", current_sector, sector_start, esp_err_to_name(err));
+                ESP_LOGE(TAG, "Failed to erase %u bytes at offset %u: %s", erase_size, erased_end, esp_err_to_name(err));
                 return false;
             }
-            
-            current_sector++;
+            erased_end += erase_size;
+            sectors_erased += erase_size / sector_size;
         }
 
-        // 写入数据到分区
-        esp_err_t err = esp_partition_write(partition_, total_written, buffer, ret);
+        esp_err_t err = esp_partition_write(partition_, offset, data, size);
         if (err != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to write to assets partition at offset %u: %s", total_written, esp_err_to_name(err));
+            ESP_LOGE(TAG, "Failed to write to assets partition at offset %u: %s", offset, esp_err_to_name(err));
             return false;
         }
-
-        total_written += ret;
-        recent_written += ret;
-
-        // 计算进度和速度
-        if (esp_timer_get_time() - last_calc_time >= 1000000 || total_written == content_length || ret == 0) {
-            size_t progress = total_written * 100 / content_length;
-            size_t speed = recent_written; // 每秒的字节数
-            ESP_LOGI(TAG, "Progress: %u%% (%u/%u), Speed: %u B/s, Sectors erased: %u", 
-                     progress, total_written, content_length, speed, current_sector);
-            if (progress_callback) {
-                progress_callback(progress, speed);
-            }
-            last_calc_time = esp_timer_get_time();
-            recent_written = 0; // 重置最近写入的字节数
-        }
+        return true;
+    });
+    DownloadPipeline pipeline(ASSETS_DOWNLOAD_BUFFER_SIZE, ASSETS_DOWNLOAD_BUFFER_COUNT);
+    pipeline.SetProgressCallback(total_bytes, progress_callback);
+    bool success = pipeline.Start([&](const char* data, size_t size, size_t offset) {
+        return inflater.Write(data, size, offset);
+    }, "assets_writer");
+    if (delta) {
+        // The runs are of the directory that was read, a file changed since then fails the download
+        pipeline.SetValidator(validator);
+    } else {
+        // A file that changed on the server is written again from the start
+        pipeline.SetRestartCallback([&]() {
+            first_sector_size = 0;
+            erased_end = sector_size;
+            inflater.Reset();
+            return true;
+        });
+    }
+
+    for (size_t i = 0; success && i < runs.size(); i++) {
+        success = pipeline.Fetch(url, runs[i].first, runs[i].second - runs[i].first);
+    }
+    success = pipeline.Finish() && success;
+    success = success && inflater.Finish();
+    if (!success || first_sector_size == 0) {
+        ESP_LOGE(TAG, "Failed to download assets");
+        return false;
     }
-    
-    http->Close();
 
-    if (total_written != content_length) {
-        ESP_LOGE(TAG, "Downloaded size (%u) does not match expected size (%u)", total_written, content_length);
+    err = esp_partition_write(partition_, 0, first_sector.data(), first_sector_size);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write the first sector: %s", esp_err_to_name(err));
         return false;
     }
 
-    ESP_LOGI(TAG, "Assets download completed, total written: %u bytes, total sectors erased: %u", 
-             total_written, current_sector);
+    auto& statistics = pipeline.statistics();
+    if (!delta) {
+        image_size = inflater.output_size();
+    }
+    size_t image_sectors = (image_size + sector_size - 1) / sector_size;
+    ESP_LOGI(TAG, "Assets %s download completed: %u of %u KB fetched, %u sectors erased, %u skipped",
+        delta ? "delta" : inflater.compressed() ? "compressed" : "full", statistics.fetched_bytes / 1024, image_size / 1024, sectors_erased,
+        image_sectors > sectors_erased ? image_sectors - sectors_erased : 0);
 
     // 重新初始化资源分区
     if (!InitializePartition()) {
@@ -530,18 +809,34 @@ bool Assets::Download(std::string url, std::function<void(int progress, size_t s
     return true;
 }
 
-bool Assets::GetAssetData(const std::string& name, void*& ptr, size_t& size) {
-    auto asset = assets_.find(name);
-    if (asset == assets_.end()) {
+bool Assets::GetAssetData(std::string_view name, void*& ptr, size_t& size) {
+    if (file_count_ == 0) {
         return false;
     }
-    auto data = (const char*)(mmap_root_ + asset->second.offset);
-    if (data[0] != 'Z' || data[1] != 'Z') {
-        ESP_LOGE(TAG, "The asset %s is not valid with magic %02x%02x", name.c_str(), data[0], data[1]);
+    auto data = layout_version_ == 2 ? FindAssetV2(name, size) : FindAssetV1(name, size);
+    if (data == nullptr) {
         return false;
     }
+    ptr = static_cast<void*>(const_cast<char*>(data));
+    return true;
+}
 
-    ptr = static_cast<void*>(const_cast<char*>(data + 2));
-    size = asset->second.size;
+bool Assets::GetAssetDataDeferred(std::string_view name, void*& ptr, size_t& size) {
+    if (file_count_ == 0 || layout_version_ != 2 || asset_states_ == nullptr) {
+        return GetAssetData(name, ptr, size);
+    }
+    int index = FindEntryV2(name);
+    if (index < 0) {
+        return false;
+    }
+    if (asset_states_[index].load(std::memory_order_acquire) == kAssetStateCorrupt) {
+        ESP_LOGE(TAG, "The asset %.*s is corrupt, CRC32 mismatch", (int)name.size(), name.data());
+        return false;
+    }
+    // Checked by the verification task once Apply() is done, not before the boot goes on
+    deferred_assets_.push_back(index);
+    auto entry = &EntriesV2(directory_, bucket_count_)[index];
+    size = entry->size;
+    ptr = static_cast<void*>(const_cast<char*>(mmap_root_ + entry->offset));
     return true;
 }
@@ -1,20 +1,19 @@
 #ifndef ASSETS_H
 #define ASSETS_H
 
-#include <map>
 #include <string>
+#include <string_view>
 #include <functional>
+#include <memory>
+#include <atomic>
+#include <vector>
+#include <utility>
 
 #include <cJSON.h>
 #include <esp_partition.h>
 #include <model_path.h>
 
 
-struct Asset {
-    size_t size;
-    size_t offset;
-};
-
 class Assets {
 public:
     static Assets& GetInstance() {
@@ -25,7 +24,7 @@ public:
 
     bool Download(std::string url, std::function<void(int progress, size_t speed)> progress_callback);
     bool Apply();
-    bool GetAssetData(const std::string& name, void*& ptr, size_t& size);
+    bool GetAssetData(std::string_view name, void*& ptr, size_t& size);
 
     inline bool partition_valid() const { return partition_valid_; }
     inline bool checksum_valid() const { return checksum_valid_; }
@@ -37,7 +36,20 @@ private:
     Assets& operator=(const Assets&) = delete;
 
     bool InitializePartition();
-    uint32_t CalculateChecksum(const char* data, uint32_t length);
+    bool InitializeDirectory();
+    bool ApplyIndex();
+    // For the multi-MB assets: the CRC32 is checked in the background after Apply()
+    bool GetAssetDataDeferred(std::string_view name, void*& ptr, size_t& size);
+    const char* FindAssetV1(std::string_view name, size_t& size) const;
+    const char* FindAssetV2(std::string_view name, size_t& size);
+    int FindEntryV2(std::string_view name) const;
+    bool PlanDelta(const std::string& url, size_t sector_size, std::vector<std::pair<size_t, size_t>>& runs, size_t& image_size,
+        std::string& validator);
+    bool VerifyAsset(uint32_t index, const char* data, size_t size, uint32_t crc32);
+    // Checks the assets at indices, or all of them
+    bool StartVerification(std::vector<uint32_t> indices = {});
+    void StopVerification();
+    void VerifyTask();
 
     const esp_partition_t* partition_ = nullptr;
     esp_partition_mmap_handle_t mmap_handle_ = 0;
@@ -46,7 +58,19 @@ private:
     bool checksum_valid_ = false;
     std::string default_assets_url_;
     srmodel_list_t* models_list_ = nullptr;
-    std::map<std::string, Asset> assets_;
+
+    // The directory is searched in place in the mapped partition, nothing is copied at boot
+    int layout_version_ = 0;
+    uint32_t file_count_ = 0;
+    uint32_t bucket_count_ = 0;     // v2 only
+    const char* directory_ = nullptr;
+
+    // v2 assets with a CRC32 are checked on their first use, or by the background verification
+    std::unique_ptr<std::atomic<uint8_t>[]> asset_states_;
+    std::atomic<bool> verify_running_ = false;
+    std::atomic<bool> verify_stop_ = false;
+    std::vector<uint32_t> verify_indices_;
+    std::vector<uint32_t> deferred_assets_;
 };
 
 #endif
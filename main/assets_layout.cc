@@ -0,0 +1,110 @@
+#include "assets_layout.h"
+
+#include <esp_log.h>
+#include <algorithm>
+#include <cstring>
+
+#define TAG "Assets"
+
+
+uint32_t AssetsChecksum(const char* data, size_t length) {
+    /*
+     * The byte sum is read a word at a time: the even and the odd bytes are added into two 16 bit
+     * lanes, each lane takes at most 2 * 255 per word, so 128 words are summed before it carries.
+     */
+    auto bytes = (const uint8_t*)data;
+    uint32_t checksum = 0;
+    while (length > 0 && ((uintptr_t)bytes & 3) != 0) {
+        checksum += *bytes++;
+        length--;
+    }
+    auto words = (const uint32_t*)bytes;
+    size_t word_count = length / 4;
+    while (word_count > 0) {
+        size_t block = std::min<size_t>(word_count, 128);
+        uint32_t lanes = 0;
+        for (size_t i = 0; i < block; i++) {
+            uint32_t word = words[i];
+            lanes += (word & 0x00FF00FF) + ((word >> 8) & 0x00FF00FF);
+        }
+        checksum += (lanes & 0xFFFF) + (lanes >> 16);
+        words += block;
+        word_count -= block;
+    }
+    bytes = (const uint8_t*)words;
+    for (size_t i = 0; i < (length & 3); i++) {
+        checksum += bytes[i];
+    }
+    return checksum & 0xFFFF;
+}
+
+size_t AssetsChecksumEndV2(const char* image, size_t image_size) {
+    auto header = (const assets_header_v2*)image;
+    uint64_t end = std::min<uint64_t>(sizeof(assets_header_v2) + (uint64_t)header->length, image_size);
+    uint64_t entries_end = sizeof(assets_header_v2) + (header->bucket_count + 1ULL) * sizeof(uint32_t) +
+        (uint64_t)header->file_count * sizeof(assets_entry_v2);
+    if (entries_end >= end) {
+        return end;
+    }
+    /* The names follow the entries, the zeros after them up to the data add nothing to the sum */
+    uint64_t names_end = entries_end;
+    auto entries = EntriesV2(image + sizeof(assets_header_v2), header->bucket_count);
+    for (uint32_t i = 0; i < header->file_count; i++) {
+        names_end = std::max<uint64_t>(names_end, (uint64_t)entries[i].name_offset + entries[i].name_length);
+    }
+    return std::min(names_end, end);
+}
+
+const char* FindAssetDataV1(const char* image, size_t image_size, std::string_view name, size_t& size) {
+    /* The v1 table is ordered by extension, so it is scanned, in place */
+    uint32_t file_count = *(const uint32_t*)image;
+    auto table = (const mmap_assets_table*)(image + 12);
+    if (name.size() > sizeof(table->asset_name)) {
+        return nullptr;
+    }
+    for (uint32_t i = 0; i < file_count; i++) {
+        auto item = &table[i];
+        if (memcmp(item->asset_name, name.data(), name.size()) != 0 ||
+            (name.size() < sizeof(item->asset_name) && item->asset_name[name.size()] != '\0')) {
+            continue;
+        }
+        size_t offset = 12 + file_count * sizeof(mmap_assets_table) + item->asset_offset;
+        if (offset + 2 > image_size || item->asset_size > image_size - offset - 2) {
+            ESP_LOGE(TAG, "The asset %.*s exceeds the partition", (int)name.size(), name.data());
+            return nullptr;
+        }
+        auto data = image + offset;
+        if (data[0] != 'Z' || data[1] != 'Z') {
+            ESP_LOGE(TAG, "The asset %.*s is not valid with magic %02x%02x", (int)name.size(), name.data(), data[0], data[1]);
+            return nullptr;
+        }
+        size = item->asset_size;
+        return data + 2;
+    }
+    return nullptr;
+}
+
+int FindAssetEntryV2(const char* image, size_t image_size, std::string_view name) {
+    auto header = (const assets_header_v2*)image;
+    auto buckets = (const uint32_t*)(image + sizeof(assets_header_v2));
+    auto entries = EntriesV2(image + sizeof(assets_header_v2), header->bucket_count);
+    uint32_t hash = HashAssetName(name);
+    uint32_t bucket = hash & (header->bucket_count - 1);
+    uint32_t end = std::min(buckets[bucket + 1], header->file_count);
+    for (uint32_t i = buckets[bucket]; i < end; i++) {
+        auto entry = &entries[i];
+        if (entry->hash != hash || entry->name_length != name.size()) {
+            continue;
+        }
+        if (entry->name_offset > image_size - name.size() ||
+            memcmp(image + entry->name_offset, name.data(), name.size()) != 0) {
+            continue;
+        }
+        if (entry->offset > image_size || entry->size > image_size - entry->offset) {
+            ESP_LOGE(TAG, "The asset %.*s exceeds the partition", (int)name.size(), name.data());
+            return -1;
+        }
+        return i;
+    }
+    return -1;
+}
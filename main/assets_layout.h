@@ -0,0 +1,77 @@
+#ifndef ASSETS_LAYOUT_H
+#define ASSETS_LAYOUT_H
+
+#include <string_view>
+#include <cstdint>
+#include <cstddef>
+
+struct mmap_assets_table {
+    char asset_name[32];          /*!< Name of the asset */
+    uint32_t asset_size;          /*!< Size of the asset */
+    uint32_t asset_offset;        /*!< Offset of the asset */
+    uint16_t asset_width;         /*!< Width of the asset */
+    uint16_t asset_height;        /*!< Height of the asset */
+};
+
+/*
+ * Layout v2, written by scripts/spiffs_assets/spiffs_assets_gen.py. The magic sits where v1 keeps
+ * the table length, so older firmware rejects the partition instead of misreading it.
+ *
+ *   assets_header_v2
+ *   uint32_t buckets[bucket_count + 1]     First entry of each hash bucket, and the entry count
+ *   assets_entry_v2 entries[file_count]    Grouped by bucket, hash & (bucket_count - 1)
+ *   Names, NUL terminated, then the asset data aligned to 4 bytes
+ *
+ * All offsets are from the start of the partition. With ASSETS_V2_FLAG_CRC32 every entry carries
+ * the CRC32 of its data, which is checked on the first use of the asset, and the header checksum
+ * only covers the buckets, the entries and the names, so the boot does not read the whole partition.
+ */
+#define ASSETS_V2_MAGIC 0x32545341     // "AST2"
+#define ASSETS_V2_FLAG_CRC32 0x1
+
+struct assets_header_v2 {
+    uint32_t file_count;
+    uint32_t checksum;              /*!< 16 bit sum of the bytes after the header, as in v1 */
+    uint32_t magic;
+    uint32_t length;                /*!< Bytes after the header */
+    uint32_t bucket_count;          /*!< Power of two */
+    uint32_t flags;
+};
+
+struct assets_entry_v2 {
+    uint32_t hash;                  /*!< FNV-1a of the name */
+    uint32_t name_offset;
+    uint32_t offset;
+    uint32_t size;
+    uint32_t crc32;                 /*!< With ASSETS_V2_FLAG_CRC32, zlib compatible */
+    uint16_t name_length;
+    uint16_t width;
+    uint16_t height;
+    uint16_t padding;
+};
+
+static inline const assets_entry_v2* EntriesV2(const char* directory, uint32_t bucket_count) {
+    return (const assets_entry_v2*)(directory + (bucket_count + 1) * sizeof(uint32_t));
+}
+
+static inline uint32_t HashAssetName(std::string_view name) {
+    uint32_t hash = 0x811C9DC5;
+    for (unsigned char c : name) {
+        hash = (hash ^ c) * 0x01000193;
+    }
+    return hash;
+}
+
+// The 16 bit sum of the bytes of both layouts
+uint32_t AssetsChecksum(const char* data, size_t length);
+
+// End of what the header checksum of a v2 image with CRC32s covers, the names included
+size_t AssetsChecksumEndV2(const char* image, size_t image_size);
+
+// The data of the asset named name in a v1 image whose table was validated, after its 'ZZ', or nullptr
+const char* FindAssetDataV1(const char* image, size_t image_size, std::string_view name, size_t& size);
+
+// The entry of the asset named name in a v2 image whose directory was validated, or -1
+int FindAssetEntryV2(const char* image, size_t image_size, std::string_view name);
+
+#endif // ASSETS_LAYOUT_H
@@ -0,0 +1,53 @@
+#include "audio_mixer.h"
+
+#include <algorithm>
+#include <cstring>
+
+bool AudioMixer::AddVoice(AudioMixerVoice&& voice) {
+    if (IsFull()) {
+        return false;
+    }
+    voices_[voice_count_++] = std::move(voice);
+    return true;
+}
+
+void AudioMixer::Clear() {
+    for (size_t i = 0; i < voice_count_; i++) {
+        voices_[i] = AudioMixerVoice();
+    }
+    voice_count_ = 0;
+    speech_gain_ = AUDIO_MIXER_UNITY_GAIN;
+}
+
+int64_t AudioMixer::Mix(int16_t* pcm, size_t count, bool has_speech) {
+    /* Duck the speech while any sound plays, moving the gain gradually */
+    int32_t target_gain = HasVoices() ? AUDIO_MIXER_UNITY_GAIN * AUDIO_MIXER_DUCKING_LEVEL / 100 : AUDIO_MIXER_UNITY_GAIN;
+    int32_t gain = std::clamp(target_gain, speech_gain_ - AUDIO_MIXER_GAIN_STEP, speech_gain_ + AUDIO_MIXER_GAIN_STEP);
+    if (has_speech) {
+        ScaleSamples(pcm, count, speech_gain_, gain);
+    } else {
+        std::memset(pcm, 0, count * sizeof(int16_t));
+    }
+    speech_gain_ = gain;
+
+    int64_t request_time = 0;
+    for (size_t i = 0; i < voice_count_;) {
+        auto& voice = voices_[i];
+        size_t mixed = std::min(count, voice.sound->size() - voice.position);
+        MixSamples(pcm, voice.sound->data() + voice.position, mixed, voice.gain);
+        voice.position += mixed;
+        if (voice.request_time != 0 && (request_time == 0 || voice.request_time < request_time)) {
+            request_time = voice.request_time;
+        }
+        voice.request_time = 0;
+
+        if (voice.position >= voice.sound->size()) {
+            // Finished, the last voice takes its slot
+            voice = std::move(voices_[--voice_count_]);
+            voices_[voice_count_] = AudioMixerVoice();
+        } else {
+            i++;
+        }
+    }
+    return request_time;
+}
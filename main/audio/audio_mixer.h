@@ -0,0 +1,58 @@
+#ifndef AUDIO_MIXER_H
+#define AUDIO_MIXER_H
+
+#include <array>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+#include "sound_cache.h"
+#include "sample_kernels.h"
+
+// Sounds played at the same time, on top of the speech
+#define AUDIO_MIXER_MAX_VOICES 4
+// Gains are Q15 fixed point
+#define AUDIO_MIXER_UNITY_GAIN SAMPLE_GAIN_UNITY
+// Speech level while a sound plays, in percent
+#ifdef CONFIG_AUDIO_DUCKING_LEVEL
+#define AUDIO_MIXER_DUCKING_LEVEL CONFIG_AUDIO_DUCKING_LEVEL
+#else
+#define AUDIO_MIXER_DUCKING_LEVEL 100
+#endif
+// The speech gain moves at most this much per mixed chunk, so ducking does not click
+#define AUDIO_MIXER_GAIN_STEP (AUDIO_MIXER_UNITY_GAIN / 4)
+
+struct AudioMixerVoice {
+    std::shared_ptr<const CachedSound> sound;
+    int32_t gain = AUDIO_MIXER_UNITY_GAIN;
+    int64_t request_time = 0;   // PlaySound() call, reported once the first chunk is mixed
+    size_t position = 0;
+};
+
+/*
+ * Mixes the cached sounds into the speech stream of the audio output task, chunk by chunk.
+ * The speech is ducked to AUDIO_MIXER_DUCKING_LEVEL while any sound plays. Only used by the
+ * audio output task.
+ */
+class AudioMixer {
+public:
+    // Returns false if all voices are busy
+    bool AddVoice(AudioMixerVoice&& voice);
+    void Clear();
+    inline bool HasVoices() const { return voice_count_ > 0; }
+    inline bool IsFull() const { return voice_count_ == AUDIO_MIXER_MAX_VOICES; }
+
+    /*
+     * Mixes the next count samples of every voice into pcm, which holds count samples of speech,
+     * or is filled with silence first if there is no speech. Returns the earliest request time of
+     * the voices that started in this chunk, or 0.
+     */
+    int64_t Mix(int16_t* pcm, size_t count, bool has_speech);
+
+private:
+    std::array<AudioMixerVoice, AUDIO_MIXER_MAX_VOICES> voices_;
+    size_t voice_count_ = 0;
+    int32_t speech_gain_ = AUDIO_MIXER_UNITY_GAIN;
+};
+
+#endif // AUDIO_MIXER_H
@@ -0,0 +1,59 @@
+#ifndef AUDIO_POOL_H
+#define AUDIO_POOL_H
+
+#include <memory>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+#include "spsc_queue.h"
+
+/*
+ * Recycles AudioTask / AudioStreamPacket objects between the task that fills them and the task
+ * that consumes them, so a warm pipeline does not touch the heap per frame. The vectors inside
+ * keep their capacity across uses, since the Opus wrappers and the resamplers only resize them.
+ *
+ * The free list is a SpscQueue: Acquire() must be serialized on one side and Release() on the
+ * other. Objects released while the pool is full are freed.
+ */
+template <typename T, size_t Capacity>
+class AudioPool {
+public:
+    // Allocate count objects up front, each prepared by init (e.g. to reserve its buffers)
+    template <typename Init>
+    void Preallocate(size_t count, Init init) {
+        for (size_t i = 0; i < count && i < Capacity; i++) {
+            auto item = std::make_unique<T>();
+            init(*item);
+            if (!free_.Push(std::move(item))) {
+                break;
+            }
+        }
+    }
+
+    std::unique_ptr<T> Acquire() {
+        std::unique_ptr<T> item;
+        if (free_.Pop(item)) {
+            return item;
+        }
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return std::make_unique<T>();
+    }
+
+    void Release(std::unique_ptr<T>&& item) {
+        if (item) {
+            free_.Push(std::move(item));
+            item.reset();
+        }
+    }
+
+    // Number of Acquire() calls that had to allocate
+    inline uint32_t misses() const { return misses_.load(std::memory_order_relaxed); }
+    inline size_t available() const { return free_.Size(); }
+
+private:
+    SpscQueue<std::unique_ptr<T>, Capacity> free_;
+    std::atomic<uint32_t> misses_ = 0;
+};
+
+#endif // AUDIO_POOL_H
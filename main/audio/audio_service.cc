@@ -1,6 +1,7 @@
 #include "audio_service.h"
 #include <esp_log.h>
 #include <cstring>
+#include <algorithm>
 
 #if CONFIG_USE_AUDIO_PROCESSOR
 #include "processors/afe_audio_processor.h"
@@ -21,6 +22,14 @@
 
 #define TAG "AudioService"
 
+// In the order of AudioProfileType
+const AudioProfile AudioService::kAudioProfiles[] = {
+    { "low_latency", 20, 0 },
+    { "balanced", 40, 0 },
+    { "default", 60, 0 },
+    { "low_bandwidth", 60, 3 },
+};
+
 
 AudioService::AudioService() {
     event_group_ = xEventGroupCreate();
@@ -39,12 +48,12 @@ void AudioService::Initialize(AudioCodec* codec) {
 
     /* Setup the audio codec */
     opus_decoder_ = std::make_unique<OpusDecoderWrapper>(codec->output_sample_rate(), 1, OPUS_FRAME_DURATION_MS);
-    opus_encoder_ = std::make_unique<OpusEncoderWrapper>(16000, 1, OPUS_FRAME_DURATION_MS);
-    opus_encoder_->SetComplexity(0);
+    opus_encoder_ = std::make_unique<OpusEncoderWrapper>(16000, 1, frame_duration_);
+    opus_encoder_->SetComplexity(encode_complexity_);
+    applied_complexity_ = encode_complexity_;
 
     if (codec->input_sample_rate() != 16000) {
-        input_resampler_.Configure(codec->input_sample_rate(), 16000);
-        reference_resampler_.Configure(codec->input_sample_rate(), 16000);
+        input_resampler_.Configure(codec->input_sample_rate(), 16000, codec->input_channels());
     }
 
 #if CONFIG_USE_AUDIO_PROCESSOR
@@ -53,8 +62,8 @@ void AudioService::Initialize(AudioCodec* codec) {
     audio_processor_ = std::make_unique<NoAudioProcessor>();
 #endif
 
-    audio_processor_->OnOutput([this](std::vector<int16_t>&& data) {
-        PushTaskToEncodeQueue(kAudioTaskTypeEncodeToSendQueue, std::move(data));
+    audio_processor_->OnOutput([this](const std::vector<int16_t>& data) {
+        PushTaskToEncodeQueue(kAudioTaskTypeEncodeToSendQueue, data);
     });
 
     audio_processor_->OnVadStateChange([this](bool speaking) {
@@ -75,6 +84,39 @@ void AudioService::Initialize(AudioCodec* codec) {
         .skip_unhandled_events = true,
     };
     esp_timer_create(&audio_power_timer_args, &audio_power_timer_);
+
+    PreallocateBuffers();
+}
+
+void AudioService::PreallocateBuffers() {
+    /* Size the pools and the scratch buffers for one frame, so the warm pipeline does not allocate */
+    int input_samples = OPUS_FRAME_DURATION_MS * 16000 / 1000;
+    int output_samples = OPUS_FRAME_DURATION_MS * codec_->output_sample_rate() / 1000;
+    int raw_input_samples = OPUS_FRAME_DURATION_MS * codec_->input_sample_rate() / 1000 * codec_->input_channels();
+
+    encode_task_pool_.Preallocate(ENCODE_TASK_POOL_SIZE, [input_samples](AudioTask& task) {
+        task.pcm.reserve(input_samples);
+    });
+    playback_task_pool_.Preallocate(PLAYBACK_TASK_POOL_SIZE, [output_samples](AudioTask& task) {
+        task.pcm.reserve(output_samples);
+    });
+    send_packet_pool_.Preallocate(SEND_PACKET_POOL_PREALLOCATED, [](AudioStreamPacket& packet) {
+        packet.payload.reserve(OPUS_PAYLOAD_RESERVE_BYTES + AUDIO_PACKET_HEADROOM);
+    });
+    decode_packet_pool_.Preallocate(DECODE_PACKET_POOL_SIZE / 2, [](AudioStreamPacket& packet) {
+        packet.payload.reserve(OPUS_PAYLOAD_RESERVE_BYTES + AUDIO_PACKET_HEADROOM);
+    });
+    sound_packet_.payload.reserve(OPUS_PAYLOAD_RESERVE_BYTES);
+    encode_buffer_.reserve(OPUS_PAYLOAD_RESERVE_BYTES);
+    if (WAKE_WORD_PREROLL_MS > 0) {
+        preroll_pcm_.reserve(input_samples);
+    }
+    output_buffer_.reserve(AUDIO_CODEC_DMA_FRAME_NUM);
+
+    input_buffer_.reserve(std::max(raw_input_samples, input_samples * codec_->input_channels()));
+    if (codec_->input_sample_rate() != 16000) {
+        input_resampler_.Reserve(raw_input_samples / codec_->input_channels());
+    }
 }
 
 void AudioService::Start() {
@@ -88,6 +130,7 @@ void AudioService::Start() {
     xTaskCreatePinnedToCore([](void* arg) {
         AudioService* audio_service = (AudioService*)arg;
         audio_service->AudioInputTask();
+        audio_service->audio_input_task_handle_ = nullptr;
         vTaskDelete(NULL);
     }, "audio_input", 2048 * 3, this, 8, &audio_input_task_handle_, 0);
 
@@ -95,6 +138,7 @@ void AudioService::Start() {
     xTaskCreate([](void* arg) {
         AudioService* audio_service = (AudioService*)arg;
         audio_service->AudioOutputTask();
+        audio_service->audio_output_task_handle_ = nullptr;
         vTaskDelete(NULL);
     }, "audio_output", 2048 * 2, this, 4, &audio_output_task_handle_);
 #else
@@ -102,6 +146,7 @@ void AudioService::Start() {
     xTaskCreate([](void* arg) {
         AudioService* audio_service = (AudioService*)arg;
         audio_service->AudioInputTask();
+        audio_service->audio_input_task_handle_ = nullptr;
         vTaskDelete(NULL);
     }, "audio_input", 2048 * 2, this, 8, &audio_input_task_handle_);
 
@@ -109,6 +154,7 @@ void AudioService::Start() {
     xTaskCreate([](void* arg) {
         AudioService* audio_service = (AudioService*)arg;
         audio_service->AudioOutputTask();
+        audio_service->audio_output_task_handle_ = nullptr;
         vTaskDelete(NULL);
     }, "audio_output", 2048, this, 4, &audio_output_task_handle_);
 #endif
@@ -117,6 +163,7 @@ void AudioService::Start() {
     xTaskCreate([](void* arg) {
         AudioService* audio_service = (AudioService*)arg;
         audio_service->OpusCodecTask();
+        audio_service->opus_codec_task_handle_ = nullptr;
         vTaskDelete(NULL);
     }, "opus_codec", 2048 * 13, this, 2, &opus_codec_task_handle_);
 }
@@ -128,12 +175,21 @@ void AudioService::Stop() {
         AS_EVENT_WAKE_WORD_RUNNING |
         AS_EVENT_AUDIO_PROCESSOR_RUNNING);
 
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    audio_encode_queue_.clear();
-    audio_decode_queue_.clear();
-    audio_playback_queue_.clear();
-    audio_testing_queue_.clear();
-    audio_queue_cv_.notify_all();
+    testing_playback_ = false;
+    jitter_buffer_reset_ = true;
+    audio_encode_queue_.Clear();
+    audio_decode_queue_.Clear();
+    sound_queue_.Clear();
+    cached_sound_queue_.Clear();
+    mixer_reset_ = true;
+    speech_reset_ = true;
+    audio_playback_queue_.Clear();
+    audio_testing_queue_.Clear();
+    NotifyTask(opus_codec_task_handle_);
+    NotifyTask(audio_output_task_handle_);
+    NotifyWaiter(encode_waiter_);
+    NotifyWaiter(decode_waiter_);
+    NotifyWaiter(sound_waiter_);
 }
 
 bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, int samples) {
@@ -148,27 +204,7 @@ bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, in
         if (!codec_->InputData(data)) {
             return false;
         }
-        if (codec_->input_channels() == 2) {
-            auto mic_channel = std::vector<int16_t>(data.size() / 2);
-            auto reference_channel = std::vector<int16_t>(data.size() / 2);
-            for (size_t i = 0, j = 0; i < mic_channel.size(); ++i, j += 2) {
-                mic_channel[i] = data[j];
-                reference_channel[i] = data[j + 1];
-            }
-            auto resampled_mic = std::vector<int16_t>(input_resampler_.GetOutputSamples(mic_channel.size()));
-            auto resampled_reference = std::vector<int16_t>(reference_resampler_.GetOutputSamples(reference_channel.size()));
-            input_resampler_.Process(mic_channel.data(), mic_channel.size(), resampled_mic.data());
-            reference_resampler_.Process(reference_channel.data(), reference_channel.size(), resampled_reference.data());
-            data.resize(resampled_mic.size() + resampled_reference.size());
-            for (size_t i = 0, j = 0; i < resampled_mic.size(); ++i, j += 2) {
-                data[j] = resampled_mic[i];
-                data[j + 1] = resampled_reference[i];
-            }
-        } else {
-            auto resampled = std::vector<int16_t>(input_resampler_.GetOutputSamples(data.size()));
-            input_resampler_.Process(data.data(), data.size(), resampled.data());
-            data = std::move(resampled);
-        }
+        input_resampler_.Process(data);
     } else {
         data.resize(samples * codec_->input_channels());
         if (!codec_->InputData(data)) {
@@ -192,6 +228,14 @@ bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, in
 }
 
 void AudioService::AudioInputTask() {
+    /* Reused for every frame, the mic channel is extracted in place */
+    auto& data = input_buffer_;
+    auto take_mic_channel = [this, &data]() {
+        int channels = codec_->input_channels();
+        ExtractChannel(data.data(), data.data(), data.size() / channels, channels, 0);
+        data.resize(data.size() / channels);
+    };
+
     while (true) {
         EventBits_t bits = xEventGroupWaitBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING |
             AS_EVENT_WAKE_WORD_RUNNING | AS_EVENT_AUDIO_PROCESSOR_RUNNING,
@@ -208,44 +252,37 @@ void AudioService::AudioInputTask() {
 
         /* Used for audio testing in NetworkConfiguring mode by clicking the BOOT button */
         if (bits & AS_EVENT_AUDIO_TESTING_RUNNING) {
-            if (audio_testing_queue_.size() >= AUDIO_TESTING_MAX_DURATION_MS / OPUS_FRAME_DURATION_MS) {
+            if (audio_testing_queue_.Size() >= AUDIO_TESTING_MAX_DURATION_MS / frame_duration_) {
                 ESP_LOGW(TAG, "Audio testing queue is full, stopping audio testing");
                 EnableAudioTesting(false);
                 continue;
             }
-            std::vector<int16_t> data;
-            int samples = OPUS_FRAME_DURATION_MS * 16000 / 1000;
+            int samples = frame_duration_ * 16000 / 1000;
             if (ReadAudioData(data, 16000, samples)) {
                 // If input channels is 2, we need to fetch the left channel data
                 if (codec_->input_channels() == 2) {
-                    auto mono_data = std::vector<int16_t>(data.size() / 2);
-                    for (size_t i = 0, j = 0; i < mono_data.size(); ++i, j += 2) {
-                        mono_data[i] = data[j];
-                    }
-                    data = std::move(mono_data);
+                    take_mic_channel();
                 }
-                PushTaskToEncodeQueue(kAudioTaskTypeEncodeToTestingQueue, std::move(data));
+                PushTaskToEncodeQueue(kAudioTaskTypeEncodeToTestingQueue, data);
                 continue;
             }
         }
 
         /* Feed the wake word */
         if (bits & AS_EVENT_WAKE_WORD_RUNNING) {
-            std::vector<int16_t> data;
             int samples = wake_word_->GetFeedSize();
             if (samples > 0) {
                 if (ReadAudioData(data, 16000, samples)) {
 #if CONFIG_USE_MICRO_WAKE_WORD
                     // If input channels is 2, we need to fetch the left channel data for MicroWakeWord
                     if (codec_->input_channels() == 2) {
-                        auto mono_data = std::vector<int16_t>(data.size() / 2);
-                        for (size_t i = 0, j = 0; i < mono_data.size(); ++i, j += 2) {
-                            mono_data[i] = data[j];
-                        }
-                        data = std::move(mono_data);
+                        take_mic_channel();
                     }
 #endif // CONFIG_USE_MICRO_WAKE_WORD
                     wake_word_->Feed(data);
+                    if (WAKE_WORD_PREROLL_MS > 0) {
+                        StorePrerollAudio(data, data.size() / samples);
+                    }
                     continue;
                 }
             }
@@ -253,11 +290,12 @@ void AudioService::AudioInputTask() {
 
         /* Feed the audio processor */
         if (bits & AS_EVENT_AUDIO_PROCESSOR_RUNNING) {
-            std::vector<int16_t> data;
+            // The pre-roll ends where the audio processor takes over
+            preroll_pcm_.clear();
             int samples = audio_processor_->GetFeedSize();
             if (samples > 0) {
                 if (ReadAudioData(data, 16000, samples)) {
-                    audio_processor_->Feed(std::move(data));
+                    audio_processor_->Feed(data);
                     continue;
                 }
             }
@@ -272,137 +310,419 @@ void AudioService::AudioInputTask() {
 
 void AudioService::AudioOutputTask() {
     while (true) {
-        std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-        audio_queue_cv_.wait(lock, [this]() { return !audio_playback_queue_.empty() || service_stopped_; });
+        while (!service_stopped_) {
+            if (speech_reset_.exchange(false)) {
+                playback_task_pool_.Release(std::move(output_task_));
+            }
+            if (mixer_reset_.exchange(false)) {
+                mixer_.Clear();
+            }
+            // Raised before the pop, so IsIdle() never sees a sound neither queued nor mixed
+            mixer_active_ = true;
+            AudioMixerVoice voice;
+            while (!mixer_.IsFull() && cached_sound_queue_.Pop(voice)) {
+                mixer_.AddVoice(std::move(voice));
+                NotifyWaiter(sound_waiter_);
+            }
+            mixer_active_ = mixer_.HasVoices();
+#if CONFIG_AUDIO_SOUND_PREEMPT_SPEECH
+            // Speech waits in the playback queue until the sounds are over
+            if (mixer_.HasVoices()) {
+                break;
+            }
+#endif
+            // Tasks discarded by ResetDecoder() go back to the pool, this task is its releasing side
+            if (!output_task_ && audio_playback_queue_.Pop(output_task_, [this](std::unique_ptr<AudioTask>&& task) {
+                playback_task_pool_.Release(std::move(task));
+            })) {
+                output_position_ = 0;
+                /* The codec task may be waiting for room in the playback queue */
+                if (audio_playback_queue_.Size() + 1 >= MAX_PLAYBACK_TASKS_IN_QUEUE) {
+                    NotifyTask(opus_codec_task_handle_);
+                }
+            }
+            if (output_task_ || mixer_.HasVoices()) {
+                break;
+            }
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            debug_statistics_.output_wakeups++;
+        }
         if (service_stopped_) {
             break;
         }
 
-        auto task = std::move(audio_playback_queue_.front());
-        audio_playback_queue_.pop_front();
-        audio_queue_cv_.notify_all();
-        lock.unlock();
-
         if (!codec_->output_enabled()) {
             esp_timer_stop(audio_power_timer_);
             esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
             codec_->EnableOutput(true);
         }
-        codec_->OutputData(task->pcm);
+
+        /* Write one DMA buffer at a time, so a sound joins the speech within a few milliseconds */
+        auto& task = output_task_;
+        bool has_speech = task != nullptr;
+#if CONFIG_AUDIO_SOUND_PREEMPT_SPEECH
+        has_speech = has_speech && !mixer_.HasVoices();
+#endif
+        size_t count = AUDIO_CODEC_DMA_FRAME_NUM;
+        int64_t request_time = 0;
+        if (has_speech) {
+            count = std::min(count, task->pcm.size() - output_position_);
+            auto begin = task->pcm.begin() + output_position_;
+            output_buffer_.assign(begin, begin + count);
+            if (output_position_ == 0) {
+                request_time = task->request_time;
+            }
+            output_position_ += count;
+        } else {
+            output_buffer_.resize(count);
+        }
+        bool had_voices = mixer_.HasVoices();
+        int64_t voice_request_time = mixer_.Mix(output_buffer_.data(), count, has_speech);
+        if (voice_request_time != 0) {
+            request_time = voice_request_time;
+        }
+        if (had_voices && !mixer_.HasVoices()) {
+            mixer_active_ = false;
+            // Decoded sounds queued behind the cached ones may start now
+            if (!sound_queue_.Empty()) {
+                NotifyTask(opus_codec_task_handle_);
+            }
+        }
+
+        int64_t output_start = esp_timer_get_time();
+        if (count > 0) {
+            codec_->OutputData(output_buffer_);
+        }
 
         /* Update the last output time */
         last_output_time_ = std::chrono::steady_clock::now();
+        int64_t output_end = esp_timer_get_time();
+        debug_statistics_.output_time.Add(output_end - output_start);
+        if (request_time != 0) {
+            debug_statistics_.sound_latency.Add(output_end - request_time);
+        }
+        if (!has_speech || output_position_ < task->pcm.size()) {
+            continue;
+        }
         debug_statistics_.playback_count++;
+        debug_statistics_.downlink_latency.Add(output_end - task->start_time);
 
 #if CONFIG_USE_SERVER_AEC
         /* Record the timestamp for server AEC */
-        if (task->timestamp > 0) {
-            lock.lock();
-            timestamp_queue_.push_back(task->timestamp);
+        if (task->timestamp > 0 && !timestamp_queue_.Push(task->timestamp)) {
+            debug_statistics_.timestamp_queue_drops++;
         }
 #endif
+        playback_task_pool_.Release(std::move(task));
     }
 
     ESP_LOGW(TAG, "Audio output task stopped");
 }
 
 void AudioService::OpusCodecTask() {
-    while (true) {
-        std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-        audio_queue_cv_.wait(lock, [this]() {
-            return service_stopped_ ||
-                (!audio_encode_queue_.empty() && audio_send_queue_.size() < MAX_SEND_PACKETS_IN_QUEUE) ||
-                (!audio_decode_queue_.empty() && audio_playback_queue_.size() < MAX_PLAYBACK_TASKS_IN_QUEUE);
-        });
-        if (service_stopped_) {
-            break;
+    bool woken = false;
+    while (!service_stopped_) {
+        bool busy = false;
+
+        if (jitter_buffer_reset_.exchange(false)) {
+            jitter_buffer_.Reset();
+            decode_packet_pool_.Release(std::move(local_packet_));
+            current_sound_.reset();
+            sound_recording_.reset();
+            sound_active_ = false;
+        }
+        if (preroll_reset_.exchange(false)) {
+            ClearPreroll();
+        }
+        if (preroll_flush_.exchange(false)) {
+            FlushPreroll();
         }
 
-        /* Decode the audio from decode queue */
-        if (!audio_decode_queue_.empty() && audio_playback_queue_.size() < MAX_PLAYBACK_TASKS_IN_QUEUE) {
-            auto packet = std::move(audio_decode_queue_.front());
-            audio_decode_queue_.pop_front();
-            audio_queue_cv_.notify_all();
-            lock.unlock();
-
-            auto task = std::make_unique<AudioTask>();
-            task->type = kAudioTaskTypeDecodeToPlaybackQueue;
-            task->timestamp = packet->timestamp;
-
-            SetDecodeSampleRate(packet->sample_rate, packet->frame_duration);
-            if (opus_decoder_->Decode(std::move(packet->payload), task->pcm)) {
-                // Resample if the sample rate is different
-                if (opus_decoder_->sample_rate() != codec_->output_sample_rate()) {
-                    int target_size = output_resampler_.GetOutputSamples(task->pcm.size());
-                    std::vector<int16_t> resampled(target_size);
-                    output_resampler_.Process(task->pcm.data(), task->pcm.size(), resampled.data());
-                    task->pcm = std::move(resampled);
+        /* Sort the network audio into the jitter buffer up to its target depth, unsequenced packets bypass it.
+         * The rest waits in the decode queue, past MAX_DECODE_PACKETS_IN_QUEUE the network drops them. */
+        std::unique_ptr<AudioStreamPacket> packet;
+        auto release_packet = [this](std::unique_ptr<AudioStreamPacket>&& discarded) {
+            decode_packet_pool_.Release(std::move(discarded));
+        };
+        while (!local_packet_ && !jitter_buffer_.Full() && audio_decode_queue_.Pop(packet, release_packet)) {
+            busy = true;
+            if (packet->sequence == 0) {
+                local_packet_ = std::move(packet);
+            } else if (!jitter_buffer_.Push(packet, packet->queue_time)) {
+                decode_packet_pool_.Release(std::move(packet));
+            }
+        }
+        NotifyWaiter(decode_waiter_);
+
+        /* Decode the local audio, the sounds, the jitter buffer, or the recorded audio after audio testing */
+        if (audio_playback_queue_.Size() < MAX_PLAYBACK_TASKS_IN_QUEUE) {
+            bool conceal = false;
+            AudioStreamPacket* source = nullptr;
+            // The recorded packets came from the send pool, they go back through its spares
+            auto drop_send_packet = [this](std::unique_ptr<AudioStreamPacket>&& discarded) {
+                DropSendPacket(std::move(discarded));
+            };
+            bool testing_packet = false;
+            if (testing_playback_) {
+                testing_packet = audio_testing_queue_.Pop(packet, drop_send_packet);
+                testing_playback_ = testing_packet;
+            }
+            if (!testing_playback_) {
+                if (local_packet_) {
+                    packet = std::move(local_packet_);
+                } else if (PullSoundPacket()) {
+                    source = &sound_packet_;
+                } else {
+                    // Lost packets are concealed only when the output is about to run dry
+                    auto result = jitter_buffer_.Pop(packet, audio_playback_queue_.Empty(), esp_timer_get_time());
+                    conceal = result == kJitterBufferConceal;
                 }
+            }
+            if (packet) {
+                source = packet.get();
+            }
 
-                lock.lock();
-                audio_playback_queue_.push_back(std::move(task));
-                audio_queue_cv_.notify_all();
-            } else {
-                ESP_LOGE(TAG, "Failed to decode audio");
-                lock.lock();
+            if (source || conceal) {
+                busy = true;
+                auto task = playback_task_pool_.Acquire();
+                task->type = kAudioTaskTypeDecodeToPlaybackQueue;
+                task->timestamp = source ? source->timestamp : 0;
+                task->start_time = esp_timer_get_time();
+                task->request_time = source == &sound_packet_ ? std::exchange(sound_request_time_, 0) : 0;
+
+                if (source) {
+                    SetDecodeSampleRate(source->sample_rate, source->frame_duration);
+                }
+                // Decode into the scratch buffer if the output has to be resampled
+                bool resample = opus_decoder_->sample_rate() != codec_->output_sample_rate();
+                auto& pcm = resample ? decode_buffer_ : task->pcm;
+                if (source ? opus_decoder_->Decode(std::move(source->payload), pcm) : ConcealFrame(pcm)) {
+                    if (resample) {
+                        task->pcm.resize(output_resampler_.GetOutputSamples(pcm.size()));
+                        output_resampler_.Process(pcm.data(), pcm.size(), task->pcm.data());
+                    }
+                    debug_statistics_.decode_time.Add(esp_timer_get_time() - task->start_time);
+                    if (source == &sound_packet_) {
+                        // The cache keeps the recorded level, the volume is applied on every play
+                        RecordSoundFrame(task->pcm);
+                        ScaleSamples(task->pcm.data(), task->pcm.size(), sound_gain_, sound_gain_);
+                    }
+
+                    if (audio_playback_queue_.Push(std::move(task))) {
+                        NotifyTask(audio_output_task_handle_);
+                    } else {
+                        ESP_LOGW(TAG, "Playback queue is full, dropping audio");
+                    }
+                } else {
+                    ESP_LOGE(TAG, "Failed to decode audio");
+                    if (source == &sound_packet_) {
+                        sound_recording_.reset();
+                    }
+                }
+                // A task that was not queued is freed here, the output task is the releasing side of its pool
+                if (testing_packet) {
+                    DropSendPacket(std::move(packet));
+                } else {
+                    decode_packet_pool_.Release(std::move(packet));
+                }
+                debug_statistics_.decode_count++;
             }
-            debug_statistics_.decode_count++;
         }
-        
+
         /* Encode the audio to send queue */
-        if (!audio_encode_queue_.empty() && audio_send_queue_.size() < MAX_SEND_PACKETS_IN_QUEUE) {
-            auto task = std::move(audio_encode_queue_.front());
-            audio_encode_queue_.pop_front();
-            audio_queue_cv_.notify_all();
-            lock.unlock();
-
-            auto packet = std::make_unique<AudioStreamPacket>();
-            packet->frame_duration = OPUS_FRAME_DURATION_MS;
+        std::unique_ptr<AudioTask> task;
+        auto release_task = [this](std::unique_ptr<AudioTask>&& discarded) {
+            encode_task_pool_.Release(std::move(discarded));
+        };
+        if (audio_send_queue_.Size() < MAX_SEND_PACKETS_IN_QUEUE && audio_encode_queue_.Pop(task, release_task)) {
+            busy = true;
+            NotifyWaiter(encode_waiter_);
+
+            /* Follow the audio profile, the frame duration is taken from the frame itself */
+            SetEncodeSampleRate(encode_sample_rate_, task->pcm.size() * 1000 / 16000);
+            if (applied_complexity_ != encode_complexity_) {
+                applied_complexity_ = encode_complexity_;
+                opus_encoder_->SetComplexity(applied_complexity_);
+            }
+
+            auto packet = task->type == kAudioTaskTypeEncodeToPreroll ? AcquirePrerollPacket() : AcquireSendPacket();
+            packet->frame_duration = opus_encoder_->duration_ms();
             packet->sample_rate = 16000;
             packet->timestamp = task->timestamp;
 #ifdef CONFIG_LSPLATFORM
             if (opus_encoder_->sample_rate() != 16000) {
-                int target_size = uplink_resampler_.GetOutputSamples(task->pcm.size());
-                std::vector<int16_t> resampled(target_size);
-                uplink_resampler_.Process(task->pcm.data(), task->pcm.size(), resampled.data());
-                task->pcm = std::move(resampled);
+                uplink_resample_buffer_.resize(uplink_resampler_.GetOutputSamples(task->pcm.size()));
+                uplink_resampler_.Process(task->pcm.data(), task->pcm.size(), uplink_resample_buffer_.data());
+                task->pcm.swap(uplink_resample_buffer_);
                 packet->sample_rate = opus_encoder_->sample_rate();
             }
 #endif // CONFIG_LSPLATFORM
-            if (!opus_encoder_->Encode(std::move(task->pcm), packet->payload)) {
+            /* Packets for the network keep AUDIO_PACKET_HEADROOM in front of the Opus data for the transport
+             * header. The esp-opus-encoder wrapper only writes at the front of a vector, so its output is copied
+             * behind the headroom, the one copy of the uplink, counted in encode_copy_bytes. Transports without
+             * a header turn the headroom off. */
+            bool headroom = send_headroom_ && task->type != kAudioTaskTypeEncodeToTestingQueue;
+            int64_t encode_start = esp_timer_get_time();
+            if (!opus_encoder_->Encode(std::move(task->pcm), headroom ? encode_buffer_ : packet->payload)) {
                 ESP_LOGE(TAG, "Failed to encode audio");
+                encode_task_pool_.Release(std::move(task));
+                DropSendPacket(std::move(packet));
                 continue;
             }
+            packet->headroom = headroom ? AUDIO_PACKET_HEADROOM : 0;
+            if (headroom) {
+                packet->payload.resize(AUDIO_PACKET_HEADROOM + encode_buffer_.size());
+                memcpy(packet->payload.data() + AUDIO_PACKET_HEADROOM, encode_buffer_.data(), encode_buffer_.size());
+                debug_statistics_.encode_copy_bytes += encode_buffer_.size();
+            }
+            int64_t encode_end = esp_timer_get_time();
+            debug_statistics_.encode_time.Add(encode_end - encode_start);
 
-            if (task->type == kAudioTaskTypeEncodeToSendQueue) {
-                {
-                    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-                    audio_send_queue_.push_back(std::move(packet));
+            bool to_send = task->type == kAudioTaskTypeEncodeToSendQueue;
+            if (task->type == kAudioTaskTypeEncodeToPreroll) {
+                // Kept for the wake word, or sent live once the pre-roll was drained
+                to_send = !StorePrerollPacket(packet);
+            }
+            if (to_send) {
+                packet->queue_time = encode_end;
+                if (!audio_send_queue_.Push(std::move(packet))) {
+                    ESP_LOGW(TAG, "Send queue is full, dropping audio");
+                    debug_statistics_.send_queue_drops++;
                 }
+                debug_statistics_.send_queue_peak = std::max<uint32_t>(debug_statistics_.send_queue_peak, audio_send_queue_.Size());
+                debug_statistics_.uplink_latency.Add(encode_end - task->start_time);
                 if (callbacks_.on_send_queue_available) {
                     callbacks_.on_send_queue_available();
                 }
             } else if (task->type == kAudioTaskTypeEncodeToTestingQueue) {
-                std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-                audio_testing_queue_.push_back(std::move(packet));
+                audio_testing_queue_.Push(std::move(packet));
             }
+            DropSendPacket(std::move(packet));
+            encode_task_pool_.Release(std::move(task));
             debug_statistics_.encode_count++;
-            lock.lock();
         }
+
+        if (!busy) {
+            if (woken) {
+                debug_statistics_.codec_idle_wakeups++;
+            }
+            // Poll while the jitter buffer holds audio that is not due yet
+            bool waiting = !jitter_buffer_.Empty() && audio_playback_queue_.Size() < MAX_PLAYBACK_TASKS_IN_QUEUE;
+            if (ulTaskNotifyTake(pdTRUE, waiting ? pdMS_TO_TICKS(JITTER_BUFFER_POLL_MS) : portMAX_DELAY) == 0) {
+                woken = false;
+                continue;
+            }
+            debug_statistics_.codec_wakeups++;
+        }
+        woken = !busy;
     }
 
     ESP_LOGW(TAG, "Opus codec task stopped");
 }
 
+bool AudioService::PullSoundPacket() {
+    while (!current_sound_ || sound_position_ >= current_sound_->packets.size()) {
+        current_sound_.reset();
+        sound_recording_.reset();
+        sound_position_ = 0;
+        // Cached sounds played before this one go first, the output task wakes us when they are over
+        if (IsMixerBusy()) {
+            return false;
+        }
+        // Raised before the pop, so IsIdle() never sees the sound neither queued nor active
+        sound_active_ = true;
+        SoundRequest request;
+        if (!sound_queue_.Pop(request)) {
+            sound_active_ = false;
+            return false;
+        }
+        NotifyWaiter(sound_waiter_);
+        current_sound_ = std::move(request.stream);
+        sound_request_time_ = request.request_time;
+        sound_gain_ = request.gain;
+
+        /* Short sounds are decoded into the cache as they play */
+        int output_sample_rate = codec_->output_sample_rate();
+        int duration = current_sound_->packets.size() * current_sound_->frame_duration;
+        // The resampler may emit a few more samples than the nominal duration
+        size_t samples = (duration + current_sound_->frame_duration) * output_sample_rate / 1000;
+        if (duration <= SOUND_CACHE_MAX_DURATION_MS && sound_cache_.Fits(samples)) {
+            sound_recording_ = std::make_shared<CachedSound>(current_sound_->data.data(), output_sample_rate, samples);
+        }
+    }
+    /* The decoder takes a vector, so the packet is copied from the flash into a reused buffer */
+    auto payload = current_sound_->packet(sound_position_++);
+    sound_packet_.sample_rate = current_sound_->sample_rate;
+    sound_packet_.frame_duration = current_sound_->frame_duration;
+    sound_packet_.timestamp = 0;
+    sound_packet_.sequence = 0;
+    sound_packet_.payload.assign(payload.begin(), payload.end());
+    return true;
+}
+
+void AudioService::RecordSoundFrame(const std::vector<int16_t>& pcm) {
+    if (!sound_recording_) {
+        return;
+    }
+    if (!sound_recording_->Append(pcm.data(), pcm.size())) {
+        sound_recording_.reset();
+        return;
+    }
+    if (sound_position_ >= current_sound_->packets.size()) {
+        sound_cache_.Put(std::move(sound_recording_));
+    }
+}
+
+bool AudioService::IsMixerBusy() const {
+    return !cached_sound_queue_.Empty() || mixer_active_;
+}
+
+bool AudioService::ConcealFrame(std::vector<int16_t>& pcm) {
+    // An empty packet makes the Opus decoder run its packet loss concealment
+    std::vector<uint8_t> lost;
+    if (!opus_decoder_->Decode(std::move(lost), pcm)) {
+        pcm.assign(opus_decoder_->sample_rate() * opus_decoder_->duration_ms() / 1000, 0);
+    }
+    return true;
+}
+
 #ifdef CONFIG_LSPLATFORM
 void AudioService::SetNarrowbandMode(bool enabled) {
-    if (enabled) {
-        SetEncodeSampleRate(8000, OPUS_FRAME_DURATION_MS);
-    } else {
-        SetEncodeSampleRate(16000, OPUS_FRAME_DURATION_MS);
+    // Applied by the opus codec task before the next frame
+    encode_sample_rate_ = enabled ? 8000 : 16000;
+}
+#endif // CONFIG_LSPLATFORM
+
+void AudioService::SetAudioProfile(AudioProfileType type) {
+    auto& profile = kAudioProfiles[type];
+    ESP_LOGI(TAG, "Audio profile: %s, frame duration %dms, complexity %d", profile.name, profile.frame_duration, profile.complexity);
+    audio_profile_ = type;
+    encode_complexity_ = profile.complexity;
+    SetFrameDuration(profile.frame_duration);
+}
+
+void AudioService::SetFrameDuration(int frame_duration) {
+    if (frame_duration < MIN_OPUS_FRAME_DURATION_MS || frame_duration > OPUS_FRAME_DURATION_MS ||
+        frame_duration % MIN_OPUS_FRAME_DURATION_MS != 0) {
+        ESP_LOGW(TAG, "Unsupported frame duration: %d", frame_duration);
+        return;
+    }
+    /* The processor cuts the frames, the codec task reconfigures the encoder when their size changes */
+    frame_duration_ = frame_duration;
+    if (audio_processor_initialized_) {
+        audio_processor_->SetFrameDuration(frame_duration);
     }
 }
 
+AudioProfileType AudioService::FindAudioProfile(const std::string& name) {
+    for (int i = 0; i < kAudioProfileCount; i++) {
+        if (name == kAudioProfiles[i].name) {
+            return (AudioProfileType)i;
+        }
+    }
+    return kAudioProfileCount;
+}
+
 void AudioService::SetEncodeSampleRate(int sample_rate, int frame_duration) {
     if (opus_encoder_->sample_rate() == sample_rate && opus_encoder_->duration_ms() == frame_duration) {
         return;
@@ -410,13 +730,15 @@ void AudioService::SetEncodeSampleRate(int sample_rate, int frame_duration) {
 
     opus_encoder_.reset();
     opus_encoder_ = std::make_unique<OpusEncoderWrapper>(sample_rate, 1, frame_duration);
+    applied_complexity_ = -1;
 
+#ifdef CONFIG_LSPLATFORM
     if (opus_encoder_->sample_rate() != 16000) {
         ESP_LOGI(TAG, "Resampling uplink audio to %d", opus_encoder_->sample_rate());
         uplink_resampler_.Configure(16000, opus_encoder_->sample_rate());
     }
-}
 #endif // CONFIG_LSPLATFORM
+}
 
 void AudioService::SetDecodeSampleRate(int sample_rate, int frame_duration) {
     if (opus_decoder_->sample_rate() == sample_rate && opus_decoder_->duration_ms() == frame_duration) {
@@ -433,57 +755,126 @@ void AudioService::SetDecodeSampleRate(int sample_rate, int frame_duration) {
     }
 }
 
-void AudioService::PushTaskToEncodeQueue(AudioTaskType type, std::vector<int16_t>&& pcm) {
-    auto task = std::make_unique<AudioTask>();
+void AudioService::PushTaskToEncodeQueue(AudioTaskType type, const std::vector<int16_t>& pcm) {
+    auto task = encode_task_pool_.Acquire();
     task->type = type;
-    task->pcm = std::move(pcm);
-    
-    /* Push the task to the encode queue */
-    std::unique_lock<std::mutex> lock(audio_queue_mutex_);
+    task->timestamp = 0;
+    task->pcm.assign(pcm.begin(), pcm.end());
+    task->start_time = esp_timer_get_time();
 
     /* If the task is to send queue, we need to set the timestamp */
-    if (type == kAudioTaskTypeEncodeToSendQueue && !timestamp_queue_.empty()) {
-        if (timestamp_queue_.size() <= MAX_TIMESTAMPS_IN_QUEUE) {
-            task->timestamp = timestamp_queue_.front();
-        } else {
-            ESP_LOGW(TAG, "Timestamp queue (%u) is full, dropping timestamp", timestamp_queue_.size());
+    if (type == kAudioTaskTypeEncodeToSendQueue) {
+        size_t pending = timestamp_queue_.Size();
+        uint32_t timestamp;
+        if (timestamp_queue_.Pop(timestamp)) {
+            if (pending <= MAX_TIMESTAMPS_IN_QUEUE) {
+                task->timestamp = timestamp;
+            } else {
+                ESP_LOGW(TAG, "Timestamp queue (%u) is full, dropping timestamp", pending);
+            }
         }
-        timestamp_queue_.pop_front();
     }
 
-    audio_queue_cv_.wait(lock, [this]() { return audio_encode_queue_.size() < MAX_ENCODE_TASKS_IN_QUEUE; });
-    audio_encode_queue_.push_back(std::move(task));
-    audio_queue_cv_.notify_all();
+    /* Push the task to the encode queue */
+    if (!PushOrWait(encode_waiter_, [this, &task]() { return audio_encode_queue_.Push(std::move(task)); })) {
+        return;
+    }
+    NotifyTask(opus_codec_task_handle_);
 }
 
 bool AudioService::PushPacketToDecodeQueue(std::unique_ptr<AudioStreamPacket> packet, bool wait) {
-    std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-    if (audio_decode_queue_.size() >= MAX_DECODE_PACKETS_IN_QUEUE) {
-        if (wait) {
-            audio_queue_cv_.wait(lock, [this]() { return audio_decode_queue_.size() < MAX_DECODE_PACKETS_IN_QUEUE; });
-        } else {
+    packet->queue_time = esp_timer_get_time();
+    auto try_push = [this, &packet]() {
+        std::lock_guard<std::mutex> lock(decode_producer_mutex_);
+        return audio_decode_queue_.Size() < MAX_DECODE_PACKETS_IN_QUEUE && audio_decode_queue_.Push(std::move(packet));
+    };
+    auto keep_spare = [this, &packet]() {
+        RecycleDecodePacket(std::move(packet));
+        return false;
+    };
+    if (wait) {
+        // One waiting producer at a time, the others keep pushing
+        std::lock_guard<std::mutex> lock(decode_wait_mutex_);
+        if (!PushOrWait(decode_waiter_, try_push)) {
+            return keep_spare();
+        }
+    } else if (!try_push()) {
+        // Dropped, the network does not wait for room
+        return keep_spare();
+    }
+    NotifyTask(opus_codec_task_handle_);
+    return true;
+}
+
+std::unique_ptr<AudioStreamPacket> AudioService::AcquireDecodePacket() {
+    std::lock_guard<std::mutex> lock(decode_producer_mutex_);
+    if (decode_packet_spare_) {
+        return std::move(decode_packet_spare_);
+    }
+    return decode_packet_pool_.Acquire();
+}
+
+void AudioService::RecycleDecodePacket(std::unique_ptr<AudioStreamPacket> packet) {
+    std::lock_guard<std::mutex> lock(decode_producer_mutex_);
+    decode_packet_spare_ = std::move(packet);
+}
+
+void AudioService::RecycleSendPacket(std::unique_ptr<AudioStreamPacket> packet, bool sent) {
+    if (!sent) {
+        debug_statistics_.send_failures++;
+    } else if (packet->queue_time != 0) {
+        debug_statistics_.send_latency.Add(esp_timer_get_time() - packet->queue_time);
+    }
+    send_packet_pool_.Release(std::move(packet));
+}
+
+size_t AudioService::PopPacketsFromSendQueue(std::unique_ptr<AudioStreamPacket>* packets, size_t max_count, size_t min_count) {
+    size_t queued = audio_send_queue_.Size();
+    if (queued < min_count) {
+        return 0;
+    }
+    size_t count = 0;
+    while (count < max_count && audio_send_queue_.Pop(packets[count])) {
+        count++;
+    }
+    /* The codec task may be waiting for room in the send queue */
+    if (count > 0 && queued >= MAX_SEND_PACKETS_IN_QUEUE) {
+        NotifyTask(opus_codec_task_handle_);
+    }
+    return count;
+}
+
+template <typename TryPush>
+bool AudioService::PushOrWait(std::atomic<TaskHandle_t>& waiter, TryPush try_push) {
+    while (!try_push()) {
+        if (service_stopped_) {
             return false;
         }
+        waiter = xTaskGetCurrentTaskHandle();
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        // The consumer may have made room before it saw us waiting
+        if (try_push()) {
+            waiter = nullptr;
+            break;
+        }
+        debug_statistics_.producer_waits++;
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        waiter = nullptr;
     }
-    audio_decode_queue_.push_back(std::move(packet));
-    audio_queue_cv_.notify_all();
     return true;
 }
 
-std::unique_ptr<AudioStreamPacket> AudioService::PopPacketFromSendQueue() {
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    if (audio_send_queue_.empty()) {
-        return nullptr;
+void AudioService::NotifyWaiter(std::atomic<TaskHandle_t>& waiter) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    TaskHandle_t task = waiter;
+    if (task != nullptr) {
+        xTaskNotifyGive(task);
     }
-    auto packet = std::move(audio_send_queue_.front());
-    audio_send_queue_.pop_front();
-    audio_queue_cv_.notify_all();
-    return packet;
 }
 
-void AudioService::EncodeWakeWord() {
-    if (wake_word_) {
-        wake_word_->EncodeWakeWordData();
+void AudioService::NotifyTask(TaskHandle_t task) {
+    if (task != nullptr) {
+        xTaskNotifyGive(task);
     }
 }
 
@@ -491,12 +882,104 @@ const std::string& AudioService::GetLastWakeWord() const {
     return wake_word_->GetLastDetectedWakeWord();
 }
 
-std::unique_ptr<AudioStreamPacket> AudioService::PopWakeWordPacket() {
-    auto packet = std::make_unique<AudioStreamPacket>();
-    if (wake_word_->GetWakeWordOpus(packet->payload)) {
+size_t AudioService::FlushWakeWordPackets() {
+    xEventGroupClearBits(event_group_, AS_EVENT_PREROLL_FLUSHED);
+    preroll_flush_ = true;
+    NotifyTask(opus_codec_task_handle_);
+    EventBits_t bits = xEventGroupWaitBits(event_group_, AS_EVENT_PREROLL_FLUSHED, pdFALSE, pdFALSE, pdMS_TO_TICKS(100));
+    if (!(bits & AS_EVENT_PREROLL_FLUSHED)) {
+        ESP_LOGW(TAG, "Codec task did not flush the pre-roll");
+        return 0;
+    }
+    return preroll_flushed_;
+}
+
+void AudioService::StorePrerollAudio(const std::vector<int16_t>& data, int channels) {
+    /* Cut the mic channel into encoder frames, whatever the feed size of the wake word */
+    size_t frame_samples = frame_duration_ * 16000 / 1000;
+    size_t frames = data.size() / channels;
+    size_t offset = 0;
+    while (offset < frames) {
+        if (preroll_pcm_.size() >= frame_samples) {
+            // The frame duration changed meanwhile
+            preroll_pcm_.clear();
+        }
+        size_t size = preroll_pcm_.size();
+        size_t count = std::min(frames - offset, frame_samples - size);
+        preroll_pcm_.resize(size + count);
+        ExtractChannel(data.data() + offset * channels, preroll_pcm_.data() + size, count, channels, 0);
+        offset += count;
+        if (preroll_pcm_.size() == frame_samples) {
+            PushTaskToEncodeQueue(kAudioTaskTypeEncodeToPreroll, preroll_pcm_);
+            preroll_pcm_.clear();
+        }
+    }
+}
+
+std::unique_ptr<AudioStreamPacket> AudioService::AcquireSendPacket() {
+    std::unique_ptr<AudioStreamPacket> packet;
+    if (send_packet_spares_.Pop(packet)) {
         return packet;
     }
-    return nullptr;
+    return send_packet_pool_.Acquire();
+}
+
+void AudioService::DropSendPacket(std::unique_ptr<AudioStreamPacket>&& packet) {
+    // Freed if there are enough spares already
+    if (packet) {
+        send_packet_spares_.Push(std::move(packet));
+        packet.reset();
+    }
+}
+
+std::unique_ptr<AudioStreamPacket> AudioService::AcquirePrerollPacket() {
+    /* A full ring gives its oldest packet, so encoding ahead does not drain the pool */
+    size_t max_packets = std::max(WAKE_WORD_PREROLL_MS / frame_duration_, 1);
+    std::unique_ptr<AudioStreamPacket> packet;
+    if (!preroll_streaming_ && preroll_queue_.Size() >= max_packets && preroll_queue_.Pop(packet)) {
+        return packet;
+    }
+    return AcquireSendPacket();
+}
+
+bool AudioService::StorePrerollPacket(std::unique_ptr<AudioStreamPacket>& packet) {
+    if (preroll_streaming_) {
+        return false;
+    }
+    packet->queue_time = 0;
+    if (!preroll_queue_.Push(std::move(packet))) {
+        DropSendPacket(std::move(packet));
+    }
+    // The ring is shorter after the frame duration grew
+    size_t max_packets = std::max(WAKE_WORD_PREROLL_MS / frame_duration_, 1);
+    std::unique_ptr<AudioStreamPacket> oldest;
+    while (preroll_queue_.Size() > max_packets && preroll_queue_.Pop(oldest)) {
+        DropSendPacket(std::move(oldest));
+    }
+    return true;
+}
+
+void AudioService::ClearPreroll() {
+    std::unique_ptr<AudioStreamPacket> packet;
+    while (preroll_queue_.Pop(packet)) {
+        DropSendPacket(std::move(packet));
+    }
+    preroll_streaming_ = false;
+}
+
+void AudioService::FlushPreroll() {
+    size_t count = 0;
+    std::unique_ptr<AudioStreamPacket> packet;
+    while (preroll_queue_.Pop(packet)) {
+        if (audio_send_queue_.Push(std::move(packet))) {
+            count++;
+        } else {
+            DropSendPacket(std::move(packet));
+        }
+    }
+    preroll_streaming_ = true;
+    preroll_flushed_ = count;
+    xEventGroupSetBits(event_group_, AS_EVENT_PREROLL_FLUSHED);
 }
 
 void AudioService::EnableWakeWordDetection(bool enable) {
@@ -514,6 +997,8 @@ void AudioService::EnableWakeWordDetection(bool enable) {
             wake_word_initialized_ = true;
         }
         wake_word_->Start();
+        // Audio of an earlier detection is stale now
+        preroll_reset_ = true;
         xEventGroupSetBits(event_group_, AS_EVENT_WAKE_WORD_RUNNING);
     } else {
         wake_word_->Stop();
@@ -525,18 +1010,23 @@ void AudioService::EnableVoiceProcessing(bool enable) {
     ESP_LOGD(TAG, "%s voice processing", enable ? "Enabling" : "Disabling");
     if (enable) {
         if (!audio_processor_initialized_) {
-            audio_processor_->Initialize(codec_, OPUS_FRAME_DURATION_MS, models_list_);
+            audio_processor_->Initialize(codec_, frame_duration_, models_list_);
             audio_processor_initialized_ = true;
         }
 
         /* We should make sure no audio is playing */
         ResetDecoder();
-        audio_input_need_warmup_ = true;
+        // The input is already warm while it feeds the wake word, and the pre-roll continues without a gap
+        audio_input_need_warmup_ = !IsWakeWordRunning();
         audio_processor_->Start();
         xEventGroupSetBits(event_group_, AS_EVENT_AUDIO_PROCESSOR_RUNNING);
     } else {
         audio_processor_->Stop();
         xEventGroupClearBits(event_group_, AS_EVENT_AUDIO_PROCESSOR_RUNNING);
+        /* Frames held back for an uplink batch are flushed once no more will come */
+        if (!audio_send_queue_.Empty() && callbacks_.on_send_queue_available) {
+            callbacks_.on_send_queue_available();
+        }
     }
 }
 
@@ -546,17 +1036,16 @@ void AudioService::EnableAudioTesting(bool enable) {
         xEventGroupSetBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING);
     } else {
         xEventGroupClearBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING);
-        /* Copy audio_testing_queue_ to audio_decode_queue_ */
-        std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-        audio_decode_queue_ = std::move(audio_testing_queue_);
-        audio_queue_cv_.notify_all();
+        /* Let the codec task play back audio_testing_queue_ */
+        testing_playback_ = true;
+        NotifyTask(opus_codec_task_handle_);
     }
 }
 
 void AudioService::EnableDeviceAec(bool enable) {
     ESP_LOGI(TAG, "%s device AEC", enable ? "Enabling" : "Disabling");
     if (!audio_processor_initialized_) {
-        audio_processor_->Initialize(codec_, OPUS_FRAME_DURATION_MS, models_list_);
+        audio_processor_->Initialize(codec_, frame_duration_, models_list_);
         audio_processor_initialized_ = true;
     }
 
@@ -567,118 +1056,112 @@ void AudioService::SetCallbacks(AudioServiceCallbacks& callbacks) {
     callbacks_ = callbacks;
 }
 
-void AudioService::PlaySound(const std::string_view& ogg) {
+void AudioService::PlaySound(const std::string_view& ogg, int volume) {
     if (!codec_->output_enabled()) {
         esp_timer_stop(audio_power_timer_);
         esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
         codec_->EnableOutput(true);
     }
-
-    const uint8_t* buf = reinterpret_cast<const uint8_t*>(ogg.data());
-    size_t size = ogg.size();
-    size_t offset = 0;
-
-    auto find_page = [&](size_t start)->size_t {
-        for (size_t i = start; i + 4 <= size; ++i) {
-            if (buf[i] == 'O' && buf[i+1] == 'g' && buf[i+2] == 'g' && buf[i+3] == 'S') return i;
+    int64_t request_time = esp_timer_get_time();
+    int32_t gain = AUDIO_MIXER_UNITY_GAIN * std::clamp(volume, 0, 100) / 100;
+
+    auto cached = sound_cache_.Get(ogg.data(), codec_->output_sample_rate());
+    std::shared_ptr<const OggOpusStream> stream;
+    if (!cached) {
+        stream = ogg_index_cache_.Get(ogg);
+        if (stream == nullptr) {
+            return;
         }
-        return static_cast<size_t>(-1);
-    };
-
-    bool seen_head = false;
-    bool seen_tags = false;
-    int sample_rate = 16000; // 默认值
-
-    while (true) {
-        size_t pos = find_page(offset);
-        if (pos == static_cast<size_t>(-1)) break;
-        offset = pos;
-        if (offset + 27 > size) break;
-
-        const uint8_t* page = buf + offset;
-        uint8_t page_segments = page[26];
-        size_t seg_table_off = offset + 27;
-        if (seg_table_off + page_segments > size) break;
-
-        size_t body_size = 0;
-        for (size_t i = 0; i < page_segments; ++i) body_size += page[27 + i];
-
-        size_t body_off = seg_table_off + page_segments;
-        if (body_off + body_size > size) break;
-
-        // Parse packets using lacing
-        size_t cur = body_off;
-        size_t seg_idx = 0;
-        while (seg_idx < page_segments) {
-            size_t pkt_len = 0;
-            size_t pkt_start = cur;
-            bool continued = false;
-            do {
-                uint8_t l = page[27 + seg_idx++];
-                pkt_len += l;
-                cur += l;
-                continued = (l == 255);
-            } while (continued && seg_idx < page_segments);
-
-            if (pkt_len == 0) continue;
-            const uint8_t* pkt_ptr = buf + pkt_start;
-
-            if (!seen_head) {
-                // 解析OpusHead包
-                if (pkt_len >= 19 && std::memcmp(pkt_ptr, "OpusHead", 8) == 0) {
-                    seen_head = true;
-                    
-                    // OpusHead结构：[0-7] "OpusHead", [8] version, [9] channel_count, [10-11] pre_skip
-                    // [12-15] input_sample_rate, [16-17] output_gain, [18] mapping_family
-                    if (pkt_len >= 12) {
-                        uint8_t version = pkt_ptr[8];
-                        uint8_t channel_count = pkt_ptr[9];
-                        
-                        if (pkt_len >= 16) {
-                            // 读取输入采样率 (little-endian)
-                            sample_rate = pkt_ptr[12] | (pkt_ptr[13] << 8) | 
-                                        (pkt_ptr[14] << 16) | (pkt_ptr[15] << 24);
-                            ESP_LOGI(TAG, "OpusHead: version=%d, channels=%d, sample_rate=%d", 
-                                   version, channel_count, sample_rate);
-                        }
-                    }
-                }
-                continue;
-            }
-            if (!seen_tags) {
-                // Expect OpusTags in second packet
-                if (pkt_len >= 8 && std::memcmp(pkt_ptr, "OpusTags", 8) == 0) {
-                    seen_tags = true;
-                }
-                continue;
-            }
+    }
 
-            // Audio packet (Opus)
-            auto packet = std::make_unique<AudioStreamPacket>();
-            packet->sample_rate = sample_rate;
-            packet->frame_duration = 60;
-            packet->payload.resize(pkt_len);
-            std::memcpy(packet->payload.data(), pkt_ptr, pkt_len);
-            PushPacketToDecodeQueue(std::move(packet), true);
+    // Waiting for room here must not hold decode_producer_mutex_, the network needs it
+    std::lock_guard<std::mutex> lock(sound_producer_mutex_);
+    /* A cached sound goes straight to the output, unless it would overtake a sound being decoded */
+    if (cached && sound_queue_.Empty() && !sound_active_) {
+        debug_statistics_.sound_cache_hits++;
+        if (!PushOrWait(sound_waiter_, [this, &cached, gain, request_time]() {
+            return cached_sound_queue_.Push(AudioMixerVoice{cached, gain, request_time});
+        })) {
+            return;
         }
+        NotifyTask(audio_output_task_handle_);
+        return;
+    }
 
-        offset = body_off + body_size;
+    if (stream == nullptr) {
+        stream = ogg_index_cache_.Get(ogg);
+        if (stream == nullptr) {
+            return;
+        }
     }
+    debug_statistics_.sound_cache_misses++;
+    if (!PushOrWait(sound_waiter_, [this, &stream, gain, request_time]() {
+        return sound_queue_.Push(SoundRequest{stream, gain, request_time});
+    })) {
+        return;
+    }
+    NotifyTask(opus_codec_task_handle_);
 }
 
 bool AudioService::IsIdle() {
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    return audio_encode_queue_.empty() && audio_decode_queue_.empty() && audio_playback_queue_.empty() && audio_testing_queue_.empty();
+    // The sound queue is checked before the sound being played, see PullSoundPacket()
+    return audio_encode_queue_.Empty() && audio_decode_queue_.Empty() && jitter_buffer_.Empty() &&
+        sound_queue_.Empty() && !sound_active_ && !IsMixerBusy() &&
+        audio_playback_queue_.Empty() && audio_testing_queue_.Empty();
 }
 
 void AudioService::ResetDecoder() {
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
     opus_decoder_->ResetState();
-    timestamp_queue_.clear();
-    audio_decode_queue_.clear();
-    audio_playback_queue_.clear();
-    audio_testing_queue_.clear();
-    audio_queue_cv_.notify_all();
+    testing_playback_ = false;
+    jitter_buffer_reset_ = true;
+    timestamp_queue_.Clear();
+    audio_decode_queue_.Clear();
+    sound_queue_.Clear();
+    // Cached sounds are not decoded, they keep playing over what comes next
+    speech_reset_ = true;
+    audio_playback_queue_.Clear();
+    audio_testing_queue_.Clear();
+    NotifyTask(opus_codec_task_handle_);
+    NotifyTask(audio_output_task_handle_);
+}
+
+void AudioService::PrintDebugStatistics() {
+    auto& stats = debug_statistics_;
+    ESP_LOGI(TAG, "Frames: input=%lu encode=%lu decode=%lu playback=%lu, profile=%s (%dms)",
+        stats.input_count, stats.encode_count, stats.decode_count, stats.playback_count,
+        kAudioProfiles[audio_profile_].name, frame_duration_.load());
+    ESP_LOGI(TAG, "Wakeups: codec=%lu (idle %lu) output=%lu, producer waits=%lu",
+        stats.codec_wakeups, stats.codec_idle_wakeups, stats.output_wakeups, stats.producer_waits);
+    stats.pool_misses = encode_task_pool_.misses() + playback_task_pool_.misses() +
+        send_packet_pool_.misses() + decode_packet_pool_.misses();
+    ESP_LOGI(TAG, "Pool misses: %lu (free encode=%u playback=%u send=%u decode=%u)", stats.pool_misses,
+        encode_task_pool_.available(), playback_task_pool_.available(),
+        send_packet_pool_.available(), decode_packet_pool_.available());
+
+    auto print = [](const char* name, const LatencyStatistics& latency) {
+        if (latency.count() == 0) {
+            return;
+        }
+        ESP_LOGI(TAG, "%-16s p50=%luus p90=%luus p99=%luus max=%luus (n=%u)", name,
+            latency.Percentile(50), latency.Percentile(90), latency.Percentile(99), latency.Percentile(100),
+            latency.count());
+    };
+    ESP_LOGI(TAG, "Sound cache: hits=%lu misses=%lu, %u / %u bytes", stats.sound_cache_hits, stats.sound_cache_misses,
+        sound_cache_.bytes(), SOUND_CACHE_BUDGET_BYTES);
+    ESP_LOGI(TAG, "Send queue: peak=%lu dropped=%lu failed=%lu, copied=%lu bytes, timestamps dropped=%lu",
+        stats.send_queue_peak, stats.send_queue_drops, stats.send_failures, stats.encode_copy_bytes,
+        stats.timestamp_queue_drops);
+    auto& jitter = jitter_buffer_.statistics();
+    ESP_LOGI(TAG, "Jitter buffer: jitter=%luus target=%lu late=%lu concealed=%lu dropped=%lu",
+        jitter.jitter_us, jitter.target_depth, jitter.late_packets, jitter.concealed_frames, jitter.dropped_packets);
+
+    print("encode", stats.encode_time);
+    print("decode", stats.decode_time);
+    print("output", stats.output_time);
+    print("uplink", stats.uplink_latency);
+    print("send", stats.send_latency);
+    print("downlink", stats.downlink_latency);
+    print("sound", stats.sound_latency);
 }
 
 void AudioService::CheckAndUpdateAudioPowerState() {
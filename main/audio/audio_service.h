@@ -2,8 +2,7 @@
 #define AUDIO_SERVICE_H
 
 #include <memory>
-#include <deque>
-#include <condition_variable>
+#include <atomic>
 #include <chrono>
 #include <mutex>
 
@@ -20,6 +19,14 @@
 #include "audio_codec.h"
 #include "audio_processor.h"
 #include "processors/audio_debugger.h"
+#include "latency_statistics.h"
+#include "audio_pool.h"
+#include "jitter_buffer.h"
+#include "ogg_demuxer.h"
+#include "sound_cache.h"
+#include "audio_mixer.h"
+#include "interleaved_resampler.h"
+#include "spsc_queue.h"
 #include "wake_word.h"
 #include "protocol.h"
 
@@ -27,15 +34,29 @@
 /*
  * There are two types of audio data flow:
  * 1. (MIC) -> [Processors] -> {Encode Queue} -> [Opus Encoder] -> {Send Queue} -> (Server)
- * 2. (Server) -> {Decode Queue} -> [Opus Decoder] -> {Playback Queue} -> (Speaker)
+ * 2. (Server) -> {Decode Queue} -> [Jitter Buffer] -> [Opus Decoder] -> {Playback Queue} -> (Speaker)
  *
  * We use one task for MIC / Speaker / Processors, and one task for Opus Encoder / Opus Decoder.
  * 
  * Decode Queue and Send Queue are the main queues, because Opus packets are quite smaller than PCM packets.
- * 
+ *
+ * Every queue is a lock-free single-producer / single-consumer ring. Producers wake the consumer task
+ * with a task notification, and consumers wake a producer blocked on a full queue the same way.
+ * The decode queue and the sound queues have several producers, which are serialized by a mutex
+ * per queue that the consumer never takes. Nobody waits for room while holding the decode queue
+ * mutex, the network takes it for every packet. Sounds are queued as parsed Ogg streams, and the
+ * codec task pulls their packets from the flash one at a time.
+ *
+ * While the wake word runs, the mic channel is also encoded into a ring of Opus packets covering
+ * the last WAKE_WORD_PREROLL_MS, which only the codec task touches. Once the wake word is detected
+ * the codec task moves the ring into the send queue, and the frames captured after it follow,
+ * until the audio processor takes over.
  */
 
+// Default and longest Opus frame duration, the buffers are sized for it
 #define OPUS_FRAME_DURATION_MS 60
+// Shortest Opus frame duration of the audio profiles, the frame counts are sized for it
+#define MIN_OPUS_FRAME_DURATION_MS 20
 #define MAX_ENCODE_TASKS_IN_QUEUE 2
 #define MAX_PLAYBACK_TASKS_IN_QUEUE 2
 #define MAX_DECODE_PACKETS_IN_QUEUE (2400 / OPUS_FRAME_DURATION_MS)
@@ -43,6 +64,56 @@
 #define AUDIO_TESTING_MAX_DURATION_MS 10000
 #define MAX_TIMESTAMPS_IN_QUEUE 3
 
+// Audio before the wake word sent to the server, encoded ahead while the wake word runs
+#if CONFIG_SEND_WAKE_WORD_DATA
+#define WAKE_WORD_PREROLL_MS CONFIG_WAKE_WORD_PREROLL_MS
+#else
+#define WAKE_WORD_PREROLL_MS 0
+#endif
+
+// Ring capacities, powers of two. Queues cleared from another task keep the discarded items
+// until their consumer runs, so those get room for twice the limits above.
+#define ENCODE_QUEUE_CAPACITY 2
+#define PLAYBACK_QUEUE_CAPACITY 4
+#define DECODE_QUEUE_CAPACITY 128
+// The pre-roll is moved into the send queue at once
+#define SEND_QUEUE_CAPACITY (WAKE_WORD_PREROLL_MS > 0 ? 256 : 64)
+#define PREROLL_QUEUE_CAPACITY (WAKE_WORD_PREROLL_MS > 0 ? 128 : 4)
+#define TESTING_QUEUE_CAPACITY 1024
+#define TIMESTAMP_QUEUE_CAPACITY 8
+#define SOUND_QUEUE_CAPACITY 8
+#define CACHED_SOUND_QUEUE_CAPACITY 8
+static_assert(TESTING_QUEUE_CAPACITY >= 2 * AUDIO_TESTING_MAX_DURATION_MS / MIN_OPUS_FRAME_DURATION_MS,
+    "The testing queue must hold AUDIO_TESTING_MAX_DURATION_MS of the shortest frames");
+static_assert(PREROLL_QUEUE_CAPACITY >= WAKE_WORD_PREROLL_MS / MIN_OPUS_FRAME_DURATION_MS,
+    "The pre-roll ring must hold WAKE_WORD_PREROLL_MS of the shortest frames");
+static_assert(WAKE_WORD_PREROLL_MS == 0 ||
+    SEND_QUEUE_CAPACITY >= 2 * MAX_SEND_PACKETS_IN_QUEUE + WAKE_WORD_PREROLL_MS / MIN_OPUS_FRAME_DURATION_MS,
+    "The send queue must take the pre-roll on top of its limit");
+
+// Recycled AudioTask / AudioStreamPacket objects, see audio_pool.h
+#define ENCODE_TASK_POOL_SIZE 4
+#define PLAYBACK_TASK_POOL_SIZE 4
+// The send pool takes back the whole pre-roll after it was sent, only a few are allocated up front
+#define SEND_PACKET_POOL_SIZE (WAKE_WORD_PREROLL_MS > 0 ? 256 : 16)
+#define SEND_PACKET_POOL_PREALLOCATED 8
+#define DECODE_PACKET_POOL_SIZE 32
+static_assert(WAKE_WORD_PREROLL_MS == 0 ||
+    SEND_PACKET_POOL_SIZE >= MAX_SEND_PACKETS_IN_QUEUE + WAKE_WORD_PREROLL_MS / MIN_OPUS_FRAME_DURATION_MS,
+    "The send pool must take back the pre-roll and a full send queue");
+// Opus payload reserved per packet, enough for 32 kbps
+#define OPUS_PAYLOAD_RESERVE_BYTES (32000 / 8 * OPUS_FRAME_DURATION_MS / 1000)
+
+// Decoded sounds, see sound_cache.h. Without a budget every sound is decoded when played.
+#ifdef CONFIG_AUDIO_SOUND_CACHE_SIZE
+#define SOUND_CACHE_BUDGET_BYTES (CONFIG_AUDIO_SOUND_CACHE_SIZE * 1024)
+#else
+#define SOUND_CACHE_BUDGET_BYTES 0
+#endif
+
+// Interval of the codec task checking the jitter buffer while audio is buffered but not due
+#define JITTER_BUFFER_POLL_MS 10
+
 #define AUDIO_POWER_TIMEOUT_MS 15000
 #define AUDIO_POWER_CHECK_INTERVAL_MS 1000
 
@@ -51,6 +122,7 @@
 #define AS_EVENT_WAKE_WORD_RUNNING          (1 << 1)
 #define AS_EVENT_AUDIO_PROCESSOR_RUNNING    (1 << 2)
 #define AS_EVENT_PLAYBACK_NOT_EMPTY         (1 << 3)
+#define AS_EVENT_PREROLL_FLUSHED            (1 << 4)
 
 struct AudioServiceCallbacks {
     std::function<void(void)> on_send_queue_available;
@@ -60,9 +132,29 @@ struct AudioServiceCallbacks {
 };
 
 
+/*
+ * Uplink encoder settings, switched at runtime. Short frames cut the latency of barge-in,
+ * long frames save the per-packet overhead on slow links. The frame duration is advertised
+ * in the hello message and the server may ask for another one in its reply.
+ */
+enum AudioProfileType {
+    kAudioProfileLowLatency,
+    kAudioProfileBalanced,
+    kAudioProfileDefault,
+    kAudioProfileLowBandwidth,
+    kAudioProfileCount,
+};
+
+struct AudioProfile {
+    const char* name;
+    int frame_duration;     // Opus frame duration in milliseconds, a multiple of 20 up to OPUS_FRAME_DURATION_MS
+    int complexity;         // Opus encoder complexity, 0 - 10
+};
+
 enum AudioTaskType {
     kAudioTaskTypeEncodeToSendQueue,
     kAudioTaskTypeEncodeToTestingQueue,
+    kAudioTaskTypeEncodeToPreroll,
     kAudioTaskTypeDecodeToPlaybackQueue,
 };
 
@@ -70,6 +162,14 @@ struct AudioTask {
     AudioTaskType type;
     std::vector<int16_t> pcm;
     uint32_t timestamp;
+    int64_t start_time = 0; // esp_timer_get_time() when the task entered the pipeline
+    int64_t request_time = 0; // PlaySound() call, on the first frame of a sound only
+};
+
+struct SoundRequest {
+    std::shared_ptr<const OggOpusStream> stream;
+    int32_t gain = AUDIO_MIXER_UNITY_GAIN;
+    int64_t request_time = 0;
 };
 
 struct DebugStatistics {
@@ -77,6 +177,25 @@ struct DebugStatistics {
     uint32_t decode_count = 0;
     uint32_t encode_count = 0;
     uint32_t playback_count = 0;
+    uint32_t codec_wakeups = 0;         // Opus codec task woken by a notification
+    uint32_t codec_idle_wakeups = 0;    // ... and found nothing to do
+    uint32_t output_wakeups = 0;        // Audio output task woken by a notification
+    uint32_t producer_waits = 0;        // A producer blocked on a full encode / decode queue
+    uint32_t pool_misses = 0;           // AudioTask / AudioStreamPacket allocated outside the pools
+    uint32_t sound_cache_hits = 0;      // Sounds played from the decoded sound cache
+    uint32_t sound_cache_misses = 0;    // ... and decoded
+    uint32_t send_queue_peak = 0;       // Most packets waiting for the network at once
+    uint32_t send_queue_drops = 0;      // Encoded packets dropped on a full send queue
+    uint32_t timestamp_queue_drops = 0; // Server AEC timestamps dropped on a full timestamp queue
+    uint32_t send_failures = 0;         // Packets the protocol failed to send
+    uint32_t encode_copy_bytes = 0;     // Opus data copied behind the headroom of the send packets
+    LatencyStatistics encode_time;      // Opus encode time per frame
+    LatencyStatistics decode_time;      // Opus decode + resample time per frame
+    LatencyStatistics output_time;      // Codec write time per DMA buffer
+    LatencyStatistics uplink_latency;   // Processor output -> send queue
+    LatencyStatistics downlink_latency; // Decode start -> written to codec
+    LatencyStatistics sound_latency;    // PlaySound() -> first frame written to codec
+    LatencyStatistics send_latency;     // Send queue -> handed to the transport
 };
 
 class AudioService {
@@ -87,8 +206,9 @@ public:
     void Initialize(AudioCodec* codec);
     void Start();
     void Stop();
-    void EncodeWakeWord();
-    std::unique_ptr<AudioStreamPacket> PopWakeWordPacket();
+    // Moves the wake word pre-roll to the send queue, the next frames are then sent live. Returns
+    // the number of pre-roll packets, 0 if the codec task did not take the request in time.
+    size_t FlushWakeWordPackets();
     const std::string& GetLastWakeWord() const;
     bool IsVoiceDetected() const { return voice_detected_; }
     bool IsIdle();
@@ -104,10 +224,28 @@ public:
     void SetCallbacks(AudioServiceCallbacks& callbacks);
 
     bool PushPacketToDecodeQueue(std::unique_ptr<AudioStreamPacket> packet, bool wait = false);
-    std::unique_ptr<AudioStreamPacket> PopPacketFromSendQueue();
-    void PlaySound(const std::string_view& sound);
+    // Pops up to max_count packets, or none while fewer than min_count are queued
+    size_t PopPacketsFromSendQueue(std::unique_ptr<AudioStreamPacket>* packets, size_t max_count, size_t min_count = 1);
+    // Called by the network task once the packet went out, or failed to
+    void RecycleSendPacket(std::unique_ptr<AudioStreamPacket> packet, bool sent);
+    std::unique_ptr<AudioStreamPacket> AcquireDecodePacket();
+    // A packet from AcquireDecodePacket() that was not pushed, handed out again by the next one
+    void RecycleDecodePacket(std::unique_ptr<AudioStreamPacket> packet);
+    // volume is in percent of the recorded level
+    void PlaySound(const std::string_view& sound, int volume = 100);
     bool ReadAudioData(std::vector<int16_t>& data, int sample_rate, int samples);
     void ResetDecoder();
+    void SetAudioProfile(AudioProfileType type);
+    const AudioProfile& GetAudioProfile() const { return kAudioProfiles[audio_profile_]; }
+    void SetFrameDuration(int frame_duration);
+    // Whether send packets keep AUDIO_PACKET_HEADROOM for the transport header, which costs a copy
+    // of the Opus data. Off for transports that send the data as it is.
+    void EnableSendHeadroom(bool enable) { send_headroom_ = enable; }
+    int frame_duration() const { return frame_duration_; }
+    // Returns kAudioProfileCount if there is no profile with this name
+    static AudioProfileType FindAudioProfile(const std::string& name);
+    void PrintDebugStatistics();
+    const DebugStatistics& debug_statistics() const { return debug_statistics_; }
 #if CONFIG_USE_MICRO_WAKE_WORD
     void SetMicroWakeWordModel(const void* model_data, size_t model_size);
 #else // !CONFIG_USE_MICRO_WAKE_WORD
@@ -119,6 +257,8 @@ public:
 #endif // CONFIG_LSPLATFORM
 
 private:
+    static const AudioProfile kAudioProfiles[kAudioProfileCount];
+
     AudioCodec* codec_ = nullptr;
     AudioServiceCallbacks callbacks_;
     std::unique_ptr<AudioProcessor> audio_processor_;
@@ -126,13 +266,19 @@ private:
     std::unique_ptr<AudioDebugger> audio_debugger_;
     std::unique_ptr<OpusEncoderWrapper> opus_encoder_;
     std::unique_ptr<OpusDecoderWrapper> opus_decoder_;
-    OpusResampler input_resampler_;
-    OpusResampler reference_resampler_;
+    InterleavedResampler input_resampler_;
 #ifdef CONFIG_LSPLATFORM
     OpusResampler uplink_resampler_;
 #endif // CONFIG_LSPLATFORM
     OpusResampler output_resampler_;
     DebugStatistics debug_statistics_;
+    // Requested by SetAudioProfile() / SetNarrowbandMode(), applied by the opus codec task
+    AudioProfileType audio_profile_ = kAudioProfileDefault;
+    std::atomic<int> frame_duration_ = OPUS_FRAME_DURATION_MS;
+    std::atomic<int> encode_complexity_ = 0;
+    std::atomic<bool> send_headroom_ = true;
+    std::atomic<int> encode_sample_rate_ = 16000;
+    int applied_complexity_ = -1;
     srmodel_list_t* models_list_ = nullptr;
 
     EventGroupHandle_t event_group_;
@@ -141,15 +287,79 @@ private:
     TaskHandle_t audio_input_task_handle_ = nullptr;
     TaskHandle_t audio_output_task_handle_ = nullptr;
     TaskHandle_t opus_codec_task_handle_ = nullptr;
-    std::mutex audio_queue_mutex_;
-    std::condition_variable audio_queue_cv_;
-    std::deque<std::unique_ptr<AudioStreamPacket>> audio_decode_queue_;
-    std::deque<std::unique_ptr<AudioStreamPacket>> audio_send_queue_;
-    std::deque<std::unique_ptr<AudioStreamPacket>> audio_testing_queue_;
-    std::deque<std::unique_ptr<AudioTask>> audio_encode_queue_;
-    std::deque<std::unique_ptr<AudioTask>> audio_playback_queue_;
+    SpscQueue<std::unique_ptr<AudioStreamPacket>, DECODE_QUEUE_CAPACITY> audio_decode_queue_;
+    SpscQueue<std::unique_ptr<AudioStreamPacket>, SEND_QUEUE_CAPACITY> audio_send_queue_;
+    SpscQueue<std::unique_ptr<AudioStreamPacket>, TESTING_QUEUE_CAPACITY> audio_testing_queue_;
+    SpscQueue<std::unique_ptr<AudioTask>, ENCODE_QUEUE_CAPACITY> audio_encode_queue_;
+    SpscQueue<std::unique_ptr<AudioTask>, PLAYBACK_QUEUE_CAPACITY> audio_playback_queue_;
     // For server AEC
-    std::deque<uint32_t> timestamp_queue_;
+    SpscQueue<uint32_t, TIMESTAMP_QUEUE_CAPACITY> timestamp_queue_;
+    // Serializes the producers of the decode queue, and those waiting for room in it
+    std::mutex decode_producer_mutex_;
+    // A packet the network could not queue, handed out again by AcquireDecodePacket(). The codec
+    // task is the releasing side of the decode pool, so the producers cannot give it back there.
+    std::unique_ptr<AudioStreamPacket> decode_packet_spare_;
+    std::mutex decode_wait_mutex_;
+    // Serializes PlaySound(), the only producer of the sound queues
+    std::mutex sound_producer_mutex_;
+    // Producers blocked on a full queue, woken by the consumer
+    std::atomic<TaskHandle_t> encode_waiter_ = nullptr;
+    std::atomic<TaskHandle_t> decode_waiter_ = nullptr;
+    std::atomic<TaskHandle_t> sound_waiter_ = nullptr;
+    // Play the recorded testing audio from audio_testing_queue_
+    std::atomic<bool> testing_playback_ = false;
+    // Network audio waiting for its playout, owned by the codec task, the releasing side of the decode pool
+    JitterBuffer jitter_buffer_{[this](std::unique_ptr<AudioStreamPacket>&& packet) {
+        decode_packet_pool_.Release(std::move(packet));
+    }};
+    std::unique_ptr<AudioStreamPacket> local_packet_;
+    // Sounds from PlaySound(), the one being played is owned by the codec task
+    SpscQueue<SoundRequest, SOUND_QUEUE_CAPACITY> sound_queue_;
+    OggIndexCache ogg_index_cache_;
+    std::shared_ptr<const OggOpusStream> current_sound_;
+    size_t sound_position_ = 0;
+    int64_t sound_request_time_ = 0;
+    int32_t sound_gain_ = AUDIO_MIXER_UNITY_GAIN;
+    AudioStreamPacket sound_packet_;
+    std::atomic<bool> sound_active_ = false;
+    // Short sounds are decoded into the cache the first time they are played. Cached sounds skip
+    // the codec task and are mixed into the speech by the audio output task, which owns the mixer.
+    SoundCache sound_cache_{SOUND_CACHE_BUDGET_BYTES};
+    std::shared_ptr<CachedSound> sound_recording_;
+    SpscQueue<AudioMixerVoice, CACHED_SOUND_QUEUE_CAPACITY> cached_sound_queue_;
+    AudioMixer mixer_;
+    std::atomic<bool> mixer_active_ = false;
+    std::atomic<bool> mixer_reset_ = false;
+    std::atomic<bool> speech_reset_ = false;
+    // Speech frame being written by the audio output task, one DMA buffer at a time
+    std::unique_ptr<AudioTask> output_task_;
+    size_t output_position_ = 0;
+    std::vector<int16_t> output_buffer_;
+    std::atomic<bool> jitter_buffer_reset_ = false;
+    // Wake word pre-roll: the input task cuts the mic channel into frames, the codec task keeps
+    // their packets until FlushWakeWordPackets() asks it to move them to the send queue
+    std::vector<int16_t> preroll_pcm_;
+    SpscQueue<std::unique_ptr<AudioStreamPacket>, PREROLL_QUEUE_CAPACITY> preroll_queue_;
+    bool preroll_streaming_ = false;
+    std::atomic<bool> preroll_reset_ = false;
+    std::atomic<bool> preroll_flush_ = false;
+    std::atomic<size_t> preroll_flushed_ = 0;
+    // Send packets the codec task did not hand to the network. The network is the releasing
+    // side of the send pool, so the codec task keeps these for its next frames.
+    SpscQueue<std::unique_ptr<AudioStreamPacket>, PREROLL_QUEUE_CAPACITY> send_packet_spares_;
+    // Encode tasks: input -> codec, playback tasks: codec -> output,
+    // send packets: codec -> network, decode packets: network / PlaySound -> codec
+    AudioPool<AudioTask, ENCODE_TASK_POOL_SIZE> encode_task_pool_;
+    AudioPool<AudioTask, PLAYBACK_TASK_POOL_SIZE> playback_task_pool_;
+    AudioPool<AudioStreamPacket, SEND_PACKET_POOL_SIZE> send_packet_pool_;
+    AudioPool<AudioStreamPacket, DECODE_PACKET_POOL_SIZE> decode_packet_pool_;
+    // Scratch buffers of the audio input task and the opus codec task
+    std::vector<int16_t> input_buffer_;
+    std::vector<int16_t> decode_buffer_;
+    std::vector<uint8_t> encode_buffer_;
+#ifdef CONFIG_LSPLATFORM
+    std::vector<int16_t> uplink_resample_buffer_;
+#endif // CONFIG_LSPLATFORM
 
     bool wake_word_initialized_ = false;
     bool audio_processor_initialized_ = false;
@@ -164,10 +374,24 @@ private:
     void AudioInputTask();
     void AudioOutputTask();
     void OpusCodecTask();
-    void PushTaskToEncodeQueue(AudioTaskType type, std::vector<int16_t>&& pcm);
-#ifdef CONFIG_LSPLATFORM
+    bool ConcealFrame(std::vector<int16_t>& pcm);
+    bool PullSoundPacket();
+    void RecordSoundFrame(const std::vector<int16_t>& pcm);
+    bool IsMixerBusy() const;
+    void PushTaskToEncodeQueue(AudioTaskType type, const std::vector<int16_t>& pcm);
+    void StorePrerollAudio(const std::vector<int16_t>& data, int channels);
+    std::unique_ptr<AudioStreamPacket> AcquireSendPacket();
+    void DropSendPacket(std::unique_ptr<AudioStreamPacket>&& packet);
+    std::unique_ptr<AudioStreamPacket> AcquirePrerollPacket();
+    bool StorePrerollPacket(std::unique_ptr<AudioStreamPacket>& packet);
+    void ClearPreroll();
+    void FlushPreroll();
+    void PreallocateBuffers();
+    template <typename TryPush>
+    bool PushOrWait(std::atomic<TaskHandle_t>& waiter, TryPush try_push);
+    void NotifyTask(TaskHandle_t task);
+    void NotifyWaiter(std::atomic<TaskHandle_t>& waiter);
     void SetEncodeSampleRate(int sample_rate, int frame_duration);
-#endif // CONFIG_LSPLATFORM
     void SetDecodeSampleRate(int sample_rate, int frame_duration);
     void CheckAndUpdateAudioPowerState();
 };
@@ -10,12 +10,18 @@
 class NoAudioCodec : public AudioCodec {
 protected:
     std::mutex data_if_mutex_;
+    // 32-bit I2S samples, reused by every Write() / Read()
+    std::vector<int32_t> write_buffer_;
+    std::vector<int32_t> read_buffer_;
+    int32_t volume_factor_ = 0;
+    int volume_factor_volume_ = -1;
 
     virtual int Write(const int16_t* data, int samples) override;
     virtual int Read(int16_t* dest, int samples) override;
 
 public:
     virtual ~NoAudioCodec();
+    virtual void Start() override;
 };
 
 class NoAudioCodecDuplex : public NoAudioCodec {
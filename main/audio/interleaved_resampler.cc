@@ -0,0 +1,53 @@
+#include "interleaved_resampler.h"
+#include "sample_kernels.h"
+
+#include <esp_log.h>
+#include <algorithm>
+#include <cstring>
+
+#define TAG "InterleavedResampler"
+
+void InterleavedResampler::Configure(int input_sample_rate, int output_sample_rate, int channels) {
+    if (channels < 1 || channels > INTERLEAVED_RESAMPLER_MAX_CHANNELS) {
+        ESP_LOGE(TAG, "Unsupported channel count: %d", channels);
+        channels = std::clamp(channels, 1, INTERLEAVED_RESAMPLER_MAX_CHANNELS);
+    }
+    channels_ = channels;
+    for (int i = 0; i < channels_; i++) {
+        resamplers_[i].Configure(input_sample_rate, output_sample_rate);
+    }
+}
+
+void InterleavedResampler::Reserve(size_t input_frames) {
+    size_t output_frames = resamplers_[0].GetOutputSamples(input_frames);
+    planar_output_.reserve(output_frames * channels_);
+    if (channels_ > 1) {
+        planar_input_.reserve(input_frames * channels_);
+    }
+}
+
+void InterleavedResampler::Process(std::vector<int16_t>& data) {
+    size_t input_frames = data.size() / channels_;
+    size_t output_frames = resamplers_[0].GetOutputSamples(input_frames);
+    planar_output_.resize(output_frames * channels_);
+
+    if (channels_ == 1) {
+        resamplers_[0].Process(data.data(), input_frames, planar_output_.data());
+        data.resize(output_frames);
+        std::memcpy(data.data(), planar_output_.data(), output_frames * sizeof(int16_t));
+        return;
+    }
+
+    /* Gather every channel, resample it, then scatter the results back into data */
+    planar_input_.resize(input_frames * channels_);
+    for (int c = 0; c < channels_; c++) {
+        int16_t* input = planar_input_.data() + c * input_frames;
+        int16_t* output = planar_output_.data() + c * output_frames;
+        ExtractChannel(data.data(), input, input_frames, channels_, c);
+        resamplers_[c].Process(input, input_frames, output);
+    }
+    data.resize(output_frames * channels_);
+    for (int c = 0; c < channels_; c++) {
+        InsertChannel(planar_output_.data() + c * output_frames, data.data(), output_frames, channels_, c);
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef INTERLEAVED_RESAMPLER_H
+#define INTERLEAVED_RESAMPLER_H
+
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include <opus_resampler.h>
+
+// Mic + reference is the widest input layout of the codecs
+#define INTERLEAVED_RESAMPLER_MAX_CHANNELS 2
+
+/*
+ * Resamples interleaved multi-channel PCM in place, one OpusResampler per channel.
+ *
+ * OpusResampler only reads contiguous samples, so every channel is gathered once into a planar
+ * scratch buffer and the resampled channels are written straight back into the caller's buffer.
+ * The scratch buffers keep their capacity, nothing is allocated once the first frame is done.
+ */
+class InterleavedResampler {
+public:
+    void Configure(int input_sample_rate, int output_sample_rate, int channels);
+    // Sizes the scratch buffers for input frames of this many samples per channel
+    void Reserve(size_t input_frames);
+    // Resamples data, which holds interleaved frames, and resizes it to the output frames
+    void Process(std::vector<int16_t>& data);
+
+    inline int channels() const { return channels_; }
+
+private:
+    std::array<OpusResampler, INTERLEAVED_RESAMPLER_MAX_CHANNELS> resamplers_;
+    int channels_ = 1;
+    std::vector<int16_t> planar_input_;
+    std::vector<int16_t> planar_output_;
+};
+
+#endif // INTERLEAVED_RESAMPLER_H
@@ -0,0 +1,185 @@
+#include "jitter_buffer.h"
+
+#include <esp_log.h>
+#include <algorithm>
+#include <cstdlib>
+
+#define TAG "JitterBuffer"
+
+#define SLOT(sequence) slots_[(sequence) & (JITTER_BUFFER_CAPACITY - 1)]
+
+JitterBuffer::JitterBuffer(Release release) : release_(std::move(release)) {
+}
+
+bool JitterBuffer::Push(std::unique_ptr<AudioStreamPacket>& packet, int64_t arrival_us) {
+    uint32_t sequence = packet->sequence + sequence_offset_;
+    if (packet->frame_duration > 0) {
+        frame_us_ = packet->frame_duration * 1000;
+    }
+
+    int32_t behind = (int32_t)(played_sequence_ - sequence);
+    if (has_played_ && behind > 0 && behind <= JITTER_BUFFER_CAPACITY) {
+        // Behind what was already played or concealed
+        statistics_.late_packets++;
+        return false;
+    }
+    if (Empty() && !playing_) {
+        next_sequence_ = sequence;
+        last_sequence_ = sequence;
+        buffering_since_us_ = arrival_us;
+    } else {
+        int32_t ahead = (int32_t)(sequence - next_sequence_);
+        if (ahead < 0 && !playing_ && (int32_t)(last_sequence_ - sequence) < JITTER_BUFFER_CAPACITY) {
+            // Reordered before the playout started, it becomes the first packet
+            next_sequence_ = sequence;
+        } else if (ahead < 0 || ahead >= JITTER_BUFFER_CAPACITY) {
+            // Keep the buffered audio, the new numbering continues after it
+            ESP_LOGW(TAG, "Sequence jumped from %lu to %lu, resynchronizing", last_sequence_ - sequence_offset_,
+                packet->sequence);
+            uint32_t resync = last_sequence_ + 1;
+            sequence_offset_ += resync - sequence;
+            sequence = resync;
+            if (Empty()) {
+                next_sequence_ = sequence;
+            }
+            last_arrival_us_ = 0;
+        }
+    }
+    UpdateJitter(sequence, arrival_us);
+
+    auto& slot = SLOT(sequence);
+    if (slot) {
+        statistics_.late_packets++;
+        return false;
+    }
+    slot = std::move(packet);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    if ((int32_t)(sequence - last_sequence_) > 0) {
+        last_sequence_ = sequence;
+    }
+    return true;
+}
+
+JitterBufferResult JitterBuffer::Pop(std::unique_ptr<AudioStreamPacket>& packet, bool starving, int64_t now_us) {
+    if (Empty()) {
+        if (playing_) {
+            // Underrun, buffer up to the target depth again before resuming
+            playing_ = false;
+            concealed_in_row_ = 0;
+        }
+        return kJitterBufferWait;
+    }
+
+    uint32_t target_depth = TargetDepth();
+    if (!playing_) {
+        if (Size() < target_depth && now_us - buffering_since_us_ < target_depth * frame_us_) {
+            return kJitterBufferWait;
+        }
+        FindFirstBuffered(next_sequence_);
+        played_sequence_ = next_sequence_;
+        playing_ = true;
+        has_played_ = true;
+    }
+
+    /* Bound the latency, dropping the oldest audio */
+    uint32_t max_depth = std::max<int64_t>(JITTER_BUFFER_MAX_DEPTH_MS * 1000 / frame_us_, target_depth + 1);
+    while (last_sequence_ - next_sequence_ + 1 > max_depth) {
+        Drop(next_sequence_);
+        played_sequence_ = ++next_sequence_;
+        statistics_.dropped_packets++;
+    }
+
+    auto& slot = SLOT(next_sequence_);
+    if (slot) {
+        packet = std::move(slot);
+        count_.fetch_sub(1, std::memory_order_relaxed);
+        played_sequence_ = ++next_sequence_;
+        concealed_in_row_ = 0;
+        return kJitterBufferPacket;
+    }
+
+    /* The next packet is missing, but later ones have arrived */
+    if (!starving && Size() <= target_depth) {
+        return kJitterBufferWait;
+    }
+    if (concealed_in_row_ < JITTER_BUFFER_MAX_CONCEALED_FRAMES) {
+        concealed_in_row_++;
+        played_sequence_ = ++next_sequence_;
+        statistics_.concealed_frames++;
+        return kJitterBufferConceal;
+    }
+
+    /* Too many frames lost in a row, continue with the next packet we have */
+    FindFirstBuffered(next_sequence_);
+    packet = std::move(SLOT(next_sequence_));
+    count_.fetch_sub(1, std::memory_order_relaxed);
+    played_sequence_ = ++next_sequence_;
+    concealed_in_row_ = 0;
+    return kJitterBufferPacket;
+}
+
+bool JitterBuffer::Full() const {
+    // At the target depth one more packet is still taken while the next one is missing,
+    // past it the missing packet is concealed anyway
+    size_t size = Size();
+    size_t target_depth = TargetDepth();
+    return size > target_depth || (size == target_depth && SLOT(next_sequence_));
+}
+
+void JitterBuffer::Reset() {
+    for (auto& slot : slots_) {
+        if (slot) {
+            release_(std::move(slot));
+            slot.reset();
+        }
+    }
+    count_.store(0, std::memory_order_relaxed);
+    playing_ = false;
+    has_played_ = false;
+    concealed_in_row_ = 0;
+    last_arrival_us_ = 0;
+    sequence_offset_ = 0;
+}
+
+void JitterBuffer::UpdateJitter(uint32_t sequence, int64_t now_us) {
+    if (last_arrival_us_ != 0 && (int32_t)(sequence - last_arrival_sequence_) > 0) {
+        // Difference between the arrival spacing and the media spacing of two packets
+        int64_t d = (now_us - last_arrival_us_) - (int64_t)(sequence - last_arrival_sequence_) * frame_us_;
+        // A pause between two responses is not jitter
+        if (std::llabs(d) < JITTER_BUFFER_MAX_DEPTH_MS * 1000) {
+            jitter_us_ += (std::llabs(d) - jitter_us_) / 16;
+            statistics_.jitter_us = jitter_us_;
+            statistics_.target_depth = TargetDepth();
+        }
+    }
+    if (last_arrival_us_ == 0 || (int32_t)(sequence - last_arrival_sequence_) > 0) {
+        last_arrival_us_ = now_us;
+        last_arrival_sequence_ = sequence;
+    }
+}
+
+uint32_t JitterBuffer::TargetDepth() const {
+    // Cover twice the jitter, plus the frame being played
+    int64_t depth = (2 * jitter_us_ + frame_us_ - 1) / frame_us_ + 1;
+    int64_t max_depth = std::max<int64_t>(JITTER_BUFFER_MAX_TARGET_MS * 1000 / frame_us_, 1);
+    return std::clamp<int64_t>(depth, 1, max_depth);
+}
+
+bool JitterBuffer::FindFirstBuffered(uint32_t& sequence) const {
+    for (uint32_t s = sequence; (int32_t)(last_sequence_ - s) >= 0; s++) {
+        if (SLOT(s)) {
+            sequence = s;
+            return true;
+        }
+    }
+    return false;
+}
+
+void JitterBuffer::Drop(uint32_t sequence) {
+    auto& slot = SLOT(sequence);
+    if (slot) {
+        release_(std::move(slot));
+        slot.reset();
+        count_.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,96 @@
+#ifndef JITTER_BUFFER_H
+#define JITTER_BUFFER_H
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+#include "protocol.h"
+
+// Slots, a power of two. Packets further ahead of the playout point resynchronize the stream.
+#define JITTER_BUFFER_CAPACITY 64
+// Buffered audio beyond this is dropped to bound the playback latency
+#define JITTER_BUFFER_MAX_DEPTH_MS 1000
+// Upper bound of the adaptive target depth
+#define JITTER_BUFFER_MAX_TARGET_MS 360
+// Lost frames concealed in a row before skipping to the next buffered packet
+#define JITTER_BUFFER_MAX_CONCEALED_FRAMES 3
+
+struct JitterBufferStatistics {
+    uint32_t late_packets = 0;      // Arrived after their playout time, or duplicated
+    uint32_t concealed_frames = 0;  // Lost frames replaced by packet loss concealment
+    uint32_t dropped_packets = 0;   // Dropped to bound the latency
+    uint32_t jitter_us = 0;         // Inter-arrival jitter estimate (RFC 3550)
+    uint32_t target_depth = 0;      // Frames buffered before the playout starts
+};
+
+enum JitterBufferResult {
+    kJitterBufferWait,      // Nothing to play yet
+    kJitterBufferPacket,    // The next packet in sequence order
+    kJitterBufferConceal,   // The next packet is lost, conceal one frame
+};
+
+/*
+ * Reorders the downlink packets by their transport sequence number and paces the start of the
+ * playout by the measured inter-arrival jitter.
+ *
+ * The buffer is owned by the opus codec task. It takes packets from the decode queue until it is
+ * Full(), so a burst faster than real time stays in the decode queue, whose producers drop the
+ * packets that do not fit, and Pop() is called whenever the playback queue has room. A missing packet is only
+ * declared lost once the output is about to starve, or more than the target depth of later
+ * packets is already buffered. When the buffer runs empty, the playout pauses until the target
+ * depth is buffered again.
+ *
+ * A sequence jump (the server restarted its numbering) does not discard the buffered audio: the
+ * new numbering is shifted to continue after the last buffered packet.
+ *
+ * Packets dropped to bound the latency or by Reset() are handed to the release callback, so they
+ * go back to the pool they came from.
+ */
+class JitterBuffer {
+public:
+    using Release = std::function<void(std::unique_ptr<AudioStreamPacket>&& packet)>;
+
+    JitterBuffer(Release release);
+
+    // Returns false, leaving the packet to the caller, if it is late or a duplicate.
+    // arrival_us is the time the packet came in from the network.
+    bool Push(std::unique_ptr<AudioStreamPacket>& packet, int64_t arrival_us);
+    JitterBufferResult Pop(std::unique_ptr<AudioStreamPacket>& packet, bool starving, int64_t now_us);
+    void Reset();
+
+    // Safe to read from any task
+    inline size_t Size() const { return count_.load(std::memory_order_relaxed); }
+    inline bool Empty() const { return Size() == 0; }
+    // The target depth is buffered, further packets can wait in the decode queue
+    bool Full() const;
+    inline const JitterBufferStatistics& statistics() const { return statistics_; }
+
+private:
+    Release release_;
+    std::array<std::unique_ptr<AudioStreamPacket>, JITTER_BUFFER_CAPACITY> slots_;
+    std::atomic<size_t> count_ = 0;
+    uint32_t next_sequence_ = 0;        // Next sequence to play, or the lowest buffered one before playing
+    uint32_t last_sequence_ = 0;        // Highest buffered sequence
+    uint32_t sequence_offset_ = 0;      // Added to the transport sequence, shifted on a jump
+    bool playing_ = false;
+    bool has_played_ = false;
+    uint32_t played_sequence_ = 0;      // Packets before this one are late
+    int concealed_in_row_ = 0;
+    int64_t frame_us_ = 60000;
+    int64_t buffering_since_us_ = 0;    // Arrival of the first packet while not playing
+    int64_t last_arrival_us_ = 0;
+    uint32_t last_arrival_sequence_ = 0;
+    int64_t jitter_us_ = 0;
+    JitterBufferStatistics statistics_;
+
+    void UpdateJitter(uint32_t sequence, int64_t now_us);
+    uint32_t TargetDepth() const;
+    bool FindFirstBuffered(uint32_t& sequence) const;
+    void Drop(uint32_t sequence);
+};
+
+#endif // JITTER_BUFFER_H
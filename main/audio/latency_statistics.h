@@ -0,0 +1,51 @@
+#ifndef LATENCY_STATISTICS_H
+#define LATENCY_STATISTICS_H
+
+#include <array>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+#define LATENCY_STATISTICS_WINDOW 128
+
+/*
+ * Keeps the latest LATENCY_STATISTICS_WINDOW durations (in microseconds) of one pipeline stage
+ * and reports percentiles over them. It is written by a single task and read by another one
+ * for logging, so a snapshot may be slightly torn, which is acceptable for statistics.
+ */
+class LatencyStatistics {
+public:
+    void Add(int64_t us) {
+        samples_[index_] = us < 0 ? 0 : (uint32_t)us;
+        index_ = (index_ + 1) % LATENCY_STATISTICS_WINDOW;
+        if (count_ < LATENCY_STATISTICS_WINDOW) {
+            count_++;
+        }
+    }
+
+    uint32_t Percentile(int percent) const {
+        if (count_ == 0) {
+            return 0;
+        }
+        std::array<uint32_t, LATENCY_STATISTICS_WINDOW> sorted;
+        size_t count = count_;
+        std::copy(samples_.begin(), samples_.begin() + count, sorted.begin());
+        size_t nth = (count - 1) * percent / 100;
+        std::nth_element(sorted.begin(), sorted.begin() + nth, sorted.begin() + count);
+        return sorted[nth];
+    }
+
+    void Reset() {
+        index_ = 0;
+        count_ = 0;
+    }
+
+    inline size_t count() const { return count_; }
+
+private:
+    std::array<uint32_t, LATENCY_STATISTICS_WINDOW> samples_{};
+    size_t index_ = 0;
+    size_t count_ = 0;
+};
+
+#endif // LATENCY_STATISTICS_H
@@ -0,0 +1,186 @@
+#include "ogg_demuxer.h"
+
+#include <esp_log.h>
+#include <algorithm>
+#include <cstring>
+
+#define TAG "OggDemuxer"
+
+#define OGG_PAGE_HEADER_SIZE 27
+// header_type flag of a page whose first packet is continued from the previous page
+#define OGG_PAGE_CONTINUED 0x01
+
+// Duration of an Opus packet from its TOC byte (RFC 6716, section 3.1), 0 if malformed
+static int GetOpusPacketDuration(const uint8_t* data, size_t size) {
+    if (size < 1) {
+        return 0;
+    }
+    int config = data[0] >> 3;
+    int samples;    // Per frame at 48 kHz
+    if (config < 12) {
+        static const int silk[] = { 480, 960, 1920, 2880 };
+        samples = silk[config & 3];
+    } else if (config < 16) {
+        samples = (config & 1) ? 960 : 480;
+    } else {
+        static const int celt[] = { 120, 240, 480, 960 };
+        samples = celt[config & 3];
+    }
+    int frames;
+    switch (data[0] & 3) {
+    case 0:
+        frames = 1;
+        break;
+    case 1:
+    case 2:
+        frames = 2;
+        break;
+    default:
+        if (size < 2) {
+            return 0;
+        }
+        frames = data[1] & 0x3F;
+        break;
+    }
+    return samples * frames / 48;
+}
+
+std::shared_ptr<const OggOpusStream> ParseOggOpusStream(std::string_view ogg) {
+    auto stream = std::make_shared<OggOpusStream>();
+    stream->data = ogg;
+    const uint8_t* buf = reinterpret_cast<const uint8_t*>(ogg.data());
+    size_t size = ogg.size();
+
+    bool seen_head = false;
+    bool seen_tags = false;
+    // The start of a packet that goes on in the next page
+    std::string pending;
+    bool continued = false;
+    uint32_t page_sequence = 0;
+    auto add_packet = [&](const uint8_t* packet, size_t packet_size, size_t packet_offset, bool reassembled) {
+        if (!seen_head) {
+            // OpusHead: [0-7] "OpusHead", [8] version, [9] channel_count, [10-11] pre_skip,
+            // [12-15] input_sample_rate, [16-17] output_gain, [18] mapping_family
+            if (packet_size >= 19 && std::memcmp(packet, "OpusHead", 8) == 0) {
+                seen_head = true;
+                stream->sample_rate = packet[12] | (packet[13] << 8) | (packet[14] << 16) | (packet[15] << 24);
+            }
+        } else if (!seen_tags) {
+            if (packet_size >= 8 && std::memcmp(packet, "OpusTags", 8) == 0) {
+                seen_tags = true;
+            }
+        } else {
+            if (stream->packets.empty()) {
+                int duration = GetOpusPacketDuration(packet, packet_size);
+                if (duration > 0) {
+                    stream->frame_duration = duration;
+                }
+            }
+            if (reassembled) {
+                packet_offset = stream->reassembled.size();
+                stream->reassembled.append((const char*)packet, packet_size);
+            }
+            stream->packets.push_back({ (uint32_t)packet_offset, (uint32_t)packet_size, reassembled });
+        }
+    };
+
+    size_t offset = 0;
+    while (offset + OGG_PAGE_HEADER_SIZE <= size) {
+        const uint8_t* page = buf + offset;
+        if (std::memcmp(page, "OggS", 4) != 0) {
+            ESP_LOGW(TAG, "Invalid page at offset %u", offset);
+            break;
+        }
+        uint8_t page_segments = page[26];
+        size_t body_offset = offset + OGG_PAGE_HEADER_SIZE + page_segments;
+        if (body_offset > size) {
+            break;
+        }
+        size_t body_size = 0;
+        for (size_t i = 0; i < page_segments; i++) {
+            body_size += page[OGG_PAGE_HEADER_SIZE + i];
+        }
+        if (body_offset + body_size > size) {
+            break;
+        }
+
+        /* The start of a continued packet is only kept when the next page says it goes on there */
+        bool page_continued = page[5] & OGG_PAGE_CONTINUED;
+        uint32_t previous_sequence = page_sequence;
+        page_sequence = page[18] | (page[19] << 8) | (page[20] << 16) | ((uint32_t)page[21] << 24);
+        if (continued != page_continued || (continued && page_sequence != previous_sequence + 1)) {
+            ESP_LOGW(TAG, "Dropping a packet cut at offset %u", offset);
+            pending.clear();
+            continued = false;
+        }
+        // The rest of a packet whose start was dropped
+        bool skip_first = page_continued && !continued;
+
+        /* A lacing value below 255 ends a packet */
+        size_t packet_offset = body_offset;
+        size_t packet_size = 0;
+        for (size_t i = 0; i < page_segments; i++) {
+            uint8_t lacing = page[OGG_PAGE_HEADER_SIZE + i];
+            packet_size += lacing;
+            if (lacing == 255) {
+                continue;
+            }
+            const uint8_t* packet = buf + packet_offset;
+            if (skip_first) {
+                skip_first = false;
+            } else if (continued) {
+                // Not contiguous in the stream, the rest is copied after its start
+                pending.append((const char*)packet, packet_size);
+                add_packet((const uint8_t*)pending.data(), pending.size(), 0, true);
+                pending.clear();
+            } else if (packet_size > 0) {
+                add_packet(packet, packet_size, packet_offset, false);
+            }
+            continued = false;
+            packet_offset += packet_size;
+            packet_size = 0;
+        }
+        if (packet_size > 0 && !skip_first) {
+            pending.append((const char*)buf + packet_offset, packet_size);
+            continued = true;
+        }
+        offset = body_offset + body_size;
+    }
+
+    if (stream->packets.empty()) {
+        ESP_LOGW(TAG, "No Opus packets in the stream");
+        return nullptr;
+    }
+    stream->packets.shrink_to_fit();
+    stream->reassembled.shrink_to_fit();
+    ESP_LOGI(TAG, "Indexed %u packets, sample_rate=%d, frame_duration=%dms",
+        stream->packets.size(), stream->sample_rate, stream->frame_duration);
+    return stream;
+}
+
+std::shared_ptr<const OggOpusStream> OggIndexCache::Get(std::string_view ogg) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = std::find_if(streams_.begin(), streams_.end(), [&ogg](const auto& stream) {
+        return stream->data.data() == ogg.data() && stream->data.size() == ogg.size();
+    });
+    if (it != streams_.end()) {
+        std::rotate(streams_.begin(), it, it + 1);
+        return streams_.front();
+    }
+
+    auto stream = ParseOggOpusStream(ogg);
+    if (stream == nullptr) {
+        return nullptr;
+    }
+    // Playing sounds keep their stream alive after it is evicted
+    if (streams_.size() >= OGG_INDEX_CACHE_SIZE) {
+        streams_.pop_back();
+    }
+    streams_.insert(streams_.begin(), stream);
+    return stream;
+}
+
+void OggIndexCache::Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    streams_.clear();
+}
@@ -0,0 +1,62 @@
+#ifndef OGG_DEMUXER_H
+#define OGG_DEMUXER_H
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Parsed streams kept by OggIndexCache, the least recently played one is evicted first
+#define OGG_INDEX_CACHE_SIZE 16
+
+// Location of one Opus packet inside the Ogg stream, or inside reassembled
+struct OggPacketRef {
+    uint32_t offset;
+    uint32_t size;
+    bool reassembled;
+};
+
+/*
+ * The Opus packets of an Ogg stream that stays mapped for the lifetime of the firmware, such as
+ * the sounds embedded in the flash. Packets are referenced in place, only those continued across
+ * pages are not contiguous in the stream and are copied once into reassembled.
+ */
+struct OggOpusStream {
+    std::string_view data;
+    int sample_rate = 16000;
+    int frame_duration = 60;
+    std::vector<OggPacketRef> packets;
+    std::string reassembled;
+
+    inline std::string_view packet(size_t index) const {
+        auto& ref = packets[index];
+        auto source = ref.reassembled ? std::string_view(reassembled) : data;
+        return source.substr(ref.offset, ref.size);
+    }
+};
+
+/*
+ * Walks the pages of an Ogg Opus stream by their declared sizes and indexes its audio packets.
+ * Returns nullptr if the stream has no audio.
+ */
+std::shared_ptr<const OggOpusStream> ParseOggOpusStream(std::string_view ogg);
+
+/*
+ * Streams parsed by ParseOggOpusStream(), keyed by their address, so a sound played again
+ * starts without being parsed again. Safe to use from any task.
+ */
+class OggIndexCache {
+public:
+    std::shared_ptr<const OggOpusStream> Get(std::string_view ogg);
+    void Clear();
+
+private:
+    std::mutex mutex_;
+    // Most recently used first
+    std::vector<std::shared_ptr<const OggOpusStream>> streams_;
+};
+
+#endif // OGG_DEMUXER_H
@@ -1,4 +1,5 @@
 #include "no_audio_processor.h"
+#include "sample_kernels.h"
 #include <esp_log.h>
 
 #define TAG "NoAudioProcessor"
@@ -6,22 +7,21 @@
 void NoAudioProcessor::Initialize(AudioCodec* codec, int frame_duration_ms, srmodel_list_t* models_list) {
     codec_ = codec;
     frame_samples_ = frame_duration_ms * 16000 / 1000;
+    mono_buffer_.reserve(frame_samples_);
 }
 
-void NoAudioProcessor::Feed(std::vector<int16_t>&& data) {
+void NoAudioProcessor::Feed(const std::vector<int16_t>& data) {
     if (!is_running_ || !output_callback_) {
         return;
     }
 
     if (codec_->input_channels() == 2) {
         // If input channels is 2, we need to fetch the left channel data
-        auto mono_data = std::vector<int16_t>(data.size() / 2);
-        for (size_t i = 0, j = 0; i < mono_data.size(); ++i, j += 2) {
-            mono_data[i] = data[j];
-        }
-        output_callback_(std::move(mono_data));
+        mono_buffer_.resize(data.size() / 2);
+        ExtractChannel(data.data(), mono_buffer_.data(), mono_buffer_.size(), 2, 0);
+        output_callback_(mono_buffer_);
     } else {
-        output_callback_(std::move(data));
+        output_callback_(data);
     }
 }
 
@@ -37,7 +37,7 @@ bool NoAudioProcessor::IsRunning() {
     return is_running_;
 }
 
-void NoAudioProcessor::OnOutput(std::function<void(std::vector<int16_t>&& data)> callback) {
+void NoAudioProcessor::OnOutput(std::function<void(const std::vector<int16_t>& data)> callback) {
     output_callback_ = callback;
 }
 
@@ -52,6 +52,10 @@ size_t NoAudioProcessor::GetFeedSize() {
     return frame_samples_;
 }
 
+void NoAudioProcessor::SetFrameDuration(int frame_duration_ms) {
+    frame_samples_ = frame_duration_ms * 16000 / 1000;
+}
+
 void NoAudioProcessor::EnableDeviceAec(bool enable) {
     if (enable) {
         ESP_LOGE(TAG, "Device AEC is not supported");
@@ -0,0 +1,110 @@
+#include "sample_kernels.h"
+
+#include <algorithm>
+
+static inline int16_t Saturate(int32_t sample) {
+    return std::clamp<int32_t>(sample, INT16_MIN, INT16_MAX);
+}
+
+static inline int16_t SaturateSymmetric(int32_t sample) {
+    return std::clamp<int32_t>(sample, -INT16_MAX, INT16_MAX);
+}
+
+void ConvertInt16ToInt32(const int16_t* src, int32_t* dst, size_t count, int32_t gain) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        dst[i] = src[i] * gain;
+        dst[i + 1] = src[i + 1] * gain;
+        dst[i + 2] = src[i + 2] * gain;
+        dst[i + 3] = src[i + 3] * gain;
+    }
+    for (; i < count; i++) {
+        dst[i] = src[i] * gain;
+    }
+}
+
+void ConvertInt32ToInt16(const int32_t* src, int16_t* dst, size_t count, int shift) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        dst[i] = SaturateSymmetric(src[i] >> shift);
+        dst[i + 1] = SaturateSymmetric(src[i + 1] >> shift);
+        dst[i + 2] = SaturateSymmetric(src[i + 2] >> shift);
+        dst[i + 3] = SaturateSymmetric(src[i + 3] >> shift);
+    }
+    for (; i < count; i++) {
+        dst[i] = SaturateSymmetric(src[i] >> shift);
+    }
+}
+
+void AmplifySamples(int16_t* samples, size_t count, int32_t gain) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        samples[i] = SaturateSymmetric(samples[i] * gain);
+        samples[i + 1] = SaturateSymmetric(samples[i + 1] * gain);
+        samples[i + 2] = SaturateSymmetric(samples[i + 2] * gain);
+        samples[i + 3] = SaturateSymmetric(samples[i + 3] * gain);
+    }
+    for (; i < count; i++) {
+        samples[i] = SaturateSymmetric(samples[i] * gain);
+    }
+}
+
+void ScaleSamples(int16_t* samples, size_t count, int32_t gain_start, int32_t gain_end) {
+    if (count == 0 || (gain_start == SAMPLE_GAIN_UNITY && gain_end == SAMPLE_GAIN_UNITY)) {
+        return;
+    }
+    // The gain is kept with 8 more fractional bits while it moves
+    int32_t gain = gain_start << 8;
+    int32_t step = ((gain_end - gain_start) << 8) / (int32_t)count;
+    for (size_t i = 0; i < count; i++) {
+        samples[i] = Saturate((samples[i] * (gain >> 8)) >> 15);
+        gain += step;
+    }
+}
+
+void MixSamples(int16_t* dst, const int16_t* src, size_t count, int32_t gain) {
+    size_t i = 0;
+    if (gain == SAMPLE_GAIN_UNITY) {
+        for (; i + 4 <= count; i += 4) {
+            dst[i] = Saturate(dst[i] + src[i]);
+            dst[i + 1] = Saturate(dst[i + 1] + src[i + 1]);
+            dst[i + 2] = Saturate(dst[i + 2] + src[i + 2]);
+            dst[i + 3] = Saturate(dst[i + 3] + src[i + 3]);
+        }
+        for (; i < count; i++) {
+            dst[i] = Saturate(dst[i] + src[i]);
+        }
+        return;
+    }
+    for (; i + 4 <= count; i += 4) {
+        dst[i] = Saturate(dst[i] + ((src[i] * gain) >> 15));
+        dst[i + 1] = Saturate(dst[i + 1] + ((src[i + 1] * gain) >> 15));
+        dst[i + 2] = Saturate(dst[i + 2] + ((src[i + 2] * gain) >> 15));
+        dst[i + 3] = Saturate(dst[i + 3] + ((src[i + 3] * gain) >> 15));
+    }
+    for (; i < count; i++) {
+        dst[i] = Saturate(dst[i] + ((src[i] * gain) >> 15));
+    }
+}
+
+void ExtractChannel(const int16_t* src, int16_t* dst, size_t frames, int channels, int channel) {
+    // dst[i] never overwrites a frame that is not read yet, so it works in place
+    src += channel;
+    if (channels == 2) {
+        // Constant stride for the common mic + reference layout
+        for (size_t i = 0; i < frames; i++) {
+            dst[i] = src[2 * i];
+        }
+        return;
+    }
+    for (size_t i = 0; i < frames; i++) {
+        dst[i] = src[i * channels];
+    }
+}
+
+void InsertChannel(const int16_t* src, int16_t* dst, size_t frames, int channels, int channel) {
+    dst += channel;
+    for (size_t i = 0; i < frames; i++) {
+        dst[i * channels] = src[i];
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef SAMPLE_KERNELS_H
+#define SAMPLE_KERNELS_H
+
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * Sample format conversions shared by the codecs, the audio service and the mixer.
+ *
+ * Every kernel works on caller-provided buffers and never allocates. They are plain C++ written
+ * four samples per iteration, so the compiler keeps the Xtensa / RISC-V pipelines busy and turns
+ * the saturation into min / max instructions where the core has them. There is no esp-dsp path
+ * for the ESP32-S3 PIE: esp-dsp is not a dependency of main/, it has no gain ramp nor the
+ * symmetric clamp of the codecs, and a frame is at most 960 samples. See tests/host/sample_kernels_benchmark.cc.
+ */
+
+// Unity of the Q15 gains
+#define SAMPLE_GAIN_UNITY 32768
+// Unity of the Q16 gains of ConvertInt16ToInt32()
+#define SAMPLE_GAIN_UNITY_Q16 65536
+
+// dst[i] = src[i] * gain, gain in Q16 up to SAMPLE_GAIN_UNITY_Q16, which fills the 32 bits
+void ConvertInt16ToInt32(const int16_t* src, int32_t* dst, size_t count, int32_t gain);
+// dst[i] = saturate(src[i] >> shift), clamped symmetrically to +-INT16_MAX
+void ConvertInt32ToInt16(const int32_t* src, int16_t* dst, size_t count, int shift);
+// samples[i] = saturate(samples[i] * gain), with an integer gain
+void AmplifySamples(int16_t* samples, size_t count, int32_t gain);
+// Scales the samples in place by a Q15 gain moving linearly from gain_start to gain_end
+void ScaleSamples(int16_t* samples, size_t count, int32_t gain_start, int32_t gain_end);
+// dst[i] = saturate(dst[i] + src[i] * gain), gain in Q15
+void MixSamples(int16_t* dst, const int16_t* src, size_t count, int32_t gain);
+// Copies one channel of interleaved frames to contiguous samples, dst may be src
+void ExtractChannel(const int16_t* src, int16_t* dst, size_t frames, int channels, int channel);
+// Writes contiguous samples into one channel of interleaved frames
+void InsertChannel(const int16_t* src, int16_t* dst, size_t frames, int channels, int channel);
+
+// Reads one channel of interleaved frames in place, without copying it out
+class ChannelView {
+public:
+    ChannelView(const int16_t* data, size_t samples, int channels, int channel)
+        : data_(data + channel), frames_(samples / channels), channels_(channels) {}
+
+    inline size_t size() const { return frames_; }
+    inline int16_t operator[](size_t i) const { return data_[i * channels_]; }
+
+private:
+    const int16_t* data_;
+    size_t frames_;
+    int channels_;
+};
+
+#endif // SAMPLE_KERNELS_H
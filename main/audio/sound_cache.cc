@@ -0,0 +1,76 @@
+#include "sound_cache.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <algorithm>
+#include <cstring>
+
+#define TAG "SoundCache"
+
+#ifdef CONFIG_SPIRAM
+#define SOUND_CACHE_MALLOC_CAPS (MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT)
+#else
+#define SOUND_CACHE_MALLOC_CAPS MALLOC_CAP_8BIT
+#endif
+
+CachedSound::CachedSound(const void* key, int sample_rate, size_t capacity)
+    : key_(key), sample_rate_(sample_rate), capacity_(capacity) {
+    data_ = (int16_t*)heap_caps_malloc(capacity * sizeof(int16_t), SOUND_CACHE_MALLOC_CAPS);
+    if (data_ == nullptr) {
+        ESP_LOGW(TAG, "Failed to allocate %u bytes", capacity * sizeof(int16_t));
+        capacity_ = 0;
+    }
+}
+
+CachedSound::~CachedSound() {
+    heap_caps_free(data_);
+}
+
+bool CachedSound::Append(const int16_t* samples, size_t count) {
+    if (size_ + count > capacity_) {
+        return false;
+    }
+    std::memcpy(data_ + size_, samples, count * sizeof(int16_t));
+    size_ += count;
+    return true;
+}
+
+std::shared_ptr<const CachedSound> SoundCache::Get(const void* key, int sample_rate) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = std::find_if(sounds_.begin(), sounds_.end(), [key, sample_rate](const auto& sound) {
+        return sound->key() == key && sound->sample_rate() == sample_rate;
+    });
+    if (it == sounds_.end()) {
+        return nullptr;
+    }
+    std::rotate(sounds_.begin(), it, it + 1);
+    return sounds_.front();
+}
+
+void SoundCache::Put(std::shared_ptr<const CachedSound> sound) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (sound->bytes() > budget_bytes_) {
+        return;
+    }
+    // A sound played again before it was cached replaces the older copy
+    auto it = std::find_if(sounds_.begin(), sounds_.end(), [&sound](const auto& cached) {
+        return cached->key() == sound->key() && cached->sample_rate() == sound->sample_rate();
+    });
+    if (it != sounds_.end()) {
+        bytes_ -= (*it)->bytes();
+        sounds_.erase(it);
+    }
+    // Playing sounds keep their PCM alive after they are evicted
+    while (!sounds_.empty() && bytes_ + sound->bytes() > budget_bytes_) {
+        bytes_ -= sounds_.back()->bytes();
+        sounds_.pop_back();
+    }
+    bytes_ += sound->bytes();
+    sounds_.insert(sounds_.begin(), std::move(sound));
+    ESP_LOGI(TAG, "Cached %u samples, %u / %u bytes used", sounds_.front()->size(), bytes_, budget_bytes_);
+}
+
+size_t SoundCache::bytes() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytes_;
+}
@@ -0,0 +1,63 @@
+#ifndef SOUND_CACHE_H
+#define SOUND_CACHE_H
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Sounds longer than this are always decoded when played
+#define SOUND_CACHE_MAX_DURATION_MS 3000
+
+/*
+ * The decoded PCM of one sound at the output sample rate, allocated in PSRAM if there is any.
+ * The buffer is sized for the whole sound up front and filled frame by frame by Append().
+ */
+class CachedSound {
+public:
+    CachedSound(const void* key, int sample_rate, size_t capacity);
+    ~CachedSound();
+    CachedSound(const CachedSound&) = delete;
+    CachedSound& operator=(const CachedSound&) = delete;
+
+    // Returns false if the buffer could not be allocated or is full
+    bool Append(const int16_t* samples, size_t count);
+
+    inline const void* key() const { return key_; }
+    inline int sample_rate() const { return sample_rate_; }
+    inline const int16_t* data() const { return data_; }
+    inline size_t size() const { return size_; }
+    inline size_t bytes() const { return capacity_ * sizeof(int16_t); }
+
+private:
+    const void* key_;
+    int sample_rate_;
+    int16_t* data_ = nullptr;
+    size_t size_ = 0;
+    size_t capacity_;
+};
+
+/*
+ * Least recently used cache of decoded sounds, keyed by the address of their Ogg data and
+ * bounded by a byte budget. Safe to use from any task.
+ */
+class SoundCache {
+public:
+    SoundCache(size_t budget_bytes) : budget_bytes_(budget_bytes) {}
+
+    std::shared_ptr<const CachedSound> Get(const void* key, int sample_rate);
+    void Put(std::shared_ptr<const CachedSound> sound);
+    // Whether a sound of this many samples may be cached at all
+    inline bool Fits(size_t samples) const { return samples * sizeof(int16_t) <= budget_bytes_; }
+    size_t bytes();
+
+private:
+    std::mutex mutex_;
+    // Most recently used first
+    std::vector<std::shared_ptr<const CachedSound>> sounds_;
+    size_t bytes_ = 0;
+    size_t budget_bytes_;
+};
+
+#endif // SOUND_CACHE_H
@@ -0,0 +1,93 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+
+/*
+ * Fixed-capacity, lock-free single-producer / single-consumer ring.
+ *
+ * Push() must only be called from the producer task and Pop() only from the consumer task.
+ * Clear() and Size() may be called from any task: Clear() marks everything pushed so far as
+ * discarded, and the consumer releases those items on its next Pop(). Items pushed after
+ * Clear() are kept. The queue does not block; callers signal each other with task notifications.
+ */
+template <typename T, size_t Capacity>
+class SpscQueue {
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    bool Push(T&& item) {
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) >= Capacity) {
+            return false;
+        }
+        slots_[head & (Capacity - 1)] = std::move(item);
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // For copyable items such as the timestamps, the item is left as it is
+    bool Push(const T& item) {
+        T copy = item;
+        return Push(std::move(copy));
+    }
+
+    bool Pop(T& item) {
+        return Pop(item, [](T&&) {});
+    }
+
+    // The items discarded by Clear() are handed to discard, e.g. to return them to their pool
+    template <typename Discard>
+    bool Pop(T& item, Discard discard) {
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        if (clear_pending_.exchange(false, std::memory_order_acquire)) {
+            uint32_t clear = clear_.load(std::memory_order_acquire);
+            while ((int32_t)(clear - tail) > 0) {
+                discard(std::move(slots_[tail & (Capacity - 1)]));
+                slots_[tail & (Capacity - 1)] = T();
+                tail++;
+            }
+            tail_.store(tail, std::memory_order_release);
+        }
+        if (tail == head_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = std::move(slots_[tail & (Capacity - 1)]);
+        slots_[tail & (Capacity - 1)] = T();
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    void Clear() {
+        clear_.store(head_.load(std::memory_order_acquire), std::memory_order_release);
+        clear_pending_.store(true, std::memory_order_release);
+    }
+
+    size_t Size() const {
+        uint32_t tail = tail_.load(std::memory_order_acquire);
+        uint32_t head = head_.load(std::memory_order_acquire);
+        if (clear_pending_.load(std::memory_order_acquire)) {
+            uint32_t clear = clear_.load(std::memory_order_acquire);
+            if ((int32_t)(clear - tail) > 0) {
+                tail = clear;
+            }
+        }
+        return head - tail;
+    }
+
+    inline bool Empty() const { return Size() == 0; }
+    static constexpr size_t capacity() { return Capacity; }
+
+private:
+    std::array<T, Capacity> slots_{};
+    std::atomic<uint32_t> head_{0};
+    std::atomic<uint32_t> tail_{0};
+    std::atomic<uint32_t> clear_{0};
+    std::atomic<bool> clear_pending_{false};
+};
+
+#endif // SPSC_QUEUE_H
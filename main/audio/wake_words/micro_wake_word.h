@@ -30,8 +30,6 @@ public:
     void Start() override;
     void Stop() override;
     size_t GetFeedSize() override;
-    void EncodeWakeWordData() override;
-    bool GetWakeWordOpus(std::vector<uint8_t>& opus) override;
     const std::string& GetLastDetectedWakeWord() const override { return last_detected_wake_word_; }
 
 private:
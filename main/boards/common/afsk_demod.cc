@@ -4,6 +4,7 @@
 #include "esp_log.h"
 #include "display.h"
 #include "ssid_manager.h"
+#include "sample_kernels.h"
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -41,31 +42,26 @@ namespace audio_wifi_config
                 continue;
             }
 
-            if (input_channels == 2) { // 如果是双声道输入，转换为单声道
-                auto mono_data = std::vector<int16_t>(audio_data.size() / 2);
-                for (size_t i = 0, j = 0; i < mono_data.size(); ++i, j += 2) {
-                    mono_data[i] = audio_data[j];
-                }
-                audio_data = std::move(mono_data);
-            }
-            
+            // 双声道输入时直接按步长读取左声道，不复制
+            ChannelView mic(audio_data.data(), audio_data.size(), input_channels, 0);
+
             // Downsample the audio data
             std::vector<float> downsampled_data;
             size_t last_index = 0;
 
             if (kDownsampleStep > 1.0f) {
-                downsampled_data.reserve(audio_data.size() / static_cast<size_t>(kDownsampleStep));
-                for (size_t i = 0; i < audio_data.size(); ++i) {
+                downsampled_data.reserve(mic.size() / static_cast<size_t>(kDownsampleStep));
+                for (size_t i = 0; i < mic.size(); ++i) {
                     size_t sample_index = static_cast<size_t>(i / kDownsampleStep);
                     if ((sample_index + 1) > last_index) {
-                        downsampled_data.push_back(static_cast<float>(audio_data[i]));
+                        downsampled_data.push_back(static_cast<float>(mic[i]));
                         last_index = sample_index + 1;
                     }
                 }
             } else {
-                downsampled_data.reserve(audio_data.size());
-                for (int16_t sample : audio_data) {
-                    downsampled_data.push_back(static_cast<float>(sample));
+                downsampled_data.reserve(mic.size());
+                for (size_t i = 0; i < mic.size(); ++i) {
+                    downsampled_data.push_back(static_cast<float>(mic[i]));
                 }
             }
             
@@ -4,6 +4,7 @@
 #include "display/display.h"
 #include "display/oled_display.h"
 #include "assets/lang_config.h"
+#include "application.h"
 
 #include <esp_log.h>
 #include <esp_ota_ops.h>
@@ -86,6 +87,21 @@ Led* Board::GetLed() {
     return &led;
 }
 
+void Board::AddAudioLinkStatusJson(cJSON* root) {
+    AudioLinkStatistics statistics;
+    if (!Application::GetInstance().GetAudioLinkStatistics(statistics) || statistics.received == 0) {
+        return;
+    }
+    auto audio_link = cJSON_CreateObject();
+    cJSON_AddNumberToObject(audio_link, "received", statistics.received);
+    cJSON_AddNumberToObject(audio_link, "loss_percent", (int)(statistics.loss_percent() * 10) / 10.0);
+    cJSON_AddNumberToObject(audio_link, "jitter_ms", statistics.jitter_us / 1000);
+    cJSON_AddNumberToObject(audio_link, "reordered", statistics.reordered);
+    cJSON_AddNumberToObject(audio_link, "duplicated", statistics.duplicated);
+    cJSON_AddNumberToObject(audio_link, "late", statistics.late);
+    cJSON_AddItemToObject(root, "audio_link", audio_link);
+}
+
 std::string Board::GetSystemInfoJson() {
     /* 
         {
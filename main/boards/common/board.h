@@ -8,6 +8,7 @@
 #include <string>
 #include <functional>
 #include <network_interface.h>
+#include <cJSON.h>
 
 #include "led/led.h"
 #include "backlight.h"
@@ -56,6 +57,8 @@ private:
 protected:
     Board();
     std::string GenerateUuid();
+    // Adds the "audio_link" object of GetDeviceStatusJson() when the transport keeps statistics
+    void AddAudioLinkStatusJson(cJSON* root);
 
     // 软件生成的设备唯一标识
     std::string uuid_;
@@ -208,6 +208,14 @@ std::string Ml307Board::GetDeviceStatusJson() {
      *         "type": "cellular",
      *         "carrier": "CHINA MOBILE",
      *         "csq": 10
+     *     },
+     *     "audio_link": {          // MQTT + UDP only, once audio was received
+     *         "received": 1200,
+     *         "loss_percent": 0.5,
+     *         "jitter_ms": 12,
+     *         "reordered": 3,
+     *         "duplicated": 0,
+     *         "late": 1
      *     }
      * }
      */
@@ -266,6 +274,9 @@ std::string Ml307Board::GetDeviceStatusJson() {
     }
     cJSON_AddItemToObject(root, "network", network);
 
+    // Audio link quality of datagram transports
+    AddAudioLinkStatusJson(root);
+
     auto json_str = cJSON_PrintUnformatted(root);
     std::string json(json_str);
     cJSON_free(json_str);
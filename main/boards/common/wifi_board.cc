@@ -399,6 +399,9 @@ std::string WifiBoard::GetDeviceStatusJson() {
         cJSON_AddItemToObject(root, "chip", chip);
     }
 
+    // Audio link quality of datagram transports
+    AddAudioLinkStatusJson(root);
+
     auto str = cJSON_PrintUnformatted(root);
     std::string result(str);
     cJSON_free(str);
@@ -0,0 +1,342 @@
+#include "download_pipeline.h"
+#include "board.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <freertos/task.h>
+#include <http.h>
+#include <algorithm>
+
+#define TAG "DownloadPipeline"
+
+// A strong ETag, or the Last-Modified date, for If-Range. Weak ETags are not allowed there.
+static std::string GetValidator(Http* http) {
+    auto etag = http->GetResponseHeader("ETag");
+    if (!etag.empty() && etag.compare(0, 2, "W/") != 0) {
+        return etag;
+    }
+    return http->GetResponseHeader("Last-Modified");
+}
+
+DownloadPipeline::DownloadPipeline(size_t buffer_size, int buffer_count)
+    : buffer_size_(buffer_size), buffer_count_(buffer_count) {
+}
+
+DownloadPipeline::~DownloadPipeline() {
+    if (running_) {
+        failed_ = true;
+        Finish();
+    }
+    for (auto& buffer : buffers_) {
+        heap_caps_free(buffer.data);
+    }
+    if (free_queue_ != nullptr) {
+        vQueueDelete(free_queue_);
+    }
+    if (filled_queue_ != nullptr) {
+        vQueueDelete(filled_queue_);
+    }
+    if (writer_done_ != nullptr) {
+        vSemaphoreDelete(writer_done_);
+    }
+}
+
+bool DownloadPipeline::Start(Sink sink, const char* name) {
+    /* The buffers go to PSRAM when there is some, the internal RAM is kept for the network */
+    for (int i = 0; i < buffer_count_; i++) {
+        auto data = (char*)heap_caps_malloc(buffer_size_, MALLOC_CAP_SPIRAM);
+        if (data == nullptr) {
+            data = (char*)heap_caps_malloc(buffer_size_, MALLOC_CAP_8BIT);
+        }
+        if (data == nullptr) {
+            ESP_LOGE(TAG, "Failed to allocate %d buffers of %u bytes", buffer_count_, buffer_size_);
+            return false;
+        }
+        buffers_.push_back({data, 0, 0});
+    }
+
+    free_queue_ = xQueueCreate(buffer_count_, sizeof(Buffer*));
+    filled_queue_ = xQueueCreate(buffer_count_ + 1, sizeof(Buffer*));
+    writer_done_ = xSemaphoreCreateBinary();
+    for (auto& buffer : buffers_) {
+        Buffer* p = &buffer;
+        xQueueSend(free_queue_, &p, 0);
+    }
+
+    sink_ = std::move(sink);
+    failed_ = false;
+    statistics_ = DownloadStatistics();
+    start_time_ = esp_timer_get_time();
+    last_progress_time_ = start_time_;
+    last_progress_bytes_ = 0;
+
+    if (xTaskCreate([](void* arg) {
+        auto pipeline = (DownloadPipeline*)arg;
+        pipeline->WriterTask();
+        vTaskDelete(NULL);
+    }, name, 4096, this, 3, nullptr) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create the writer task");
+        return false;
+    }
+    running_ = true;
+    return true;
+}
+
+void DownloadPipeline::WriterTask() {
+    while (true) {
+        Buffer* buffer;
+        xQueueReceive(filled_queue_, &buffer, portMAX_DELAY);
+        if (buffer == nullptr) {
+            break;
+        }
+        // After a failure the buffers are only recycled, so the reader never blocks
+        if (!failed_) {
+            auto start_time = esp_timer_get_time();
+            if (!sink_(buffer->data, buffer->size, buffer->offset)) {
+                failed_ = true;
+            }
+            statistics_.writer_busy_us += esp_timer_get_time() - start_time;
+        }
+        xQueueSend(free_queue_, &buffer, portMAX_DELAY);
+    }
+    xSemaphoreGive(writer_done_);
+}
+
+bool DownloadPipeline::Submit(Buffer* buffer) {
+    return xQueueSend(filled_queue_, &buffer, portMAX_DELAY) == pdTRUE;
+}
+
+bool DownloadPipeline::Fetch(const std::string& url, size_t offset, size_t length) {
+    if (!running_ || failed_) {
+        return false;
+    }
+
+    auto network = Board::GetInstance().GetNetwork();
+    size_t position = offset;
+    size_t end = length > 0 ? offset + length : SIZE_MAX;
+    int retries = 0;
+
+    while (position < end && !failed_) {
+        auto http = network->CreateHttp(0);
+        bool ranged = position > 0 || length > 0;
+        if (ranged) {
+            std::string range = "bytes=" + std::to_string(position) + "-";
+            if (end != SIZE_MAX) {
+                range += std::to_string(end - 1);
+            }
+            http->SetHeader("Range", range);
+            if (!validator_.empty()) {
+                http->SetHeader("If-Range", validator_);
+            }
+        }
+
+        bool progressed = false;
+        if (http->Open("GET", url)) {
+            int status_code = http->GetStatusCode();
+            bool restart = false;
+            if (ranged && status_code == 200) {
+                // The whole file is coming: it changed since the first response, or Range is not supported
+                if (offset > 0 || length > 0 || !restart_callback_ || statistics_.restarts >= DOWNLOAD_MAX_RETRIES) {
+                    ESP_LOGE(TAG, "The file changed on the server or it does not support Range requests");
+                    http->Close();
+                    break;
+                }
+                ESP_LOGW(TAG, "The file changed on the server, restarting from 0 instead of %u", position);
+                if (!Restart()) {
+                    http->Close();
+                    break;
+                }
+                restart = true;
+                position = 0;
+                end = SIZE_MAX;
+                validator_.clear();
+            }
+            if (status_code != (ranged && !restart ? 206 : 200)) {
+                ESP_LOGE(TAG, "Failed to get %u-, status code: %d", position, status_code);
+                http->Close();
+                if (status_code >= 400 && status_code < 500) {
+                    break;
+                }
+            } else {
+                if (end == SIZE_MAX) {
+                    size_t body_length = http->GetBodyLength();
+                    if (body_length == 0) {
+                        ESP_LOGE(TAG, "Failed to get content length");
+                        http->Close();
+                        break;
+                    }
+                    end = offset + body_length;
+                    if (restart) {
+                        total_bytes_ = body_length;
+                    }
+                    if (total_bytes_ == 0) {
+                        total_bytes_ = body_length;
+                    }
+                }
+
+                if (validator_.empty()) {
+                    validator_ = GetValidator(http.get());
+                }
+
+                /* Read into whole buffers, a partial buffer is kept across a reconnection */
+                while (position < end && !failed_) {
+                    if (current_ == nullptr) {
+                        auto start_time = esp_timer_get_time();
+                        xQueueReceive(free_queue_, &current_, portMAX_DELAY);
+                        statistics_.reader_wait_us += esp_timer_get_time() - start_time;
+                        current_->size = 0;
+                        current_->offset = position;
+                    }
+                    size_t size = std::min(buffer_size_ - current_->size, end - position);
+                    int ret = http->Read(current_->data + current_->size, size);
+                    if (ret <= 0) {
+                        if (ret < 0) {
+                            ESP_LOGW(TAG, "Failed to read HTTP data at %u: %d", position, ret);
+                        }
+                        break;
+                    }
+                    current_->size += ret;
+                    position += ret;
+                    statistics_.fetched_bytes += ret;
+                    progressed = true;
+                    if (current_->size == buffer_size_) {
+                        Submit(current_);
+                        current_ = nullptr;
+                    }
+                    ReportProgress(false);
+                }
+                http->Close();
+            }
+        } else {
+            ESP_LOGE(TAG, "Failed to open HTTP connection");
+        }
+
+        if (position >= end || failed_) {
+            break;
+        }
+        retries = progressed ? 1 : retries + 1;
+        if (retries > DOWNLOAD_MAX_RETRIES) {
+            ESP_LOGE(TAG, "Giving up at %u after %d retries", position, DOWNLOAD_MAX_RETRIES);
+            break;
+        }
+        statistics_.reconnects++;
+        ESP_LOGW(TAG, "Resuming at %u, retry %d", position, retries);
+        vTaskDelay(pdMS_TO_TICKS(500 * retries));
+    }
+
+    // The next fetch may not be contiguous
+    if (current_ != nullptr && current_->size > 0) {
+        Submit(current_);
+        current_ = nullptr;
+    }
+    if (position < end) {
+        failed_ = true;
+        return false;
+    }
+    return !failed_;
+}
+
+bool DownloadPipeline::Restart() {
+    /* Holding every buffer means the writer is idle, the data read so far is dropped */
+    if (current_ != nullptr) {
+        xQueueSend(free_queue_, &current_, 0);
+        current_ = nullptr;
+    }
+    std::vector<Buffer*> held(buffer_count_);
+    for (auto& buffer : held) {
+        xQueueReceive(free_queue_, &buffer, portMAX_DELAY);
+    }
+    bool restarted = !failed_ && restart_callback_();
+    for (auto& buffer : held) {
+        xQueueSend(free_queue_, &buffer, 0);
+    }
+    if (!restarted) {
+        failed_ = true;
+        return false;
+    }
+    statistics_.restarts++;
+    return true;
+}
+
+bool DownloadPipeline::Finish() {
+    if (!running_) {
+        return false;
+    }
+    if (current_ != nullptr) {
+        if (current_->size > 0 && !failed_) {
+            Submit(current_);
+        } else {
+            xQueueSend(free_queue_, &current_, 0);
+        }
+        current_ = nullptr;
+    }
+    Buffer* sentinel = nullptr;
+    Submit(sentinel);
+    xSemaphoreTake(writer_done_, portMAX_DELAY);
+    running_ = false;
+
+    statistics_.elapsed_us = esp_timer_get_time() - start_time_;
+    ReportProgress(true);
+    auto elapsed_ms = std::max<int64_t>(statistics_.elapsed_us / 1000, 1);
+    ESP_LOGI(TAG, "Fetched %u KB in %d ms (%d KB/s), reader waited %d ms, writer busy %d ms, %d reconnects, %d restarts",
+        statistics_.fetched_bytes / 1024, int(elapsed_ms), int(statistics_.fetched_bytes / elapsed_ms * 1000 / 1024),
+        int(statistics_.reader_wait_us / 1000), int(statistics_.writer_busy_us / 1000), statistics_.reconnects,
+        statistics_.restarts);
+    return !failed_;
+}
+
+void DownloadPipeline::SetProgressCallback(size_t total_bytes, ProgressCallback callback) {
+    total_bytes_ = total_bytes;
+    progress_callback_ = std::move(callback);
+}
+
+void DownloadPipeline::SetRestartCallback(RestartCallback callback) {
+    restart_callback_ = std::move(callback);
+}
+
+void DownloadPipeline::ReportProgress(bool force) {
+    auto now = esp_timer_get_time();
+    if (!force && now - last_progress_time_ < 1000000) {
+        return;
+    }
+    size_t bytes = statistics_.fetched_bytes;
+    size_t speed = (bytes - last_progress_bytes_) * 1000000LL / std::max<int64_t>(now - last_progress_time_, 1);
+    int progress = total_bytes_ > 0 ? std::min<size_t>(bytes * 100 / total_bytes_, 100) : 0;
+    ESP_LOGI(TAG, "Progress: %d%% (%u/%u), Speed: %u B/s", progress, bytes, total_bytes_, speed);
+    if (progress_callback_) {
+        progress_callback_(progress, speed);
+    }
+    last_progress_time_ = now;
+    last_progress_bytes_ = bytes;
+}
+
+bool DownloadPipeline::FetchRange(const std::string& url, size_t offset, size_t length, std::string& data,
+    std::string* validator) {
+    auto network = Board::GetInstance().GetNetwork();
+    auto http = network->CreateHttp(0);
+    http->SetHeader("Range", "bytes=" + std::to_string(offset) + "-" + std::to_string(offset + length - 1));
+    if (validator != nullptr && !validator->empty()) {
+        http->SetHeader("If-Range", *validator);
+    }
+    if (!http->Open("GET", url)) {
+        ESP_LOGE(TAG, "Failed to open HTTP connection");
+        return false;
+    }
+    int status_code = http->GetStatusCode();
+    if (status_code != 206) {
+        // 200 means the server ignored the Range or the file changed, do not read the whole file
+        ESP_LOGW(TAG, "Failed to get range %u+%u, status code: %d", offset, length, status_code);
+        http->Close();
+        return false;
+    }
+    if (validator != nullptr && validator->empty()) {
+        *validator = GetValidator(http.get());
+    }
+    data = http->ReadAll();
+    http->Close();
+    if (data.size() > length) {
+        data.resize(length);
+    }
+    return true;
+}
@@ -0,0 +1,100 @@
+#ifndef DOWNLOAD_PIPELINE_H
+#define DOWNLOAD_PIPELINE_H
+
+#include <string>
+#include <functional>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+
+// Reconnections without progress before a download gives up
+#define DOWNLOAD_MAX_RETRIES 5
+
+struct DownloadStatistics {
+    size_t fetched_bytes = 0;
+    int64_t elapsed_us = 0;
+    int64_t reader_wait_us = 0;     // Waiting for a free buffer, the writer is the bottleneck
+    int64_t writer_busy_us = 0;     // Inside the sink
+    int reconnects = 0;
+    int restarts = 0;               // The file changed on the server and was downloaded again
+};
+
+/*
+ * Downloads byte ranges of a URL and hands them to a sink running on its own writer task.
+ * The caller's task reads HTTP into a ring of buffers while the writer erases and writes the
+ * previous ones, so the network and the flash latency overlap instead of adding up. A dropped
+ * connection is resumed with a Range request at the first byte not received yet, and with an
+ * If-Range of the ETag or Last-Modified of the first response, so a file that changed on the
+ * server in between comes back whole instead of being spliced.
+ */
+class DownloadPipeline {
+public:
+    // Called on the writer task with consecutive data of the file at offset, returns false to abort
+    using Sink = std::function<bool(const char* data, size_t size, size_t offset)>;
+    using ProgressCallback = std::function<void(int progress, size_t speed)>;
+    // Called on the caller's task with the writer idle, before the sink sees the file again from the start
+    using RestartCallback = std::function<bool()>;
+
+    DownloadPipeline(size_t buffer_size, int buffer_count);
+    ~DownloadPipeline();
+
+    // Allocates the buffers and starts the writer task
+    bool Start(Sink sink, const char* name);
+    // Downloads [offset, offset + length) of url, or the whole file when length is 0
+    bool Fetch(const std::string& url, size_t offset, size_t length);
+    // Waits for the writer to drain, returns false if a fetch or the sink failed
+    bool Finish();
+
+    // Bytes expected over all the fetches, for the progress percentage
+    void SetProgressCallback(size_t total_bytes, ProgressCallback callback);
+    // Lets a whole file fetch start over when the file changed, instead of failing
+    void SetRestartCallback(RestartCallback callback);
+    // The If-Range of the resumed requests, taken from the first response when not set
+    inline void SetValidator(const std::string& validator) { validator_ = validator; }
+    inline const std::string& validator() const { return validator_; }
+    inline const DownloadStatistics& statistics() const { return statistics_; }
+
+    // Reads [offset, offset + length) of url into data, clamped to the end of the file. With a
+    // validator, fails if the file is not that version any more, an empty one is filled in.
+    static bool FetchRange(const std::string& url, size_t offset, size_t length, std::string& data,
+        std::string* validator = nullptr);
+
+private:
+    struct Buffer {
+        char* data;
+        size_t size;
+        size_t offset;
+    };
+
+    void WriterTask();
+    bool Submit(Buffer* buffer);
+    bool Restart();
+    void ReportProgress(bool force);
+
+    size_t buffer_size_;
+    int buffer_count_;
+    std::vector<Buffer> buffers_;
+    QueueHandle_t free_queue_ = nullptr;
+    QueueHandle_t filled_queue_ = nullptr;
+    SemaphoreHandle_t writer_done_ = nullptr;
+    bool running_ = false;
+    Buffer* current_ = nullptr;
+    Sink sink_;
+    std::atomic<bool> failed_ = false;
+    std::string validator_;
+    RestartCallback restart_callback_;
+
+    DownloadStatistics statistics_;
+    int64_t start_time_ = 0;
+    size_t total_bytes_ = 0;
+    ProgressCallback progress_callback_;
+    int64_t last_progress_time_ = 0;
+    size_t last_progress_bytes_ = 0;
+};
+
+#endif // DOWNLOAD_PIPELINE_H
@@ -0,0 +1,161 @@
+#include "image_inflater.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#if __has_include(<rom/miniz.h>)
+#include <rom/miniz.h>
+#define HAVE_ROM_MINIZ 1
+#endif
+#include <cstring>
+#include <algorithm>
+
+#define TAG "ImageInflater"
+
+
+#ifdef HAVE_ROM_MINIZ
+static void* AllocateBuffer(size_t size) {
+    void* buffer = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    if (buffer == nullptr) {
+        buffer = heap_caps_malloc(size, MALLOC_CAP_8BIT);
+    }
+    return buffer;
+}
+#endif
+
+ImageInflater::ImageInflater(DownloadPipeline::Sink sink) : sink_(std::move(sink)) {
+}
+
+ImageInflater::~ImageInflater() {
+    if (decompressor_ != nullptr) {
+        heap_caps_free(decompressor_);
+    }
+    if (window_ != nullptr) {
+        heap_caps_free(window_);
+    }
+}
+
+size_t ImageInflater::GetOriginalSize(const char* data, size_t size) {
+    if (size < sizeof(compressed_image_header)) {
+        return 0;
+    }
+    auto header = (const compressed_image_header*)data;
+    return header->magic == COMPRESSED_IMAGE_MAGIC ? header->original_size : 0;
+}
+
+bool ImageInflater::Write(const char* data, size_t size, size_t offset) {
+    if (!started_) {
+        /* The first buffer of the pipeline holds the whole header */
+        started_ = true;
+        compressed_ = offset == 0 && size >= sizeof(uint32_t) && *(const uint32_t*)data == COMPRESSED_IMAGE_MAGIC;
+        if (!compressed_) {
+            return Pass(data, size, offset);
+        }
+        if (size < sizeof(compressed_image_header)) {
+            ESP_LOGE(TAG, "The compressed image header is truncated");
+            return false;
+        }
+        auto header = (const compressed_image_header*)data;
+        if (header->window_bits < COMPRESSED_IMAGE_MIN_WINDOW_BITS || header->window_bits > COMPRESSED_IMAGE_MAX_WINDOW_BITS) {
+            ESP_LOGE(TAG, "The compressed image window (%d bits) is not supported", header->window_bits);
+            return false;
+        }
+#ifndef HAVE_ROM_MINIZ
+        ESP_LOGE(TAG, "This target has no ROM inflater, download the uncompressed image");
+        return false;
+#else
+        original_size_ = header->original_size;
+        window_size_ = 1 << header->window_bits;
+        decompressor_ = (tinfl_decompressor*)AllocateBuffer(sizeof(tinfl_decompressor));
+        window_ = (uint8_t*)AllocateBuffer(window_size_);
+        if (decompressor_ == nullptr || window_ == nullptr) {
+            ESP_LOGE(TAG, "Failed to allocate the inflater (%u bytes window)", window_size_);
+            return false;
+        }
+        tinfl_init(decompressor_);
+        ESP_LOGI(TAG, "Inflating a compressed image of %u bytes, %u bytes window", original_size_, window_size_);
+        return Inflate((const uint8_t*)data + sizeof(compressed_image_header), size - sizeof(compressed_image_header));
+#endif
+    }
+    if (!compressed_) {
+        return Pass(data, size, offset);
+    }
+    if (done_) {
+        // Bytes after the end of the stream are ignored, as in a plain image
+        return true;
+    }
+    return Inflate((const uint8_t*)data, size);
+}
+
+bool ImageInflater::Pass(const char* data, size_t size, size_t offset) {
+    output_size_ = std::max(output_size_, offset + size);
+    return sink_(data, size, offset);
+}
+
+bool ImageInflater::Inflate(const uint8_t* data, size_t size) {
+#ifndef HAVE_ROM_MINIZ
+    return false;
+#else
+    while (!done_) {
+        /* The window is the output buffer, the sink gets each run of output before it wraps */
+        size_t in_size = size;
+        size_t out_size = window_size_ - window_position_;
+        auto start_time = esp_timer_get_time();
+        auto status = tinfl_decompress(decompressor_, data, &in_size, window_, window_ + window_position_, &out_size,
+            TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_COMPUTE_ADLER32 | TINFL_FLAG_HAS_MORE_INPUT);
+        inflate_time_us_ += esp_timer_get_time() - start_time;
+        data += in_size;
+        size -= in_size;
+        if (status < TINFL_STATUS_DONE) {
+            ESP_LOGE(TAG, "Failed to inflate at %u: %d", output_size_, (int)status);
+            return false;
+        }
+        if (out_size > 0) {
+            if (output_size_ + out_size > original_size_) {
+                ESP_LOGE(TAG, "The inflated image exceeds %u bytes", original_size_);
+                return false;
+            }
+            if (!sink_((const char*)window_ + window_position_, out_size, output_size_)) {
+                return false;
+            }
+            output_size_ += out_size;
+            window_position_ = (window_position_ + out_size) & (window_size_ - 1);
+        }
+        done_ = status == TINFL_STATUS_DONE;
+        // Output may still be pending when the input is used up
+        if (status == TINFL_STATUS_NEEDS_MORE_INPUT && size == 0) {
+            break;
+        }
+    }
+    return true;
+#endif
+}
+
+void ImageInflater::Reset() {
+    started_ = false;
+    compressed_ = false;
+    done_ = false;
+    original_size_ = 0;
+    output_size_ = 0;
+    window_position_ = 0;
+    if (decompressor_ != nullptr) {
+        heap_caps_free(decompressor_);
+        decompressor_ = nullptr;
+    }
+    if (window_ != nullptr) {
+        heap_caps_free(window_);
+        window_ = nullptr;
+    }
+}
+
+bool ImageInflater::Finish() {
+    if (!compressed_) {
+        return true;
+    }
+    if (!done_ || output_size_ != original_size_) {
+        ESP_LOGE(TAG, "The compressed image is truncated, %u of %u bytes inflated", output_size_, original_size_);
+        return false;
+    }
+    ESP_LOGI(TAG, "Inflated %u KB in %d ms of CPU", output_size_ / 1024, int(inflate_time_us_ / 1000));
+    return true;
+}
@@ -0,0 +1,72 @@
+#ifndef IMAGE_INFLATER_H
+#define IMAGE_INFLATER_H
+
+#include "download_pipeline.h"
+
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * A compressed firmware or assets image, written by scripts/release.py and
+ * scripts/spiffs_assets/build.py:
+ *
+ *   compressed_image_header
+ *   zlib stream of the original image, with a window of 1 << window_bits bytes
+ */
+#define COMPRESSED_IMAGE_MAGIC 0x474D495A     // "ZIMG"
+// zlib has no 256 byte window, a stream made with 8 bits uses 9
+#define COMPRESSED_IMAGE_MIN_WINDOW_BITS 9
+#define COMPRESSED_IMAGE_MAX_WINDOW_BITS 15
+
+struct compressed_image_header {
+    uint32_t magic;
+    uint32_t original_size;
+    uint8_t window_bits;
+    uint8_t reserved[3];
+};
+
+struct tinfl_decompressor_tag;
+
+/*
+ * Sits between the download pipeline and the flash writer. Images starting with the magic are
+ * inflated as they arrive, with the ROM inflater and a window of the size the image was made
+ * with, other images are passed through. Either way the sink sees the original image in order.
+ * Without the ROM inflater (rom/miniz.h) compressed images are rejected.
+ */
+class ImageInflater {
+public:
+    ImageInflater(DownloadPipeline::Sink sink);
+    ~ImageInflater();
+
+    // The pipeline sink, takes the downloaded file in order
+    bool Write(const char* data, size_t size, size_t offset);
+    // Returns false if a compressed image was truncated or its size does not match the header
+    bool Finish();
+    // For a download that starts over, the next Write() is the start of the file again
+    void Reset();
+
+    inline bool compressed() const { return compressed_; }
+    // End of the data passed to the sink
+    inline size_t output_size() const { return output_size_; }
+
+    // The original size of a compressed image, 0 if the header is not one
+    static size_t GetOriginalSize(const char* data, size_t size);
+
+private:
+    bool Pass(const char* data, size_t size, size_t offset);
+    bool Inflate(const uint8_t* data, size_t size);
+
+    DownloadPipeline::Sink sink_;
+    bool started_ = false;
+    bool compressed_ = false;
+    bool done_ = false;
+    size_t original_size_ = 0;
+    size_t output_size_ = 0;
+    tinfl_decompressor_tag* decompressor_ = nullptr;
+    uint8_t* window_ = nullptr;
+    size_t window_size_ = 0;
+    size_t window_position_ = 0;
+    int64_t inflate_time_us_ = 0;
+};
+
+#endif // IMAGE_INFLATER_H
@@ -29,10 +29,11 @@ McpServer::McpServer() {
 }
 
 McpServer::~McpServer() {
-    for (auto tool : tools_) {
-        delete tool;
+    for (auto& entry : tools_) {
+        delete entry.tool;
     }
     tools_.clear();
+    tool_index_.clear();
 }
 
 void McpServer::AddCommonTools() {
@@ -228,7 +229,7 @@ void McpServer::AddCommonTools() {
                 return std::string("已完成操作");
             });
 
-        AddTool("ls.built_in.show_image",
+        auto show_image = AddTool("ls.built_in.show_image",
             "显示图片\n",
             PropertyList({
                 Property("url", kPropertyTypeString, {"图片资源地址"})
@@ -244,13 +245,15 @@ void McpServer::AddCommonTools() {
                 display->ShowImage(std::move(image));
                 return std::string("已完成操作");
             });
+        show_image->set_worker(true);
     }
 #endif // CONFIG_LSPLATFORM
 
     auto camera = board.GetCamera();
     if (camera) {
+        McpTool* take_photo;
 #ifdef CONFIG_LSPLATFORM
-        AddTool("ls.built_in.take_photo",
+        take_photo = AddTool("ls.built_in.take_photo",
             "拍照\n",
             PropertyList(),
             [camera](const PropertyList& properties) -> ReturnValue {
@@ -281,7 +284,7 @@ void McpServer::AddCommonTools() {
                 return raw;
             });
 #else // !CONFIG_LSPLATFORM
-        AddTool("self.camera.take_photo",
+        take_photo = AddTool("self.camera.take_photo",
             "Take a photo and explain it. Use this tool after the user asks you to see something.\n"
             "Args:\n"
             "  `question`: The question that you want to ask about the photo.\n"
@@ -301,11 +304,15 @@ void McpServer::AddCommonTools() {
                 return camera->Explain(question);
             });
 #endif // CONFIG_LSPLATFORM
+        // The photo is uploaded and explained remotely, which takes longer than the other tools
+        take_photo->set_worker(true);
+        take_photo->set_timeout_ms(MCP_TOOL_DEFAULT_TIMEOUT_MS * 2);
     }
 #endif
 
     // Restore the original tools list to the end of the tools list
     tools_.insert(tools_.end(), original_tools.begin(), original_tools.end());
+    tools_pages_dirty_ = true;
 }
 
 void McpServer::AddUserOnlyTools() {
@@ -351,6 +358,22 @@ void McpServer::AddUserOnlyTools() {
             return true;
         });
 
+    AddUserOnlyTool("self.audio.set_profile", "Set the uplink audio profile: low_latency (20ms frames), balanced (40ms), default (60ms) or low_bandwidth (60ms, higher encoder complexity). The profile is saved and applied immediately.",
+        PropertyList({
+            Property("profile", kPropertyTypeString)
+        }),
+        [this](const PropertyList& properties) -> ReturnValue {
+            auto name = properties["profile"].value<std::string>();
+            auto profile = AudioService::FindAudioProfile(name);
+            if (profile == kAudioProfileCount) {
+                throw std::runtime_error("Unknown audio profile: " + name);
+            }
+            Settings settings("audio", true);
+            settings.SetString("profile", name);
+            Application::GetInstance().SetAudioProfile(profile);
+            return true;
+        });
+
     // Display control
 #ifdef HAVE_LVGL
     auto display = dynamic_cast<LvglDisplay*>(Board::GetInstance().GetDisplay());
@@ -370,7 +393,7 @@ void McpServer::AddUserOnlyTools() {
             });
 
 #if CONFIG_LV_USE_SNAPSHOT
-        AddUserOnlyTool("self.screen.snapshot", "Snapshot the screen and upload it to a specific URL",
+        auto snapshot = AddUserOnlyTool("self.screen.snapshot", "Snapshot the screen and upload it to a specific URL",
             PropertyList({
                 Property("url", kPropertyTypeString),
                 Property("quality", kPropertyTypeInteger, 80, 1, 100)
@@ -423,8 +446,9 @@ void McpServer::AddUserOnlyTools() {
                 ESP_LOGI(TAG, "Snapshot screen result: %s", result.c_str());
                 return true;
             });
+        snapshot->set_worker(true);
         
-        AddUserOnlyTool("self.screen.preview_image", "Preview an image on the screen",
+        auto preview_image = AddUserOnlyTool("self.screen.preview_image", "Preview an image on the screen",
             PropertyList({
                 Property("url", kPropertyTypeString)
             }),
@@ -447,6 +471,10 @@ void McpServer::AddUserOnlyTools() {
                 }
                 size_t total_read = 0;
                 while (total_read < content_length) {
+                    if (McpServer::GetInstance().IsToolCallCancelled()) {
+                        heap_caps_free(data);
+                        throw std::runtime_error("Cancelled");
+                    }
                     int ret = http->Read(data + total_read, content_length - total_read);
                     if (ret < 0) {
                         heap_caps_free(data);
@@ -463,6 +491,7 @@ void McpServer::AddUserOnlyTools() {
                 display->SetPreviewImage(std::move(image));
                 return true;
             });
+        preview_image->set_worker(true);
 #endif // CONFIG_LV_USE_SNAPSHOT
     }
 #endif // HAVE_LVGL
@@ -483,25 +512,32 @@ void McpServer::AddUserOnlyTools() {
     }
 }
 
-void McpServer::AddTool(McpTool* tool) {
+McpTool* McpServer::AddTool(McpTool* tool) {
     // Prevent adding duplicate tools
-    if (std::find_if(tools_.begin(), tools_.end(), [tool](const McpTool* t) { return t->name() == tool->name(); }) != tools_.end()) {
+    auto existing = tool_index_.find(tool->name());
+    if (existing != tool_index_.end()) {
         ESP_LOGW(TAG, "Tool %s already added", tool->name().c_str());
-        return;
+        return existing->second;
     }
 
     ESP_LOGI(TAG, "Add tool: %s%s", tool->name().c_str(), tool->user_only() ? " [user]" : "");
-    tools_.push_back(tool);
+    // The tool does not change once added, so its JSON is kept for every tools/list
+    auto json = tool->to_json();
+    tools_.push_back({tool, tool->name(), tool->user_only(), tools_json_.size(), json.size()});
+    tools_json_ += json;
+    tool_index_.emplace(tool->name(), tool);
+    tools_pages_dirty_ = true;
+    return tool;
 }
 
-void McpServer::AddTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback) {
-    AddTool(new McpTool(name, description, properties, callback));
+McpTool* McpServer::AddTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback) {
+    return AddTool(new McpTool(name, description, properties, callback));
 }
 
-void McpServer::AddUserOnlyTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback) {
+McpTool* McpServer::AddUserOnlyTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback) {
     auto tool = new McpTool(name, description, properties, callback);
     tool->set_user_only(true);
-    AddTool(tool);
+    return AddTool(tool);
 }
 
 void McpServer::ParseMessage(const std::string& message) {
@@ -636,74 +672,31 @@ void McpServer::ReplyError(int id, const std::string& message) {
 }
 
 void McpServer::GetToolsList(int id, const std::string& cursor, bool list_user_only_tools) {
-    const int max_payload_size = 8000;
-    std::string json = "{\"tools\":[";
-    
-    bool found_cursor = cursor.empty();
-    auto it = tools_.begin();
-    std::string next_cursor = "";
-    
-    while (it != tools_.end()) {
-        // 如果我们还没有找到起始位置，继续搜索
-        if (!found_cursor) {
-            if ((*it)->name() == cursor) {
-                found_cursor = true;
-            } else {
-                ++it;
-                continue;
-            }
-        }
-
-        if (!list_user_only_tools && (*it)->user_only()) {
-            ++it;
-            continue;
-        }
-        
-        // 添加tool前检查大小
-        std::string tool_json = (*it)->to_json() + ",";
-        if (json.length() + tool_json.length() + 30 > max_payload_size) {
-            // 如果添加这个tool会超出大小限制，设置next_cursor并退出循环
-            next_cursor = (*it)->name();
-            break;
-        }
-        
-        json += tool_json;
-        ++it;
-    }
-    
-    if (json.back() == ',') {
-        json.pop_back();
-    }
-    
-    if (json.back() == '[' && !tools_.empty()) {
-        // 如果没有添加任何tool，返回错误
-        ESP_LOGE(TAG, "tools/list: Failed to add tool %s because of payload size limit", next_cursor.c_str());
-        ReplyError(id, "Failed to add tool " + next_cursor + " because of payload size limit");
-        return;
+    if (tools_pages_dirty_) {
+        tools_pages_.Build(tools_, MCP_TOOLS_PAGE_MAX_BYTES);
+        tools_pages_dirty_ = false;
     }
 
-    if (next_cursor.empty()) {
-        json += "]}";
-    } else {
-        json += "],\"nextCursor\":\"" + next_cursor + "\"}";
+    std::string json;
+    std::string error;
+    if (!tools_pages_.GetPage(tools_, tools_json_, cursor, list_user_only_tools, json, error)) {
+        ESP_LOGE(TAG, "tools/list: %s", error.c_str());
+        ReplyError(id, error);
+        return;
     }
-    
     ReplyResult(id, json);
 }
 
 void McpServer::DoToolCall(int id, const std::string& tool_name, const cJSON* tool_arguments) {
-    auto tool_iter = std::find_if(tools_.begin(), tools_.end(), 
-                                 [&tool_name](const McpTool* tool) { 
-                                     return tool->name() == tool_name; 
-                                 });
-    
-    if (tool_iter == tools_.end()) {
+    auto tool_iter = tool_index_.find(tool_name);
+    if (tool_iter == tool_index_.end()) {
         ESP_LOGE(TAG, "tools/call: Unknown tool: %s", tool_name.c_str());
         ReplyError(id, "Unknown tool: " + tool_name);
         return;
     }
+    auto tool = tool_iter->second;
 
-    PropertyList arguments = (*tool_iter)->properties();
+    PropertyList arguments = tool->properties();
     try {
         for (auto& argument : arguments) {
             bool found = false;
@@ -733,14 +726,224 @@ void McpServer::DoToolCall(int id, const std::string& tool_name, const cJSON* to
         return;
     }
 
-    // Use main thread to call the tool
-    auto& app = Application::GetInstance();
-    app.Schedule([this, id, tool_iter, arguments = std::move(arguments)]() {
-        try {
-            ReplyResult(id, (*tool_iter)->Call(arguments));
-        } catch (const std::exception& e) {
-            ESP_LOGE(TAG, "tools/call: %s", e.what());
-            ReplyError(id, e.what());
+    auto call = new ToolCall{id, tool, std::move(arguments), esp_timer_get_time(), 0};
+    if (tool->timeout_ms() > 0) {
+        call->deadline = call->queue_time + tool->timeout_ms() * 1000LL;
+    }
+
+    if (!tool->worker()) {
+        // Nothing else runs on the main loop meanwhile, so these calls have no timeout
+        Application::GetInstance().Schedule([this, call]() {
+            RunToolCall(call);
+        });
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(calls_mutex_);
+        if (timeout_timer_ == nullptr) {
+            StartToolWorkers();
+        }
+        if (queued_calls_.size() >= MCP_TOOL_QUEUE_SIZE) {
+            delete call;
+            call = nullptr;
+        } else {
+            queued_calls_.push_back(call);
+            if (call->deadline != 0 && !esp_timer_is_active(timeout_timer_)) {
+                esp_timer_start_periodic(timeout_timer_, MCP_TOOL_TIMEOUT_CHECK_MS * 1000);
+            }
         }
-    });
+    }
+    if (call == nullptr) {
+        ESP_LOGW(TAG, "tools/call: Queue full, %s rejected", tool_name.c_str());
+        ReplyError(id, "Too many tool calls in progress");
+        return;
+    }
+    calls_cv_.notify_one();
+}
+
+void McpServer::StartToolWorkers() {
+    esp_timer_create_args_t timer_args = {
+        .callback = [](void* arg) {
+            static_cast<McpServer*>(arg)->CheckToolCallTimeouts();
+        },
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "mcp_timeout",
+        .skip_unhandled_events = true,
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &timeout_timer_));
+
+    for (int i = 0; i < MCP_TOOL_WORKERS; i++) {
+        StartToolWorker();
+    }
+}
+
+void McpServer::StartToolWorker() {
+    // Same stack as the main task, where the tools used to run
+    if (xTaskCreate([](void* arg) {
+            static_cast<McpServer*>(arg)->ToolWorkerTask();
+            vTaskDelete(NULL);
+        }, "mcp_tool", 4096 * 2, this, 2, nullptr) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start a tool worker");
+        return;
+    }
+    tool_workers_++;
+}
+
+void McpServer::ToolWorkerTask() {
+    while (true) {
+        ToolCall* call = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(calls_mutex_);
+            calls_cv_.wait(lock, [this, &call]() {
+                auto it = std::find_if(queued_calls_.begin(), queued_calls_.end(), [](ToolCall* queued) {
+                    return queued->tool->running_calls_ < queued->tool->max_concurrency_;
+                });
+                if (it == queued_calls_.end()) {
+                    return false;
+                }
+                call = *it;
+                queued_calls_.erase(it);
+                return true;
+            });
+            call->tool->running_calls_++;
+            call->task = xTaskGetCurrentTaskHandle();
+            running_calls_.push_back(call);
+        }
+        RunToolCall(call);
+
+        std::lock_guard<std::mutex> lock(calls_mutex_);
+        if (tool_workers_ - hung_workers_ > MCP_TOOL_WORKERS) {
+            // Another worker took our place while our call was late
+            tool_workers_--;
+            break;
+        }
+    }
+}
+
+McpToolStatistics& McpServer::ToolStatistics(McpTool* tool) {
+    if (!tool->statistics_) {
+        tool->statistics_ = std::make_unique<McpToolStatistics>();
+    }
+    return *tool->statistics_;
+}
+
+void McpServer::RunToolCall(ToolCall* call) {
+    int64_t start_time = esp_timer_get_time();
+    std::string result;
+    bool failed = false;
+    try {
+        result = call->tool->Call(call->arguments);
+    } catch (const std::exception& e) {
+        ESP_LOGE(TAG, "tools/call: %s", e.what());
+        result = e.what();
+        failed = true;
+    }
+    int64_t end_time = esp_timer_get_time();
+
+    bool cancelled;
+    uint32_t wait_p90, run_p50, run_p90;
+    {
+        std::lock_guard<std::mutex> lock(calls_mutex_);
+        auto tool = call->tool;
+        if (tool->worker()) {
+            tool->running_calls_--;
+            running_calls_.erase(std::find(running_calls_.begin(), running_calls_.end(), call));
+        }
+        cancelled = call->cancelled;
+        if (cancelled) {
+            // The worker is free again
+            hung_workers_--;
+        }
+
+        auto& statistics = ToolStatistics(tool);
+        statistics.calls++;
+        statistics.queue_wait.Add(start_time - call->queue_time);
+        statistics.execution_time.Add(end_time - start_time);
+        wait_p90 = statistics.queue_wait.Percentile(90);
+        run_p50 = statistics.execution_time.Percentile(50);
+        run_p90 = statistics.execution_time.Percentile(90);
+    }
+    // A call of the same tool may be allowed to start now
+    calls_cv_.notify_all();
+
+    ESP_LOGI(TAG, "tools/call: %s waited %lld ms, ran %lld ms (wait p90=%lums, run p50=%lums p90=%lums)",
+        call->tool->name().c_str(), (start_time - call->queue_time) / 1000, (end_time - start_time) / 1000,
+        wait_p90 / 1000, run_p50 / 1000, run_p90 / 1000);
+    if (cancelled) {
+        ESP_LOGW(TAG, "tools/call: %s finished after its timeout, result dropped", call->tool->name().c_str());
+    } else if (failed) {
+        ReplyError(call->id, result);
+    } else {
+        ReplyResult(call->id, result);
+    }
+    delete call;
+}
+
+void McpServer::CheckToolCallTimeouts() {
+    std::vector<std::pair<int, std::string>> expired;
+    {
+        std::lock_guard<std::mutex> lock(calls_mutex_);
+        auto now = esp_timer_get_time();
+        auto has_expired = [now](const ToolCall* call) {
+            return call->deadline != 0 && now >= call->deadline;
+        };
+
+        /* Queued calls are cancelled before they start */
+        for (auto it = queued_calls_.begin(); it != queued_calls_.end();) {
+            auto call = *it;
+            if (!has_expired(call)) {
+                ++it;
+                continue;
+            }
+            ToolStatistics(call->tool).timeouts++;
+            expired.emplace_back(call->id, call->tool->name());
+            delete call;
+            it = queued_calls_.erase(it);
+        }
+
+        /* A running tool can not be stopped, it polls IsToolCallCancelled() or its result is dropped */
+        for (auto call : running_calls_) {
+            if (!call->cancelled && has_expired(call)) {
+                call->cancelled = true;
+                hung_workers_++;
+                ToolStatistics(call->tool).timeouts++;
+                expired.emplace_back(call->id, call->tool->name());
+            }
+        }
+
+        /* A worker held by a late call is replaced, so a hung tool does not stop the other calls */
+        while (tool_workers_ - hung_workers_ < MCP_TOOL_WORKERS && tool_workers_ < MCP_TOOL_WORKERS + MCP_TOOL_SPARE_WORKERS) {
+            int workers = tool_workers_;
+            StartToolWorker();
+            if (tool_workers_ == workers) {
+                break;
+            }
+        }
+
+        auto pending = [](const ToolCall* call) {
+            return call->deadline != 0 && !call->cancelled;
+        };
+        if (std::none_of(queued_calls_.begin(), queued_calls_.end(), pending) &&
+            std::none_of(running_calls_.begin(), running_calls_.end(), pending)) {
+            esp_timer_stop(timeout_timer_);
+        }
+    }
+
+    for (auto& [id, name] : expired) {
+        ESP_LOGW(TAG, "tools/call: %s timed out", name.c_str());
+        ReplyError(id, "Tool call timed out: " + name);
+    }
+}
+
+bool McpServer::IsToolCallCancelled() {
+    std::lock_guard<std::mutex> lock(calls_mutex_);
+    auto task = xTaskGetCurrentTaskHandle();
+    for (auto call : running_calls_) {
+        if (call->task == task) {
+            return call->cancelled;
+        }
+    }
+    return false;
 }
@@ -4,14 +4,43 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
+#include <string_view>
 #include <functional>
 #include <variant>
 #include <optional>
 #include <stdexcept>
 #include <thread>
+#include <memory>
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
 #include <mbedtls/base64.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 
 #include <cJSON.h>
+#include "latency_statistics.h"
+#include "mcp_tools_pages.h"
+
+// Largest tools/list result, the list is split into pages with a nextCursor
+#define MCP_TOOLS_PAGE_MAX_BYTES 8000
+
+#ifdef CONFIG_MCP_TOOL_WORKERS
+#define MCP_TOOL_WORKERS CONFIG_MCP_TOOL_WORKERS
+#define MCP_TOOL_QUEUE_SIZE CONFIG_MCP_TOOL_QUEUE_SIZE
+#define MCP_TOOL_DEFAULT_TIMEOUT_MS (CONFIG_MCP_TOOL_TIMEOUT * 1000)
+#else
+#define MCP_TOOL_WORKERS 2
+#define MCP_TOOL_QUEUE_SIZE 8
+#define MCP_TOOL_DEFAULT_TIMEOUT_MS 30000
+#endif
+// Workers started in place of the ones held by calls that timed out
+#define MCP_TOOL_SPARE_WORKERS 2
+// The deadlines of the calls in flight are checked this often
+#define MCP_TOOL_TIMEOUT_CHECK_MS 500
 
 class ImageContent {
 private:
@@ -243,13 +272,30 @@ public:
     }
 };
 
+// Allocated on the first call of a tool, most tools are never called
+struct McpToolStatistics {
+    LatencyStatistics queue_wait;
+    LatencyStatistics execution_time;
+    uint32_t calls = 0;
+    uint32_t timeouts = 0;
+};
+
 class McpTool {
 private:
+    friend class McpServer;
+
     std::string name_;
     std::string description_;
     PropertyList properties_;
     std::function<ReturnValue(const PropertyList&)> callback_;
     bool user_only_ = false;
+    bool worker_ = false;
+    int max_concurrency_ = 1;
+    int timeout_ms_ = MCP_TOOL_DEFAULT_TIMEOUT_MS;
+
+    // Owned by the McpServer, under its calls mutex
+    int running_calls_ = 0;
+    std::unique_ptr<McpToolStatistics> statistics_;
 
 public:
     McpTool(const std::string& name, 
@@ -262,10 +308,19 @@ public:
         callback_(callback) {}
 
     void set_user_only(bool user_only) { user_only_ = user_only; }
+    // Run on the tool workers instead of the main task, for slow tools (camera, network)
+    void set_worker(bool worker) { worker_ = worker; }
+    // Calls of this tool running at once on the workers, the next ones wait in the queue
+    void set_max_concurrency(int max_concurrency) { max_concurrency_ = std::max(max_concurrency, 1); }
+    // A JSON-RPC error is replied when the call is not over in time, 0 waits forever
+    void set_timeout_ms(int timeout_ms) { timeout_ms_ = timeout_ms; }
     inline const std::string& name() const { return name_; }
     inline const std::string& description() const { return description_; }
     inline const PropertyList& properties() const { return properties_; }
     inline bool user_only() const { return user_only_; }
+    inline bool worker() const { return worker_; }
+    inline int max_concurrency() const { return max_concurrency_; }
+    inline int timeout_ms() const { return timeout_ms_; }
 
     std::string to_json() const {
         std::vector<std::string> required = properties_.GetRequired();
@@ -361,16 +416,30 @@ public:
 
     void AddCommonTools();
     void AddUserOnlyTools();
-    void AddTool(McpTool* tool);
-    void AddTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback);
-    void AddUserOnlyTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback);
+    McpTool* AddTool(McpTool* tool);
+    McpTool* AddTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback);
+    McpTool* AddUserOnlyTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback);
     void ParseMessage(const cJSON* json);
     void ParseMessage(const std::string& message);
 
+    // True when the tool call running on this task timed out. Long tools poll it and give up,
+    // the error is already replied and their result is dropped.
+    bool IsToolCallCancelled();
+
 private:
     McpServer();
     ~McpServer();
 
+    struct ToolCall {
+        int id;
+        McpTool* tool;
+        PropertyList arguments;
+        int64_t queue_time;
+        int64_t deadline;           // 0 without a timeout
+        TaskHandle_t task = nullptr;
+        bool cancelled = false;     // Timed out, the error is replied
+    };
+
     void ParseCapabilities(const cJSON* capabilities);
 
     void ReplyResult(int id, const std::string& result);
@@ -378,8 +447,34 @@ private:
 
     void GetToolsList(int id, const std::string& cursor, bool list_user_only_tools);
     void DoToolCall(int id, const std::string& tool_name, const cJSON* tool_arguments);
-
-    std::vector<McpTool*> tools_;
+    void StartToolWorkers();
+    void StartToolWorker();
+    void ToolWorkerTask();
+    void RunToolCall(ToolCall* call);
+    void CheckToolCallTimeouts();
+    McpToolStatistics& ToolStatistics(McpTool* tool);
+
+    // In tools/list order, indexed by name. Every tool is serialized once when it is added,
+    // and the pages are laid out again only after the list changed.
+    std::vector<McpToolEntry> tools_;
+    std::unordered_map<std::string_view, McpTool*> tool_index_;
+    std::string tools_json_;
+    McpToolsPages tools_pages_;
+    bool tools_pages_dirty_ = true;
+
+    /*
+     * Tools marked with set_worker() run on MCP_TOOL_WORKERS tasks, so a slow camera or network
+     * tool does not hold the main loop, the others run on the main loop. A worker takes the oldest
+     * queued call whose tool is below its concurrency limit. Deadlines are checked by a timer while
+     * calls are in flight, and a worker held by a late call is replaced by a spare one.
+     */
+    std::mutex calls_mutex_;
+    std::condition_variable calls_cv_;
+    std::deque<ToolCall*> queued_calls_;
+    std::vector<ToolCall*> running_calls_;
+    int tool_workers_ = 0;
+    int hung_workers_ = 0;      // Running a call that timed out
+    esp_timer_handle_t timeout_timer_ = nullptr;
 };
 
 #endif // MCP_SERVER_H
@@ -0,0 +1,87 @@
+#include "mcp_tools_pages.h"
+
+#include <algorithm>
+#include <cstring>
+
+void McpToolsPages::Build(const std::vector<McpToolEntry>& tools, size_t max_bytes) {
+    /* Same limits as a page built tool by tool: 30 bytes are left for the nextCursor */
+    const size_t prefix_size = strlen("{\"tools\":[");
+    for (int with_user_only = 0; with_user_only < 2; with_user_only++) {
+        auto& pages = pages_[with_user_only];
+        pages.clear();
+        Page page = {0, 0, prefix_size, ""};
+        bool oversized = false;
+        for (size_t i = 0; i < tools.size(); i++) {
+            auto& entry = tools[i];
+            if (!with_user_only && entry.user_only) {
+                continue;
+            }
+            if (page.json_size + entry.json_size + 1 + 30 > max_bytes) {
+                if (page.json_size > prefix_size) {
+                    page.last = i;
+                    page.next_cursor = entry.name;
+                    page.json_size += strlen("],\"nextCursor\":\"\"}") + page.next_cursor.size();
+                    pages.push_back(std::move(page));
+                    page = {i, i, prefix_size, ""};
+                }
+                if (prefix_size + entry.json_size + 1 + 30 > max_bytes) {
+                    // A tool that does not fit alone ends the list, its empty page replies an error
+                    oversized = true;
+                    page.last = i;
+                    page.next_cursor = entry.name;
+                    pages.push_back(std::move(page));
+                    break;
+                }
+            }
+            page.json_size += entry.json_size + 1;
+        }
+        if (!oversized) {
+            page.last = tools.size();
+            page.json_size += strlen("]}");
+            pages.push_back(std::move(page));
+        }
+    }
+}
+
+bool McpToolsPages::GetPage(const std::vector<McpToolEntry>& tools, const std::string& tools_json,
+    const std::string& cursor, bool with_user_only, std::string& result, std::string& error) const {
+    /* A cursor is the first tool of a page */
+    auto& pages = pages_[with_user_only ? 1 : 0];
+    auto page = pages.begin();
+    if (!cursor.empty()) {
+        page = std::find_if(pages.begin(), pages.end(), [&tools, &cursor](const Page& p) {
+            return p.first < tools.size() && tools[p.first].name == cursor;
+        });
+    }
+    if (page == pages.end()) {
+        error = "Invalid cursor " + cursor;
+        return false;
+    }
+
+    result = "{\"tools\":[";
+    result.reserve(page->json_size);
+    for (size_t i = page->first; i < page->last; i++) {
+        auto& entry = tools[i];
+        if (!with_user_only && entry.user_only) {
+            continue;
+        }
+        result.append(tools_json, entry.json_offset, entry.json_size);
+        result += ',';
+    }
+    if (result.back() == ',') {
+        result.pop_back();
+    }
+
+    if (result.back() == '[' && !page->next_cursor.empty()) {
+        // 如果没有添加任何tool，返回错误
+        error = "Failed to add tool " + page->next_cursor + " because of payload size limit";
+        return false;
+    }
+
+    if (page->next_cursor.empty()) {
+        result += "]}";
+    } else {
+        result += "],\"nextCursor\":\"" + page->next_cursor + "\"}";
+    }
+    return true;
+}
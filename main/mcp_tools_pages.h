@@ -0,0 +1,44 @@
+#ifndef MCP_TOOLS_PAGES_H
+#define MCP_TOOLS_PAGES_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstddef>
+
+class McpTool;
+
+// A tool in tools/list order, serialized once when it is added
+struct McpToolEntry {
+    McpTool* tool;
+    std::string_view name;      // Owned by the tool
+    bool user_only;
+    size_t json_offset;         // Serialized tool in the tools JSON
+    size_t json_size;
+};
+
+/*
+ * The tools/list pages, laid out again only after the tools changed. A page is a range of tools
+ * whose result fits max_bytes with room for the nextCursor, so a reply is a few appends from the
+ * tools JSON. A tool that does not fit a page alone ends the list, its page replies an error.
+ */
+class McpToolsPages {
+public:
+    void Build(const std::vector<McpToolEntry>& tools, size_t max_bytes);
+    // The result of the page starting at the tool named cursor, the first page for an empty cursor.
+    // Returns false with the error message for an unknown cursor or a tool that does not fit.
+    bool GetPage(const std::vector<McpToolEntry>& tools, const std::string& tools_json,
+        const std::string& cursor, bool with_user_only, std::string& result, std::string& error) const;
+
+private:
+    struct Page {
+        size_t first;
+        size_t last;
+        size_t json_size;       // Result size, to reserve it at once
+        std::string next_cursor;
+    };
+
+    std::vector<Page> pages_[2];    // Without and with the user only tools
+};
+
+#endif // MCP_TOOLS_PAGES_H
@@ -2,6 +2,8 @@
 #include "system_info.h"
 #include "settings.h"
 #include "assets/lang_config.h"
+#include "download_pipeline.h"
+#include "image_inflater.h"
 
 #include <cJSON.h>
 #include <esp_log.h>
@@ -10,6 +12,7 @@
 #include <esp_app_format.h>
 #include <esp_efuse.h>
 #include <esp_efuse_table.h>
+#include <mbedtls/sha256.h>
 #ifdef SOC_HMAC_SUPPORTED
 #include <esp_hmac.h>
 #endif
@@ -21,6 +24,15 @@
 
 #define TAG "Ota"
 
+// The HTTP reader fills the ring while the writer task writes the previous buffers to flash
+#ifdef CONFIG_SPIRAM
+#define OTA_BUFFER_SIZE (16 * 1024)
+#define OTA_BUFFER_COUNT 4
+#else
+#define OTA_BUFFER_SIZE (8 * 1024)
+#define OTA_BUFFER_COUNT 2
+#endif
+
 
 Ota::Ota() {
 #ifdef ESP_EFUSE_BLOCK_USR_DATA
@@ -288,81 +300,129 @@ bool Ota::Upgrade(const std::string& firmware_url, std::function<void(int progre
     }
 
     ESP_LOGI(TAG, "Writing to partition %s at offset 0x%lx", update_partition->label, update_partition->address);
-    bool image_header_checked = false;
+    bool ota_begun = false;
+    bool hash_appended = false;
+
+    /*
+     * The image is hashed while it is written. With hash_appended, the last 32 bytes of the file
+     * are the SHA-256 of everything before them, so they are held back from the hash until the
+     * end, and a corrupted download is rejected before the image is validated.
+     */
+    mbedtls_sha256_context sha256;
+    mbedtls_sha256_init(&sha256);
+    mbedtls_sha256_starts(&sha256, 0);
+    uint8_t tail[32];
+    size_t tail_size = 0;
+    auto hash = [&](const char* data, size_t size) {
+        size_t held = std::min(size, sizeof(tail));
+        size_t released = tail_size + held > sizeof(tail) ? tail_size + held - sizeof(tail) : 0;
+        mbedtls_sha256_update(&sha256, tail, released);
+        memmove(tail, tail + released, tail_size - released);
+        tail_size -= released;
+        mbedtls_sha256_update(&sha256, (const uint8_t*)data, size - held);
+        memcpy(tail + tail_size, data + size - held, held);
+        tail_size += held;
+    };
+
+    // Runs on the writer task behind the inflater, while the next buffer is downloaded
     std::string image_header;
-
-    auto network = Board::GetInstance().GetNetwork();
-    auto http = network->CreateHttp(0);
-    if (!http->Open("GET", firmware_url)) {
-        ESP_LOGE(TAG, "Failed to open HTTP connection");
-        return false;
-    }
-
-    if (http->GetStatusCode() != 200) {
-        ESP_LOGE(TAG, "Failed to get firmware, status code: %d", http->GetStatusCode());
-        return false;
-    }
-
-    size_t content_length = http->GetBodyLength();
-    if (content_length == 0) {
-        ESP_LOGE(TAG, "Failed to get content length");
-        return false;
-    }
-
-    char buffer[512];
-    size_t total_read = 0, recent_read = 0;
-    auto last_calc_time = esp_timer_get_time();
-    while (true) {
-        int ret = http->Read(buffer, sizeof(buffer));
-        if (ret < 0) {
-            ESP_LOGE(TAG, "Failed to read HTTP data: %s", esp_err_to_name(ret));
-            return false;
-        }
-
-        // Calculate speed and progress every second
-        recent_read += ret;
-        total_read += ret;
-        if (esp_timer_get_time() - last_calc_time >= 1000000 || ret == 0) {
-            size_t progress = total_read * 100 / content_length;
-            ESP_LOGI(TAG, "Progress: %u%% (%u/%u), Speed: %uB/s", progress, total_read, content_length, recent_read);
-            if (callback) {
-                callback(progress, recent_read);
+    ImageInflater inflater([&](const char* data, size_t size, size_t offset) {
+        if (!ota_begun) {
+            // The inflater may hand over the header in pieces
+            image_header.append(data, size);
+            if (image_header.size() < sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t) + sizeof(esp_app_desc_t)) {
+                return true;
             }
-            last_calc_time = esp_timer_get_time();
-            recent_read = 0;
-        }
-
-        if (ret == 0) {
-            break;
-        }
-
-        if (!image_header_checked) {
-            image_header.append(buffer, ret);
-            if (image_header.size() >= sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t) + sizeof(esp_app_desc_t)) {
-                esp_app_desc_t new_app_info;
-                memcpy(&new_app_info, image_header.data() + sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t), sizeof(esp_app_desc_t));
-                
-                auto current_version = esp_app_get_description()->version;
-                ESP_LOGI(TAG, "Current version: %s, New version: %s", current_version, new_app_info.version);
-
-                if (esp_ota_begin(update_partition, OTA_WITH_SEQUENTIAL_WRITES, &update_handle)) {
-                    esp_ota_abort(update_handle);
-                    ESP_LOGE(TAG, "Failed to begin OTA");
-                    return false;
-                }
-
-                image_header_checked = true;
-                std::string().swap(image_header);
+            data = image_header.data();
+            size = image_header.size();
+
+            esp_image_header_t header;
+            memcpy(&header, data, sizeof(esp_image_header_t));
+            hash_appended = header.hash_appended == 1;
+
+            esp_app_desc_t new_app_info;
+            memcpy(&new_app_info, data + sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t), sizeof(esp_app_desc_t));
+            auto current_version = esp_app_get_description()->version;
+            ESP_LOGI(TAG, "Current version: %s, New version: %s", current_version, new_app_info.version);
+
+            if (esp_ota_begin(update_partition, OTA_WITH_SEQUENTIAL_WRITES, &update_handle)) {
+                esp_ota_abort(update_handle);
+                ESP_LOGE(TAG, "Failed to begin OTA");
+                return false;
             }
+            ota_begun = true;
         }
-        auto err = esp_ota_write(update_handle, buffer, ret);
+        hash(data, size);
+        auto err = esp_ota_write(update_handle, data, size);
         if (err != ESP_OK) {
             ESP_LOGE(TAG, "Failed to write OTA data: %s", esp_err_to_name(err));
-            esp_ota_abort(update_handle);
             return false;
         }
+        std::string().swap(image_header);
+        return true;
+    });
+    DownloadPipeline pipeline(OTA_BUFFER_SIZE, OTA_BUFFER_COUNT);
+    pipeline.SetProgressCallback(0, callback);
+    bool success = pipeline.Start([&](const char* data, size_t size, size_t offset) {
+        return inflater.Write(data, size, offset);
+    }, "ota_writer");
+    // A firmware that changed on the server is written again from the start
+    pipeline.SetRestartCallback([&]() {
+        if (ota_begun) {
+            esp_ota_abort(update_handle);
+            ota_begun = false;
+        }
+        image_header.clear();
+        mbedtls_sha256_free(&sha256);
+        mbedtls_sha256_init(&sha256);
+        mbedtls_sha256_starts(&sha256, 0);
+        tail_size = 0;
+        inflater.Reset();
+        return true;
+    });
+
+    // A dropped connection resumes with a Range request after the last byte received
+    success = success && pipeline.Fetch(firmware_url, 0, 0);
+    success = pipeline.Finish() && success;
+    success = success && inflater.Finish();
+    if (success && !ota_begun) {
+        ESP_LOGE(TAG, "The firmware image is too small");
+        success = false;
+    }
+
+    uint8_t digest[32];
+    if (success && !hash_appended) {
+        mbedtls_sha256_update(&sha256, tail, tail_size);
+    }
+    mbedtls_sha256_finish(&sha256, digest);
+    mbedtls_sha256_free(&sha256);
+    if (!success) {
+        if (ota_begun) {
+            esp_ota_abort(update_handle);
+        }
+        return false;
     }
-    http->Close();
+
+    char hex[sizeof(digest) * 2 + 1];
+    for (size_t i = 0; i < sizeof(digest); i++) {
+        snprintf(hex + i * 2, 3, "%02x", digest[i]);
+    }
+    ESP_LOGI(TAG, "Firmware SHA-256: %s", hex);
+#ifndef CONFIG_SECURE_SIGNED_APPS
+    // A signature block follows the digest in signed images
+    if (hash_appended && (tail_size != sizeof(tail) || memcmp(digest, tail, sizeof(digest)) != 0)) {
+        ESP_LOGE(TAG, "The firmware SHA-256 does not match the appended one, the download is corrupted");
+        esp_ota_abort(update_handle);
+        return false;
+    }
+#endif
+
+    auto& statistics = pipeline.statistics();
+    auto elapsed_ms = std::max<int64_t>(statistics.elapsed_us / 1000, 1);
+    size_t kb_per_second = statistics.fetched_bytes / elapsed_ms * 1000 / 1024;
+    ESP_LOGI(TAG, "Downloaded %u KB (%u KB written) in %d ms, %u.%02u MB/s, %d reconnects, %d restarts",
+        statistics.fetched_bytes / 1024, inflater.output_size() / 1024, int(elapsed_ms), kb_per_second / 1024,
+        kb_per_second % 1024 * 100 / 1024, statistics.reconnects, statistics.restarts);
 
     esp_err_t err = esp_ota_end(update_handle);
     if (err != ESP_OK) {
@@ -0,0 +1,70 @@
+#include "audio_cipher.h"
+
+#include <esp_log.h>
+#include <cstring>
+#include <arpa/inet.h>
+
+#define TAG "AudioCipher"
+
+AudioCipher::AudioCipher() {
+    mbedtls_aes_init(&context_);
+}
+
+AudioCipher::~AudioCipher() {
+    mbedtls_aes_free(&context_);
+}
+
+bool AudioCipher::Configure(const std::string& key, const std::string& nonce) {
+    if (nonce.size() != AUDIO_CIPHER_NONCE_SIZE) {
+        ESP_LOGE(TAG, "Invalid nonce size: %u", nonce.size());
+        return false;
+    }
+    nonce_ = nonce;
+    if (key == key_) {
+        // Same key as the last session, the schedule is still valid
+        return true;
+    }
+    if (mbedtls_aes_setkey_enc(&context_, (const unsigned char*)key.data(), key.size() * 8) != 0) {
+        ESP_LOGE(TAG, "Invalid key size: %u", key.size());
+        key_.clear();
+        return false;
+    }
+    key_ = key;
+    return true;
+}
+
+bool AudioCipher::Encrypt(const uint8_t* payload, size_t size, uint32_t timestamp, uint32_t sequence, uint8_t* out) {
+    if (key_.empty()) {
+        return false;
+    }
+    /* |type 1u|flags 1u|payload_len 2u|ssrc 4u|timestamp 4u|sequence 4u| */
+    memcpy(out, nonce_.data(), AUDIO_CIPHER_NONCE_SIZE);
+    uint16_t payload_len = htons(size);
+    timestamp = htonl(timestamp);
+    sequence = htonl(sequence);
+    memcpy(out + 2, &payload_len, sizeof(payload_len));
+    memcpy(out + 8, &timestamp, sizeof(timestamp));
+    memcpy(out + 12, &sequence, sizeof(sequence));
+    return Crypt(out, payload, size, out + AUDIO_CIPHER_NONCE_SIZE);
+}
+
+bool AudioCipher::Decrypt(const uint8_t* nonce, const uint8_t* in, size_t size, uint8_t* out) {
+    if (key_.empty()) {
+        return false;
+    }
+    return Crypt(nonce, in, size, out);
+}
+
+bool AudioCipher::Crypt(const uint8_t* nonce, const uint8_t* in, size_t size, uint8_t* out) {
+    // mbedtls advances the counter, the nonce in the packet stays as it was sent
+    uint8_t counter[AUDIO_CIPHER_NONCE_SIZE];
+    uint8_t stream_block[AUDIO_CIPHER_NONCE_SIZE];
+    size_t nc_off = 0;
+    memcpy(counter, nonce, sizeof(counter));
+    int ret = mbedtls_aes_crypt_ctr(&context_, size, &nc_off, counter, stream_block, in, out);
+    if (ret != 0) {
+        ESP_LOGE(TAG, "AES-CTR failed: %d", ret);
+        return false;
+    }
+    return true;
+}
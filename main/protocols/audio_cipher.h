@@ -0,0 +1,43 @@
+#ifndef AUDIO_CIPHER_H
+#define AUDIO_CIPHER_H
+
+#include <mbedtls/aes.h>
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// Every UDP audio packet starts with its nonce, which is also the initial CTR counter
+#define AUDIO_CIPHER_NONCE_SIZE 16
+
+/*
+ * AES-128-CTR of the UDP audio packets.
+ *
+ * The key is scheduled once and kept for as long as the server hands out the same key. mbedtls
+ * runs it on the AES peripheral when CONFIG_MBEDTLS_HARDWARE_AES is set, and in software on other
+ * targets. Packets are encrypted straight into the datagram buffer and decrypted straight into the
+ * payload of a recycled packet, without any intermediate buffer.
+ */
+class AudioCipher {
+public:
+    AudioCipher();
+    ~AudioCipher();
+    AudioCipher(const AudioCipher&) = delete;
+    AudioCipher& operator=(const AudioCipher&) = delete;
+
+    // key and nonce are raw bytes, AUDIO_CIPHER_NONCE_SIZE bytes each
+    bool Configure(const std::string& key, const std::string& nonce);
+    // Writes the packet nonce followed by the encrypted payload, out holds AUDIO_CIPHER_NONCE_SIZE + size bytes
+    bool Encrypt(const uint8_t* payload, size_t size, uint32_t timestamp, uint32_t sequence, uint8_t* out);
+    // Decrypts size bytes that followed nonce in a packet, out may be in
+    bool Decrypt(const uint8_t* nonce, const uint8_t* in, size_t size, uint8_t* out);
+
+private:
+    mbedtls_aes_context context_;
+    std::string key_;
+    std::string nonce_;
+
+    bool Crypt(const uint8_t* nonce, const uint8_t* in, size_t size, uint8_t* out);
+};
+
+#endif // AUDIO_CIPHER_H
@@ -0,0 +1,62 @@
+#include "audio_link_monitor.h"
+
+#include <esp_log.h>
+
+#define TAG "AudioLink"
+
+void AudioLinkMonitor::Reset() {
+    statistics_ = AudioLinkStatistics();
+    started_ = false;
+    first_sequence_ = 0;
+    highest_sequence_ = 0;
+    received_mask_ = 0;
+    has_transit_ = false;
+    last_transit_us_ = 0;
+    jitter_us_ = 0;
+}
+
+bool AudioLinkMonitor::OnPacket(uint32_t sequence, uint32_t timestamp_ms, int64_t arrival_us) {
+    if (!started_) {
+        started_ = true;
+        first_sequence_ = sequence;
+        highest_sequence_ = sequence;
+        received_mask_ = 1;
+    } else if ((int32_t)(sequence - highest_sequence_) > 0) {
+        uint32_t advance = sequence - highest_sequence_;
+        if (advance > 1) {
+            ESP_LOGD(TAG, "Sequence gap: %lu, expected: %lu", sequence, highest_sequence_ + 1);
+        }
+        received_mask_ = advance < 64 ? (received_mask_ << advance) | 1 : 1;
+        highest_sequence_ = sequence;
+    } else {
+        uint32_t behind = highest_sequence_ - sequence;
+        if (behind >= AUDIO_LINK_REORDER_WINDOW) {
+            statistics_.late++;
+            return false;
+        }
+        if (received_mask_ & (1ULL << behind)) {
+            statistics_.duplicated++;
+            return false;
+        }
+        received_mask_ |= 1ULL << behind;
+        statistics_.reordered++;
+    }
+    statistics_.received++;
+    statistics_.expected = highest_sequence_ - first_sequence_ + 1;
+
+    /* RFC 3550 interarrival jitter in microseconds, servers that send no timestamps are skipped */
+    if (timestamp_ms != 0) {
+        int64_t transit_us = arrival_us - (int64_t)timestamp_ms * 1000;
+        if (has_transit_) {
+            int64_t d = transit_us - last_transit_us_;
+            if (d < 0) {
+                d = -d;
+            }
+            jitter_us_ += d - ((jitter_us_ + 8) >> 4);
+            statistics_.jitter_us = jitter_us_ >> 4;
+        }
+        last_transit_us_ = transit_us;
+        has_transit_ = true;
+    }
+    return true;
+}
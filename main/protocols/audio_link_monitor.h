@@ -0,0 +1,48 @@
+#ifndef AUDIO_LINK_MONITOR_H
+#define AUDIO_LINK_MONITOR_H
+
+#include <cstdint>
+
+// Packets behind the newest one that are still accepted, up to 64
+#define AUDIO_LINK_REORDER_WINDOW 32
+
+struct AudioLinkStatistics {
+    uint32_t received = 0;      // Unique packets accepted
+    uint32_t expected = 0;      // Sequence numbers spanned since the session started
+    uint32_t reordered = 0;     // Accepted after a newer packet
+    uint32_t duplicated = 0;    // Dropped, already received
+    uint32_t late = 0;          // Dropped, older than the reorder window
+    uint32_t jitter_us = 0;     // Interarrival jitter (RFC 3550)
+
+    // Lost packets in percent, reordered packets still on their way count as lost
+    inline float loss_percent() const {
+        return expected > received ? (expected - received) * 100.0f / expected : 0.0f;
+    }
+};
+
+/*
+ * Receive side accounting of a datagram audio link. Packets may arrive up to
+ * AUDIO_LINK_REORDER_WINDOW sequence numbers behind the newest one, the jitter buffer puts them
+ * back in order. Duplicates and older packets are rejected before they are decrypted.
+ * Written by the receiving task only, readers may see a slightly torn snapshot.
+ */
+class AudioLinkMonitor {
+public:
+    void Reset();
+    // Returns false if the packet should be dropped
+    bool OnPacket(uint32_t sequence, uint32_t timestamp_ms, int64_t arrival_us);
+
+    inline const AudioLinkStatistics& statistics() const { return statistics_; }
+
+private:
+    AudioLinkStatistics statistics_;
+    bool started_ = false;
+    uint32_t first_sequence_ = 0;
+    uint32_t highest_sequence_ = 0;
+    uint64_t received_mask_ = 0;    // Bit n: highest_sequence_ - n was received
+    bool has_transit_ = false;
+    int64_t last_transit_us_ = 0;
+    int64_t jitter_us_ = 0;         // Scaled by 16, as in RFC 3550 A.8
+};
+
+#endif // AUDIO_LINK_MONITOR_H
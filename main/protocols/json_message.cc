@@ -0,0 +1,333 @@
+#include "json_message.h"
+
+#include <cstdint>
+
+/*
+ * Perfect hash of the dispatched words: length, first and last character. Every word owns a
+ * slot, the static_assert below fails if a new word collides with another one.
+ */
+#define JSON_WORD_TABLE_SIZE 32
+
+struct JsonWordEntry {
+    std::string_view word;
+    JsonWord value = kJsonWordUnknown;
+};
+
+static constexpr JsonWordEntry kJsonWords[] = {
+    { "hello", kJsonWordHello },
+    { "goodbye", kJsonWordGoodbye },
+    { "tts", kJsonWordTts },
+    { "stt", kJsonWordStt },
+    { "llm", kJsonWordLlm },
+    { "mcp", kJsonWordMcp },
+    { "system", kJsonWordSystem },
+    { "alert", kJsonWordAlert },
+    { "custom", kJsonWordCustom },
+    { "start", kJsonWordStart },
+    { "stop", kJsonWordStop },
+    { "sentence_start", kJsonWordSentenceStart },
+};
+
+static constexpr size_t JsonWordHash(std::string_view word) {
+    return (word.size() + (uint8_t)word.front() + (uint8_t)word.back() * 9) & (JSON_WORD_TABLE_SIZE - 1);
+}
+
+static constexpr std::array<JsonWordEntry, JSON_WORD_TABLE_SIZE> kJsonWordTable = [] {
+    std::array<JsonWordEntry, JSON_WORD_TABLE_SIZE> table{};
+    for (const auto& entry : kJsonWords) {
+        table[JsonWordHash(entry.word)] = entry;
+    }
+    return table;
+}();
+
+static constexpr bool JsonWordsHaveSlots() {
+    for (const auto& entry : kJsonWords) {
+        if (kJsonWordTable[JsonWordHash(entry.word)].value != entry.value) {
+            return false;
+        }
+    }
+    return true;
+}
+static_assert(JsonWordsHaveSlots(), "JSON words collide, change the hash");
+
+JsonWord JsonMessage::LookupWord(std::string_view word) {
+    if (word.empty()) {
+        return kJsonWordUnknown;
+    }
+    const auto& entry = kJsonWordTable[JsonWordHash(word)];
+    return entry.word == word ? entry.value : kJsonWordUnknown;
+}
+
+static inline const char* SkipSpace(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+        p++;
+    }
+    return p;
+}
+
+// p is after the opening quote, returns the closing quote or nullptr
+static const char* ScanString(const char* p, const char* end, bool& escaped) {
+    escaped = false;
+    while (p < end) {
+        if (*p == '"') {
+            return p;
+        }
+        if (*p == '\\') {
+            escaped = true;
+            p++;
+        }
+        p++;
+    }
+    return nullptr;
+}
+
+// p is at the opening bracket, returns the character after the closing one or nullptr
+static const char* SkipNested(const char* p, const char* end) {
+    int depth = 0;
+    bool escaped;
+    while (p < end) {
+        char c = *p;
+        if (c == '"') {
+            p = ScanString(p + 1, end, escaped);
+            if (p == nullptr) {
+                return nullptr;
+            }
+        } else if (c == '{' || c == '[') {
+            depth++;
+        } else if (c == '}' || c == ']') {
+            if (--depth == 0) {
+                return p + 1;
+            }
+        }
+        p++;
+    }
+    return nullptr;
+}
+
+bool JsonMessage::Parse(const char* data, size_t size) {
+    text_ = std::string_view(data, size);
+    field_count_ = 0;
+    type_ = kJsonWordUnknown;
+
+    const char* end = data + size;
+    const char* p = SkipSpace(data, end);
+    if (p == end || *p != '{') {
+        return false;
+    }
+    p = SkipSpace(p + 1, end);
+    if (p < end && *p == '}') {
+        return true;
+    }
+
+    while (p < end) {
+        /* Key */
+        bool escaped;
+        if (*p != '"') {
+            return false;
+        }
+        const char* key_end = ScanString(p + 1, end, escaped);
+        if (key_end == nullptr) {
+            return false;
+        }
+        Field field;
+        field.key = std::string_view(p + 1, key_end - p - 1);
+        p = SkipSpace(key_end + 1, end);
+        if (p == end || *p != ':') {
+            return false;
+        }
+        p = SkipSpace(p + 1, end);
+        if (p == end) {
+            return false;
+        }
+
+        /* Value */
+        field.escaped = false;
+        if (*p == '"') {
+            const char* value_end = ScanString(p + 1, end, field.escaped);
+            if (value_end == nullptr) {
+                return false;
+            }
+            field.kind = kJsonValueString;
+            field.value = std::string_view(p + 1, value_end - p - 1);
+            p = value_end + 1;
+        } else if (*p == '{' || *p == '[') {
+            const char* value_end = SkipNested(p, end);
+            if (value_end == nullptr) {
+                return false;
+            }
+            field.kind = *p == '{' ? kJsonValueObject : kJsonValueArray;
+            field.value = std::string_view(p, value_end - p);
+            p = value_end;
+        } else {
+            const char* value_end = p;
+            while (value_end < end && *value_end != ',' && *value_end != '}' &&
+                *value_end != ' ' && *value_end != '\t' && *value_end != '\n' && *value_end != '\r') {
+                value_end++;
+            }
+            field.kind = kJsonValueLiteral;
+            field.value = std::string_view(p, value_end - p);
+            p = value_end;
+        }
+        if (field_count_ < fields_.size()) {
+            fields_[field_count_++] = field;
+        }
+        if (field.kind == kJsonValueString && !field.escaped && field.key == "type") {
+            type_ = LookupWord(field.value);
+        }
+
+        p = SkipSpace(p, end);
+        if (p == end) {
+            return false;
+        }
+        if (*p == '}') {
+            return true;
+        }
+        if (*p != ',') {
+            return false;
+        }
+        p = SkipSpace(p + 1, end);
+    }
+    return false;
+}
+
+const JsonMessage::Field* JsonMessage::Find(const char* key) const {
+    for (size_t i = 0; i < field_count_; i++) {
+        if (fields_[i].key == key) {
+            return &fields_[i];
+        }
+    }
+    return nullptr;
+}
+
+bool JsonMessage::Has(const char* key) const {
+    return Find(key) != nullptr;
+}
+
+JsonWord JsonMessage::GetWord(const char* key) const {
+    auto field = Find(key);
+    if (field == nullptr || field->kind != kJsonValueString || field->escaped) {
+        return kJsonWordUnknown;
+    }
+    return LookupWord(field->value);
+}
+
+static int HexValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+static bool ReadHex4(const char* p, const char* end, uint32_t& value) {
+    if (end - p < 4) {
+        return false;
+    }
+    value = 0;
+    for (int i = 0; i < 4; i++) {
+        int digit = HexValue(p[i]);
+        if (digit < 0) {
+            return false;
+        }
+        value = (value << 4) | digit;
+    }
+    return true;
+}
+
+static void AppendUtf8(std::string& out, uint32_t code) {
+    if (code < 0x80) {
+        out.push_back((char)code);
+    } else if (code < 0x800) {
+        out.push_back((char)(0xC0 | (code >> 6)));
+        out.push_back((char)(0x80 | (code & 0x3F)));
+    } else if (code < 0x10000) {
+        out.push_back((char)(0xE0 | (code >> 12)));
+        out.push_back((char)(0x80 | ((code >> 6) & 0x3F)));
+        out.push_back((char)(0x80 | (code & 0x3F)));
+    } else {
+        out.push_back((char)(0xF0 | (code >> 18)));
+        out.push_back((char)(0x80 | ((code >> 12) & 0x3F)));
+        out.push_back((char)(0x80 | ((code >> 6) & 0x3F)));
+        out.push_back((char)(0x80 | (code & 0x3F)));
+    }
+}
+
+bool JsonMessage::GetString(const char* key, std::string& value) const {
+    auto field = Find(key);
+    if (field == nullptr || field->kind != kJsonValueString) {
+        return false;
+    }
+    if (!field->escaped) {
+        value.assign(field->value.data(), field->value.size());
+        return true;
+    }
+
+    /* Escape sequences only make the text shorter, except for code points written as \u */
+    value.clear();
+    value.reserve(field->value.size());
+    const char* p = field->value.data();
+    const char* end = p + field->value.size();
+    while (p < end) {
+        if (*p != '\\') {
+            value.push_back(*p++);
+            continue;
+        }
+        if (++p == end) {
+            break;
+        }
+        char c = *p++;
+        switch (c) {
+        case 'b': value.push_back('\b'); break;
+        case 'f': value.push_back('\f'); break;
+        case 'n': value.push_back('\n'); break;
+        case 'r': value.push_back('\r'); break;
+        case 't': value.push_back('\t'); break;
+        case 'u': {
+            uint32_t code;
+            if (!ReadHex4(p, end, code)) {
+                return false;
+            }
+            p += 4;
+            // A surrogate pair encodes a code point above the BMP
+            uint32_t low;
+            if (code >= 0xD800 && code < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u' &&
+                ReadHex4(p + 2, end, low) && low >= 0xDC00 && low < 0xE000) {
+                code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                p += 6;
+            }
+            AppendUtf8(value, code);
+            break;
+        }
+        default:
+            // \" \\ \/
+            value.push_back(c);
+            break;
+        }
+    }
+    return true;
+}
+
+std::string_view JsonMessage::GetRaw(const char* key) const {
+    auto field = Find(key);
+    if (field == nullptr) {
+        return std::string_view();
+    }
+    if (field->kind == kJsonValueString) {
+        // Include the quotes, so the text stays valid JSON
+        return std::string_view(field->value.data() - 1, field->value.size() + 2);
+    }
+    return field->value;
+}
+
+cJSON* JsonMessage::ParseObject(const char* key) const {
+    auto field = Find(key);
+    if (field == nullptr || field->kind != kJsonValueObject) {
+        return nullptr;
+    }
+    return cJSON_ParseWithLength(field->value.data(), field->value.size());
+}
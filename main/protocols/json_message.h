@@ -0,0 +1,80 @@
+#ifndef JSON_MESSAGE_H
+#define JSON_MESSAGE_H
+
+#include <cJSON.h>
+#include <array>
+#include <string>
+#include <string_view>
+#include <cstddef>
+
+// Top level fields indexed per message, the later ones are skipped
+#define JSON_MESSAGE_MAX_FIELDS 16
+
+// The "type" and "state" values the protocols dispatch on
+enum JsonWord {
+    kJsonWordUnknown,
+    kJsonWordHello,
+    kJsonWordGoodbye,
+    kJsonWordTts,
+    kJsonWordStt,
+    kJsonWordLlm,
+    kJsonWordMcp,
+    kJsonWordSystem,
+    kJsonWordAlert,
+    kJsonWordCustom,
+    kJsonWordStart,
+    kJsonWordStop,
+    kJsonWordSentenceStart,
+};
+
+enum JsonValueKind {
+    kJsonValueString,
+    kJsonValueObject,
+    kJsonValueArray,
+    kJsonValueLiteral,     // Number, true, false or null
+};
+
+/*
+ * An incoming protocol message, indexed in a single pass without building a cJSON tree.
+ * Only the top level fields are located, their values are read on demand: strings are
+ * unescaped into the caller's buffer, and nested objects such as the MCP payload are handed
+ * to cJSON by themselves. The text must outlive the message.
+ */
+class JsonMessage {
+public:
+    // Returns false if the text is not a JSON object
+    bool Parse(const char* data, size_t size);
+
+    // The "type" field, looked up in the word table
+    inline JsonWord type() const { return type_; }
+    inline std::string_view text() const { return text_; }
+
+    bool Has(const char* key) const;
+    // A string field looked up in the word table, kJsonWordUnknown if it is not one
+    JsonWord GetWord(const char* key) const;
+    // Unescapes a string field into value, returns false if there is no such string
+    bool GetString(const char* key, std::string& value) const;
+    // The JSON text of a field as received, e.g. a whole object
+    std::string_view GetRaw(const char* key) const;
+    // Parses an object field with cJSON, nullptr if there is none. The caller deletes it.
+    cJSON* ParseObject(const char* key) const;
+
+    static JsonWord LookupWord(std::string_view word);
+
+private:
+    struct Field {
+        std::string_view key;
+        std::string_view value;     // Strings without their quotes
+        JsonValueKind kind;
+        bool escaped;               // A string with escape sequences
+    };
+
+    std::string_view text_;
+    std::array<Field, JSON_MESSAGE_MAX_FIELDS> fields_;
+    size_t field_count_ = 0;
+    JsonWord type_ = kJsonWordUnknown;
+
+    const Field* Find(const char* key) const;
+};
+
+#endif // JSON_MESSAGE_H
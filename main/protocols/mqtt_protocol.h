@@ -3,10 +3,11 @@
 
 
 #include "protocol.h"
+#include "audio_cipher.h"
+#include "latency_statistics.h"
 #include <mqtt.h>
 #include <udp.h>
 #include <cJSON.h>
-#include <mbedtls/aes.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/event_groups.h>
 #include <esp_timer.h>
@@ -29,10 +30,11 @@ public:
     ~MqttProtocol();
 
     bool Start() override;
-    bool SendAudio(std::unique_ptr<AudioStreamPacket> packet) override;
+    bool SendAudio(AudioStreamPacket& packet) override;
     bool OpenAudioChannel() override;
     void CloseAudioChannel() override;
     bool IsAudioChannelOpened() const override;
+    const AudioLinkStatistics* GetLinkStatistics() const override { return &link_monitor_.statistics(); }
 
 private:
     // Alive flag for safe scheduled callbacks - set to false in destructor
@@ -45,12 +47,15 @@ private:
     std::mutex channel_mutex_;
     std::unique_ptr<Mqtt> mqtt_;
     std::unique_ptr<Udp> udp_;
-    mbedtls_aes_context aes_ctx_;
-    std::string aes_nonce_;
+    AudioCipher cipher_;
+    // Outgoing datagram, keeps its capacity
+    std::string send_buffer_;
+    LatencyStatistics encrypt_time_;
+    LatencyStatistics decrypt_time_;
     std::string udp_server_;
     int udp_port_;
     uint32_t local_sequence_;
-    uint32_t remote_sequence_;
+    AudioLinkMonitor link_monitor_;
     esp_timer_handle_t reconnect_timer_;
 
     bool StartMqttClient(bool report_error=false);
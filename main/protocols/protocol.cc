@@ -4,7 +4,7 @@
 
 #define TAG "Protocol"
 
-void Protocol::OnIncomingJson(std::function<void(const cJSON* root)> callback) {
+void Protocol::OnIncomingJson(std::function<void(const JsonMessage& message)> callback) {
     on_incoming_json_ = callback;
 }
 
@@ -32,6 +32,52 @@ void Protocol::OnDisconnected(std::function<void()> callback) {
     on_disconnected_ = callback;
 }
 
+void Protocol::SetAudioPacketAllocator(std::function<std::unique_ptr<AudioStreamPacket>()> allocator) {
+    audio_packet_allocator_ = allocator;
+}
+
+void Protocol::SetAudioPacketRecycler(std::function<void(std::unique_ptr<AudioStreamPacket> packet)> recycler) {
+    audio_packet_recycler_ = recycler;
+}
+
+void Protocol::SetClientFrameDuration(int frame_duration) {
+    // The frame durations of the audio profiles, anything else keeps the current one
+    if (frame_duration != 20 && frame_duration != 40 && frame_duration != 60) {
+        ESP_LOGW(TAG, "Unsupported uplink frame duration: %d, keeping %d", frame_duration, client_frame_duration_);
+        return;
+    }
+    client_frame_duration_ = frame_duration;
+}
+
+std::unique_ptr<AudioStreamPacket> Protocol::AllocateAudioPacket() {
+    auto packet = audio_packet_allocator_ != nullptr ? audio_packet_allocator_() : std::make_unique<AudioStreamPacket>();
+    // A recycled packet may have been an outgoing one
+    packet->headroom = 0;
+    return packet;
+}
+
+void Protocol::RecycleAudioPacket(std::unique_ptr<AudioStreamPacket> packet) {
+    if (audio_packet_recycler_ != nullptr) {
+        audio_packet_recycler_(std::move(packet));
+    }
+}
+
+bool Protocol::SendAudioBatch(std::unique_ptr<AudioStreamPacket>* packets, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (!SendAudio(*packets[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint8_t* Protocol::GetHeaderRoom(AudioStreamPacket& packet, size_t size) {
+    if (packet.headroom < size) {
+        return nullptr;
+    }
+    return packet.payload.data() + packet.headroom - size;
+}
+
 #ifdef CONFIG_LSPLATFORM
 void Protocol::SetNarrowbandMode(bool enabled) {
     narrowband_mode_ = enabled;
@@ -6,17 +6,34 @@
 #include <functional>
 #include <chrono>
 #include <vector>
+#include <memory>
+#include <algorithm>
+
+#include "audio_link_monitor.h"
+#include "json_message.h"
+
+// Room kept in front of the Opus data of an outgoing packet, so a transport writes its header
+// there in place. Covers BinaryProtocol2, the largest header.
+#define AUDIO_PACKET_HEADROOM 16
+// Most Opus frames coalesced into one transport frame, see docs/websocket.md
+#define AUDIO_BATCH_MAX_PACKETS 8
 
 struct AudioStreamPacket {
     int sample_rate = 0;
     int frame_duration = 0;
     uint32_t timestamp = 0;
+    uint32_t sequence = 0;  // Transport sequence number of incoming audio, 0 for local audio
+    int64_t queue_time = 0; // esp_timer_get_time() when the packet was queued for sending or decoding
+    uint16_t headroom = 0;  // Leading bytes of payload kept for a transport header, the Opus data follows
     std::vector<uint8_t> payload;
+
+    inline const uint8_t* data() const { return payload.data() + headroom; }
+    inline size_t size() const { return payload.size() - headroom; }
 };
 
 struct BinaryProtocol2 {
     uint16_t version;
-    uint16_t type;          // Message type (0: OPUS, 1: JSON)
+    uint16_t type;          // Message type (0: OPUS, 1: JSON, 2: OPUS batch)
     uint32_t reserved;      // Reserved for future use
     uint32_t timestamp;     // Timestamp in milliseconds (used for server-side AEC)
     uint32_t payload_size;  // Payload size in bytes
@@ -51,17 +68,35 @@ public:
     inline int server_frame_duration() const {
         return server_frame_duration_;
     }
+    inline int client_frame_duration() const {
+        return client_frame_duration_;
+    }
     inline const std::string& session_id() const {
         return session_id_;
     }
+    // Uplink Opus frames coalesced into one transport frame, 1 unless the server asked for batches
+    inline size_t uplink_batch_size() const {
+        if (uplink_batch_ms_ <= 0 || client_frame_duration_ <= 0) {
+            return 1;
+        }
+        return std::clamp(uplink_batch_ms_ / client_frame_duration_, 1, AUDIO_BATCH_MAX_PACKETS);
+    }
 
     void OnIncomingAudio(std::function<void(std::unique_ptr<AudioStreamPacket> packet)> callback);
-    void OnIncomingJson(std::function<void(const cJSON* root)> callback);
+    // Incoming messages other than the hello, only valid during the call
+    void OnIncomingJson(std::function<void(const JsonMessage& message)> callback);
     void OnAudioChannelOpened(std::function<void()> callback);
     void OnAudioChannelClosed(std::function<void()> callback);
     void OnNetworkError(std::function<void(const std::string& message)> callback);
     void OnConnected(std::function<void()> callback);
     void OnDisconnected(std::function<void()> callback);
+    // Incoming audio packets are taken from this allocator, so the receiver can recycle them
+    void SetAudioPacketAllocator(std::function<std::unique_ptr<AudioStreamPacket>()> allocator);
+    // Takes back the allocated packets that are not passed on, e.g. those failing to decrypt
+    void SetAudioPacketRecycler(std::function<void(std::unique_ptr<AudioStreamPacket> packet)> recycler);
+    // Uplink frame duration announced in the next hello, the server may override it in its reply.
+    // Only 20, 40 and 60 ms are accepted.
+    void SetClientFrameDuration(int frame_duration);
 
     virtual bool Start() = 0;
     virtual bool OpenAudioChannel() = 0;
@@ -70,33 +105,48 @@ public:
 #ifdef CONFIG_LSPLATFORM
     virtual void SetNarrowbandMode(bool enabled);
 #endif // CONFIG_LSPLATFORM
-    virtual bool SendAudio(std::unique_ptr<AudioStreamPacket> packet) = 0;
+    // Only the headroom of the packet is written, the same packet may be sent again
+    virtual bool SendAudio(AudioStreamPacket& packet) = 0;
+    // Sends consecutive packets, coalesced into one transport frame where the server accepts it
+    virtual bool SendAudioBatch(std::unique_ptr<AudioStreamPacket>* packets, size_t count);
     virtual void SendWakeWordDetected(const std::string& wake_word);
     virtual void SendStartListening(ListeningMode mode);
     virtual void SendStopListening();
     virtual void SendAbortSpeaking(AbortReason reason);
     virtual void SendMcpMessage(const std::string& message);
+    // Bytes written into the headroom of an uplink packet, 0 if the Opus data is sent or copied as it is
+    virtual size_t uplink_header_size() const { return 0; }
+    // Receive statistics of datagram transports, nullptr for stream transports
+    virtual const AudioLinkStatistics* GetLinkStatistics() const { return nullptr; }
 
 protected:
-    std::function<void(const cJSON* root)> on_incoming_json_;
+    std::function<void(const JsonMessage& message)> on_incoming_json_;
     std::function<void(std::unique_ptr<AudioStreamPacket> packet)> on_incoming_audio_;
     std::function<void()> on_audio_channel_opened_;
     std::function<void()> on_audio_channel_closed_;
     std::function<void(const std::string& message)> on_network_error_;
     std::function<void()> on_connected_;
     std::function<void()> on_disconnected_;
+    std::function<std::unique_ptr<AudioStreamPacket>()> audio_packet_allocator_;
+    std::function<void(std::unique_ptr<AudioStreamPacket> packet)> audio_packet_recycler_;
 
 #ifdef CONFIG_LSPLATFORM
     bool narrowband_mode_ = false;
 #endif // CONFIG_LSPLATFORM
     int server_sample_rate_ = 24000;
     int server_frame_duration_ = 60;
+    int client_frame_duration_ = 60;
+    int uplink_batch_ms_ = 0;
     bool error_occurred_ = false;
     std::string session_id_;
     std::chrono::time_point<std::chrono::steady_clock> last_incoming_time_;
 
     virtual bool SendText(const std::string& text) = 0;
     virtual void SetError(const std::string& message);
+    std::unique_ptr<AudioStreamPacket> AllocateAudioPacket();
+    void RecycleAudioPacket(std::unique_ptr<AudioStreamPacket> packet);
+    // The size bytes right in front of the Opus data, nullptr if the headroom is too small
+    static uint8_t* GetHeaderRoom(AudioStreamPacket& packet, size_t size);
     virtual bool IsTimeout() const;
 };
 
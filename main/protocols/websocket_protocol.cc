@@ -7,6 +7,7 @@
 #include <cstring>
 #include <cJSON.h>
 #include <esp_log.h>
+#include <esp_timer.h>
 #include <arpa/inet.h>
 #include "assets/lang_config.h"
 
@@ -17,52 +18,151 @@ WebsocketProtocol::WebsocketProtocol() {
 }
 
 WebsocketProtocol::~WebsocketProtocol() {
+    if (preconnect_started_) {
+        xEventGroupWaitBits(event_group_handle_, WEBSOCKET_PROTOCOL_PRECONNECT_DONE_EVENT, pdFALSE, pdFALSE, portMAX_DELAY);
+    }
     vEventGroupDelete(event_group_handle_);
 }
 
 bool WebsocketProtocol::Start() {
-    // Only connect to server when audio channel is needed
+#if CONFIG_WEBSOCKET_KEEP_WARM
+    /* Connect ahead of the first session, so the handshake is off the wake word path. It runs in
+     * the background, the boot does not wait for the server and a failure only costs the warm start. */
+    keep_warm_ = true;
+    preconnect_started_ = xTaskCreate([](void* arg) {
+        auto protocol = (WebsocketProtocol*)arg;
+        protocol->PreConnect();
+        xEventGroupSetBits(protocol->event_group_handle_, WEBSOCKET_PROTOCOL_PRECONNECT_DONE_EVENT);
+        vTaskDelete(NULL);
+    }, "ws_preconnect", 4096 * 2, this, 2, nullptr) == pdPASS;
+    if (!preconnect_started_) {
+        ESP_LOGW(TAG, "Failed to create the pre-connect task");
+    }
+#endif
+    // Otherwise only connect to server when audio channel is needed
     return true;
 }
 
-bool WebsocketProtocol::SendAudio(std::unique_ptr<AudioStreamPacket> packet) {
+void WebsocketProtocol::PreConnect() {
+    std::lock_guard<std::mutex> lock(connect_mutex_);
+    // A session may have connected first
+    if (websocket_ != nullptr && websocket_->IsConnected()) {
+        return;
+    }
+    if (!Connect()) {
+        ESP_LOGW(TAG, "Pre-connect failed, the first session connects");
+    }
+}
+
+bool WebsocketProtocol::SendAudio(AudioStreamPacket& packet) {
+    std::lock_guard<std::mutex> lock(channel_mutex_);
     if (websocket_ == nullptr || !websocket_->IsConnected()) {
         return false;
     }
 
+    if (uplink_batch_ms_ > 0) {
+        // Once batches are negotiated every uplink frame is one
+        BeginBatchFrame(packet.timestamp);
+        AppendToBatchFrame(packet);
+        return SendBatchFrame();
+    }
+
+    /* The header is written into the headroom in front of the Opus data, the frame is sent from the packet itself */
+    size_t header_size = version_ == 2 ? sizeof(BinaryProtocol2) : version_ == 3 ? sizeof(BinaryProtocol3) : 0;
+    uint8_t* header = GetHeaderRoom(packet, header_size);
+    if (header == nullptr) {
+        // Not encoded with headroom, assembled in the batch buffer
+        batch_buffer_.resize(header_size);
+        batch_buffer_.insert(batch_buffer_.end(), packet.data(), packet.data() + packet.size());
+        header = batch_buffer_.data();
+    }
     if (version_ == 2) {
-        std::string serialized;
-        serialized.resize(sizeof(BinaryProtocol2) + packet->payload.size());
-        auto bp2 = (BinaryProtocol2*)serialized.data();
+        auto bp2 = (BinaryProtocol2*)header;
         bp2->version = htons(version_);
         bp2->type = 0;
         bp2->reserved = 0;
-        bp2->timestamp = htonl(packet->timestamp);
-        bp2->payload_size = htonl(packet->payload.size());
-        memcpy(bp2->payload, packet->payload.data(), packet->payload.size());
-
-        return websocket_->Send(serialized.data(), serialized.size(), true);
+        bp2->timestamp = htonl(packet.timestamp);
+        bp2->payload_size = htonl(packet.size());
     } else if (version_ == 3) {
-        std::string serialized;
-        serialized.resize(sizeof(BinaryProtocol3) + packet->payload.size());
-        auto bp3 = (BinaryProtocol3*)serialized.data();
+        auto bp3 = (BinaryProtocol3*)header;
         bp3->type = 0;
         bp3->reserved = 0;
-        bp3->payload_size = htons(packet->payload.size());
-        memcpy(bp3->payload, packet->payload.data(), packet->payload.size());
+        bp3->payload_size = htons(packet.size());
+    }
+    return websocket_->Send(header, header_size + packet.size(), true);
+}
 
-        return websocket_->Send(serialized.data(), serialized.size(), true);
-    } else {
-        return websocket_->Send(packet->payload.data(), packet->payload.size(), true);
+size_t WebsocketProtocol::uplink_header_size() const {
+    // Batches are assembled in the batch buffer, v1 has no header
+    if (uplink_batch_ms_ > 0) {
+        return 0;
     }
+    return version_ == 2 ? sizeof(BinaryProtocol2) : version_ == 3 ? sizeof(BinaryProtocol3) : 0;
 }
 
-bool WebsocketProtocol::SendText(const std::string& text) {
+bool WebsocketProtocol::SendAudioBatch(std::unique_ptr<AudioStreamPacket>* packets, size_t count) {
+    if (uplink_batch_ms_ == 0) {
+        return Protocol::SendAudioBatch(packets, count);
+    }
+    std::lock_guard<std::mutex> lock(channel_mutex_);
     if (websocket_ == nullptr || !websocket_->IsConnected()) {
         return false;
     }
 
-    if (!websocket_->Send(text)) {
+    BeginBatchFrame(packets[0]->timestamp);
+    for (size_t i = 0; i < count; i++) {
+        AppendToBatchFrame(*packets[i]);
+    }
+    return SendBatchFrame();
+}
+
+void WebsocketProtocol::BeginBatchFrame(uint32_t timestamp) {
+    batch_buffer_.clear();
+    if (version_ == 2) {
+        batch_buffer_.resize(sizeof(BinaryProtocol2));
+        auto bp2 = (BinaryProtocol2*)batch_buffer_.data();
+        bp2->version = htons(version_);
+        bp2->type = htons(2);
+        bp2->reserved = 0;
+        bp2->timestamp = htonl(timestamp);
+    } else if (version_ == 3) {
+        batch_buffer_.resize(sizeof(BinaryProtocol3));
+        auto bp3 = (BinaryProtocol3*)batch_buffer_.data();
+        bp3->type = 2;
+        bp3->reserved = 0;
+    }
+}
+
+void WebsocketProtocol::AppendToBatchFrame(const AudioStreamPacket& packet) {
+    // Every Opus frame is prefixed with its size, big endian
+    uint16_t size = htons(packet.size());
+    auto prefix = (const uint8_t*)&size;
+    batch_buffer_.insert(batch_buffer_.end(), prefix, prefix + sizeof(size));
+    batch_buffer_.insert(batch_buffer_.end(), packet.data(), packet.data() + packet.size());
+}
+
+bool WebsocketProtocol::SendBatchFrame() {
+    if (version_ == 2) {
+        auto bp2 = (BinaryProtocol2*)batch_buffer_.data();
+        bp2->payload_size = htonl(batch_buffer_.size() - sizeof(BinaryProtocol2));
+    } else if (version_ == 3) {
+        auto bp3 = (BinaryProtocol3*)batch_buffer_.data();
+        bp3->payload_size = htons(batch_buffer_.size() - sizeof(BinaryProtocol3));
+    }
+    return websocket_->Send(batch_buffer_.data(), batch_buffer_.size(), true);
+}
+
+bool WebsocketProtocol::SendText(const std::string& text) {
+    bool sent;
+    {
+        std::lock_guard<std::mutex> lock(channel_mutex_);
+        if (websocket_ == nullptr || !websocket_->IsConnected()) {
+            return false;
+        }
+        sent = websocket_->Send(text);
+    }
+
+    if (!sent) {
         ESP_LOGE(TAG, "Failed to send text: %s", text.c_str());
         SetError(Lang::Strings::SERVER_ERROR);
         return false;
@@ -71,15 +171,38 @@ bool WebsocketProtocol::SendText(const std::string& text) {
     return true;
 }
 
+bool WebsocketProtocol::SendWarmHello(const std::string& message) {
+    // Failing here is not an error yet, the caller connects again
+    std::lock_guard<std::mutex> lock(channel_mutex_);
+    return websocket_ != nullptr && websocket_->IsConnected() && websocket_->Send(message);
+}
+
 bool WebsocketProtocol::IsAudioChannelOpened() const {
-    return websocket_ != nullptr && websocket_->IsConnected() && !error_occurred_ && !IsTimeout();
+    return session_active_ && websocket_ != nullptr && websocket_->IsConnected() && !error_occurred_ && !IsTimeout();
 }
 
 void WebsocketProtocol::CloseAudioChannel() {
+    if (session_active_ && session_reuse_ && websocket_ != nullptr && websocket_->IsConnected()) {
+        /* Keep the connection warm for the next session, the server ends this one in band */
+        session_active_ = false;
+        std::string message = "{";
+        message += "\"session_id\":\"" + session_id_ + "\",";
+        message += "\"type\":\"goodbye\"";
+        message += "}";
+        SendText(message);
+        if (on_audio_channel_closed_ != nullptr) {
+            on_audio_channel_closed_();
+        }
+        return;
+    }
+
+    session_active_ = false;
+    std::lock_guard<std::mutex> connect_lock(connect_mutex_);
+    std::lock_guard<std::mutex> lock(channel_mutex_);
     websocket_.reset();
 }
 
-bool WebsocketProtocol::OpenAudioChannel() {
+bool WebsocketProtocol::Connect() {
     Settings settings("websocket", false);
     std::string url = settings.GetString("url");
     std::string token = settings.GetString("token");
@@ -87,11 +210,13 @@ bool WebsocketProtocol::OpenAudioChannel() {
     if (version != 0) {
         version_ = version;
     }
-
-    error_occurred_ = false;
+    session_reuse_ = false;
 
     auto network = Board::GetInstance().GetNetwork();
-    websocket_ = network->CreateWebSocket(1);
+    {
+        std::lock_guard<std::mutex> lock(channel_mutex_);
+        websocket_ = network->CreateWebSocket(1);
+    }
     if (websocket_ == nullptr) {
         ESP_LOGE(TAG, "Failed to create websocket");
         return false;
@@ -116,64 +241,35 @@ bool WebsocketProtocol::OpenAudioChannel() {
 
     websocket_->OnData([this](const char* data, size_t len, bool binary) {
         if (binary) {
-            if (on_incoming_audio_ != nullptr) {
-                if (version_ == 2) {
-                    BinaryProtocol2* bp2 = (BinaryProtocol2*)data;
-                    bp2->version = ntohs(bp2->version);
-                    bp2->type = ntohs(bp2->type);
-                    bp2->timestamp = ntohl(bp2->timestamp);
-                    bp2->payload_size = ntohl(bp2->payload_size);
-                    auto payload = (uint8_t*)bp2->payload;
-                    on_incoming_audio_(std::make_unique<AudioStreamPacket>(AudioStreamPacket{
-                        .sample_rate = server_sample_rate_,
-                        .frame_duration = server_frame_duration_,
-                        .timestamp = bp2->timestamp,
-                        .payload = std::vector<uint8_t>(payload, payload + bp2->payload_size)
-                    }));
-                } else if (version_ == 3) {
-                    BinaryProtocol3* bp3 = (BinaryProtocol3*)data;
-                    bp3->type = bp3->type;
-                    bp3->payload_size = ntohs(bp3->payload_size);
-                    auto payload = (uint8_t*)bp3->payload;
-                    on_incoming_audio_(std::make_unique<AudioStreamPacket>(AudioStreamPacket{
-                        .sample_rate = server_sample_rate_,
-                        .frame_duration = server_frame_duration_,
-                        .timestamp = 0,
-                        .payload = std::vector<uint8_t>(payload, payload + bp3->payload_size)
-                    }));
-                } else {
-                    on_incoming_audio_(std::make_unique<AudioStreamPacket>(AudioStreamPacket{
-                        .sample_rate = server_sample_rate_,
-                        .frame_duration = server_frame_duration_,
-                        .timestamp = 0,
-                        .payload = std::vector<uint8_t>((uint8_t*)data, (uint8_t*)data + len)
-                    }));
-                }
+            // Audio of an ended session may still be in flight on a warm connection
+            if (session_active_) {
+                ParseBinaryFrame((const uint8_t*)data, len);
             }
         } else {
-            // Parse JSON data
-            auto root = cJSON_Parse(data);
-            ESP_LOGI(TAG, "JSON << %s", cJSON_PrintUnformatted(root));
-            auto type = cJSON_GetObjectItem(root, "type");
-            if (cJSON_IsString(type)) {
-                if (strcmp(type->valuestring, "hello") == 0) {
+            ESP_LOGI(TAG, "JSON << %.*s", (int)len, data);
+            JsonMessage message;
+            if (!message.Parse(data, len) || !message.Has("type")) {
+                ESP_LOGE(TAG, "Missing message type, data: %.*s", (int)len, data);
+            } else if (message.type() == kJsonWordHello) {
+                // The server hello is read in full, once per session
+                auto root = cJSON_ParseWithLength(data, len);
+                if (root != nullptr) {
                     ParseServerHello(root);
-                } else {
-                    if (on_incoming_json_ != nullptr) {
-                        on_incoming_json_(root);
-                    }
+                    cJSON_Delete(root);
+                }
+            } else if (session_active_) {
+                if (on_incoming_json_ != nullptr) {
+                    on_incoming_json_(message);
                 }
-            } else {
-                ESP_LOGE(TAG, "Missing message type, data: %s", data);
             }
-            cJSON_Delete(root);
         }
         last_incoming_time_ = std::chrono::steady_clock::now();
     });
 
     websocket_->OnDisconnected([this]() {
         ESP_LOGI(TAG, "Websocket disconnected");
-        if (on_audio_channel_closed_ != nullptr) {
+        // A warm connection dropped while idle is simply made again by the next session
+        if (session_active_.exchange(false) && on_audio_channel_closed_ != nullptr) {
             on_audio_channel_closed_();
         }
     });
@@ -181,23 +277,71 @@ bool WebsocketProtocol::OpenAudioChannel() {
     ESP_LOGI(TAG, "Connecting to websocket server: %s with version: %d", url.c_str(), version_);
     if (!websocket_->Connect(url.c_str())) {
         ESP_LOGE(TAG, "Failed to connect to websocket server");
-        SetError(Lang::Strings::SERVER_NOT_CONNECTED);
+        std::lock_guard<std::mutex> lock(channel_mutex_);
+        websocket_.reset();
         return false;
     }
+    return true;
+}
 
-    // Send hello message to describe the client
-    auto message = GetHelloMessage();
-    if (!SendText(message)) {
+bool WebsocketProtocol::OpenAudioChannel() {
+    // Waits for a pre-connect in progress instead of racing it
+    std::lock_guard<std::mutex> connect_lock(connect_mutex_);
+    int64_t start_time = esp_timer_get_time();
+    error_occurred_ = false;
+    remote_sequence_ = 0;
+    uplink_batch_ms_ = 0;
+
+    // An idle warm connection carries no data, so only the socket state tells if it may still be usable
+    bool warm = keep_warm_ && websocket_ != nullptr && websocket_->IsConnected();
+    if (!warm && !Connect()) {
+        SetError(Lang::Strings::SERVER_NOT_CONNECTED);
         return false;
     }
+    last_incoming_time_ = std::chrono::steady_clock::now();
 
-    // Wait for server hello
-    EventBits_t bits = xEventGroupWaitBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT, pdTRUE, pdFALSE, pdMS_TO_TICKS(10000));
+    // Send hello message to describe the client, it also starts a new session on a warm connection
+    auto message = GetHelloMessage();
+    EventBits_t bits = 0;
+    if (warm) {
+        /* A half-open connection still takes the hello, so the answer is awaited for a shorter time */
+        session_active_ = true;
+        xEventGroupClearBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT);
+        if (SendWarmHello(message)) {
+            bits = xEventGroupWaitBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT, pdTRUE, pdFALSE,
+                pdMS_TO_TICKS(WEBSOCKET_WARM_HELLO_TIMEOUT_MS));
+        }
+        if (!(bits & WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT)) {
+            // The warm connection is gone, or half-open, connect again
+            ESP_LOGW(TAG, "Warm connection lost, reconnecting");
+            session_active_ = false;
+            error_occurred_ = false;
+            warm = false;
+            if (!Connect()) {
+                SetError(Lang::Strings::SERVER_NOT_CONNECTED);
+                return false;
+            }
+            last_incoming_time_ = std::chrono::steady_clock::now();
+        }
+    }
+    if (!warm) {
+        session_active_ = true;
+        xEventGroupClearBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT);
+        if (!SendText(message)) {
+            session_active_ = false;
+            return false;
+        }
+        // Wait for server hello
+        bits = xEventGroupWaitBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT, pdTRUE, pdFALSE, pdMS_TO_TICKS(10000));
+    }
     if (!(bits & WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT)) {
         ESP_LOGE(TAG, "Failed to receive server hello");
+        session_active_ = false;
         SetError(Lang::Strings::SERVER_TIMEOUT);
         return false;
     }
+    ESP_LOGI(TAG, "Audio channel opened in %lld ms (%s connection)", (esp_timer_get_time() - start_time) / 1000,
+        warm ? "warm" : "new");
 
     if (on_audio_channel_opened_ != nullptr) {
         on_audio_channel_opened_();
@@ -206,6 +350,50 @@ bool WebsocketProtocol::OpenAudioChannel() {
     return true;
 }
 
+void WebsocketProtocol::ParseBinaryFrame(const uint8_t* data, size_t len) {
+    if (on_incoming_audio_ == nullptr) {
+        return;
+    }
+
+    /* The header is read where it lies, the payload is copied once into a recycled packet */
+    uint32_t timestamp = 0;
+    const uint8_t* payload = data;
+    size_t payload_size = len;
+    if (version_ == 2) {
+        if (len < sizeof(BinaryProtocol2)) {
+            ESP_LOGW(TAG, "Binary frame too short: %u", len);
+            return;
+        }
+        BinaryProtocol2 bp2;
+        memcpy(&bp2, data, sizeof(bp2));
+        timestamp = ntohl(bp2.timestamp);
+        payload = data + sizeof(BinaryProtocol2);
+        payload_size = ntohl(bp2.payload_size);
+    } else if (version_ == 3) {
+        if (len < sizeof(BinaryProtocol3)) {
+            ESP_LOGW(TAG, "Binary frame too short: %u", len);
+            return;
+        }
+        BinaryProtocol3 bp3;
+        memcpy(&bp3, data, sizeof(bp3));
+        payload = data + sizeof(BinaryProtocol3);
+        payload_size = ntohs(bp3.payload_size);
+    }
+    if (payload + payload_size > data + len) {
+        ESP_LOGW(TAG, "Invalid payload size: %u, frame size: %u", payload_size, len);
+        return;
+    }
+
+    auto packet = AllocateAudioPacket();
+    packet->sample_rate = server_sample_rate_;
+    packet->frame_duration = server_frame_duration_;
+    packet->timestamp = timestamp;
+    // Binary frames arrive in order over TCP, number them for the jitter buffer
+    packet->sequence = ++remote_sequence_;
+    packet->payload.assign(payload, payload + payload_size);
+    on_incoming_audio_(std::move(packet));
+}
+
 std::string WebsocketProtocol::GetHelloMessage() {
     // keys: message type, version, audio_params (format, sample_rate, channels)
     cJSON* root = cJSON_CreateObject();
@@ -216,6 +404,10 @@ std::string WebsocketProtocol::GetHelloMessage() {
     cJSON_AddBoolToObject(features, "aec", true);
 #endif
     cJSON_AddBoolToObject(features, "mcp", true);
+    cJSON_AddBoolToObject(features, "audio_batch", true);
+    if (keep_warm_) {
+        cJSON_AddBoolToObject(features, "session_reuse", true);
+    }
 #ifdef CONFIG_LSPLATFORM
     if (narrowband_mode_) {
         cJSON_AddNumberToObject(features, "ls_tts_prefer_bitrate", 8000);
@@ -236,7 +428,7 @@ std::string WebsocketProtocol::GetHelloMessage() {
     cJSON_AddNumberToObject(audio_params, "sample_rate", 16000);
 #endif // CONFIG_LSPLATFORM
     cJSON_AddNumberToObject(audio_params, "channels", 1);
-    cJSON_AddNumberToObject(audio_params, "frame_duration", OPUS_FRAME_DURATION_MS);
+    cJSON_AddNumberToObject(audio_params, "frame_duration", client_frame_duration_);
     cJSON_AddItemToObject(root, "audio_params", audio_params);
     auto json_str = cJSON_PrintUnformatted(root);
     std::string message(json_str);
@@ -258,6 +450,11 @@ void WebsocketProtocol::ParseServerHello(const cJSON* root) {
         ESP_LOGI(TAG, "Session ID: %s", session_id_.c_str());
     }
 
+    auto features = cJSON_GetObjectItem(root, "features");
+    if (cJSON_IsObject(features)) {
+        session_reuse_ = keep_warm_ && cJSON_IsTrue(cJSON_GetObjectItem(features, "session_reuse"));
+    }
+
     auto audio_params = cJSON_GetObjectItem(root, "audio_params");
     if (cJSON_IsObject(audio_params)) {
         auto sample_rate = cJSON_GetObjectItem(audio_params, "sample_rate");
@@ -268,6 +465,15 @@ void WebsocketProtocol::ParseServerHello(const cJSON* root) {
         if (cJSON_IsNumber(frame_duration)) {
             server_frame_duration_ = frame_duration->valueint;
         }
+        auto uplink_frame_duration = cJSON_GetObjectItem(audio_params, "uplink_frame_duration");
+        if (cJSON_IsNumber(uplink_frame_duration)) {
+            SetClientFrameDuration(uplink_frame_duration->valueint);
+        }
+        auto uplink_batch_ms = cJSON_GetObjectItem(audio_params, "uplink_batch_ms");
+        if (cJSON_IsNumber(uplink_batch_ms)) {
+            uplink_batch_ms_ = std::max(uplink_batch_ms->valueint, 0);
+            ESP_LOGI(TAG, "Uplink batch: %d ms", uplink_batch_ms_);
+        }
     }
 
     xEventGroupSetBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT);
@@ -5,10 +5,16 @@
 #include "protocol.h"
 
 #include <web_socket.h>
+#include <mutex>
+#include <atomic>
 #include <freertos/FreeRTOS.h>
 #include <freertos/event_groups.h>
 
 #define WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT (1 << 0)
+#define WEBSOCKET_PROTOCOL_PRECONNECT_DONE_EVENT (1 << 1)
+
+// Wait for the server hello on a warm connection before connecting again, it answers within a round trip
+#define WEBSOCKET_WARM_HELLO_TIMEOUT_MS 3000
 
 class WebsocketProtocol : public Protocol {
 public:
@@ -16,17 +22,38 @@ public:
     ~WebsocketProtocol();
 
     bool Start() override;
-    bool SendAudio(std::unique_ptr<AudioStreamPacket> packet) override;
+    bool SendAudio(AudioStreamPacket& packet) override;
+    bool SendAudioBatch(std::unique_ptr<AudioStreamPacket>* packets, size_t count) override;
     bool OpenAudioChannel() override;
     void CloseAudioChannel() override;
     bool IsAudioChannelOpened() const override;
+    size_t uplink_header_size() const override;
 
 private:
     EventGroupHandle_t event_group_handle_;
     std::unique_ptr<WebSocket> websocket_;
+    // Audio is sent from the network task, text from the main task
+    std::mutex channel_mutex_;
+    // Serializes connecting, the pre-connect task against the sessions
+    std::mutex connect_mutex_;
+    bool preconnect_started_ = false;
     int version_ = 1;
-
+    uint32_t remote_sequence_ = 0;
+    // Keep-warm mode: the connection outlives the audio channel, see CONFIG_WEBSOCKET_KEEP_WARM
+    bool keep_warm_ = false;
+    bool session_reuse_ = false;            // The server accepts a new session on the same connection
+    std::atomic<bool> session_active_ = false;
+    // Coalesced uplink frame, keeps its capacity
+    std::vector<uint8_t> batch_buffer_;
+
+    bool Connect();
+    void PreConnect();
+    bool SendWarmHello(const std::string& message);
     void ParseServerHello(const cJSON* root);
+    void ParseBinaryFrame(const uint8_t* data, size_t len);
+    void BeginBatchFrame(uint32_t timestamp);
+    void AppendToBatchFrame(const AudioStreamPacket& packet);
+    bool SendBatchFrame();
     bool SendText(const std::string& text) override;
     std::string GetHelloMessage();
 };
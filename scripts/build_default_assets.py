@@ -17,6 +17,7 @@ import shutil
 import sys
 import json
 import struct
+import zlib
 from datetime import datetime
 
 
@@ -319,7 +320,7 @@ def generate_index_json(assets_dir, srmodels, mwwmodel, text_font, emoji_collect
     print(f"Generated: {index_path}")
 
 
-def generate_config_json(build_dir, assets_dir):
+def generate_config_json(build_dir, assets_dir, layout_version=1):
     """Generate config.json file"""
     config_data = {
         "include_path": os.path.join(build_dir, "include"),
@@ -329,6 +330,7 @@ def generate_config_json(build_dir, assets_dir):
         "assets_size": "0x400000",
         "support_format": ".png, .gif, .jpg, .bin, .json",
         "name_length": "32",
+        "layout_version": layout_version,
         "split_height": "0",
         "support_qoi": False,
         "support_spng": False,
@@ -362,12 +364,136 @@ def sort_key(filename):
     return extension, basename
 
 
-def pack_assets_simple(target_path, include_path, out_file, assets_path, max_name_len=32):
+# The v2 layout stores a hashed directory the firmware searches in place
+ASSETS_V2_MAGIC = 0x32545341  # 'AST2'
+ASSETS_V2_HEADER_SIZE = 24
+ASSETS_V2_ENTRY_SIZE = 28
+ASSETS_V2_FLAG_CRC32 = 0x1
+ASSETS_SECTOR_SIZE = 4096
+
+
+def fnv1a_hash(name):
+    value = 0x811C9DC5
+    for byte in name.encode('utf-8'):
+        value = ((value ^ byte) * 0x01000193) & 0xFFFFFFFF
+    return value
+
+def read_layout_v2(image):
+    """
+    Read the directory of a v2 image with CRC32s.
+
+    Returns:
+    - {name: (offset, size, crc32)}, or None if the image is not one
+    """
+    if len(image) < ASSETS_V2_HEADER_SIZE:
+        return None
+    file_count, _, magic, _, bucket_count, flags = struct.unpack_from('<IIIIII', image)
+    if magic != ASSETS_V2_MAGIC or not flags & ASSETS_V2_FLAG_CRC32:
+        return None
+    entries_offset = ASSETS_V2_HEADER_SIZE + (bucket_count + 1) * 4
+    assets = {}
+    for i in range(file_count):
+        _, name_offset, offset, size, crc, name_length, _, _, _ = struct.unpack_from(
+            '<IIIIIHHHH', image, entries_offset + i * ASSETS_V2_ENTRY_SIZE)
+        assets[image[name_offset:name_offset + name_length].decode('utf-8')] = (offset, size, crc)
+    return assets
+
+def place_assets_v2(entries, data_offset, base_assets):
+    """
+    Choose the offset of every asset. The assets found unchanged in the base image keep their
+    offset, so the firmware skips their sectors when it downloads the new image. The other ones
+    go to the first gap that fits, in directory order.
+    """
+    offsets = {}
+    used = []
+    for name, blob, _, _ in entries:
+        old = base_assets.get(name) if base_assets else None
+        if old and old[0] >= data_offset and old[1] == len(blob) and old[2] == zlib.crc32(blob):
+            offsets[name] = old[0]
+            used.append((old[0], old[0] + len(blob)))
+    used.sort()
+    for name, blob, _, _ in entries:
+        if name in offsets:
+            continue
+        start = data_offset
+        for used_start, used_end in used:
+            if start + len(blob) <= used_start:
+                break
+            start = max(start, used_end + (-used_end % 4))
+        offsets[name] = start
+        used.append((start, start + len(blob)))
+        used.sort()
+    return offsets
+
+def build_layout_v2(files, base=None):
+    """
+    Build a v2 assets image.
+
+    Parameters:
+    - files (list): (name, data, width, height) of every asset.
+    - base (bytes): the image the devices have now, its unchanged assets keep their place.
+
+    Returns:
+    - (image, checksum, files in directory order)
+
+    Layout, all offsets from the start of the image:
+    - header: file_count, checksum, magic, length after the header, bucket_count, flags
+    - uint32 buckets[bucket_count + 1]: first entry of each bucket, the last one is the entry count
+    - entries, grouped by bucket (fnv1a(name) & (bucket_count - 1)):
+      hash, name_offset, offset, size, crc32, name_length (u16), width, height, padding
+    - names, NUL terminated
+    - asset data from the next 4 KB sector, each aligned to 4 bytes
+
+    Every entry carries the CRC32 of its data (ASSETS_V2_FLAG_CRC32), the firmware checks an asset
+    on its first use. The header checksum only covers the buckets, the entries and the names.
+    """
+    bucket_count = 1
+    while bucket_count < len(files):
+        bucket_count *= 2
+    bucket_of = lambda name: fnv1a_hash(name) & (bucket_count - 1)
+    entries = sorted(files, key=lambda f: (bucket_of(f[0]), f[0]))
+
+    buckets = [0] * (bucket_count + 1)
+    for name, _, _, _ in entries:
+        buckets[bucket_of(name) + 1] += 1
+    for i in range(bucket_count):
+        buckets[i + 1] += buckets[i]
+
+    names_offset = ASSETS_V2_HEADER_SIZE + (bucket_count + 1) * 4 + len(entries) * ASSETS_V2_ENTRY_SIZE
+    names = bytearray()
+    name_offsets = []
+    for name, _, _, _ in entries:
+        name_offsets.append(names_offset + len(names))
+        names.extend(name.encode('utf-8') + b'\0')
+    # The data starts on its own sector, so a slightly bigger directory does not move it
+    names.extend(b'\0' * (-(names_offset + len(names)) % ASSETS_SECTOR_SIZE))
+    data_offset = names_offset + len(names)
+
+    offsets = place_assets_v2(entries, data_offset, read_layout_v2(base) if base else None)
+    data_end = max([offsets[name] + len(blob) for name, blob, _, _ in entries], default=data_offset)
+    data = bytearray(data_end + (-data_end % 4) - data_offset)
+    directory = bytearray(struct.pack(f'<{bucket_count + 1}I', *buckets))
+    for (name, blob, width, height), name_offset in zip(entries, name_offsets):
+        offset = offsets[name]
+        directory.extend(struct.pack('<IIIIIHHHH', fnv1a_hash(name), name_offset, offset,
+                                     len(blob), zlib.crc32(blob), len(name.encode('utf-8')), width, height, 0))
+        data[offset - data_offset:offset - data_offset + len(blob)] = blob
+
+    body = directory + names + data
+    # The names are checked at boot along with the entries that point at them
+    checksum = compute_checksum(directory + names)
+    header = struct.pack('<IIIIII', len(entries), checksum, ASSETS_V2_MAGIC, len(body), bucket_count,
+                         ASSETS_V2_FLAG_CRC32)
+    return header + body, checksum, entries
+
+
+def pack_assets_simple(target_path, include_path, out_file, assets_path, max_name_len=32, layout_version=1):
     """
     Simplified version of pack_assets that handles basic file packing
     """
     merged_data = bytearray()
     file_info_list = []
+    files = []
     skip_files = ['config.json']
 
     # Ensure output directory exists
@@ -394,25 +520,30 @@ def pack_assets_simple(target_path, include_path, out_file, assets_path, max_nam
             bin_data = bin_file.read()
 
         merged_data.extend(bin_data)
+        files.append((file_name, bin_data, 0, 0))
 
     total_files = len(file_info_list)
 
-    mmap_table = bytearray()
-    for file_name, offset, file_size, width, height in file_info_list:
-        if len(file_name) > max_name_len:
-            print(f'Warning: "{file_name}" exceeds {max_name_len} bytes and will be truncated.')
-        fixed_name = file_name.ljust(max_name_len, '\0')[:max_name_len]
-        mmap_table.extend(fixed_name.encode('utf-8'))
-        mmap_table.extend(file_size.to_bytes(4, byteorder='little'))
-        mmap_table.extend(offset.to_bytes(4, byteorder='little'))
-        mmap_table.extend(width.to_bytes(2, byteorder='little'))
-        mmap_table.extend(height.to_bytes(2, byteorder='little'))
-
-    combined_data = mmap_table + merged_data
-    combined_checksum = compute_checksum(combined_data)
-    combined_data_length = len(combined_data).to_bytes(4, byteorder='little')
-    header_data = total_files.to_bytes(4, byteorder='little') + combined_checksum.to_bytes(4, byteorder='little')
-    final_data = header_data + combined_data_length + combined_data
+    if layout_version == 2:
+        final_data, combined_checksum, entries = build_layout_v2(files)
+        file_info_list = [(name, 0, len(data), width, height) for name, data, width, height in entries]
+    else:
+        mmap_table = bytearray()
+        for file_name, offset, file_size, width, height in file_info_list:
+            if len(file_name) > max_name_len:
+                print(f'Warning: "{file_name}" exceeds {max_name_len} bytes and will be truncated.')
+            fixed_name = file_name.ljust(max_name_len, '\0')[:max_name_len]
+            mmap_table.extend(fixed_name.encode('utf-8'))
+            mmap_table.extend(file_size.to_bytes(4, byteorder='little'))
+            mmap_table.extend(offset.to_bytes(4, byteorder='little'))
+            mmap_table.extend(width.to_bytes(2, byteorder='little'))
+            mmap_table.extend(height.to_bytes(2, byteorder='little'))
+
+        combined_data = mmap_table + merged_data
+        combined_checksum = compute_checksum(combined_data)
+        combined_data_length = len(combined_data).to_bytes(4, byteorder='little')
+        header_data = total_files.to_bytes(4, byteorder='little') + combined_checksum.to_bytes(4, byteorder='little')
+        final_data = header_data + combined_data_length + combined_data
 
     with open(out_file, 'wb') as output_bin:
         output_bin.write(final_data)
@@ -758,7 +889,7 @@ def get_emoji_collection_path(default_emoji_collection, emoji_path):
         return None
 
 
-def build_assets_integrated(wakenet_model_paths, multinet_model_paths, microwakeword_model_path, text_font_path, emoji_collection_path, extra_files_path, output_path, multinet_model_info=None):
+def build_assets_integrated(wakenet_model_paths, multinet_model_paths, microwakeword_model_path, text_font_path, emoji_collection_path, extra_files_path, output_path, multinet_model_info=None, layout_version=1):
     """
     Build assets using integrated functions (no external dependencies)
     """
@@ -786,7 +917,7 @@ def build_assets_integrated(wakenet_model_paths, multinet_model_paths, microwake
         generate_index_json(assets_dir, srmodels, mwwmodel, text_font, emoji_collection, extra_files, multinet_model_info)
         
         # Generate config.json for packing
-        config_path = generate_config_json(temp_build_dir, assets_dir)
+        config_path = generate_config_json(temp_build_dir, assets_dir, layout_version)
         
         # Load config and pack assets
         with open(config_path, 'r') as f:
@@ -795,7 +926,8 @@ def build_assets_integrated(wakenet_model_paths, multinet_model_paths, microwake
         # Use simplified packing function
         include_path = config_data['include_path']
         image_file = config_data['image_file']
-        pack_assets_simple(assets_dir, include_path, image_file, "assets", int(config_data['name_length']))
+        pack_assets_simple(assets_dir, include_path, image_file, "assets", int(config_data['name_length']),
+                           int(config_data.get('layout_version', 1)))
         
         # Copy final assets.bin to output location
         if os.path.exists(image_file):
@@ -830,6 +962,8 @@ def main():
     parser.add_argument('--esp_sr_model_path', help='Path to ESP-SR model directory')
     parser.add_argument('--xiaozhi_fonts_path', help='Path to xiaozhi-fonts component directory')
     parser.add_argument('--extra_files', help='Path to extra files directory to be included in assets')
+    parser.add_argument('--layout_version', type=int, choices=[1, 2], default=1,
+                        help='Partition layout, 2 (hashed directory, CRC32 per asset) is only read by newer firmware')
     
     args = parser.parse_args()
     
@@ -945,7 +1079,7 @@ def main():
     
     # Build the assets
     success = build_assets_integrated(wakenet_model_paths, multinet_model_paths, microwakeword_model_path, text_font_path, emoji_collection_path, 
-                                     extra_files_path, args.output, multinet_model_info)
+                                     extra_files_path, args.output, multinet_model_info, args.layout_version)
     
     if not success:
         sys.exit(1)
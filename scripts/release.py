@@ -1,6 +1,8 @@
 import sys
 import os
 import json
+import struct
+import zlib
 import zipfile
 import argparse
 from pathlib import Path
@@ -44,6 +46,24 @@ def merge_bin() -> None:
         sys.exit(1)
 
 
+# The firmware inflates this container while it downloads: magic, original size, window bits, then
+# a zlib stream. A small window bounds the RAM the device needs (see main/image_inflater.h).
+COMPRESSED_IMAGE_MAGIC = 0x474D495A  # 'ZIMG'
+COMPRESSED_IMAGE_WINDOW_BITS = 12
+
+
+def compress_app_bin(name: str, version: str) -> None:
+    """Compress the OTA image build/xiaozhi.bin to releases/v{version}_{name}.bin.z"""
+    data = Path("build/xiaozhi.bin").read_bytes()
+    compressor = zlib.compressobj(9, zlib.DEFLATED, COMPRESSED_IMAGE_WINDOW_BITS, 9)
+    stream = compressor.compress(data) + compressor.flush()
+    out_dir = Path("releases")
+    out_dir.mkdir(exist_ok=True)
+    output_path = out_dir / f"v{version}_{name}.bin.z"
+    output_path.write_bytes(struct.pack("<IIB3x", COMPRESSED_IMAGE_MAGIC, len(data), COMPRESSED_IMAGE_WINDOW_BITS) + stream)
+    print(f"compress bin to {output_path} done, {len(stream) + 12} of {len(data)} bytes")
+
+
 def zip_bin(name: str, version: str) -> None:
     """Zip build/merged-binary.bin to releases/v{version}_{name}.zip"""
     out_dir = Path("releases")
@@ -240,6 +260,7 @@ def release(board_type: str, config_filename: str = "config.json", *, filter_nam
 
         # Zip
         zip_bin(name, project_version)
+        compress_app_bin(name, project_version)
 
 ################################################################################
 # CLI entry
@@ -274,6 +295,7 @@ if __name__ == "__main__":
             sys.exit(1)
         project_ver = get_project_version()
         zip_bin(curr_board_type, project_ver)
+        compress_app_bin(curr_board_type, project_ver)
         sys.exit(0)
 
     # Compile mode
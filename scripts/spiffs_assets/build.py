@@ -305,7 +305,7 @@ def generate_index_json(assets_dir, srmodels, text_font, emoji_collection, icon_
     print(f"Generated: {index_path}")
 
 
-def generate_config_json(build_dir, assets_dir):
+def generate_config_json(build_dir, assets_dir, base_assets=None, compress=False, layout_version=1):
     """Generate config.json file"""
     # Get absolute path of current working directory
     workspace_dir = os.path.abspath(os.path.join(os.path.dirname(__file__)))
@@ -318,6 +318,9 @@ def generate_config_json(build_dir, assets_dir):
         "assets_size": "0x400000",
         "support_format": ".png, .gif, .jpg, .bin, .json, .eaf",
         "name_length": "32",
+        "layout_version": layout_version,
+        "base_image": os.path.abspath(base_assets) if base_assets else "",
+        "compress": compress,
         "split_height": "0",
         "support_qoi": False,
         "support_spng": False,
@@ -345,8 +348,14 @@ def main():
 
     parser.add_argument('--res_path', help='Path to res directory')
     parser.add_argument('--target_board', help='Path to target board directory')
+    parser.add_argument('--base_assets', help='Previous assets.bin, its unchanged assets keep their offsets for delta downloads')
+    parser.add_argument('--compress', action='store_true', help='Also write assets.bin.z, inflated by the firmware while it downloads')
+    parser.add_argument('--layout_version', type=int, choices=[1, 2], default=1,
+                        help='Partition layout, 2 (hashed directory, CRC32 per asset) is only read by newer firmware')
     
     args = parser.parse_args()
+    if args.base_assets and args.layout_version != 2:
+        parser.error('--base_assets needs --layout_version 2')
     
     # Get script directory
     script_dir = os.path.dirname(os.path.abspath(__file__))
@@ -378,7 +387,7 @@ def main():
     generate_index_json(assets_dir, srmodels, text_font, emoji_collection, icon_collection, layout_json)
     
     # Generate config.json
-    config_path = generate_config_json(build_dir, assets_dir)
+    config_path = generate_config_json(build_dir, assets_dir, args.base_assets, args.compress, args.layout_version)
     
     # Use spiffs_assets_gen.py to package final build/assets.bin
     try:
@@ -393,6 +402,8 @@ def main():
     
     # Copy build/output/assets.bin to build/assets.bin
     shutil.copy(os.path.join(build_dir, "output", "assets.bin"), os.path.join(build_dir, "assets.bin"))
+    if args.compress:
+        shutil.copy(os.path.join(build_dir, "output", "assets.bin.z"), os.path.join(build_dir, "assets.bin.z"))
     print("Build completed!")
 
 
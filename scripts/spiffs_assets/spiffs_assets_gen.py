@@ -6,6 +6,8 @@ import argparse
 import json
 import shutil
 import math
+import struct
+import zlib
 import sys
 import time
 import numpy as np
@@ -45,6 +47,22 @@ class PackModelsConfig:
     image_file: str
     assets_path: str
     name_length: int
+    layout_version: int = 1
+    base_image: str = ''
+    compress: bool = False
+
+# The v2 layout stores a hashed directory the firmware searches in place. Its magic sits where
+# v1 keeps the table length, so firmware without v2 support rejects the partition.
+ASSETS_V2_MAGIC = 0x32545341  # 'AST2'
+ASSETS_V2_HEADER_SIZE = 24
+ASSETS_V2_ENTRY_SIZE = 28
+ASSETS_V2_FLAG_CRC32 = 0x1
+ASSETS_SECTOR_SIZE = 4096
+
+# A compressed image the firmware inflates while it downloads: magic, original size, window bits,
+# then a zlib stream. A small window bounds the RAM the device needs.
+COMPRESSED_IMAGE_MAGIC = 0x474D495A  # 'ZIMG'
+COMPRESSED_IMAGE_WINDOW_BITS = 12
 
 def generate_header_filename(path):
     asset_name = os.path.basename(path)
@@ -60,6 +78,131 @@ def sort_key(filename):
     basename, extension = os.path.splitext(filename)
     return extension, basename
 
+def fnv1a_hash(name):
+    value = 0x811C9DC5
+    for byte in name.encode('utf-8'):
+        value = ((value ^ byte) * 0x01000193) & 0xFFFFFFFF
+    return value
+
+def read_layout_v2(image):
+    """
+    Read the directory of a v2 image with CRC32s.
+
+    Returns:
+    - {name: (offset, size, crc32)}, or None if the image is not one
+    """
+    if len(image) < ASSETS_V2_HEADER_SIZE:
+        return None
+    file_count, _, magic, _, bucket_count, flags = struct.unpack_from('<IIIIII', image)
+    if magic != ASSETS_V2_MAGIC or not flags & ASSETS_V2_FLAG_CRC32:
+        return None
+    entries_offset = ASSETS_V2_HEADER_SIZE + (bucket_count + 1) * 4
+    assets = {}
+    for i in range(file_count):
+        _, name_offset, offset, size, crc, name_length, _, _, _ = struct.unpack_from(
+            '<IIIIIHHHH', image, entries_offset + i * ASSETS_V2_ENTRY_SIZE)
+        assets[image[name_offset:name_offset + name_length].decode('utf-8')] = (offset, size, crc)
+    return assets
+
+def place_assets_v2(entries, data_offset, base_assets):
+    """
+    Choose the offset of every asset. The assets found unchanged in the base image keep their
+    offset, so the firmware skips their sectors when it downloads the new image. The other ones
+    go to the first gap that fits, in directory order.
+    """
+    offsets = {}
+    used = []
+    for name, blob, _, _ in entries:
+        old = base_assets.get(name) if base_assets else None
+        if old and old[0] >= data_offset and old[1] == len(blob) and old[2] == zlib.crc32(blob):
+            offsets[name] = old[0]
+            used.append((old[0], old[0] + len(blob)))
+    used.sort()
+    for name, blob, _, _ in entries:
+        if name in offsets:
+            continue
+        start = data_offset
+        for used_start, used_end in used:
+            if start + len(blob) <= used_start:
+                break
+            start = max(start, used_end + (-used_end % 4))
+        offsets[name] = start
+        used.append((start, start + len(blob)))
+        used.sort()
+    return offsets
+
+def build_layout_v2(files, base=None):
+    """
+    Build a v2 assets image.
+
+    Parameters:
+    - files (list): (name, data, width, height) of every asset.
+    - base (bytes): the image the devices have now, its unchanged assets keep their place.
+
+    Returns:
+    - (image, checksum, files in directory order)
+
+    Layout, all offsets from the start of the image:
+    - header: file_count, checksum, magic, length after the header, bucket_count, flags
+    - uint32 buckets[bucket_count + 1]: first entry of each bucket, the last one is the entry count
+    - entries, grouped by bucket (fnv1a(name) & (bucket_count - 1)):
+      hash, name_offset, offset, size, crc32, name_length (u16), width, height, padding
+    - names, NUL terminated
+    - asset data from the next 4 KB sector, each aligned to 4 bytes
+
+    Every entry carries the CRC32 of its data (ASSETS_V2_FLAG_CRC32), the firmware checks an asset
+    on its first use. The header checksum only covers the buckets, the entries and the names.
+    """
+    bucket_count = 1
+    while bucket_count < len(files):
+        bucket_count *= 2
+    bucket_of = lambda name: fnv1a_hash(name) & (bucket_count - 1)
+    entries = sorted(files, key=lambda f: (bucket_of(f[0]), f[0]))
+
+    buckets = [0] * (bucket_count + 1)
+    for name, _, _, _ in entries:
+        buckets[bucket_of(name) + 1] += 1
+    for i in range(bucket_count):
+        buckets[i + 1] += buckets[i]
+
+    names_offset = ASSETS_V2_HEADER_SIZE + (bucket_count + 1) * 4 + len(entries) * ASSETS_V2_ENTRY_SIZE
+    names = bytearray()
+    name_offsets = []
+    for name, _, _, _ in entries:
+        name_offsets.append(names_offset + len(names))
+        names.extend(name.encode('utf-8') + b'\0')
+    # The data starts on its own sector, so a slightly bigger directory does not move it
+    names.extend(b'\0' * (-(names_offset + len(names)) % ASSETS_SECTOR_SIZE))
+    data_offset = names_offset + len(names)
+
+    offsets = place_assets_v2(entries, data_offset, read_layout_v2(base) if base else None)
+    data_end = max([offsets[name] + len(blob) for name, blob, _, _ in entries], default=data_offset)
+    data = bytearray(data_end + (-data_end % 4) - data_offset)
+    directory = bytearray(struct.pack(f'<{bucket_count + 1}I', *buckets))
+    for (name, blob, width, height), name_offset in zip(entries, name_offsets):
+        offset = offsets[name]
+        directory.extend(struct.pack('<IIIIIHHHH', fnv1a_hash(name), name_offset, offset,
+                                     len(blob), zlib.crc32(blob), len(name.encode('utf-8')), width, height, 0))
+        data[offset - data_offset:offset - data_offset + len(blob)] = blob
+
+    body = directory + names + data
+    # The names are checked at boot along with the entries that point at them
+    checksum = compute_checksum(directory + names)
+    header = struct.pack('<IIIIII', len(entries), checksum, ASSETS_V2_MAGIC, len(body), bucket_count,
+                         ASSETS_V2_FLAG_CRC32)
+    return header + body, checksum, entries
+
+def compress_image(data, window_bits=COMPRESSED_IMAGE_WINDOW_BITS):
+    """
+    Wrap an image in the compressed container the firmware downloads (see main/image_inflater.h).
+    """
+    # The firmware takes 9 to 15 bits, zlib writes a 9 bit stream when asked for 8
+    if not 9 <= window_bits <= 15:
+        raise ValueError(f'window_bits must be between 9 and 15, not {window_bits}')
+    compressor = zlib.compressobj(9, zlib.DEFLATED, window_bits, 9)
+    stream = compressor.compress(data) + compressor.flush()
+    return struct.pack('<IIB3x', COMPRESSED_IMAGE_MAGIC, len(data), window_bits) + stream
+
 def download_v8_script(convert_path):
     """
     Ensure that the lvgl_image_converter repository is present at the specified path.
@@ -401,6 +544,7 @@ def pack_assets(config: PackModelsConfig):
 
     merged_data = bytearray()
     file_info_list = []
+    files = []
     skip_files = ['config.json', 'lvgl_image_converter']
 
     file_list = sorted(os.listdir(target_path), key=sort_key)
@@ -437,29 +581,45 @@ def pack_assets(config: PackModelsConfig):
             bin_data = bin_file.read()
 
         merged_data.extend(bin_data)
+        files.append((file_name, bin_data, width, height))
 
     total_files = len(file_info_list)
 
-    mmap_table = bytearray()
-    for file_name, offset, file_size, width, height in file_info_list:
-        if len(file_name) > int(max_name_len):
-            print(f'\033[1;33mWarn:\033[0m "{file_name}" exceeds {max_name_len} bytes and will be truncated.')
-        fixed_name = file_name.ljust(int(max_name_len), '\0')[:int(max_name_len)]
-        mmap_table.extend(fixed_name.encode('utf-8'))
-        mmap_table.extend(file_size.to_bytes(4, byteorder='little'))
-        mmap_table.extend(offset.to_bytes(4, byteorder='little'))
-        mmap_table.extend(width.to_bytes(2, byteorder='little'))
-        mmap_table.extend(height.to_bytes(2, byteorder='little'))
-
-    combined_data = mmap_table + merged_data
-    combined_checksum = compute_checksum(combined_data)
-    combined_data_length = len(combined_data).to_bytes(4, byteorder='little')
-    header_data = total_files.to_bytes(4, byteorder='little') + combined_checksum.to_bytes(4, byteorder='little')
-    final_data = header_data + combined_data_length + combined_data
+    if int(config.layout_version) == 2:
+        base = None
+        if config.base_image:
+            with open(config.base_image, 'rb') as f:
+                base = f.read()
+        final_data, combined_checksum, entries = build_layout_v2(files, base)
+        file_info_list = [(name, 0, len(data), width, height) for name, data, width, height in entries]
+    else:
+        mmap_table = bytearray()
+        for file_name, offset, file_size, width, height in file_info_list:
+            if len(file_name) > int(max_name_len):
+                print(f'\033[1;33mWarn:\033[0m "{file_name}" exceeds {max_name_len} bytes and will be truncated.')
+            fixed_name = file_name.ljust(int(max_name_len), '\0')[:int(max_name_len)]
+            mmap_table.extend(fixed_name.encode('utf-8'))
+            mmap_table.extend(file_size.to_bytes(4, byteorder='little'))
+            mmap_table.extend(offset.to_bytes(4, byteorder='little'))
+            mmap_table.extend(width.to_bytes(2, byteorder='little'))
+            mmap_table.extend(height.to_bytes(2, byteorder='little'))
+
+        combined_data = mmap_table + merged_data
+        combined_checksum = compute_checksum(combined_data)
+        combined_data_length = len(combined_data).to_bytes(4, byteorder='little')
+        header_data = total_files.to_bytes(4, byteorder='little') + combined_checksum.to_bytes(4, byteorder='little')
+        final_data = header_data + combined_data_length + combined_data
 
     with open(out_file, 'wb') as output_bin:
         output_bin.write(final_data)
 
+    if config.compress:
+        compressed_data = compress_image(final_data)
+        with open(out_file + '.z', 'wb') as output_bin:
+            output_bin.write(compressed_data)
+        print(f'Compressed {os.path.basename(out_file)}.z: {len(compressed_data)} of {len(final_data)} bytes '
+              f'({len(compressed_data) * 100 // max(len(final_data), 1)}%)')
+
     os.makedirs(assets_include_path, exist_ok=True)
     current_year = datetime.now().year
 
@@ -557,7 +717,10 @@ def process_assets_build(config_data):
         include_path=include_path,
         image_file=image_file,
         assets_path=assets_path,
-        name_length=name_length
+        name_length=name_length,
+        layout_version=int(config_data.get('layout_version', 1)),
+        base_image=config_data.get('base_image', ''),
+        compress=bool(config_data.get('compress', False))
     )
 
     print('--support_format:', support_format)
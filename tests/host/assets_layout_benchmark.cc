@@ -0,0 +1,143 @@
+/*
+ * The boot check of a v2 assets image made by the packer of scripts/build_default_assets.py: the
+ * header checksum over the directory and the names, the lookup of every asset and its CRC32, next
+ * to the byte by byte sum of the whole image the boot used to do. Also shows the CRC32 time of the
+ * speech model and the font, which Assets::Apply() leaves to the verification task.
+ *
+ *   assets_layout_benchmark <assets.bin>
+ */
+#include "assets_layout.h"
+#include "host_test.h"
+
+#include <zlib.h>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static std::string ReadFile(const char* path) {
+    std::string data;
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr) {
+        return data;
+    }
+    char buffer[65536];
+    size_t size;
+    while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        data.append(buffer, size);
+    }
+    fclose(file);
+    return data;
+}
+
+// Assets::CalculateChecksum() before the word wide sum
+static uint32_t ReferenceChecksum(const char* data, size_t length) {
+    uint32_t checksum = 0;
+    for (size_t i = 0; i < length; i++) {
+        checksum += (uint8_t)data[i];
+    }
+    return checksum & 0xFFFF;
+}
+
+static uint32_t Crc32(const char* data, size_t size) {
+    return crc32(0, (const Bytef*)data, size);
+}
+
+static std::string_view NameOf(const std::string& image, const assets_entry_v2& entry) {
+    return std::string_view(image.data() + entry.name_offset, entry.name_length);
+}
+
+static void TestImage(const std::string& image) {
+    auto header = (const assets_header_v2*)image.data();
+    CHECK(header->magic == ASSETS_V2_MAGIC);
+    CHECK((header->flags & ASSETS_V2_FLAG_CRC32) != 0);
+    CHECK(sizeof(assets_header_v2) + header->length == image.size());
+
+    size_t checked_end = AssetsChecksumEndV2(image.data(), image.size());
+    CHECK(AssetsChecksum(image.data() + sizeof(assets_header_v2), checked_end - sizeof(assets_header_v2)) ==
+        header->checksum);
+    // The word wide sum is the byte sum, at any alignment
+    for (size_t shift = 0; shift < 4; shift++) {
+        CHECK(AssetsChecksum(image.data() + shift, 100000 + shift) == ReferenceChecksum(image.data() + shift, 100000 + shift));
+    }
+
+    auto entries = EntriesV2(image.data() + sizeof(assets_header_v2), header->bucket_count);
+    for (uint32_t i = 0; i < header->file_count; i++) {
+        auto name = NameOf(image, entries[i]);
+        CHECK(FindAssetEntryV2(image.data(), image.size(), name) == (int)i);
+        CHECK(Crc32(image.data() + entries[i].offset, entries[i].size) == entries[i].crc32);
+        // The names are covered by the header checksum
+        CHECK(entries[i].name_offset + entries[i].name_length <= checked_end);
+    }
+    CHECK(FindAssetEntryV2(image.data(), image.size(), "index.jso") < 0);
+    CHECK(FindAssetEntryV2(image.data(), image.size(), "missing.png") < 0);
+
+    // A corrupt name fails the boot check, corrupt data only fails the CRC32 of its asset
+    std::string corrupt = image;
+    corrupt[entries[0].name_offset] ^= 0x20;
+    CHECK(AssetsChecksum(corrupt.data() + sizeof(assets_header_v2), checked_end - sizeof(assets_header_v2)) !=
+        header->checksum);
+    corrupt = image;
+    corrupt[entries[0].offset + entries[0].size / 2] ^= 0x20;
+    CHECK(AssetsChecksum(corrupt.data() + sizeof(assets_header_v2), checked_end - sizeof(assets_header_v2)) ==
+        header->checksum);
+    CHECK(Crc32(corrupt.data() + entries[0].offset, entries[0].size) != entries[0].crc32);
+}
+
+static void Benchmark(const std::string& image) {
+    auto header = (const assets_header_v2*)image.data();
+    size_t body = image.size() - sizeof(assets_header_v2);
+    size_t checked = AssetsChecksumEndV2(image.data(), image.size()) - sizeof(assets_header_v2);
+    const char* data = image.data() + sizeof(assets_header_v2);
+    volatile uint32_t sink = 0;
+
+    double byte_sum_us = MeasureUs(3, [&]() { sink = ReferenceChecksum(data, body); });
+    double word_sum_us = MeasureUs(3, [&]() { sink = AssetsChecksum(data, body); });
+    double directory_us = MeasureUs(1000, [&]() { sink = AssetsChecksum(data, checked); });
+    printf("%zu KB, %lu assets: byte sum of the image %.0f us, word sum %.0f us, "
+        "boot check of the directory and names (%zu bytes) %.1f us\n",
+        image.size() / 1024, (unsigned long)header->file_count, byte_sum_us, word_sum_us, checked, directory_us);
+
+    auto entries = EntriesV2(data, header->bucket_count);
+    std::vector<std::string> names;
+    for (uint32_t i = 0; i < header->file_count; i++) {
+        names.emplace_back(NameOf(image, entries[i]));
+    }
+    double lookup_us = MeasureUs(1000, [&]() {
+        for (auto& name : names) {
+            sink = FindAssetEntryV2(image.data(), image.size(), name);
+        }
+    });
+    printf("Lookup %.3f us per asset\n", lookup_us / names.size());
+
+    size_t deferred_size = 0, other_size = 0;
+    double deferred_us = 0, other_us = 0;
+    for (uint32_t i = 0; i < header->file_count; i++) {
+        auto& entry = entries[i];
+        double us = MeasureUs(1, [&]() { sink = Crc32(image.data() + entry.offset, entry.size); });
+        auto name = NameOf(image, entry);
+        // As the index.json of the packer names them
+        if (name == "srmodels.bin" || name.substr(0, 5) == "font_") {
+            deferred_size += entry.size;
+            deferred_us += us;
+        } else {
+            other_size += entry.size;
+            other_us += us;
+        }
+    }
+    printf("CRC32 of srmodels and the font (%zu KB) %.0f us, left to the verification task; "
+        "other assets (%zu KB) %.0f us, checked on first use\n", deferred_size / 1024, deferred_us,
+        other_size / 1024, other_us);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <assets.bin>\n", argv[0]);
+        return 1;
+    }
+    std::string image = ReadFile(argv[1]);
+    CHECK(image.size() >= sizeof(assets_header_v2));
+    TestImage(image);
+    Benchmark(image);
+    printf("assets_layout: OK\n");
+    return 0;
+}
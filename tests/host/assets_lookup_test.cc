@@ -0,0 +1,159 @@
+/*
+ * The asset lookup of both layouts over images made by the packer of scripts/build_default_assets.py
+ * from the same files: the v1 table scanned in place, the v2 hashed directory, and the std::map the
+ * boot used to build from the v1 table. Counts what each takes from the heap and times the lookups.
+ *
+ *   assets_lookup_test <assets_v1.bin> <assets_v2.bin>
+ */
+#include "assets_layout.h"
+#include "host_test.h"
+
+#include <cstring>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+
+static size_t heap_allocations = 0;
+static size_t heap_bytes = 0;
+
+void* operator new(size_t size) {
+    heap_allocations++;
+    heap_bytes += size;
+    void* ptr = malloc(size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+static std::string ReadFile(const char* path) {
+    std::string data;
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr) {
+        return data;
+    }
+    char buffer[65536];
+    size_t size;
+    while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        data.append(buffer, size);
+    }
+    fclose(file);
+    return data;
+}
+
+// What Assets::InitializePartition() built before the v2 layout
+struct Asset {
+    size_t size;
+    size_t offset;
+};
+
+static std::map<std::string, Asset> BuildMapV1(const std::string& image) {
+    std::map<std::string, Asset> assets;
+    uint32_t file_count = *(const uint32_t*)image.data();
+    for (uint32_t i = 0; i < file_count; i++) {
+        auto item = (const mmap_assets_table*)(image.data() + 12 + i * sizeof(mmap_assets_table));
+        assets[item->asset_name] = Asset{
+            .size = static_cast<size_t>(item->asset_size),
+            .offset = static_cast<size_t>(12 + sizeof(mmap_assets_table) * file_count + item->asset_offset)
+        };
+    }
+    return assets;
+}
+
+static std::vector<std::string> NamesV2(const std::string& image) {
+    auto header = (const assets_header_v2*)image.data();
+    auto entries = EntriesV2(image.data() + sizeof(assets_header_v2), header->bucket_count);
+    std::vector<std::string> names;
+    for (uint32_t i = 0; i < header->file_count; i++) {
+        names.emplace_back(image.data() + entries[i].name_offset, entries[i].name_length);
+    }
+    return names;
+}
+
+static void TestLookup(const std::string& v1, const std::string& v2, const std::vector<std::string>& names) {
+    auto header = (const assets_header_v2*)v2.data();
+    CHECK(header->magic == ASSETS_V2_MAGIC);
+    CHECK(*(const uint32_t*)v1.data() == header->file_count);
+    auto entries = EntriesV2(v2.data() + sizeof(assets_header_v2), header->bucket_count);
+
+    size_t allocations = heap_allocations;
+    for (auto& name : names) {
+        size_t size = 0;
+        auto data = FindAssetDataV1(v1.data(), v1.size(), name, size);
+        int index = FindAssetEntryV2(v2.data(), v2.size(), name);
+        CHECK(data != nullptr && index >= 0);
+        // The same asset in both layouts
+        CHECK(size == entries[index].size);
+        CHECK(memcmp(data, v2.data() + entries[index].offset, size) == 0);
+    }
+    size_t size;
+    CHECK(FindAssetDataV1(v1.data(), v1.size(), "missing.png", size) == nullptr);
+    CHECK(FindAssetDataV1(v1.data(), v1.size(), "index.jso", size) == nullptr);
+    CHECK(FindAssetEntryV2(v2.data(), v2.size(), "missing.png") < 0);
+    // Nothing is taken from the heap to search either layout
+    CHECK(heap_allocations == allocations);
+
+    // A damaged v1 asset is refused at its 'ZZ'
+    std::string corrupt = v1;
+    auto data = FindAssetDataV1(corrupt.data(), corrupt.size(), names[0], size);
+    corrupt[data - 2 - corrupt.data()] = 'Y';
+    CHECK(FindAssetDataV1(corrupt.data(), corrupt.size(), names[0], size) == nullptr);
+}
+
+static void Benchmark(const std::string& v1, const std::string& v2, const std::vector<std::string>& names) {
+    size_t allocations = heap_allocations, bytes = heap_bytes;
+    auto assets = BuildMapV1(v1);
+    allocations = heap_allocations - allocations;
+    bytes = heap_bytes - bytes;
+    double build_us = MeasureUs(100, [&]() { BuildMapV1(v1); });
+    // The v2 boot only keeps a state byte per asset for its CRC32, the directory stays in flash
+    printf("%zu assets. Boot: std::map of the v1 table %zu allocations, %zu bytes, %.1f us; "
+        "in place search 0 allocations, v2 CRC32 states %zu bytes\n", names.size(), allocations, bytes, build_us,
+        names.size());
+
+    volatile size_t sink = 0;
+    double map_us = MeasureUs(1000, [&]() {
+        for (auto& name : names) {
+            sink = assets.find(name)->second.offset;
+        }
+    });
+    double v1_us = MeasureUs(1000, [&]() {
+        size_t size;
+        for (auto& name : names) {
+            FindAssetDataV1(v1.data(), v1.size(), name, size);
+            sink = size;
+        }
+    });
+    double v2_us = MeasureUs(1000, [&]() {
+        for (auto& name : names) {
+            sink = FindAssetEntryV2(v2.data(), v2.size(), name);
+        }
+    });
+    printf("Lookup per asset: std::map %.3f us, v1 scan %.3f us, v2 hash %.3f us\n", map_us / names.size(),
+        v1_us / names.size(), v2_us / names.size());
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <assets_v1.bin> <assets_v2.bin>\n", argv[0]);
+        return 1;
+    }
+    std::string v1 = ReadFile(argv[1]);
+    std::string v2 = ReadFile(argv[2]);
+    CHECK(v1.size() >= 12 && v2.size() >= sizeof(assets_header_v2));
+    auto names = NamesV2(v2);
+    CHECK(!names.empty());
+    TestLookup(v1, v2, names);
+    Benchmark(v1, v2, names);
+    printf("assets_lookup: OK\n");
+    return 0;
+}
@@ -0,0 +1,92 @@
+/*
+ * Counts the heap allocations of the AudioService tasks once the pipeline is warm: the mic, the
+ * encoder, the send queue, the looped back decode queue, the jitter buffer and the speaker must
+ * not allocate per frame. Nor after a barge-in, whose ResetDecoder() discards the queued and the
+ * buffered packets: they go back to their pools.
+ */
+#include "audio_loopback.h"
+#include "host_test.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <new>
+#include <thread>
+
+#define WARMUP_SECONDS 2
+#define COUNTED_SECONDS 4
+#define BARGE_IN_SECONDS 3
+#define BARGE_IN_INTERVAL_MS 300
+// Within the packets the decode pool allocates up front
+#define BARGE_IN_BURST (DECODE_PACKET_POOL_SIZE / 2 - 4)
+
+static std::atomic<bool> counting = false;
+static std::atomic<size_t> allocations = 0;
+
+void* operator new(size_t size) {
+    if (counting.load(std::memory_order_relaxed)) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    void* p = malloc(size ? size : 1);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+int main() {
+    host_time_scale = 8;
+    std::vector<int16_t> input(16000 * (WARMUP_SECONDS + COUNTED_SECONDS + BARGE_IN_SECONDS + 1));
+    for (size_t i = 0; i < input.size(); i++) {
+        input[i] = (int16_t)(8000 * sin(2 * M_PI * 440 * i / 16000));
+    }
+    FileAudioCodec codec(input, 16000);
+    codec.ReserveOutput((WARMUP_SECONDS + COUNTED_SECONDS + BARGE_IN_SECONDS + 1) * OUTPUT_SAMPLE_RATE);
+    Board::GetInstance().SetAudioCodec(&codec);
+    AudioService audio_service;
+    AudioLoopback loopback(audio_service);
+    audio_service.Initialize(&codec);
+    audio_service.Start();
+    audio_service.EnableVoiceProcessing(true);
+
+    loopback.Run(HostClockUs() + WARMUP_SECONDS * 1000000);
+    uint32_t warm_sequence = loopback.sequence();
+    size_t warm_output = codec.output().size();
+    counting = true;
+    loopback.Run(HostClockUs() + COUNTED_SECONDS * 1000000);
+    counting = false;
+    uint32_t frames = loopback.sequence() - warm_sequence;
+    size_t output = codec.output().size() - warm_output;
+    size_t steady_allocations = allocations.exchange(0);
+
+    // Barge in while a burst of downlink audio is buffered
+    counting = true;
+    for (int i = 0; i < BARGE_IN_SECONDS * 1000 / BARGE_IN_INTERVAL_MS; i++) {
+        loopback.Run(HostClockUs() + BARGE_IN_INTERVAL_MS * 1000);
+        loopback.Burst(BARGE_IN_BURST);
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        audio_service.ResetDecoder();
+    }
+    counting = false;
+    size_t barge_in_allocations = allocations.load();
+
+    audio_service.Stop();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    printf("%u frames sent and played back (%zu samples) with %zu allocations, %d barge-ins with %zu allocations\n",
+        frames, output, steady_allocations, BARGE_IN_SECONDS * 1000 / BARGE_IN_INTERVAL_MS, barge_in_allocations);
+    CHECK(frames >= COUNTED_SECONDS * 1000 / OPUS_FRAME_DURATION_MS * 3 / 4);
+    CHECK(output >= COUNTED_SECONDS * OUTPUT_SAMPLE_RATE * 3 / 4);
+    CHECK(steady_allocations == 0);
+    CHECK(barge_in_allocations == 0);
+    printf("audio_allocation: OK\n");
+    return 0;
+}
@@ -0,0 +1,151 @@
+/*
+ * AudioCipher against the NIST AES-128-CTR vectors, and its packets per second next to the
+ * per-packet code it replaced, which copied the nonce into a string and encrypted into another
+ * one. mbedtls runs over OpenSSL here (shims/mbedtls_shim.cc) with the block by block CTR loop
+ * of the software mbedtls, so the absolute numbers are the host's, the difference is the buffers.
+ */
+#include "audio_cipher.h"
+#include "host_test.h"
+
+#include <arpa/inet.h>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static std::vector<uint8_t> FromHex(const char* hex) {
+    std::vector<uint8_t> bytes;
+    for (size_t i = 0; hex[i] && hex[i + 1]; i += 2) {
+        bytes.push_back(std::stoi(std::string(hex + i, 2), nullptr, 16));
+    }
+    return bytes;
+}
+
+static std::string ToString(const std::vector<uint8_t>& bytes) {
+    return std::string(bytes.begin(), bytes.end());
+}
+
+// NIST SP 800-38A F.5.1 and F.5.2
+static void TestVectors() {
+    auto key = FromHex("2b7e151628aed2a6abf7158809cf4f3c");
+    auto counter = FromHex("f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff");
+    auto plaintext = FromHex("6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e51"
+        "30c81c46a35ce411e5fbc1191a0a52eff69f2445df4f9b17ad2b417be66c3710");
+    auto ciphertext = FromHex("874d6191b620e3261bef6864990db6ce9806f66b7970fdff8617187bb9fffdff"
+        "5ae4df3edbd5d35e5b4f09020db03eab1e031dda2fbe03d1792170a0f3009cee");
+
+    AudioCipher cipher;
+    CHECK(cipher.Configure(ToString(key), ToString(counter)));
+    std::vector<uint8_t> out(plaintext.size());
+    CHECK(cipher.Decrypt(counter.data(), plaintext.data(), plaintext.size(), out.data()));
+    CHECK(out == ciphertext);
+    // In place, and a length that is not a multiple of the block size
+    out = ciphertext;
+    CHECK(cipher.Decrypt(counter.data(), out.data(), 41, out.data()));
+    CHECK(memcmp(out.data(), plaintext.data(), 41) == 0);
+    CHECK(memcmp(out.data() + 41, ciphertext.data() + 41, out.size() - 41) == 0);
+
+    AudioCipher unconfigured;
+    CHECK(!unconfigured.Decrypt(counter.data(), plaintext.data(), plaintext.size(), out.data()));
+    CHECK(!cipher.Configure(ToString(key), "short"));
+    CHECK(!cipher.Configure("short", ToString(counter)));
+}
+
+static void TestPacket() {
+    auto key = FromHex("000102030405060708090a0b0c0d0e0f");
+    auto nonce = FromHex("01000000112233440000000000000000");
+    AudioCipher cipher;
+    CHECK(cipher.Configure(ToString(key), ToString(nonce)));
+
+    std::vector<uint8_t> payload(123);
+    for (size_t i = 0; i < payload.size(); i++) {
+        payload[i] = i * 7;
+    }
+    std::vector<uint8_t> datagram(AUDIO_CIPHER_NONCE_SIZE + payload.size());
+    CHECK(cipher.Encrypt(payload.data(), payload.size(), 0x01020304, 42, datagram.data()));
+    // |type 1u|flags 1u|payload_len 2u|ssrc 4u|timestamp 4u|sequence 4u|
+    uint16_t payload_len;
+    uint32_t ssrc, timestamp, sequence;
+    memcpy(&payload_len, &datagram[2], 2);
+    memcpy(&ssrc, &datagram[4], 4);
+    memcpy(&timestamp, &datagram[8], 4);
+    memcpy(&sequence, &datagram[12], 4);
+    CHECK(datagram[0] == 0x01);
+    CHECK(ntohs(payload_len) == payload.size());
+    CHECK(memcmp(&ssrc, &nonce[4], 4) == 0);
+    CHECK(ntohl(timestamp) == 0x01020304);
+    CHECK(ntohl(sequence) == 42);
+    CHECK(memcmp(datagram.data() + AUDIO_CIPHER_NONCE_SIZE, payload.data(), payload.size()) != 0);
+
+    std::vector<uint8_t> decrypted(payload.size());
+    CHECK(cipher.Decrypt(datagram.data(), datagram.data() + AUDIO_CIPHER_NONCE_SIZE, payload.size(), decrypted.data()));
+    CHECK(decrypted == payload);
+}
+
+// MqttProtocol::SendAudio() before AudioCipher
+static std::string ReferenceEncrypt(mbedtls_aes_context& context, const std::string& aes_nonce,
+    const std::vector<uint8_t>& payload, uint32_t timestamp, uint32_t sequence) {
+    std::string nonce(aes_nonce);
+    *(uint16_t*)&nonce[2] = htons(payload.size());
+    *(uint32_t*)&nonce[8] = htonl(timestamp);
+    *(uint32_t*)&nonce[12] = htonl(sequence);
+
+    std::string encrypted;
+    encrypted.resize(aes_nonce.size() + payload.size());
+    memcpy(encrypted.data(), nonce.data(), nonce.size());
+
+    size_t nc_off = 0;
+    uint8_t stream_block[16] = {0};
+    mbedtls_aes_crypt_ctr(&context, payload.size(), &nc_off, (uint8_t*)nonce.c_str(), stream_block,
+        payload.data(), (uint8_t*)&encrypted[nonce.size()]);
+    return encrypted;
+}
+
+static void Benchmark(size_t payload_size, int frame_duration) {
+    auto key = ToString(FromHex("000102030405060708090a0b0c0d0e0f"));
+    auto nonce = ToString(FromHex("01000000112233440000000000000000"));
+    AudioCipher cipher;
+    CHECK(cipher.Configure(key, nonce));
+    mbedtls_aes_context context;
+    mbedtls_aes_init(&context);
+    mbedtls_aes_setkey_enc(&context, (const unsigned char*)key.data(), 128);
+
+    std::vector<uint8_t> payload(payload_size, 0x5a);
+    std::string send_buffer;
+    std::vector<uint8_t> decrypted;
+    uint32_t sequence = 0;
+    std::string reference;
+
+    double encrypt_us = MeasureUs(20000, [&]() {
+        // As SendAudio() does, the datagram buffer keeps its capacity
+        send_buffer.resize(AUDIO_CIPHER_NONCE_SIZE + payload.size());
+        sequence++;
+        cipher.Encrypt(payload.data(), payload.size(), sequence * frame_duration, sequence, (uint8_t*)send_buffer.data());
+    });
+    double decrypt_us = MeasureUs(20000, [&]() {
+        // Into the payload of a recycled packet
+        decrypted.resize(send_buffer.size() - AUDIO_CIPHER_NONCE_SIZE);
+        cipher.Decrypt((const uint8_t*)send_buffer.data(), (const uint8_t*)send_buffer.data() + AUDIO_CIPHER_NONCE_SIZE,
+            decrypted.size(), decrypted.data());
+    });
+    double reference_us = MeasureUs(20000, [&]() {
+        sequence++;
+        reference = ReferenceEncrypt(context, nonce, payload, sequence * frame_duration, sequence);
+    });
+    CHECK(decrypted == payload);
+    mbedtls_aes_free(&context);
+
+    printf("%3zu byte packets (%d ms): encrypt %.3f us/packet (%.0f packets/s), decrypt %.3f us/packet, "
+        "with nonce and ciphertext strings %.3f us/packet (%.0f packets/s)\n", payload_size, frame_duration,
+        encrypt_us, 1e6 / encrypt_us, decrypt_us, reference_us, 1e6 / reference_us);
+}
+
+int main() {
+    TestVectors();
+    TestPacket();
+    // Opus at 24 kbps in 20 and 60 ms frames, and a full 60 ms frame of OPUS_PAYLOAD_RESERVE_BYTES
+    Benchmark(60, 20);
+    Benchmark(180, 60);
+    Benchmark(240, 60);
+    printf("audio_cipher: OK\n");
+    return 0;
+}
@@ -0,0 +1,138 @@
+#ifndef AUDIO_LOOPBACK_H
+#define AUDIO_LOOPBACK_H
+
+/*
+ * AudioService on the host with its mic and speaker in memory and its send queue looped back into
+ * the decode queue, as the network would deliver it. Shared by the pipeline benchmark and tests.
+ */
+#include "audio_service.h"
+#include "host_clock.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define OUTPUT_SAMPLE_RATE 24000
+
+static void SleepUntil(int64_t host_us) {
+    int64_t now = HostClockUs();
+    if (host_us > now) {
+        std::this_thread::sleep_for(HostWallDuration(host_us - now));
+    }
+}
+
+/*
+ * The mic returns the input at its sample rate, then silence. A read returns when its last sample
+ * would have been captured, a write when the DMA buffers have room for it.
+ */
+class FileAudioCodec : public AudioCodec {
+public:
+    FileAudioCodec(std::vector<int16_t> input, int input_sample_rate) : input_(std::move(input)) {
+        input_sample_rate_ = input_sample_rate;
+        output_sample_rate_ = OUTPUT_SAMPLE_RATE;
+    }
+
+    const std::vector<int16_t>& output() const { return output_; }
+    // Writes within the capacity do not allocate
+    void ReserveOutput(size_t samples) { output_.reserve(samples); }
+
+private:
+    std::vector<int16_t> input_;
+    size_t input_position_ = 0;
+    int64_t input_clock_ = -1;
+    std::vector<int16_t> output_;
+    int64_t output_clock_ = 0;
+
+    int Read(int16_t* dest, int samples) override {
+        if (input_clock_ < 0) {
+            input_clock_ = HostClockUs();
+        }
+        input_clock_ += (int64_t)samples * 1000000 / input_sample_rate_;
+        SleepUntil(input_clock_);
+        int count = std::min<int>(samples, input_.size() - input_position_);
+        std::copy(input_.begin() + input_position_, input_.begin() + input_position_ + count, dest);
+        std::fill(dest + count, dest + samples, 0);
+        input_position_ += count;
+        return samples;
+    }
+
+    int Write(const int16_t* data, int samples) override {
+        int64_t dma_us = (int64_t)AUDIO_CODEC_DMA_DESC_NUM * AUDIO_CODEC_DMA_FRAME_NUM * 1000000 / output_sample_rate_;
+        output_clock_ = std::max(output_clock_, HostClockUs());
+        output_clock_ += (int64_t)samples * 1000000 / output_sample_rate_;
+        SleepUntil(output_clock_ - dma_us);
+        output_.insert(output_.end(), data, data + samples);
+        return samples;
+    }
+};
+
+// Sends every packet back in order, with a transport sequence number
+class AudioLoopback {
+public:
+    explicit AudioLoopback(AudioService& audio_service) : audio_service_(audio_service) {
+        AudioServiceCallbacks callbacks;
+        callbacks.on_send_queue_available = [this]() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            available_ = true;
+            send_queue_available_.notify_one();
+        };
+        audio_service_.SetCallbacks(callbacks);
+    }
+
+    // Loops the packets back until the host clock reaches end_us
+    void Run(int64_t end_us) {
+        std::unique_ptr<AudioStreamPacket> packet;
+        while (HostClockUs() < end_us) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                send_queue_available_.wait_for(lock, HostWallDuration(10000), [this]() { return available_; });
+                available_ = false;
+            }
+            while (audio_service_.PopPacketsFromSendQueue(&packet, 1) == 1) {
+                auto incoming = audio_service_.AcquireDecodePacket();
+                incoming->sample_rate = packet->sample_rate;
+                incoming->frame_duration = packet->frame_duration;
+                incoming->timestamp = packet->timestamp;
+                incoming->sequence = ++sequence_;
+                incoming->headroom = 0;
+                incoming->payload.assign(packet->data(), packet->data() + packet->size());
+                bytes_ += packet->size();
+                last_ = *incoming;
+                audio_service_.RecycleSendPacket(std::move(packet), true);
+                audio_service_.PushPacketToDecodeQueue(std::move(incoming), true);
+            }
+        }
+    }
+
+    // Delivers count copies of the last packet at once, as a response faster than real time
+    void Burst(int count) {
+        for (int i = 0; i < count && last_.payload.size() > 0; i++) {
+            auto incoming = audio_service_.AcquireDecodePacket();
+            incoming->sample_rate = last_.sample_rate;
+            incoming->frame_duration = last_.frame_duration;
+            incoming->timestamp = last_.timestamp;
+            incoming->sequence = ++sequence_;
+            incoming->headroom = 0;
+            incoming->payload.assign(last_.payload.begin(), last_.payload.end());
+            audio_service_.PushPacketToDecodeQueue(std::move(incoming));
+        }
+    }
+
+    inline uint32_t sequence() const { return sequence_; }
+    // Opus bytes looped back
+    inline size_t bytes() const { return bytes_; }
+    inline const AudioStreamPacket& last_packet() const { return last_; }
+
+private:
+    AudioService& audio_service_;
+    std::mutex mutex_;
+    std::condition_variable send_queue_available_;
+    bool available_ = false;
+    uint32_t sequence_ = 0;
+    size_t bytes_ = 0;
+    AudioStreamPacket last_;
+};
+
+#endif // AUDIO_LOOPBACK_H
@@ -0,0 +1,190 @@
+/*
+ * Runs the AudioService tasks on the host with a file backed codec: the mic reads a WAV file, or a
+ * tone, the send queue is looped back into the decode queue as the network would deliver it, and
+ * the speaker writes a WAV file. The codec paces its reads and writes like the I2S DMA, on the
+ * host clock of the shims, which --speed runs faster than real time. Prints the per-stage latency
+ * percentiles of AudioService::PrintDebugStatistics() and the CPU time per frame.
+ *
+ *   audio_pipeline_benchmark [--speed N] [--seconds S] [input.wav [output.wav]]
+ *
+ * The Opus wrappers are stand-ins (shims/opus_encoder.h), the Opus CPU time is not included.
+ */
+#include "audio_loopback.h"
+#include "esp_log.h"
+#include "host_test.h"
+
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define TONE_SAMPLE_RATE 16000
+#define TONE_FREQUENCY 440
+
+// Mono 16-bit PCM, other channels are dropped
+static bool ReadWav(const char* path, std::vector<int16_t>& samples, int& sample_rate) {
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr) {
+        return false;
+    }
+    std::vector<uint8_t> data;
+    uint8_t buffer[4096];
+    size_t size;
+    while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        data.insert(data.end(), buffer, buffer + size);
+    }
+    fclose(file);
+    if (data.size() < 12 || memcmp(data.data(), "RIFF", 4) != 0 || memcmp(data.data() + 8, "WAVE", 4) != 0) {
+        return false;
+    }
+    int channels = 0, bits = 0;
+    for (size_t pos = 12; pos + 8 <= data.size();) {
+        uint32_t chunk_size;
+        memcpy(&chunk_size, data.data() + pos + 4, 4);
+        const uint8_t* chunk = data.data() + pos + 8;
+        if (pos + 8 + chunk_size > data.size()) {
+            chunk_size = data.size() - pos - 8;
+        }
+        if (memcmp(data.data() + pos, "fmt ", 4) == 0 && chunk_size >= 16) {
+            uint16_t format, channel_count, bits_per_sample;
+            uint32_t rate;
+            memcpy(&format, chunk, 2);
+            memcpy(&channel_count, chunk + 2, 2);
+            memcpy(&rate, chunk + 4, 4);
+            memcpy(&bits_per_sample, chunk + 14, 2);
+            if (format != 1) {
+                return false;
+            }
+            channels = channel_count;
+            bits = bits_per_sample;
+            sample_rate = rate;
+        } else if (memcmp(data.data() + pos, "data", 4) == 0 && channels > 0 && bits == 16) {
+            size_t frames = chunk_size / 2 / channels;
+            samples.resize(frames);
+            for (size_t i = 0; i < frames; i++) {
+                memcpy(&samples[i], chunk + i * channels * 2, 2);
+            }
+            return true;
+        }
+        pos += 8 + chunk_size + (chunk_size & 1);
+    }
+    return false;
+}
+
+static bool WriteWav(const char* path, const std::vector<int16_t>& samples, int sample_rate) {
+    FILE* file = fopen(path, "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    uint32_t data_size = samples.size() * 2;
+    uint32_t riff_size = 36 + data_size;
+    uint32_t fmt_size = 16, rate = sample_rate, byte_rate = sample_rate * 2;
+    uint16_t format = 1, channels = 1, block_align = 2, bits = 16;
+    fwrite("RIFF", 1, 4, file);
+    fwrite(&riff_size, 4, 1, file);
+    fwrite("WAVEfmt ", 1, 8, file);
+    fwrite(&fmt_size, 4, 1, file);
+    fwrite(&format, 2, 1, file);
+    fwrite(&channels, 2, 1, file);
+    fwrite(&rate, 4, 1, file);
+    fwrite(&byte_rate, 4, 1, file);
+    fwrite(&block_align, 2, 1, file);
+    fwrite(&bits, 2, 1, file);
+    fwrite("data", 1, 4, file);
+    fwrite(&data_size, 4, 1, file);
+    fwrite(samples.data(), 2, samples.size(), file);
+    fclose(file);
+    return true;
+}
+
+static double Rms(const int16_t* samples, size_t count) {
+    double sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        sum += (double)samples[i] * samples[i];
+    }
+    return count ? sqrt(sum / count) : 0;
+}
+
+int main(int argc, char** argv) {
+    double seconds = 0;
+    const char* input_path = nullptr;
+    const char* output_path = nullptr;
+    host_time_scale = 4;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+            host_time_scale = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+            seconds = atof(argv[++i]);
+        } else if (input_path == nullptr) {
+            input_path = argv[i];
+        } else {
+            output_path = argv[i];
+        }
+    }
+    CHECK(host_time_scale > 0);
+
+    std::vector<int16_t> input;
+    int input_sample_rate = TONE_SAMPLE_RATE;
+    if (input_path) {
+        if (!ReadWav(input_path, input, input_sample_rate)) {
+            fprintf(stderr, "%s is not a 16-bit PCM WAV file\n", input_path);
+            return 1;
+        }
+    } else {
+        input.resize(TONE_SAMPLE_RATE * 5);
+        for (size_t i = 0; i < input.size(); i++) {
+            input[i] = (int16_t)(8000 * sin(2 * M_PI * TONE_FREQUENCY * i / TONE_SAMPLE_RATE));
+        }
+    }
+    if (seconds <= 0) {
+        // Time for the tail of the input to come back through the pipeline
+        seconds = (double)input.size() / input_sample_rate + 1;
+    }
+
+    FileAudioCodec codec(input, input_sample_rate);
+    codec.ReserveOutput(seconds * OUTPUT_SAMPLE_RATE);
+    Board::GetInstance().SetAudioCodec(&codec);
+    AudioService audio_service;
+
+    AudioLoopback loopback(audio_service);
+    audio_service.Initialize(&codec);
+    audio_service.Start();
+    audio_service.EnableVoiceProcessing(true);
+
+    std::clock_t cpu_start = std::clock();
+    loopback.Run(HostClockUs() + (int64_t)(seconds * 1000000));
+    uint32_t sequence = loopback.sequence();
+    double cpu_us = (double)(std::clock() - cpu_start) * 1000000 / CLOCKS_PER_SEC;
+
+    host_log_info = true;
+    audio_service.PrintDebugStatistics();
+    host_log_info = false;
+    audio_service.Stop();
+    // The tasks end once they see the service stopped
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    auto& output = codec.output();
+    int frame_duration = audio_service.frame_duration();
+    printf("%.1f s of audio at %.1fx: %u packets looped back, %.1f us CPU per %d ms frame (all tasks), "
+        "times above in host clock us\n", seconds, host_time_scale, sequence, sequence ? cpu_us / sequence : 0.0,
+        frame_duration);
+
+    // Everything but the start and the tail, which are still in the pipeline, is played back
+    int64_t frames_expected = (int64_t)(seconds * 1000) / frame_duration;
+    CHECK(sequence >= frames_expected * 3 / 4);
+    CHECK(output.size() >= (size_t)(seconds * OUTPUT_SAMPLE_RATE / 2));
+    if (!input_path) {
+        double input_rms = Rms(input.data(), input.size());
+        double output_rms = Rms(output.data(), output.size());
+        printf("Tone RMS %.0f in, %.0f out\n", input_rms, output_rms);
+        CHECK(output_rms > input_rms / 4);
+    }
+    if (output_path && !WriteWav(output_path, output, OUTPUT_SAMPLE_RATE)) {
+        fprintf(stderr, "Failed to write %s\n", output_path);
+        return 1;
+    }
+    printf("audio_pipeline: OK\n");
+    return 0;
+}
@@ -0,0 +1,155 @@
+/*
+ * The audio profiles and the uplink frame duration negotiation: the ladder of kAudioProfiles, the
+ * frame durations AudioService and Protocol accept, and the batches the server may ask for. Then
+ * each tier runs through the host loopback, reporting packets/s, bytes/s with the v3 header and
+ * the encode time per frame.
+ *
+ *   audio_profile_test [--speed N] [--seconds S]
+ *
+ * The Opus encoder is the stand-in of shims/opus_encoder.h: it does not depend on the complexity
+ * and its CPU time is not that of Opus, so the encode time only shows the per-frame cost around
+ * the encoder. The cost of each complexity has to be measured on the device.
+ */
+#include "audio_loopback.h"
+#include "host_test.h"
+#include "protocol.h"
+
+#include <cmath>
+#include <cstring>
+
+#define TONE_SAMPLE_RATE 16000
+#define TONE_FREQUENCY 440
+
+// Protocol with the transport left out, for the negotiated settings
+class NegotiationProtocol : public Protocol {
+public:
+    bool Start() override { return true; }
+    bool OpenAudioChannel() override { return true; }
+    void CloseAudioChannel() override {}
+    bool IsAudioChannelOpened() const override { return true; }
+    bool SendAudio(AudioStreamPacket& packet) override { return true; }
+    void SetUplinkBatch(int batch_ms) { uplink_batch_ms_ = batch_ms; }
+
+private:
+    bool SendText(const std::string& text) override { return true; }
+};
+
+static void TestLadder(AudioService& audio_service) {
+    static const char* names[] = { "low_latency", "balanced", "default", "low_bandwidth" };
+    int previous_duration = 0;
+    for (int i = 0; i < kAudioProfileCount; i++) {
+        auto type = AudioService::FindAudioProfile(names[i]);
+        CHECK(type == (AudioProfileType)i);
+        audio_service.SetAudioProfile(type);
+        auto& profile = audio_service.GetAudioProfile();
+        CHECK(strcmp(profile.name, names[i]) == 0);
+        CHECK(audio_service.frame_duration() == profile.frame_duration);
+        // Each tier trades latency for fewer packets, none goes back down
+        CHECK(profile.frame_duration >= previous_duration);
+        CHECK(profile.frame_duration % MIN_OPUS_FRAME_DURATION_MS == 0 && profile.frame_duration <= OPUS_FRAME_DURATION_MS);
+        CHECK(profile.complexity >= 0 && profile.complexity <= 10);
+        previous_duration = profile.frame_duration;
+    }
+    CHECK(AudioService::FindAudioProfile("ultra") == kAudioProfileCount);
+    CHECK(AudioService::FindAudioProfile("") == kAudioProfileCount);
+    CHECK(audio_service.GetAudioProfile().frame_duration == OPUS_FRAME_DURATION_MS);
+
+    // Only the multiples of MIN_OPUS_FRAME_DURATION_MS up to OPUS_FRAME_DURATION_MS are taken
+    audio_service.SetFrameDuration(40);
+    CHECK(audio_service.frame_duration() == 40);
+    for (int duration : {0, -20, 10, 50, 80, 120}) {
+        audio_service.SetFrameDuration(duration);
+        CHECK(audio_service.frame_duration() == 40);
+    }
+    audio_service.SetAudioProfile(kAudioProfileDefault);
+}
+
+static void TestNegotiation() {
+    NegotiationProtocol protocol;
+    CHECK(protocol.client_frame_duration() == 60);
+    for (int duration : {20, 40, 60}) {
+        protocol.SetClientFrameDuration(duration);
+        CHECK(protocol.client_frame_duration() == duration);
+    }
+    // What a server may put in uplink_frame_duration, anything else keeps the last one
+    for (int duration : {0, -60, 10, 30, 50, 80, 120, 2500}) {
+        protocol.SetClientFrameDuration(duration);
+        CHECK(protocol.client_frame_duration() == 60);
+    }
+
+    // Batches of whole frames, at least one and at most AUDIO_BATCH_MAX_PACKETS
+    CHECK(protocol.uplink_batch_size() == 1);
+    protocol.SetUplinkBatch(120);
+    CHECK(protocol.uplink_batch_size() == 2);
+    protocol.SetClientFrameDuration(20);
+    CHECK(protocol.uplink_batch_size() == 6);
+    protocol.SetUplinkBatch(50);
+    CHECK(protocol.uplink_batch_size() == 2);
+    protocol.SetUplinkBatch(10);
+    CHECK(protocol.uplink_batch_size() == 1);
+    protocol.SetUplinkBatch(10000);
+    CHECK(protocol.uplink_batch_size() == AUDIO_BATCH_MAX_PACKETS);
+    protocol.SetUplinkBatch(-1);
+    CHECK(protocol.uplink_batch_size() == 1);
+}
+
+static void BenchmarkTier(AudioProfileType type, const std::vector<int16_t>& input, double seconds) {
+    FileAudioCodec codec(input, TONE_SAMPLE_RATE);
+    codec.ReserveOutput(seconds * OUTPUT_SAMPLE_RATE);
+    Board::GetInstance().SetAudioCodec(&codec);
+    AudioService audio_service;
+    AudioLoopback loopback(audio_service);
+    audio_service.Initialize(&codec);
+    audio_service.Start();
+    audio_service.SetAudioProfile(type);
+    audio_service.EnableVoiceProcessing(true);
+    loopback.Run(HostClockUs() + (int64_t)(seconds * 1000000));
+    auto encode_us = audio_service.debug_statistics().encode_time.Percentile(50);
+    auto& profile = audio_service.GetAudioProfile();
+    audio_service.Stop();
+    // The tasks end once they see the service stopped
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    uint32_t packets = loopback.sequence();
+    CHECK(loopback.last_packet().frame_duration == profile.frame_duration);
+    // All but the frames still in the pipeline
+    double expected = seconds * 1000 / profile.frame_duration;
+    CHECK(packets >= expected * 3 / 4 && packets <= expected + 1);
+    double packets_per_second = packets / seconds;
+    double bytes_per_second = (loopback.bytes() + packets * sizeof(BinaryProtocol3)) / seconds;
+    printf("%-14s %2d ms, complexity %d: %5.1f packets/s, %6.0f bytes/s with v3 headers, encode p50 %u us\n",
+        profile.name, profile.frame_duration, profile.complexity, packets_per_second, bytes_per_second, encode_us);
+}
+
+int main(int argc, char** argv) {
+    double seconds = 2;
+    host_time_scale = 4;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--speed") == 0) {
+            host_time_scale = atof(argv[i + 1]);
+        } else if (strcmp(argv[i], "--seconds") == 0) {
+            seconds = atof(argv[i + 1]);
+        }
+    }
+    CHECK(host_time_scale > 0 && seconds > 0);
+
+    {
+        std::vector<int16_t> silence(TONE_SAMPLE_RATE);
+        FileAudioCodec codec(silence, TONE_SAMPLE_RATE);
+        Board::GetInstance().SetAudioCodec(&codec);
+        AudioService audio_service;
+        audio_service.Initialize(&codec);
+        TestLadder(audio_service);
+    }
+    TestNegotiation();
+
+    std::vector<int16_t> input(TONE_SAMPLE_RATE * seconds);
+    for (size_t i = 0; i < input.size(); i++) {
+        input[i] = (int16_t)(8000 * sin(2 * M_PI * TONE_FREQUENCY * i / TONE_SAMPLE_RATE));
+    }
+    for (int type = 0; type < kAudioProfileCount; type++) {
+        BenchmarkTier((AudioProfileType)type, input, seconds);
+    }
+    printf("audio_profile: OK\n");
+    return 0;
+}
@@ -0,0 +1,160 @@
+/*
+ * The uplink of AudioService framed for each binary protocol version as WebsocketProtocol does,
+ * with the send headroom set as Application sets it from uplink_header_size(): the header written
+ * into the headroom of the send packet, and, for comparison, the packet assembled behind the
+ * header in a frame buffer as for packets encoded without headroom. Reports the packets per second
+ * the framing takes on this host and the bytes copied per packet.
+ *
+ *   audio_uplink_benchmark [--speed N] [--seconds S]
+ *
+ * One copy remains with the headroom: the esp-opus-encoder wrapper writes at the front of its
+ * output vector, so the codec task copies the Opus data behind the headroom (encode_copy_bytes).
+ * v1 has no header and turns the headroom off, nothing is copied.
+ */
+#include "audio_loopback.h"
+#include "host_test.h"
+
+#include <arpa/inet.h>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#define TONE_SAMPLE_RATE 16000
+#define TONE_FREQUENCY 440
+
+static size_t header_size(int version) {
+    return version == 2 ? sizeof(BinaryProtocol2) : version == 3 ? sizeof(BinaryProtocol3) : 0;
+}
+
+// The frame of WebsocketProtocol::SendAudio(), in the packet when it has room for the header
+static size_t FrameAudio(int version, AudioStreamPacket& packet, std::vector<uint8_t>& frame_buffer,
+    const uint8_t*& frame, size_t& copied) {
+    size_t size = header_size(version);
+    uint8_t* header = packet.headroom >= size ? packet.payload.data() + packet.headroom - size : nullptr;
+    if (header == nullptr) {
+        frame_buffer.resize(size);
+        frame_buffer.insert(frame_buffer.end(), packet.data(), packet.data() + packet.size());
+        header = frame_buffer.data();
+        copied += packet.size();
+    }
+    if (version == 2) {
+        auto bp2 = (BinaryProtocol2*)header;
+        bp2->version = htons(version);
+        bp2->type = 0;
+        bp2->reserved = 0;
+        bp2->timestamp = htonl(packet.timestamp);
+        bp2->payload_size = htonl(packet.size());
+    } else if (version == 3) {
+        auto bp3 = (BinaryProtocol3*)header;
+        bp3->type = 0;
+        bp3->reserved = 0;
+        bp3->payload_size = htons(packet.size());
+    }
+    frame = header;
+    return size + packet.size();
+}
+
+struct UplinkResult {
+    uint32_t packets = 0;
+    size_t opus_bytes = 0;
+    size_t encode_copied = 0;
+    size_t headroom_copied = 0;
+    size_t assembled_copied = 0;
+    double headroom_us = 0;
+    double assembled_us = 0;
+};
+
+static UplinkResult RunUplink(int version, const std::vector<int16_t>& input, double seconds) {
+    FileAudioCodec codec(input, TONE_SAMPLE_RATE);
+    codec.ReserveOutput(seconds * OUTPUT_SAMPLE_RATE);
+    Board::GetInstance().SetAudioCodec(&codec);
+    AudioService audio_service;
+    std::mutex mutex;
+    std::condition_variable send_queue_available;
+    bool available = false;
+    AudioServiceCallbacks callbacks;
+    callbacks.on_send_queue_available = [&]() {
+        std::lock_guard<std::mutex> lock(mutex);
+        available = true;
+        send_queue_available.notify_one();
+    };
+    audio_service.SetCallbacks(callbacks);
+    audio_service.Initialize(&codec);
+    audio_service.Start();
+    audio_service.EnableVoiceProcessing(true);
+    audio_service.EnableSendHeadroom(header_size(version) > 0);
+
+    UplinkResult result;
+    std::vector<uint8_t> frame_buffer;
+    frame_buffer.reserve(OPUS_PAYLOAD_RESERVE_BYTES + AUDIO_PACKET_HEADROOM);
+    std::unique_ptr<AudioStreamPacket> packet;
+    AudioStreamPacket plain;
+    plain.payload.reserve(OPUS_PAYLOAD_RESERVE_BYTES);
+    int64_t end_us = HostClockUs() + (int64_t)(seconds * 1000000);
+    while (HostClockUs() < end_us) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            send_queue_available.wait_for(lock, HostWallDuration(10000), [&]() { return available; });
+            available = false;
+        }
+        while (audio_service.PopPacketsFromSendQueue(&packet, 1) == 1) {
+            CHECK(packet->headroom == (version == 1 ? 0 : AUDIO_PACKET_HEADROOM));
+            result.packets++;
+            result.opus_bytes += packet->size();
+            const uint8_t* frame;
+            auto start = std::chrono::steady_clock::now();
+            size_t size = FrameAudio(version, *packet, frame_buffer, frame, result.headroom_copied);
+            std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+            result.headroom_us += elapsed.count();
+            CHECK(frame + size == packet->payload.data() + packet->payload.size());
+
+            // The same Opus data without headroom
+            plain.payload.assign(packet->data(), packet->data() + packet->size());
+            start = std::chrono::steady_clock::now();
+            size = FrameAudio(version, plain, frame_buffer, frame, result.assembled_copied);
+            elapsed = std::chrono::steady_clock::now() - start;
+            result.assembled_us += elapsed.count();
+            CHECK(size == header_size(version) + plain.size() && memcmp(frame + size - plain.size(), plain.data(), plain.size()) == 0);
+            audio_service.RecycleSendPacket(std::move(packet), true);
+        }
+    }
+    result.encode_copied = audio_service.debug_statistics().encode_copy_bytes;
+    audio_service.Stop();
+    // The tasks end once they see the service stopped
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    return result;
+}
+
+int main(int argc, char** argv) {
+    double seconds = 3;
+    host_time_scale = 4;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--speed") == 0) {
+            host_time_scale = atof(argv[i + 1]);
+        } else if (strcmp(argv[i], "--seconds") == 0) {
+            seconds = atof(argv[i + 1]);
+        }
+    }
+    CHECK(host_time_scale > 0 && seconds > 0);
+
+    std::vector<int16_t> input(TONE_SAMPLE_RATE * seconds);
+    for (size_t i = 0; i < input.size(); i++) {
+        input[i] = (int16_t)(8000 * sin(2 * M_PI * TONE_FREQUENCY * i / TONE_SAMPLE_RATE));
+    }
+    for (int version : {1, 2, 3}) {
+        auto result = RunUplink(version, input, seconds);
+        CHECK(result.packets > 0);
+        // Only the encoder copy is left with the headroom, the transport copies nothing. v1, which
+        // has no header, sends the packet as it is.
+        CHECK(result.headroom_copied == 0);
+        CHECK(result.assembled_copied == (version == 1 ? 0 : result.opus_bytes));
+        CHECK(version == 1 ? result.encode_copied == 0 : result.encode_copied >= result.opus_bytes);
+        printf("v%d: %u packets of %zu bytes. Headroom: %.1f M packets/s, %zu bytes copied per packet "
+            "by the encoder. Assembled: %.1f M packets/s, %zu bytes copied per packet by the transport\n", version,
+            result.packets, result.opus_bytes / result.packets, result.packets / result.headroom_us,
+            result.encode_copied / result.packets, result.packets / result.assembled_us,
+            result.assembled_copied / result.packets);
+    }
+    printf("audio_uplink: OK\n");
+    return 0;
+}
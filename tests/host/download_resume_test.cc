@@ -0,0 +1,162 @@
+/*
+ * The resume of DownloadPipeline against a local HTTP server whose file changes between two
+ * connections: the If-Range of the resumed requests, the restart of a whole file download from
+ * the first byte, and the failure of a range that no longer belongs to the file that was planned,
+ * as the assets delta download fetches them.
+ */
+#include "download_pipeline.h"
+#include "esp_log.h"
+#include "host_clock.h"
+#include "host_test.h"
+#include "local_http_server.h"
+
+#include <random>
+#include <string>
+
+#define BUFFER_SIZE (16 * 1024)
+#define BUFFER_COUNT 2
+
+static std::string RandomFile(size_t size, unsigned seed) {
+    std::mt19937 random(seed);
+    std::string file(size, '\0');
+    for (auto& byte : file) {
+        byte = (char)random();
+    }
+    return file;
+}
+
+// What the sink has written, restarted like the assets partition
+struct Download {
+    std::string written;
+    int restarts = 0;
+    DownloadStatistics statistics;
+    std::string validator;
+
+    bool Run(const std::string& url, bool restartable, size_t offset = 0, size_t length = 0,
+        const std::string& validator_in = "") {
+        DownloadPipeline pipeline(BUFFER_SIZE, BUFFER_COUNT);
+        bool started = pipeline.Start([this](const char* data, size_t size, size_t offset) {
+            if (offset != written.size()) {
+                return false;
+            }
+            written.append(data, size);
+            return true;
+        }, "download_writer");
+        CHECK(started);
+        if (restartable) {
+            pipeline.SetRestartCallback([this]() {
+                written.clear();
+                restarts++;
+                return true;
+            });
+        }
+        pipeline.SetValidator(validator_in);
+        written.resize(offset);
+        bool fetched = pipeline.Fetch(url, offset, length);
+        bool finished = pipeline.Finish();
+        statistics = pipeline.statistics();
+        validator = pipeline.validator();
+        return fetched && finished;
+    }
+};
+
+static void TestIfRange() {
+    auto file = RandomFile(200 * 1024 + 17, 1);
+    LocalHttpServer server("");
+    server.set_file(file, "\"v1\"", "Tue, 13 Oct 2026 08:00:00 GMT");
+    server.set_drop_after(70 * 1024);
+
+    Download download;
+    CHECK(download.Run(server.url(), true));
+    CHECK(download.written == file);
+    CHECK(download.restarts == 0);
+    CHECK(download.validator == "\"v1\"");
+    auto requests = server.requests();
+    CHECK(requests.size() == 3);
+    CHECK(requests[0].count("If-Range") == 0);
+    for (size_t i = 1; i < requests.size(); i++) {
+        CHECK(requests[i]["If-Range"] == "\"v1\"");
+    }
+
+    // Last-Modified when there is no ETag, or only a weak one
+    server.set_file(file, "W/\"v1\"", "Tue, 13 Oct 2026 08:00:00 GMT");
+    Download dated;
+    CHECK(dated.Run(server.url(), true));
+    CHECK(dated.written == file);
+    CHECK(dated.validator == "Tue, 13 Oct 2026 08:00:00 GMT");
+    CHECK(server.requests().back()["If-Range"] == "Tue, 13 Oct 2026 08:00:00 GMT");
+}
+
+static void TestRestart() {
+    auto old_file = RandomFile(200 * 1024 + 17, 2);
+    auto new_file = RandomFile(230 * 1024 + 5, 3);
+    LocalHttpServer server("");
+    server.set_file(old_file, "\"v1\"");
+    server.set_drop_after(70 * 1024);
+    // A new version is published while the first connection is being read
+    server.set_on_request([&](size_t index) {
+        if (index == 1) {
+            server.set_file(new_file, "\"v2\"");
+        }
+    });
+
+    Download download;
+    CHECK(download.Run(server.url(), true));
+    CHECK(download.written == new_file);
+    CHECK(download.restarts == 1);
+    CHECK(download.statistics.restarts == 1);
+    CHECK(download.validator == "\"v2\"");
+    auto requests = server.requests();
+    CHECK(requests[1]["If-Range"] == "\"v1\"");
+    CHECK(requests[2]["If-Range"] == "\"v2\"");
+    CHECK(requests[2]["Range"] == "bytes=" + std::to_string(70 * 1024) + "-" + std::to_string(new_file.size() - 1));
+
+    // Without a restart callback the spliced file is refused
+    server.set_file(old_file, "\"v1\"");
+    server.set_on_request([&](size_t index) {
+        if (index == 6) {
+            server.set_file(new_file, "\"v3\"");
+        }
+    });
+    Download refused;
+    CHECK(!refused.Run(server.url(), false));
+    CHECK(refused.written.size() < old_file.size());
+    CHECK(server.requests().size() == 7);
+}
+
+static void TestDeltaRange() {
+    auto old_file = RandomFile(200 * 1024, 4);
+    auto new_file = RandomFile(200 * 1024, 5);
+    LocalHttpServer server("");
+    server.set_file(old_file, "\"v1\"");
+
+    // The directory is read first and its validator kept for the ranges
+    std::string directory, validator;
+    CHECK(DownloadPipeline::FetchRange(server.url(), 0, 4096, directory, &validator));
+    CHECK(directory == old_file.substr(0, 4096));
+    CHECK(validator == "\"v1\"");
+    std::string more;
+    CHECK(DownloadPipeline::FetchRange(server.url(), 4096, 4096, more, &validator));
+    CHECK(server.requests().back()["If-Range"] == "\"v1\"");
+
+    Download run;
+    CHECK(run.Run(server.url(), false, 64 * 1024, 32 * 1024, validator));
+    CHECK(run.written.substr(64 * 1024) == old_file.substr(64 * 1024, 32 * 1024));
+
+    // After a new version the planned ranges are refused, not mixed into the partition
+    server.set_file(new_file, "\"v2\"");
+    CHECK(!DownloadPipeline::FetchRange(server.url(), 8192, 4096, more, &validator));
+    Download stale;
+    CHECK(!stale.Run(server.url(), false, 64 * 1024, 32 * 1024, validator));
+    CHECK(stale.written.size() == 64 * 1024);
+}
+
+int main() {
+    // The retries wait 500 ms and more on the device
+    host_time_scale = 50;
+    TestIfRange();
+    TestRestart();
+    TestDeltaRange();
+    printf("download_resume: OK\n");
+    return 0;
+}
@@ -0,0 +1,34 @@
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+// Fails the test binary with the location of the broken expectation
+#define CHECK(condition) do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            exit(1); \
+        } \
+    } while (0)
+
+// Microseconds per run of body, best of a few rounds
+template <typename Body>
+double MeasureUs(int runs, Body body) {
+    double best = 0;
+    for (int round = 0; round < 5; round++) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < runs; i++) {
+            body();
+        }
+        std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+        double us = elapsed.count() / runs;
+        if (round == 0 || us < best) {
+            best = us;
+        }
+    }
+    return best;
+}
+
+#endif // HOST_TEST_H
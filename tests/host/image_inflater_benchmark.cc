@@ -0,0 +1,195 @@
+/*
+ * ImageInflater over images compressed as scripts/release.py does: the round trip at several
+ * buffer sizes, the refusal of truncated streams and of windows the firmware does not take, and
+ * the download time saved against the inflate CPU per MB. Built a second time without rom/miniz.h,
+ * as image_inflater_fallback_test, where compressed images must be refused.
+ *
+ *   image_inflater_benchmark [image.bin]      The image defaults to this program
+ *
+ * ctest gives it the cmake program, a few MB of machine code as a firmware image is. It is x86
+ * code and the inflate runs on the host with zlib, so the ratio and the CPU time are estimates of
+ * those of the device.
+ */
+#include "image_inflater.h"
+#include "host_test.h"
+
+#include <zlib.h>
+#include <cstring>
+#include <string>
+
+#if __has_include(<rom/miniz.h>)
+#define HAVE_ROM_MINIZ 1
+#endif
+
+// As scripts/release.py and scripts/spiffs_assets/spiffs_assets_gen.py
+#define WINDOW_BITS 12
+
+static std::string ReadFile(const char* path) {
+    std::string data;
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr) {
+        return data;
+    }
+    char buffer[65536];
+    size_t size;
+    while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        data.append(buffer, size);
+    }
+    fclose(file);
+    return data;
+}
+
+static std::string Compress(const std::string& data, int stream_bits, int header_bits) {
+    z_stream stream = {};
+    CHECK(deflateInit2(&stream, 9, Z_DEFLATED, stream_bits, 9, Z_DEFAULT_STRATEGY) == Z_OK);
+    std::string output(deflateBound(&stream, data.size()), '\0');
+    stream.next_in = (Bytef*)data.data();
+    stream.avail_in = data.size();
+    stream.next_out = (Bytef*)output.data();
+    stream.avail_out = output.size();
+    CHECK(deflate(&stream, Z_FINISH) == Z_STREAM_END);
+    output.resize(stream.total_out);
+    deflateEnd(&stream);
+
+    compressed_image_header header = {};
+    header.magic = COMPRESSED_IMAGE_MAGIC;
+    header.original_size = data.size();
+    header.window_bits = header_bits;
+    return std::string((const char*)&header, sizeof(header)) + output;
+}
+
+// Feeds the file in buffers of chunk bytes, as the pipeline does
+static bool Inflate(ImageInflater& inflater, const std::string& file, size_t chunk) {
+    for (size_t offset = 0; offset < file.size(); offset += chunk) {
+        if (!inflater.Write(file.data() + offset, std::min(chunk, file.size() - offset), offset)) {
+            return false;
+        }
+    }
+    return inflater.Finish();
+}
+
+// What the sink was given in output
+static bool Inflate(const std::string& file, size_t chunk, std::string& output) {
+    output.clear();
+    ImageInflater inflater([&output](const char* data, size_t size, size_t offset) {
+        if (offset != output.size()) {
+            return false;
+        }
+        output.append(data, size);
+        return true;
+    });
+    return Inflate(inflater, file, chunk);
+}
+
+static void TestPlain(const std::string& image) {
+    std::string output;
+    CHECK(Inflate(image, 16 * 1024, output));
+    CHECK(output == image);
+}
+
+#ifdef HAVE_ROM_MINIZ
+static void TestRoundTrip(const std::string& image) {
+    std::string small = image.substr(0, 64 * 1024);
+    std::string output;
+    // The first buffer holds at least the header
+    for (size_t chunk : {sizeof(compressed_image_header), (size_t)1000, (size_t)4096}) {
+        CHECK(Inflate(Compress(small, WINDOW_BITS, WINDOW_BITS), chunk, output));
+        CHECK(output == small);
+    }
+    std::string large = image.substr(0, 1024 * 1024);
+    for (int bits = COMPRESSED_IMAGE_MIN_WINDOW_BITS; bits <= COMPRESSED_IMAGE_MAX_WINDOW_BITS; bits++) {
+        auto file = Compress(large, bits, bits);
+        for (size_t chunk : {(size_t)16 * 1024, file.size()}) {
+            CHECK(Inflate(file, chunk, output));
+            CHECK(output == large);
+        }
+    }
+
+    // Reset() for a download that starts over
+    auto file = Compress(small, WINDOW_BITS, WINDOW_BITS);
+    output.clear();
+    ImageInflater inflater([&output](const char* data, size_t size, size_t offset) {
+        output.resize(offset);
+        output.append(data, size);
+        return true;
+    });
+    CHECK(inflater.Write(file.data(), 4096, 0));
+    inflater.Reset();
+    CHECK(Inflate(inflater, file, 4096));
+    CHECK(inflater.compressed());
+    CHECK(output == small);
+}
+
+static void TestRefused(const std::string& image) {
+    std::string small = image.substr(0, 64 * 1024);
+    std::string output;
+    auto file = Compress(small, WINDOW_BITS, WINDOW_BITS);
+
+    CHECK(!Inflate(file.substr(0, file.size() - 100), 4096, output));
+    CHECK(!Inflate(file.substr(0, file.size() - 1), 4096, output));
+    auto corrupt = file;
+    corrupt[file.size() / 2] ^= 0x55;
+    CHECK(!Inflate(corrupt, 4096, output));
+    // The size in the header must match
+    auto sized = file;
+    ((compressed_image_header*)sized.data())->original_size -= 1;
+    CHECK(!Inflate(sized, 4096, output));
+    ((compressed_image_header*)sized.data())->original_size += 2;
+    CHECK(!Inflate(sized, 4096, output));
+
+    // zlib writes a 9 bit stream when asked for 8, a header of 8 bits is refused, as are 16 and 0
+    CHECK(!Inflate(Compress(small, 9, 8), 4096, output));
+    CHECK(!Inflate(Compress(small, 15, 16), 4096, output));
+    CHECK(!Inflate(Compress(small, 9, 0), 4096, output));
+    CHECK(output.empty());
+}
+
+static void Benchmark(const std::string& image) {
+    auto file = Compress(image, WINDOW_BITS, WINDOW_BITS);
+    printf("%zu KB image, %zu KB compressed with a %d bytes window (%.1f%%)\n", image.size() / 1024,
+        file.size() / 1024, 1 << WINDOW_BITS, 100.0 * file.size() / image.size());
+
+    double inflate_us = MeasureUs(3, [&]() {
+        ImageInflater inflater([](const char*, size_t, size_t) { return true; });
+        CHECK(Inflate(inflater, file, 16 * 1024));
+    });
+    double us_per_mb = inflate_us * 1024 * 1024 / image.size();
+    printf("Inflate %.0f us per MB on this host, %.1f ms for the image\n", us_per_mb, inflate_us / 1000);
+
+    // Link rates of the device, in KB/s
+    for (double rate : {100.0, 300.0, 1000.0}) {
+        double plain_s = image.size() / 1024.0 / rate;
+        double compressed_s = file.size() / 1024.0 / rate;
+        printf("At %4.0f KB/s: %.1f s plain, %.1f s compressed, %.1f s saved\n", rate, plain_s, compressed_s,
+            plain_s - compressed_s);
+    }
+}
+#else
+static void TestRefused(const std::string& image) {
+    std::string output;
+    ImageInflater inflater([&output](const char* data, size_t size, size_t offset) {
+        output.append(data, size);
+        return true;
+    });
+    auto file = Compress(image.substr(0, 64 * 1024), WINDOW_BITS, WINDOW_BITS);
+    CHECK(!inflater.Write(file.data(), 4096, 0));
+    CHECK(output.empty());
+}
+#endif
+
+int main(int argc, char** argv) {
+    std::string image = ReadFile(argc > 1 ? argv[1] : argv[0]);
+    CHECK(image.size() >= 64 * 1024);
+    CHECK(memcmp(image.data(), "\x5A\x49\x4D\x47", 4) != 0);
+    TestPlain(image);
+#ifdef HAVE_ROM_MINIZ
+    TestRoundTrip(image);
+    TestRefused(image);
+    Benchmark(image);
+    printf("image_inflater: OK\n");
+#else
+    TestRefused(image);
+    printf("image_inflater without rom/miniz.h: OK\n");
+#endif
+    return 0;
+}
@@ -0,0 +1,104 @@
+/*
+ * InterleavedResampler on stereo mic + reference input at the input rates of the codecs, down to
+ * the 16 kHz of the audio processor. Every channel must come out as the mono resampler gives it
+ * alone, and no frame after the first takes from the heap. Then the time per 20 ms frame against
+ * two mono resamplers on channels that are already planar.
+ *
+ *   interleaved_resampler_benchmark
+ *
+ * OpusResampler is the linear stand-in of shims/opus_resampler.h, so the times are those of the
+ * gather and scatter around it more than of the resampling of the device.
+ */
+#include "interleaved_resampler.h"
+#include "sample_kernels.h"
+#include "host_test.h"
+
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <vector>
+
+#define OUTPUT_SAMPLE_RATE 16000
+#define FRAME_DURATION_MS 20
+
+static size_t heap_allocations = 0;
+
+void* operator new(size_t size) {
+    heap_allocations++;
+    void* ptr = malloc(size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+static std::mt19937 random_engine(1);
+
+static std::vector<int16_t> RandomSamples(size_t count) {
+    std::uniform_int_distribution<int> distribution(INT16_MIN, INT16_MAX);
+    std::vector<int16_t> samples(count);
+    for (auto& sample : samples) {
+        sample = distribution(random_engine);
+    }
+    return samples;
+}
+
+static void TestRate(int input_sample_rate) {
+    size_t input_frames = input_sample_rate * FRAME_DURATION_MS / 1000;
+    InterleavedResampler resampler;
+    resampler.Configure(input_sample_rate, OUTPUT_SAMPLE_RATE, 2);
+    resampler.Reserve(input_frames);
+    CHECK(resampler.channels() == 2);
+    OpusResampler mono;
+    mono.Configure(input_sample_rate, OUTPUT_SAMPLE_RATE);
+    size_t output_frames = mono.GetOutputSamples(input_frames);
+
+    auto input = RandomSamples(input_frames * 2);
+    std::vector<int16_t> data;
+    data.reserve(input.size());
+    std::vector<int16_t> channel(input_frames), expected(output_frames), actual(output_frames);
+    size_t allocations = heap_allocations;
+    for (int frame = 0; frame < 3; frame++) {
+        data.assign(input.begin(), input.end());
+        resampler.Process(data);
+        CHECK(data.size() == output_frames * 2);
+        for (int c = 0; c < 2; c++) {
+            ExtractChannel(input.data(), channel.data(), input_frames, 2, c);
+            mono.Process(channel.data(), input_frames, expected.data());
+            ExtractChannel(data.data(), actual.data(), output_frames, 2, c);
+            CHECK(actual == expected);
+        }
+    }
+    // The scratch buffers were sized by Reserve()
+    CHECK(heap_allocations == allocations);
+
+    double stereo_us = MeasureUs(2000, [&]() {
+        data.assign(input.begin(), input.end());
+        resampler.Process(data);
+    });
+    std::vector<int16_t> left(input_frames), right(input_frames), output(output_frames * 2);
+    ExtractChannel(input.data(), left.data(), input_frames, 2, 0);
+    ExtractChannel(input.data(), right.data(), input_frames, 2, 1);
+    double planar_us = MeasureUs(2000, [&]() {
+        mono.Process(left.data(), input_frames, output.data());
+        mono.Process(right.data(), input_frames, output.data() + output_frames);
+    });
+    printf("%5d Hz stereo -> %d Hz: %6.2f us per %d ms frame, two planar mono resamplers %6.2f us\n",
+        input_sample_rate, OUTPUT_SAMPLE_RATE, stereo_us, FRAME_DURATION_MS, planar_us);
+}
+
+int main() {
+    for (int input_sample_rate : {24000, 44100, 48000}) {
+        TestRate(input_sample_rate);
+    }
+    printf("interleaved_resampler: OK\n");
+    return 0;
+}
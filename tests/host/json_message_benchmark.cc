@@ -0,0 +1,325 @@
+/*
+ * JsonMessage over a corpus of server messages as the protocols receive them (tts, stt, llm,
+ * mcp, system, alert), checked field by field, and timed against the dispatch it replaced:
+ * a tree of the whole message and a strcmp chain on "type". cJSON is not part of the tree, so
+ * the reference builds the tree the way cJSON does, one allocation per value and per string.
+ */
+#include "json_message.h"
+#include "host_test.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// MCP payloads are read with GetRaw() here, ParseObject() is not called
+cJSON* cJSON_ParseWithLength(const char*, size_t) {
+    return nullptr;
+}
+
+static const std::vector<std::string> kCorpus = {
+    R"({"type":"hello","transport":"websocket","session_id":"c8a3b1f0","audio_params":{"format":"opus","sample_rate":24000,"channels":1,"frame_duration":60}})",
+    R"({"type":"stt","text":"今天天气怎么样？","session_id":"c8a3b1f0"})",
+    R"({"type":"llm","text":"😊","emotion":"happy","session_id":"c8a3b1f0"})",
+    R"({"type":"tts","state":"start","sample_rate":24000,"session_id":"c8a3b1f0"})",
+    R"({"type":"tts","state":"sentence_start","text":"今天是晴天，最高气温二十五度。","session_id":"c8a3b1f0"})",
+    R"({"type":"tts","state":"sentence_start","text":"He said \"bring an umbrella\"\nlater \u4f60\u597d \ud83d\ude00","session_id":"c8a3b1f0"})",
+    R"({"type":"tts","state":"stop","session_id":"c8a3b1f0"})",
+    R"({"session_id":"c8a3b1f0","type":"mcp","payload":{"jsonrpc":"2.0","id":7,"method":"tools/call","params":{"name":"self.audio_speaker.set_volume","arguments":{"volume":60}}}})",
+    R"({"session_id":"c8a3b1f0","type":"mcp","payload":{"jsonrpc":"2.0","id":2,"method":"tools/list","params":{"cursor":"self.camera.take_photo","withUserTools":true}}})",
+    R"({"type":"system","command":"reboot","session_id":"c8a3b1f0"})",
+    R"({"type":"alert","status":"Warning","message":"Battery low, please charge","emotion":"sad"})",
+    R"( { "type" : "tts" , "state" : "stop" } )",
+};
+
+/*
+ * The reference: a tree of the whole message, keys and strings copied, as cJSON_Parse() builds
+ * it, then cJSON_GetObjectItem() style lookups.
+ */
+struct Node {
+    enum Kind { kNull, kBool, kNumber, kString, kArray, kObject } kind = kNull;
+    char* key = nullptr;
+    char* string = nullptr;
+    double number = 0;
+    Node* child = nullptr;
+    Node* next = nullptr;
+};
+
+static void FreeNode(Node* node) {
+    while (node) {
+        Node* next = node->next;
+        FreeNode(node->child);
+        free(node->key);
+        free(node->string);
+        delete node;
+        node = next;
+    }
+}
+
+static const char* SkipSpace(const char* p) {
+    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') {
+        p++;
+    }
+    return p;
+}
+
+static const char* ParseString(const char* p, char** out) {
+    std::string value;
+    for (p++; *p && *p != '"'; p++) {
+        if (*p != '\\') {
+            value.push_back(*p);
+            continue;
+        }
+        p++;
+        switch (*p) {
+        case 'n': value.push_back('\n'); break;
+        case 't': value.push_back('\t'); break;
+        case 'u': {
+            uint32_t code = strtoul(std::string(p + 1, 4).c_str(), nullptr, 16);
+            p += 4;
+            if (code >= 0xD800 && code < 0xDC00 && p[1] == '\\' && p[2] == 'u') {
+                uint32_t low = strtoul(std::string(p + 3, 4).c_str(), nullptr, 16);
+                code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                p += 6;
+            }
+            if (code < 0x80) {
+                value.push_back(code);
+            } else if (code < 0x800) {
+                value += {(char)(0xC0 | (code >> 6)), (char)(0x80 | (code & 0x3F))};
+            } else if (code < 0x10000) {
+                value += {(char)(0xE0 | (code >> 12)), (char)(0x80 | ((code >> 6) & 0x3F)), (char)(0x80 | (code & 0x3F))};
+            } else {
+                value += {(char)(0xF0 | (code >> 18)), (char)(0x80 | ((code >> 12) & 0x3F)),
+                    (char)(0x80 | ((code >> 6) & 0x3F)), (char)(0x80 | (code & 0x3F))};
+            }
+            break;
+        }
+        default: value.push_back(*p); break;
+        }
+    }
+    *out = strdup(value.c_str());
+    return *p == '"' ? p + 1 : nullptr;
+}
+
+static const char* ParseValue(const char* p, Node* node) {
+    p = SkipSpace(p);
+    if (*p == '"') {
+        node->kind = Node::kString;
+        return ParseString(p, &node->string);
+    }
+    if (*p == '{' || *p == '[') {
+        bool object = *p == '{';
+        node->kind = object ? Node::kObject : Node::kArray;
+        p = SkipSpace(p + 1);
+        Node** tail = &node->child;
+        while (p && *p != (object ? '}' : ']')) {
+            Node* child = new Node;
+            *tail = child;
+            tail = &child->next;
+            if (object) {
+                p = ParseString(p, &child->key);
+                if (p == nullptr || *(p = SkipSpace(p)) != ':') {
+                    return nullptr;
+                }
+                p++;
+            }
+            p = ParseValue(p, child);
+            if (p && *(p = SkipSpace(p)) == ',') {
+                p = SkipSpace(p + 1);
+            }
+        }
+        return p ? p + 1 : nullptr;
+    }
+    char* end;
+    node->number = strtod(p, &end);
+    node->kind = end != p ? Node::kNumber : *p == 'n' ? Node::kNull : Node::kBool;
+    while (*end && *end != ',' && *end != '}' && *end != ']' && *end != ' ') {
+        end++;
+    }
+    return end;
+}
+
+static Node* GetItem(Node* object, const char* key) {
+    for (Node* child = object->child; child; child = child->next) {
+        if (strcmp(child->key, key) == 0) {
+            return child;
+        }
+    }
+    return nullptr;
+}
+
+static bool GetItemString(Node* object, const char* key, std::string& value) {
+    Node* item = GetItem(object, key);
+    if (item == nullptr || item->kind != Node::kString) {
+        return false;
+    }
+    value = item->string;
+    return true;
+}
+
+// What a handler gets out of a message, collected by both dispatchers
+struct Dispatched {
+    int type = 0;
+    int state = 0;
+    std::string text;
+    std::string emotion;
+    std::string payload_method;
+};
+
+static bool ReferenceDispatch(const std::string& data, Dispatched& out) {
+    Node root;
+    if (ParseValue(data.c_str(), &root) == nullptr || root.kind != Node::kObject) {
+        FreeNode(root.child);
+        return false;
+    }
+    std::string type;
+    GetItemString(&root, "type", type);
+    if (strcmp(type.c_str(), "tts") == 0) {
+        out.type = kJsonWordTts;
+        std::string state;
+        GetItemString(&root, "state", state);
+        if (strcmp(state.c_str(), "start") == 0) {
+            out.state = kJsonWordStart;
+        } else if (strcmp(state.c_str(), "stop") == 0) {
+            out.state = kJsonWordStop;
+        } else if (strcmp(state.c_str(), "sentence_start") == 0) {
+            out.state = kJsonWordSentenceStart;
+            GetItemString(&root, "text", out.text);
+        }
+    } else if (strcmp(type.c_str(), "stt") == 0) {
+        out.type = kJsonWordStt;
+        GetItemString(&root, "text", out.text);
+    } else if (strcmp(type.c_str(), "llm") == 0) {
+        out.type = kJsonWordLlm;
+        GetItemString(&root, "emotion", out.emotion);
+    } else if (strcmp(type.c_str(), "mcp") == 0) {
+        out.type = kJsonWordMcp;
+        Node* payload = GetItem(&root, "payload");
+        if (payload && payload->kind == Node::kObject) {
+            GetItemString(payload, "method", out.payload_method);
+        }
+    } else if (strcmp(type.c_str(), "system") == 0) {
+        out.type = kJsonWordSystem;
+        GetItemString(&root, "command", out.text);
+    } else if (strcmp(type.c_str(), "alert") == 0) {
+        out.type = kJsonWordAlert;
+        GetItemString(&root, "message", out.text);
+        GetItemString(&root, "emotion", out.emotion);
+    } else if (strcmp(type.c_str(), "hello") == 0) {
+        out.type = kJsonWordHello;
+    }
+    FreeNode(root.child);
+    return true;
+}
+
+// As Application's OnIncomingJson handler reads the message. The MCP payload is handed to cJSON
+// there; its method is located here with a second JsonMessage, which is not slower than cJSON.
+static bool Dispatch(const std::string& data, Dispatched& out) {
+    JsonMessage message;
+    if (!message.Parse(data.data(), data.size())) {
+        return false;
+    }
+    out.type = message.type();
+    switch (message.type()) {
+    case kJsonWordTts:
+        out.state = message.GetWord("state");
+        if (out.state == kJsonWordSentenceStart) {
+            message.GetString("text", out.text);
+        }
+        break;
+    case kJsonWordStt:
+        message.GetString("text", out.text);
+        break;
+    case kJsonWordLlm:
+        message.GetString("emotion", out.emotion);
+        break;
+    case kJsonWordMcp: {
+        auto payload = message.GetRaw("payload");
+        JsonMessage inner;
+        if (inner.Parse(payload.data(), payload.size())) {
+            inner.GetString("method", out.payload_method);
+        }
+        break;
+    }
+    case kJsonWordSystem:
+        message.GetString("command", out.text);
+        break;
+    case kJsonWordAlert:
+        message.GetString("message", out.text);
+        message.GetString("emotion", out.emotion);
+        break;
+    default:
+        break;
+    }
+    return true;
+}
+
+static void TestCorpus() {
+    for (auto& data : kCorpus) {
+        Dispatched expected, actual;
+        CHECK(ReferenceDispatch(data, expected));
+        CHECK(Dispatch(data, actual));
+        CHECK(actual.type == expected.type);
+        CHECK(actual.state == expected.state);
+        CHECK(actual.text == expected.text);
+        CHECK(actual.emotion == expected.emotion);
+        CHECK(actual.payload_method == expected.payload_method);
+        CHECK(actual.type != kJsonWordUnknown);
+    }
+
+    Dispatched escaped;
+    CHECK(Dispatch(kCorpus[5], escaped));
+    CHECK(escaped.text == "He said \"bring an umbrella\"\nlater 你好 😀");
+
+    JsonMessage message;
+    CHECK(message.Parse(kCorpus[0].data(), kCorpus[0].size()));
+    CHECK(message.type() == kJsonWordHello);
+    CHECK(message.GetRaw("audio_params") ==
+        R"({"format":"opus","sample_rate":24000,"channels":1,"frame_duration":60})");
+    CHECK(message.GetRaw("session_id") == "\"c8a3b1f0\"");
+    CHECK(message.Has("transport"));
+    CHECK(!message.Has("text"));
+    std::string value;
+    CHECK(!message.GetString("audio_params", value));
+
+    CHECK(JsonMessage::LookupWord("sentence_start") == kJsonWordSentenceStart);
+    CHECK(JsonMessage::LookupWord("sentence_stop") == kJsonWordUnknown);
+    CHECK(JsonMessage::LookupWord("") == kJsonWordUnknown);
+
+    for (const char* bad : {"", "[]", "{\"type\":\"tts\"", "{\"type\" \"tts\"}", "{\"type\":\"tts}", "{type:1}",
+            "{\"payload\":{\"a\":[1,2}"}) {
+        CHECK(!message.Parse(bad, strlen(bad)));
+    }
+    CHECK(message.Parse("{}", 2));
+    CHECK(message.type() == kJsonWordUnknown);
+}
+
+static void BenchmarkCorpus() {
+    size_t bytes = 0;
+    for (auto& data : kCorpus) {
+        bytes += data.size();
+    }
+    Dispatched out;
+    double json_message_us = MeasureUs(20000, [&]() {
+        for (auto& data : kCorpus) {
+            out = Dispatched();
+            Dispatch(data, out);
+        }
+    });
+    double reference_us = MeasureUs(20000, [&]() {
+        for (auto& data : kCorpus) {
+            out = Dispatched();
+            ReferenceDispatch(data, out);
+        }
+    });
+    size_t count = kCorpus.size();
+    printf("%zu messages, %zu bytes: JsonMessage %.3f us/message, tree and strcmp %.3f us/message (%.1fx)\n",
+        count, bytes, json_message_us / count, reference_us / count, reference_us / json_message_us);
+}
+
+int main() {
+    TestCorpus();
+    BenchmarkCorpus();
+    printf("json_message: OK\n");
+    return 0;
+}
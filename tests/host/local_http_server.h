@@ -0,0 +1,185 @@
+#ifndef LOCAL_HTTP_SERVER_H
+#define LOCAL_HTTP_SERVER_H
+
+/*
+ * Serves one file on 127.0.0.1 for the download tests, one connection at a time. It answers
+ * Range requests with 206 unless told not to, or unless an If-Range does not match the ETag or
+ * Last-Modified of the file, can drop every connection after a number of body bytes, and paces
+ * the body to a given rate. The headers of every request are kept.
+ */
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+class LocalHttpServer {
+public:
+    using Headers = std::map<std::string, std::string>;
+
+    explicit LocalHttpServer(std::string file) : file_(std::move(file)) {
+        listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+        int reuse = 1;
+        setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(listen_fd_, (sockaddr*)&address, sizeof(address));
+        socklen_t length = sizeof(address);
+        getsockname(listen_fd_, (sockaddr*)&address, &length);
+        port_ = ntohs(address.sin_port);
+        listen(listen_fd_, 4);
+        thread_ = std::thread(&LocalHttpServer::Serve, this);
+    }
+
+    ~LocalHttpServer() {
+        shutdown(listen_fd_, SHUT_RDWR);
+        close(listen_fd_);
+        thread_.join();
+    }
+
+    std::string url() const { return "http://127.0.0.1:" + std::to_string(port_) + "/firmware.bin"; }
+
+    void set_file(std::string file, std::string etag = "", std::string last_modified = "") {
+        std::lock_guard<std::mutex> lock(mutex_);
+        file_ = std::move(file);
+        etag_ = std::move(etag);
+        last_modified_ = std::move(last_modified);
+    }
+    // Called with the number of the request before it is answered, to change the file in between
+    void set_on_request(std::function<void(size_t)> on_request) { on_request_ = std::move(on_request); }
+    void set_range_supported(bool supported) { range_supported_ = supported; }
+    // Body bytes sent per connection before it is closed, 0 for no limit
+    void set_drop_after(size_t bytes) { drop_after_ = bytes; }
+    // Body bytes per second, 0 for as fast as the socket takes them
+    void set_rate(size_t bytes_per_second) { rate_ = bytes_per_second; }
+    void set_status(int status) { status_ = status; }
+
+    std::vector<Headers> requests() const { std::lock_guard<std::mutex> lock(mutex_); return requests_; }
+    size_t served_bytes() const { return served_bytes_; }
+
+private:
+    int listen_fd_;
+    int port_;
+    std::thread thread_;
+    mutable std::mutex mutex_;
+    std::string file_;
+    std::string etag_;
+    std::string last_modified_;
+    std::function<void(size_t)> on_request_;
+    std::vector<Headers> requests_;
+    std::atomic<bool> range_supported_ = true;
+    std::atomic<size_t> drop_after_ = 0;
+    std::atomic<size_t> rate_ = 0;
+    std::atomic<int> status_ = 0;
+    std::atomic<size_t> served_bytes_ = 0;
+
+    void Serve() {
+        int fd;
+        while ((fd = accept(listen_fd_, nullptr, nullptr)) >= 0) {
+            Handle(fd);
+            close(fd);
+        }
+    }
+
+    void Handle(int fd) {
+        std::string head;
+        char buffer[1024];
+        while (head.find("\r\n\r\n") == std::string::npos) {
+            ssize_t ret = recv(fd, buffer, sizeof(buffer), 0);
+            if (ret <= 0) {
+                return;
+            }
+            head.append(buffer, ret);
+        }
+        Headers headers;
+        for (size_t start = head.find("\r\n") + 2, end; (end = head.find("\r\n", start)) != start; start = end + 2) {
+            std::string line = head.substr(start, end - start);
+            size_t colon = line.find(':');
+            if (colon != std::string::npos) {
+                headers[line.substr(0, colon)] = line.substr(line.find_first_not_of(' ', colon + 1));
+            }
+        }
+        size_t index;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            index = requests_.size();
+            requests_.push_back(headers);
+        }
+        if (on_request_) {
+            on_request_(index);
+        }
+        std::string file, etag, last_modified;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            file = file_;
+            etag = etag_;
+            last_modified = last_modified_;
+        }
+
+        int status = 200;
+        size_t begin = 0, end = file.size();
+        auto range = headers.find("Range");
+        auto if_range = headers.find("If-Range");
+        bool current = if_range == headers.end() || (!etag.empty() && if_range->second == etag) ||
+            (!last_modified.empty() && if_range->second == last_modified);
+        if (range != headers.end() && range_supported_ && current) {
+            size_t first = 0, last = SIZE_MAX;
+            sscanf(range->second.c_str(), "bytes=%zu-%zu", &first, &last);
+            if (first >= file.size()) {
+                status = 416;
+                end = begin;
+            } else {
+                status = 206;
+                begin = first;
+                end = std::min(last == SIZE_MAX ? last : last + 1, file.size());
+            }
+        }
+        if (status_ != 0) {
+            status = status_;
+            begin = end = 0;
+        }
+
+        std::string response = "HTTP/1.1 " + std::to_string(status) + " OK\r\nContent-Length: " +
+            std::to_string(end - begin) + "\r\nConnection: close\r\n";
+        if (!etag.empty()) {
+            response += "ETag: " + etag + "\r\n";
+        }
+        if (!last_modified.empty()) {
+            response += "Last-Modified: " + last_modified + "\r\n";
+        }
+        if (status == 206) {
+            response += "Content-Range: bytes " + std::to_string(begin) + "-" + std::to_string(end - 1) + "/" +
+                std::to_string(file.size()) + "\r\n";
+        }
+        response += "\r\n";
+        send(fd, response.data(), response.size(), MSG_NOSIGNAL);
+
+        size_t limit = drop_after_ ? std::min(end, begin + drop_after_) : end;
+        auto start_time = std::chrono::steady_clock::now();
+        for (size_t position = begin; position < limit;) {
+            size_t size = std::min<size_t>(limit - position, 1460);
+            ssize_t ret = send(fd, file.data() + position, size, MSG_NOSIGNAL);
+            if (ret <= 0) {
+                return;
+            }
+            position += ret;
+            served_bytes_ += ret;
+            if (rate_) {
+                std::this_thread::sleep_until(start_time +
+                    std::chrono::microseconds((int64_t)((position - begin) * 1000000 / rate_)));
+            }
+        }
+    }
+};
+
+#endif // LOCAL_HTTP_SERVER_H
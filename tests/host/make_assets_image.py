@@ -0,0 +1,50 @@
+#!/usr/bin/env python3
+"""
+Writes an assets image for the host tests with the packer of scripts/build_default_assets.py:
+a speech model and a font of the usual sizes, an emoji collection and index.json.
+
+    make_assets_image.py <output.bin> <layout_version>
+"""
+
+import json
+import os
+import random
+import sys
+import tempfile
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', '..', 'scripts'))
+from build_default_assets import pack_assets_simple
+
+EMOJIS = ['neutral', 'happy', 'laughing', 'funny', 'sad', 'angry', 'crying', 'loving', 'embarrassed',
+          'surprised', 'shocked', 'thinking', 'winking', 'cool', 'relaxed', 'delicious', 'kissy',
+          'confident', 'sleepy', 'silly', 'confused']
+
+
+def main():
+    output, layout_version = sys.argv[1], int(sys.argv[2])
+    rng = random.Random(2024)
+    files = {
+        'srmodels.bin': rng.randbytes(3 * 1024 * 1024 + 333),
+        'font_puhui_common_20_4.bin': rng.randbytes(1200 * 1024 + 77),
+    }
+    for i, name in enumerate(EMOJIS):
+        files[f'{name}.png'] = rng.randbytes(6000 + i * 411)
+    files['index.json'] = json.dumps({
+        'version': 1,
+        'srmodels': 'srmodels.bin',
+        'text_font': 'font_puhui_common_20_4.bin',
+        'emoji_collection': [{'name': name, 'file': f'{name}.png'} for name in EMOJIS],
+    }).encode('utf-8')
+
+    with tempfile.TemporaryDirectory() as build_dir:
+        assets_dir = os.path.join(build_dir, 'assets')
+        os.makedirs(assets_dir)
+        for name, data in files.items():
+            with open(os.path.join(assets_dir, name), 'wb') as f:
+                f.write(data)
+        pack_assets_simple(assets_dir, os.path.join(build_dir, 'include'), os.path.abspath(output), 'assets', 32,
+                           layout_version)
+
+
+if __name__ == '__main__':
+    main()
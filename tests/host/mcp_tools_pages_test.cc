@@ -0,0 +1,248 @@
+/*
+ * tools/list paging with a few hundred synthetic tools: every page must match the result of
+ * building it tool by tool, which is what GetToolsList did before the pages were cached, and
+ * the cached pages are timed against it. The reference serializes a tool with plain string
+ * appends, cheaper than cJSON, so the measured speedup is a lower bound.
+ */
+#include "mcp_tools_pages.h"
+#include "host_test.h"
+
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#define MAX_BYTES 8000
+
+struct SyntheticTool {
+    std::string name;
+    std::string description;
+    std::vector<std::string> properties;
+    bool user_only;
+};
+
+static std::string ToJson(const SyntheticTool& tool) {
+    std::string json = "{\"name\":\"" + tool.name + "\",\"description\":\"" + tool.description +
+        "\",\"inputSchema\":{\"type\":\"object\",\"properties\":{";
+    for (size_t i = 0; i < tool.properties.size(); i++) {
+        json += (i ? ",\"" : "\"") + tool.properties[i] + "\":{\"type\":\"integer\"}";
+    }
+    json += "}}}";
+    return json;
+}
+
+// The page built tool by tool from the cursor on, serializing every tool again
+static bool ReferencePage(const std::vector<SyntheticTool>& tools, const std::string& cursor,
+    bool with_user_only, std::string& result, std::string& error) {
+    result = "{\"tools\":[";
+    bool found_cursor = cursor.empty();
+    std::string next_cursor;
+    size_t i = 0;
+    for (; i < tools.size(); i++) {
+        if (!found_cursor) {
+            if (tools[i].name != cursor) {
+                continue;
+            }
+            found_cursor = true;
+        }
+        if (!with_user_only && tools[i].user_only) {
+            continue;
+        }
+        std::string tool_json = ToJson(tools[i]) + ",";
+        if (result.size() + tool_json.size() + 30 > MAX_BYTES) {
+            next_cursor = tools[i].name;
+            break;
+        }
+        result += tool_json;
+    }
+    if (!found_cursor) {
+        error = "Invalid cursor " + cursor;
+        return false;
+    }
+    if (result.back() == ',') {
+        result.pop_back();
+    }
+    if (result.back() == '[' && !next_cursor.empty()) {
+        error = "Failed to add tool " + next_cursor + " because of payload size limit";
+        return false;
+    }
+    if (next_cursor.empty()) {
+        result += "]}";
+    } else {
+        result += "],\"nextCursor\":\"" + next_cursor + "\"}";
+    }
+    return true;
+}
+
+struct Registry {
+    std::vector<SyntheticTool> tools;
+    std::vector<McpToolEntry> entries;
+    std::string tools_json;
+    McpToolsPages pages;
+
+    void Add(SyntheticTool tool) {
+        tools.push_back(std::move(tool));
+    }
+
+    // Serializes the tools once, as McpServer::AddTool() does
+    void Build() {
+        entries.clear();
+        tools_json.clear();
+        for (auto& tool : tools) {
+            auto json = ToJson(tool);
+            entries.push_back({nullptr, tool.name, tool.user_only, tools_json.size(), json.size()});
+            tools_json += json;
+        }
+        pages.Build(entries, MAX_BYTES);
+    }
+};
+
+static SyntheticTool MakeTool(int index, size_t description_size, bool user_only) {
+    SyntheticTool tool;
+    tool.name = "self.synthetic.tool_" + std::to_string(index);
+    tool.description.assign(description_size, 'a' + index % 26);
+    for (int i = 0; i < 1 + index % 4; i++) {
+        tool.properties.push_back("argument_" + std::to_string(i));
+    }
+    tool.user_only = user_only;
+    return tool;
+}
+
+// Follows the nextCursor chain and compares every reply to the reference. Returns the number of
+// tools listed, or -1 if the chain ended with an error, whose tool is set in error_tool.
+static int WalkPages(const Registry& registry, bool with_user_only, std::string* error_tool = nullptr) {
+    std::string cursor;
+    int listed = 0;
+    for (;;) {
+        std::string result, error, expected, expected_error;
+        bool ok = registry.pages.GetPage(registry.entries, registry.tools_json, cursor, with_user_only, result, error);
+        bool expected_ok = ReferencePage(registry.tools, cursor, with_user_only, expected, expected_error);
+        CHECK(ok == expected_ok);
+        if (!ok) {
+            CHECK(error == expected_error);
+            if (error_tool) {
+                *error_tool = error.substr(strlen("Failed to add tool "));
+                error_tool->resize(error_tool->find(' '));
+            }
+            return -1;
+        }
+        CHECK(result == expected);
+
+        for (size_t pos = 0; (pos = result.find("{\"name\":\"", pos)) != std::string::npos; pos++) {
+            listed++;
+        }
+        size_t next = result.find("\"nextCursor\":\"");
+        if (next == std::string::npos) {
+            CHECK(result.size() <= MAX_BYTES);
+            return listed;
+        }
+        next += strlen("\"nextCursor\":\"");
+        cursor = result.substr(next, result.find('"', next) - next);
+        // The 30 bytes kept free cover the nextCursor up to a 12 byte name
+        CHECK(result.size() <= MAX_BYTES + cursor.size());
+    }
+}
+
+static void TestSyntheticTools() {
+    Registry registry;
+    std::mt19937 random(42);
+    int user_only = 0;
+    for (int i = 0; i < 400; i++) {
+        bool is_user_only = random() % 5 == 0;
+        user_only += is_user_only;
+        registry.Add(MakeTool(i, 50 + random() % 700, is_user_only));
+    }
+    registry.Build();
+    CHECK(WalkPages(registry, true) == 400);
+    CHECK(WalkPages(registry, false) == 400 - user_only);
+
+    std::string result, error;
+    CHECK(!registry.pages.GetPage(registry.entries, registry.tools_json, "self.unknown", false, result, error));
+    CHECK(error == "Invalid cursor self.unknown");
+}
+
+static void TestOversizedTools() {
+    // Alone on its first page
+    Registry first;
+    first.Add(MakeTool(0, MAX_BYTES, false));
+    first.Add(MakeTool(1, 100, false));
+    first.Build();
+    std::string error_tool;
+    CHECK(WalkPages(first, true, &error_tool) == -1);
+    CHECK(error_tool == first.tools[0].name);
+
+    // Starting a fresh page after a full one
+    Registry fresh;
+    for (int i = 0; i < 20; i++) {
+        fresh.Add(MakeTool(i, 700, false));
+    }
+    fresh.Add(MakeTool(20, MAX_BYTES - 100, false));
+    fresh.Add(MakeTool(21, 100, false));
+    fresh.Build();
+    CHECK(WalkPages(fresh, true, &error_tool) == -1);
+    CHECK(error_tool == fresh.tools[20].name);
+
+    // Last in the list, after a page that is not full
+    Registry last;
+    last.Add(MakeTool(0, 100, false));
+    last.Add(MakeTool(1, MAX_BYTES, false));
+    last.Build();
+    CHECK(WalkPages(last, true, &error_tool) == -1);
+    CHECK(error_tool == last.tools[1].name);
+
+    // Hidden from the list without the user only tools
+    Registry hidden;
+    hidden.Add(MakeTool(0, 100, false));
+    hidden.Add(MakeTool(1, MAX_BYTES, true));
+    hidden.Add(MakeTool(2, 100, false));
+    hidden.Build();
+    CHECK(WalkPages(hidden, false) == 2);
+    CHECK(WalkPages(hidden, true) == -1);
+}
+
+static void BenchmarkToolsList() {
+    Registry registry;
+    std::mt19937 random(7);
+    for (int i = 0; i < 300; i++) {
+        registry.Add(MakeTool(i, 100 + random() % 400, false));
+    }
+    registry.Build();
+
+    // The cursors of all pages, a full tools/list walk requests each of them once
+    std::vector<std::string> cursors = {""};
+    for (;;) {
+        std::string result, error;
+        CHECK(registry.pages.GetPage(registry.entries, registry.tools_json, cursors.back(), false, result, error));
+        size_t next = result.find("\"nextCursor\":\"");
+        if (next == std::string::npos) {
+            break;
+        }
+        next += strlen("\"nextCursor\":\"");
+        cursors.push_back(result.substr(next, result.find('"', next) - next));
+    }
+
+    std::string result, error;
+    double cached_us = MeasureUs(200, [&]() {
+        for (auto& cursor : cursors) {
+            registry.pages.GetPage(registry.entries, registry.tools_json, cursor, false, result, error);
+        }
+    });
+    double reference_us = MeasureUs(200, [&]() {
+        for (auto& cursor : cursors) {
+            ReferencePage(registry.tools, cursor, false, result, error);
+        }
+    });
+    double build_us = MeasureUs(200, [&]() {
+        registry.pages.Build(registry.entries, MAX_BYTES);
+    });
+    printf("tools/list of 300 tools in %zu pages: %.1f us cached, %.1f us tool by tool (%.1fx), "
+        "%.1f us to lay out the pages\n", cursors.size(), cached_us, reference_us, reference_us / cached_us, build_us);
+}
+
+int main() {
+    TestSyntheticTools();
+    TestOversizedTools();
+    BenchmarkToolsList();
+    printf("mcp_tools_pages: OK\n");
+    return 0;
+}
@@ -0,0 +1,196 @@
+/*
+ * ParseOggOpusStream() over streams paged here with few segments per page, so packets, the
+ * OpusTags and a packet larger than a page are continued across pages. Every packet must come back
+ * as it was written, in place unless it was continued. Streams cut inside a page, and a stream
+ * missing a page, keep the packets that are whole.
+ *
+ *   ogg_demuxer_test
+ */
+#include "ogg_demuxer.h"
+#include "host_test.h"
+
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+// 60 ms SILK frames, code 0: the TOC byte of the packets
+#define OPUS_TOC_60MS 0x18
+
+static std::mt19937 random_engine(1);
+
+static std::string OpusHead(uint32_t sample_rate) {
+    std::string head("OpusHead\x01\x01\x38\x01", 12);
+    for (int i = 0; i < 4; i++) {
+        head += (char)(sample_rate >> (8 * i));
+    }
+    head += std::string("\x00\x00\x00", 3);
+    return head;
+}
+
+static std::string OpusPacket(size_t size) {
+    std::uniform_int_distribution<int> distribution(0, 255);
+    std::string packet(size, '\0');
+    packet[0] = OPUS_TOC_60MS;
+    for (size_t i = 1; i < size; i++) {
+        packet[i] = (char)distribution(random_engine);
+    }
+    return packet;
+}
+
+struct Page {
+    std::string data;
+    bool continued;
+};
+
+// Pages of at most max_segments lacing values, numbered from 0. The CRC is left at 0, the demuxer
+// does not check it.
+static std::vector<Page> WritePages(const std::vector<std::string>& packets, size_t max_segments) {
+    std::vector<uint8_t> lacing;
+    std::string body;
+    for (auto& packet : packets) {
+        for (size_t size = packet.size();; size -= 255) {
+            lacing.push_back(size >= 255 ? 255 : size);
+            if (size < 255) {
+                break;
+            }
+        }
+        body += packet;
+    }
+
+    std::vector<Page> pages;
+    size_t body_offset = 0;
+    bool continued = false;
+    for (size_t first = 0; first < lacing.size(); first += max_segments) {
+        size_t count = std::min(max_segments, lacing.size() - first);
+        std::string header(27, '\0');
+        memcpy(&header[0], "OggS", 4);
+        header[5] = continued ? 0x01 : 0x00;
+        for (int i = 0; i < 4; i++) {
+            header[18 + i] = (char)(pages.size() >> (8 * i));
+        }
+        header[26] = (char)count;
+        size_t body_size = 0;
+        for (size_t i = first; i < first + count; i++) {
+            header += (char)lacing[i];
+            body_size += lacing[i];
+        }
+        pages.push_back({ header + body.substr(body_offset, body_size), continued });
+        body_offset += body_size;
+        continued = lacing[first + count - 1] == 255;
+    }
+    return pages;
+}
+
+static std::string Join(const std::vector<Page>& pages) {
+    std::string ogg;
+    for (auto& page : pages) {
+        ogg += page.data;
+    }
+    return ogg;
+}
+
+static std::vector<std::string> AudioPackets() {
+    std::vector<std::string> packets;
+    std::uniform_int_distribution<int> distribution(1, 400);
+    for (int i = 0; i < 100; i++) {
+        packets.push_back(OpusPacket(distribution(random_engine)));
+    }
+    // Larger than a page of 8 segments
+    packets.push_back(OpusPacket(3000));
+    packets.push_back(OpusPacket(255));
+    packets.push_back(OpusPacket(510));
+    packets.push_back(OpusPacket(7));
+    return packets;
+}
+
+static bool InStream(const OggOpusStream& stream, std::string_view packet) {
+    return packet.data() >= stream.data.data() && packet.data() + packet.size() <= stream.data.data() + stream.data.size();
+}
+
+static void TestContinued() {
+    auto audio = AudioPackets();
+    std::vector<std::string> packets = { OpusHead(24000), "OpusTags" + std::string(2000, 't') };
+    packets.insert(packets.end(), audio.begin(), audio.end());
+
+    for (size_t max_segments : {(size_t)3, (size_t)8, (size_t)255}) {
+        std::string ogg = Join(WritePages(packets, max_segments));
+        auto stream = ParseOggOpusStream(ogg);
+        CHECK(stream != nullptr);
+        CHECK(stream->sample_rate == 24000);
+        CHECK(stream->frame_duration == 60);
+        CHECK(stream->packets.size() == audio.size());
+        size_t reassembled = 0;
+        for (size_t i = 0; i < audio.size(); i++) {
+            auto packet = stream->packet(i);
+            CHECK(packet == audio[i]);
+            CHECK(InStream(*stream, packet) != stream->packets[i].reassembled);
+            reassembled += stream->packets[i].reassembled ? packet.size() : 0;
+        }
+        // Only the continued packets are copied
+        CHECK(stream->reassembled.size() == reassembled);
+        CHECK(max_segments == 255 || reassembled > 3000);
+        printf("%3zu segments per page: %zu packets, %zu bytes reassembled of %zu\n", max_segments,
+            stream->packets.size(), reassembled, ogg.size());
+    }
+}
+
+static void TestTruncated() {
+    auto audio = AudioPackets();
+    std::vector<std::string> packets = { OpusHead(16000), "OpusTags" };
+    packets.insert(packets.end(), audio.begin(), audio.end());
+    auto pages = WritePages(packets, 8);
+
+    // Cut inside each page in turn: only the packets ended in the whole pages before it are kept
+    size_t whole = 0;
+    std::string ogg;
+    for (size_t i = 0; i + 1 < pages.size(); i++) {
+        auto stream = ParseOggOpusStream(ogg + pages[i].data.substr(0, pages[i].data.size() / 2));
+        size_t count = stream ? stream->packets.size() : 0;
+        CHECK(count == whole);
+        for (size_t j = 0; j < count; j++) {
+            CHECK(stream->packet(j) == audio[j]);
+        }
+        ogg += pages[i].data;
+        auto full = ParseOggOpusStream(ogg);
+        whole = full ? full->packets.size() : 0;
+    }
+    CHECK(whole > 0 && whole < audio.size());
+
+    // A missing page: the packets it ends are dropped, as is the tail in the next page. Where the
+    // pages around it both continue a packet only the page sequence shows that it is not the same.
+    size_t both_continued = 0;
+    for (size_t missing = 2; missing + 1 < pages.size(); missing++) {
+        if (!pages[missing + 1].continued) {
+            continue;
+        }
+        both_continued += pages[missing].continued;
+        std::string cut;
+        for (size_t i = 0; i < pages.size(); i++) {
+            if (i != missing) {
+                cut += pages[i].data;
+            }
+        }
+        auto stream = ParseOggOpusStream(cut);
+        CHECK(stream != nullptr && stream->packets.size() < audio.size());
+        // Whatever is kept is a packet that was written, in order
+        size_t next = 0;
+        for (size_t j = 0; j < stream->packets.size(); j++) {
+            auto packet = stream->packet(j);
+            while (next < audio.size() && packet != audio[next]) {
+                next++;
+            }
+            CHECK(next < audio.size());
+            next++;
+        }
+        CHECK(stream->packet(stream->packets.size() - 1) == audio.back());
+    }
+    CHECK(both_continued > 0);
+}
+
+int main() {
+    TestContinued();
+    TestTruncated();
+    printf("ogg_demuxer: OK\n");
+    return 0;
+}
@@ -0,0 +1,225 @@
+/*
+ * The OTA download of Ota::Upgrade() against a local HTTP server: DownloadPipeline with the ring
+ * of 16 KB buffers Ota uses, and a mock flash as the sink that erases a 4 KB sector before the
+ * first write into it and hashes what it writes, like esp_ota_write() and the streaming SHA-256.
+ * Reports MB/s next to the loop it replaced, 512-byte reads with the flash write in between, and
+ * checks the resume after dropped connections and the failures that must not be resumed.
+ * Ota::Upgrade() itself needs esp_ota and efuse, it does not build on the host.
+ */
+#include "download_pipeline.h"
+#include "board.h"
+#include "esp_log.h"
+#include "host_clock.h"
+#include "host_test.h"
+#include "local_http_server.h"
+
+#include <openssl/evp.h>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define OTA_BUFFER_SIZE (16 * 1024)
+#define OTA_BUFFER_COUNT 4
+#define FLASH_SECTOR_SIZE 4096
+
+// Per sector erase and per byte write time, scaled down from a SPI flash for a short test
+#define FLASH_ERASE_US 500
+#define FLASH_WRITE_US_PER_KB 60
+// The server's rate, so the network takes about as long as the flash
+#define NETWORK_BYTES_PER_SECOND (6 * 1024 * 1024)
+
+static std::string Sha256(const void* data, size_t size) {
+    unsigned char digest[32];
+    unsigned int length;
+    EVP_Digest(data, size, digest, &length, EVP_sha256(), nullptr);
+    return std::string((char*)digest, length);
+}
+
+// A partition written front to back, as esp_ota_write() does
+class MockFlash {
+public:
+    explicit MockFlash(size_t size) : data_(size, '\xff') {
+        context_ = EVP_MD_CTX_new();
+        EVP_DigestInit_ex(context_, EVP_sha256(), nullptr);
+    }
+
+    ~MockFlash() {
+        EVP_MD_CTX_free(context_);
+    }
+
+    bool Write(const char* data, size_t size, size_t offset) {
+        if (offset != written_ || offset + size > data_.size()) {
+            return false;
+        }
+        size_t end = offset + size;
+        int64_t busy_us = (int64_t)size * FLASH_WRITE_US_PER_KB / 1024;
+        for (; erased_ < end; erased_ += FLASH_SECTOR_SIZE) {
+            busy_us += FLASH_ERASE_US;
+            erased_sectors_++;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(busy_us));
+        memcpy(&data_[offset], data, size);
+        EVP_DigestUpdate(context_, data, size);
+        written_ = end;
+        return true;
+    }
+
+    std::string Digest() {
+        unsigned char digest[32];
+        unsigned int length;
+        EVP_DigestFinal_ex(context_, digest, &length);
+        return std::string((char*)digest, length);
+    }
+
+    const std::string& data() const { return data_; }
+    size_t written() const { return written_; }
+    int erased_sectors() const { return erased_sectors_; }
+
+private:
+    std::string data_;
+    EVP_MD_CTX* context_;
+    size_t written_ = 0;
+    size_t erased_ = 0;
+    int erased_sectors_ = 0;
+};
+
+static double MegabytesPerSecond(size_t bytes, double seconds) {
+    return seconds > 0 ? bytes / seconds / (1024 * 1024) : 0;
+}
+
+static double Seconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Ota::Upgrade() before DownloadPipeline
+static bool SerialDownload(const std::string& url, MockFlash& flash) {
+    auto http = Board::GetInstance().GetNetwork()->CreateHttp(0);
+    if (!http->Open("GET", url) || http->GetStatusCode() != 200) {
+        return false;
+    }
+    char buffer[512];
+    size_t offset = 0;
+    int ret;
+    while ((ret = http->Read(buffer, sizeof(buffer))) > 0) {
+        if (!flash.Write(buffer, ret, offset)) {
+            return false;
+        }
+        offset += ret;
+    }
+    http->Close();
+    return ret == 0 && offset == http->GetBodyLength();
+}
+
+static bool PipelinedDownload(const std::string& url, MockFlash& flash, DownloadStatistics* statistics = nullptr) {
+    DownloadPipeline pipeline(OTA_BUFFER_SIZE, OTA_BUFFER_COUNT);
+    bool started = pipeline.Start([&flash](const char* data, size_t size, size_t offset) {
+        return flash.Write(data, size, offset);
+    }, "ota_writer");
+    CHECK(started);
+    bool fetched = pipeline.Fetch(url, 0, 0);
+    bool finished = pipeline.Finish();
+    if (statistics) {
+        *statistics = pipeline.statistics();
+    }
+    return fetched && finished;
+}
+
+static void Benchmark(const std::string& firmware) {
+    LocalHttpServer server(firmware);
+    server.set_rate(NETWORK_BYTES_PER_SECOND);
+    std::string digest = Sha256(firmware.data(), firmware.size());
+
+    MockFlash serial_flash(firmware.size());
+    auto start = std::chrono::steady_clock::now();
+    CHECK(SerialDownload(server.url(), serial_flash));
+    double serial_seconds = Seconds(start);
+    CHECK(serial_flash.data() == firmware);
+    CHECK(serial_flash.Digest() == digest);
+
+    MockFlash flash(firmware.size());
+    DownloadStatistics statistics;
+    start = std::chrono::steady_clock::now();
+    CHECK(PipelinedDownload(server.url(), flash, &statistics));
+    double pipelined_seconds = Seconds(start);
+    CHECK(flash.data() == firmware);
+    CHECK(flash.Digest() == digest);
+    CHECK(statistics.fetched_bytes == firmware.size());
+    CHECK(statistics.reconnects == 0);
+
+    printf("%zu KB at %d KB/s, %d sectors of %d us: 512-byte reads and inline writes %.2f MB/s, "
+        "%d x %d KB pipeline %.2f MB/s (writer busy %lld ms, reader waited %lld ms)\n",
+        firmware.size() / 1024, NETWORK_BYTES_PER_SECOND / 1024, flash.erased_sectors(), FLASH_ERASE_US,
+        MegabytesPerSecond(firmware.size(), serial_seconds), OTA_BUFFER_COUNT, OTA_BUFFER_SIZE / 1024,
+        MegabytesPerSecond(firmware.size(), pipelined_seconds), (long long)statistics.writer_busy_us / 1000,
+        (long long)statistics.reader_wait_us / 1000);
+    // The network and the flash overlap instead of adding up
+    CHECK(pipelined_seconds < serial_seconds * 0.8);
+}
+
+static void TestResume(const std::string& firmware) {
+    LocalHttpServer server(firmware);
+    // Not on a buffer boundary, the partial buffer is kept across the reconnection
+    const size_t drop_after = 300 * 1024 + 123;
+    server.set_drop_after(drop_after);
+
+    MockFlash flash(firmware.size());
+    DownloadStatistics statistics;
+    CHECK(PipelinedDownload(server.url(), flash, &statistics));
+    CHECK(flash.data() == firmware);
+    CHECK(flash.Digest() == Sha256(firmware.data(), firmware.size()));
+
+    auto requests = server.requests();
+    size_t expected = (firmware.size() + drop_after - 1) / drop_after;
+    CHECK(requests.size() == expected);
+    CHECK(statistics.reconnects == (int)expected - 1);
+    CHECK(requests[0].count("Range") == 0);
+    for (size_t i = 1; i < requests.size(); i++) {
+        // The end is known from the first response
+        CHECK(requests[i]["Range"] == "bytes=" + std::to_string(i * drop_after) + "-" +
+            std::to_string(firmware.size() - 1));
+    }
+    // Nothing was downloaded twice
+    CHECK(server.served_bytes() == firmware.size());
+}
+
+static void TestFailures(const std::string& firmware) {
+    // A server without Range support cannot resume, the download must fail instead of restarting
+    LocalHttpServer server(firmware);
+    server.set_range_supported(false);
+    server.set_drop_after(100 * 1024);
+    MockFlash flash(firmware.size());
+    CHECK(!PipelinedDownload(server.url(), flash));
+    CHECK(server.requests().size() == 2);
+    CHECK(flash.written() <= 100 * 1024);
+
+    server.set_drop_after(0);
+    server.set_status(404);
+    MockFlash missing(firmware.size());
+    size_t requests = server.requests().size();
+    CHECK(!PipelinedDownload(server.url(), missing));
+    CHECK(server.requests().size() == requests + 1);
+    CHECK(missing.written() == 0);
+
+    // A sink failure stops the reader
+    server.set_status(0);
+    MockFlash small(firmware.size() / 2);
+    CHECK(!PipelinedDownload(server.url(), small));
+    CHECK(small.written() <= firmware.size() / 2);
+}
+
+int main() {
+    std::mt19937 random(2024);
+    std::string firmware(1536 * 1024 + 777, '\0');
+    for (auto& byte : firmware) {
+        byte = (char)random();
+    }
+
+    Benchmark(firmware);
+    // The retries wait 500 ms and more on the device
+    host_time_scale = 50;
+    TestResume(firmware);
+    TestFailures(firmware);
+    printf("ota_download: OK\n");
+    return 0;
+}
@@ -0,0 +1,209 @@
+/*
+ * The sample kernels against scalar references written from their contracts in sample_kernels.h,
+ * on random samples and on the saturation edges, with counts that leave a tail after the loops of
+ * four. Then the samples per second of each on a 60 ms frame at 16 kHz, the largest the pipeline
+ * hands them.
+ *
+ *   sample_kernels_benchmark
+ */
+#include "sample_kernels.h"
+#include "host_test.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#define FRAME_SAMPLES 960
+
+static std::mt19937 random_engine(1);
+
+static std::vector<int16_t> RandomSamples(size_t count) {
+    std::uniform_int_distribution<int> distribution(INT16_MIN, INT16_MAX);
+    std::vector<int16_t> samples(count);
+    for (auto& sample : samples) {
+        sample = distribution(random_engine);
+    }
+    return samples;
+}
+
+// Random samples with the edges spread among them
+static std::vector<int16_t> EdgeSamples(size_t count) {
+    static const int16_t edges[] = {INT16_MIN, INT16_MIN + 1, -1, 0, 1, INT16_MAX - 1, INT16_MAX};
+    auto samples = RandomSamples(count);
+    for (size_t i = 0; i < count; i += 3) {
+        samples[i] = edges[(i / 3) % (sizeof(edges) / sizeof(edges[0]))];
+    }
+    return samples;
+}
+
+static int16_t Clamp(int64_t sample, int64_t low) {
+    return (int16_t)std::min<int64_t>(std::max<int64_t>(sample, low), INT16_MAX);
+}
+
+static void TestConvert(size_t count) {
+    auto src = EdgeSamples(count);
+    std::vector<int32_t> wide(count);
+    for (int32_t gain : {0, 1, 12345, SAMPLE_GAIN_UNITY, SAMPLE_GAIN_UNITY_Q16}) {
+        ConvertInt16ToInt32(src.data(), wide.data(), count, gain);
+        for (size_t i = 0; i < count; i++) {
+            CHECK(wide[i] == (int64_t)src[i] * gain);
+        }
+    }
+
+    std::uniform_int_distribution<int32_t> distribution(INT32_MIN, INT32_MAX);
+    for (auto& sample : wide) {
+        sample = distribution(random_engine);
+    }
+    wide[0] = INT32_MIN;
+    wide[count - 1] = INT32_MAX;
+    std::vector<int16_t> dst(count);
+    for (int shift : {0, 8, 15, 16, 17}) {
+        ConvertInt32ToInt16(wide.data(), dst.data(), count, shift);
+        for (size_t i = 0; i < count; i++) {
+            CHECK(dst[i] == Clamp(wide[i] >> shift, -INT16_MAX));
+        }
+    }
+}
+
+static void TestAmplify(size_t count) {
+    auto src = EdgeSamples(count);
+    for (int32_t gain : {0, 1, 2, 3, 10, -1}) {
+        auto samples = src;
+        AmplifySamples(samples.data(), count, gain);
+        for (size_t i = 0; i < count; i++) {
+            CHECK(samples[i] == Clamp((int64_t)src[i] * gain, -INT16_MAX));
+        }
+    }
+}
+
+static void TestScale(size_t count) {
+    auto src = EdgeSamples(count);
+    const int32_t ramps[][2] = {{0, SAMPLE_GAIN_UNITY}, {SAMPLE_GAIN_UNITY, 0}, {SAMPLE_GAIN_UNITY / 2, SAMPLE_GAIN_UNITY / 2},
+        {SAMPLE_GAIN_UNITY, 2 * SAMPLE_GAIN_UNITY}, {SAMPLE_GAIN_UNITY, SAMPLE_GAIN_UNITY}};
+    for (auto& ramp : ramps) {
+        auto samples = src;
+        ScaleSamples(samples.data(), count, ramp[0], ramp[1]);
+        if (ramp[0] == SAMPLE_GAIN_UNITY && ramp[1] == SAMPLE_GAIN_UNITY) {
+            CHECK(samples == src);
+            continue;
+        }
+        int64_t step = ((int64_t)(ramp[1] - ramp[0]) << 8) / (int64_t)count;
+        for (size_t i = 0; i < count; i++) {
+            int64_t gain = (((int64_t)ramp[0] << 8) + step * (int64_t)i) >> 8;
+            CHECK(samples[i] == Clamp((src[i] * gain) >> 15, INT16_MIN));
+            // The ramp stays between its ends
+            CHECK(gain >= std::min(ramp[0], ramp[1]) && gain <= std::max(ramp[0], ramp[1]));
+        }
+    }
+}
+
+static void TestMix(size_t count) {
+    auto src = EdgeSamples(count);
+    auto base = EdgeSamples(count);
+    std::reverse(base.begin(), base.end());
+    for (int32_t gain : {0, 1, SAMPLE_GAIN_UNITY / 3, SAMPLE_GAIN_UNITY, 2 * SAMPLE_GAIN_UNITY}) {
+        auto dst = base;
+        MixSamples(dst.data(), src.data(), count, gain);
+        for (size_t i = 0; i < count; i++) {
+            CHECK(dst[i] == Clamp(base[i] + (((int64_t)src[i] * gain) >> 15), INT16_MIN));
+        }
+    }
+}
+
+static void TestChannels(size_t frames) {
+    for (int channels : {1, 2, 3, 4}) {
+        auto interleaved = RandomSamples(frames * channels);
+        for (int channel = 0; channel < channels; channel++) {
+            std::vector<int16_t> mono(frames);
+            ExtractChannel(interleaved.data(), mono.data(), frames, channels, channel);
+            ChannelView view(interleaved.data(), interleaved.size(), channels, channel);
+            CHECK(view.size() == frames);
+            for (size_t i = 0; i < frames; i++) {
+                CHECK(mono[i] == interleaved[i * channels + channel]);
+                CHECK(view[i] == mono[i]);
+            }
+
+            // In place, as the codecs do with their input buffer
+            auto in_place = interleaved;
+            ExtractChannel(in_place.data(), in_place.data(), frames, channels, channel);
+            CHECK(std::equal(mono.begin(), mono.end(), in_place.begin()));
+
+            // Back into its channel, the others untouched
+            auto other = RandomSamples(frames * channels);
+            auto inserted = other;
+            InsertChannel(mono.data(), inserted.data(), frames, channels, channel);
+            for (size_t i = 0; i < frames * channels; i++) {
+                CHECK(inserted[i] == ((int)(i % channels) == channel ? interleaved[i] : other[i]));
+            }
+        }
+    }
+}
+
+static void Report(const char* name, double us) {
+    printf("%-22s %8.2f us per frame, %7.1f M samples/s\n", name, us, FRAME_SAMPLES / us);
+}
+
+static void Benchmark() {
+    auto src = RandomSamples(FRAME_SAMPLES);
+    auto stereo = RandomSamples(FRAME_SAMPLES * 2);
+    std::vector<int16_t> dst(FRAME_SAMPLES * 2);
+    std::vector<int32_t> wide(FRAME_SAMPLES);
+    volatile int16_t sink = 0;
+
+    printf("%d samples per frame\n", FRAME_SAMPLES);
+    Report("ConvertInt16ToInt32", MeasureUs(10000, [&]() {
+        ConvertInt16ToInt32(src.data(), wide.data(), FRAME_SAMPLES, SAMPLE_GAIN_UNITY_Q16 / 2);
+        sink = wide[0];
+    }));
+    Report("ConvertInt32ToInt16", MeasureUs(10000, [&]() {
+        ConvertInt32ToInt16(wide.data(), dst.data(), FRAME_SAMPLES, 15);
+        sink = dst[0];
+    }));
+    // The kernels below work in place, dst is refilled from src each run and timed alone first
+    double copy_us = MeasureUs(10000, [&]() {
+        std::copy(src.begin(), src.end(), dst.begin());
+        sink = dst[0];
+    });
+    Report("AmplifySamples", MeasureUs(10000, [&]() {
+        std::copy(src.begin(), src.end(), dst.begin());
+        AmplifySamples(dst.data(), FRAME_SAMPLES, 4);
+        sink = dst[0];
+    }) - copy_us);
+    Report("ScaleSamples", MeasureUs(10000, [&]() {
+        std::copy(src.begin(), src.end(), dst.begin());
+        ScaleSamples(dst.data(), FRAME_SAMPLES, 0, SAMPLE_GAIN_UNITY);
+        sink = dst[0];
+    }) - copy_us);
+    Report("MixSamples unity", MeasureUs(10000, [&]() {
+        std::copy(src.begin(), src.end(), dst.begin());
+        MixSamples(dst.data(), src.data(), FRAME_SAMPLES, SAMPLE_GAIN_UNITY);
+        sink = dst[0];
+    }) - copy_us);
+    Report("MixSamples Q15", MeasureUs(10000, [&]() {
+        std::copy(src.begin(), src.end(), dst.begin());
+        MixSamples(dst.data(), src.data(), FRAME_SAMPLES, SAMPLE_GAIN_UNITY / 2);
+        sink = dst[0];
+    }) - copy_us);
+    Report("ExtractChannel stereo", MeasureUs(10000, [&]() {
+        ExtractChannel(stereo.data(), dst.data(), FRAME_SAMPLES, 2, 1);
+        sink = dst[0];
+    }));
+    Report("InsertChannel stereo", MeasureUs(10000, [&]() {
+        InsertChannel(src.data(), dst.data(), FRAME_SAMPLES, 2, 1);
+        sink = dst[1];
+    }));
+}
+
+int main() {
+    // Tails of 0 to 3 samples after the loops of four, and a single sample
+    for (size_t count : {(size_t)1, (size_t)4, (size_t)7, (size_t)161, (size_t)FRAME_SAMPLES + 2}) {
+        TestConvert(count);
+        TestAmplify(count);
+        TestScale(count);
+        TestMix(count);
+        TestChannels(count);
+    }
+    Benchmark();
+    printf("sample_kernels: OK\n");
+    return 0;
+}
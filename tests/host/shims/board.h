@@ -0,0 +1,25 @@
+#ifndef BOARD_H
+#define BOARD_H
+
+#include "network_interface.h"
+
+class AudioCodec;
+
+// The parts of the board the host builds use, the test sets the codec
+class Board {
+public:
+    static Board& GetInstance() {
+        static Board instance;
+        return instance;
+    }
+
+    AudioCodec* GetAudioCodec() { return audio_codec_; }
+    void SetAudioCodec(AudioCodec* codec) { audio_codec_ = codec; }
+    NetworkInterface* GetNetwork() { return &network_; }
+
+private:
+    AudioCodec* audio_codec_ = nullptr;
+    HostNetwork network_;
+};
+
+#endif // BOARD_H
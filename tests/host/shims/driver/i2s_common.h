@@ -0,0 +1,6 @@
+#ifndef DRIVER_I2S_COMMON_H
+#define DRIVER_I2S_COMMON_H
+
+#include "i2s_std.h"
+
+#endif // DRIVER_I2S_COMMON_H
@@ -0,0 +1,104 @@
+#include "esp_timer.h"
+#include "host_clock.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Each timer has a thread that runs its callback, as the esp_timer task would
+struct esp_timer {
+    esp_timer_create_args_t args;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::thread thread;
+    bool active = false;
+    bool periodic = false;
+    bool deleted = false;
+    uint64_t period_us = 0;
+    std::chrono::steady_clock::time_point deadline;
+};
+
+int64_t esp_timer_get_time() {
+    return HostClockUs();
+}
+
+static void TimerThread(esp_timer* timer) {
+    std::unique_lock<std::mutex> lock(timer->mutex);
+    while (!timer->deleted) {
+        if (!timer->active) {
+            timer->cv.wait(lock);
+            continue;
+        }
+        if (timer->cv.wait_until(lock, timer->deadline) != std::cv_status::timeout || !timer->active) {
+            continue;
+        }
+        if (timer->periodic) {
+            timer->deadline += HostWallDuration(timer->period_us);
+        } else {
+            timer->active = false;
+        }
+        lock.unlock();
+        timer->args.callback(timer->args.arg);
+        lock.lock();
+    }
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* handle) {
+    auto timer = new esp_timer;
+    timer->args = *args;
+    timer->thread = std::thread(TimerThread, timer);
+    *handle = timer;
+    return ESP_OK;
+}
+
+static esp_err_t Start(esp_timer_handle_t timer, uint64_t us, bool periodic) {
+    std::lock_guard<std::mutex> lock(timer->mutex);
+    if (timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->active = true;
+    timer->periodic = periodic;
+    timer->period_us = us;
+    timer->deadline = std::chrono::steady_clock::now() + HostWallDuration(us);
+    timer->cv.notify_all();
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us) {
+    return Start(timer, period_us, true);
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    return Start(timer, timeout_us, false);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    std::lock_guard<std::mutex> lock(timer->mutex);
+    if (!timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->active = false;
+    timer->cv.notify_all();
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    {
+        std::lock_guard<std::mutex> lock(timer->mutex);
+        timer->deleted = true;
+        timer->cv.notify_all();
+    }
+    if (timer->thread.get_id() == std::this_thread::get_id()) {
+        timer->thread.detach();
+        return ESP_OK;
+    }
+    timer->thread.join();
+    delete timer;
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer) {
+    std::lock_guard<std::mutex> lock(timer->mutex);
+    return timer->active;
+}
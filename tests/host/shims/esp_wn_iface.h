@@ -0,0 +1,8 @@
+#ifndef ESP_WN_IFACE_H
+#define ESP_WN_IFACE_H
+
+// Types only, the wake word does not run on the host
+typedef struct model_iface_data_t model_iface_data_t;
+typedef struct esp_wn_iface_t esp_wn_iface_t;
+
+#endif // ESP_WN_IFACE_H
@@ -0,0 +1,4 @@
+#ifndef ESP_WN_MODELS_H
+#define ESP_WN_MODELS_H
+
+#endif // ESP_WN_MODELS_H
@@ -0,0 +1,15 @@
+#ifndef FREERTOS_SEMPHR_H
+#define FREERTOS_SEMPHR_H
+
+#include "queue.h"
+
+// Semaphores are queues of empty items, as in FreeRTOS
+#define xSemaphoreCreateBinary() xQueueCreate(1, 0)
+#define xSemaphoreCreateCounting(max, initial) xQueueCreateCounting(max, initial)
+#define xSemaphoreTake(semaphore, ticks) xQueueReceive(semaphore, nullptr, ticks)
+#define xSemaphoreGive(semaphore) xQueueSend(semaphore, nullptr, 0)
+#define vSemaphoreDelete(semaphore) vQueueDelete(semaphore)
+
+QueueHandle_t xQueueCreateCounting(UBaseType_t max_count, UBaseType_t initial_count);
+
+#endif // FREERTOS_SEMPHR_H
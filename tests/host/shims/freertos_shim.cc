@@ -0,0 +1,217 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "host_clock.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+bool host_log_info = false;
+double host_time_scale = 1.0;
+
+struct tskTaskControlBlock {
+    std::mutex mutex;
+    std::condition_variable cv;
+    uint32_t notifications = 0;
+    UBaseType_t priority = 1;
+};
+
+struct EventGroupDef_t {
+    std::mutex mutex;
+    std::condition_variable cv;
+    EventBits_t bits = 0;
+};
+
+// A ring of items, a semaphore has items of size 0
+struct QueueDefinition {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<uint8_t> items;
+    size_t item_size;
+    size_t length;
+    size_t head = 0;
+    size_t count = 0;
+};
+
+static thread_local TaskHandle_t current_task = nullptr;
+
+// Waits on cv until ready() holds or the ticks passed, portMAX_DELAY waits forever
+template <typename Ready>
+static bool WaitFor(std::condition_variable& cv, std::unique_lock<std::mutex>& lock, TickType_t ticks, Ready ready) {
+    if (ticks == portMAX_DELAY) {
+        cv.wait(lock, ready);
+        return true;
+    }
+    return cv.wait_for(lock, HostWallDuration((int64_t)ticks * 1000), ready);
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char*, uint32_t, void* arg, UBaseType_t priority, TaskHandle_t* handle) {
+    // Tasks are never freed, others may still notify a task that ended
+    auto task = new tskTaskControlBlock;
+    task->priority = priority;
+    if (handle) {
+        *handle = task;
+    }
+    std::thread([function, arg, task]() {
+        current_task = task;
+        function(arg);
+    }).detach();
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stack_depth, void* arg,
+    UBaseType_t priority, TaskHandle_t* handle, BaseType_t) {
+    return xTaskCreate(function, name, stack_depth, arg, priority, handle);
+}
+
+void vTaskDelete(TaskHandle_t) {
+}
+
+void vTaskDelay(TickType_t ticks) {
+    std::this_thread::sleep_for(HostWallDuration((int64_t)ticks * 1000));
+}
+
+TickType_t xTaskGetTickCount() {
+    return HostClockUs() / 1000;
+}
+
+int64_t HostClockUs() {
+    static const auto start = std::chrono::steady_clock::now();
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    return (int64_t)(elapsed.count() * host_time_scale);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+    // Threads that were not created as tasks, like main(), get a task on first use
+    if (current_task == nullptr) {
+        current_task = new tskTaskControlBlock;
+    }
+    return current_task;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait) {
+    auto task = xTaskGetCurrentTaskHandle();
+    std::unique_lock<std::mutex> lock(task->mutex);
+    WaitFor(task->cv, lock, ticks_to_wait, [task]() { return task->notifications > 0; });
+    uint32_t count = task->notifications;
+    if (count > 0) {
+        task->notifications = clear_on_exit ? 0 : count - 1;
+    }
+    return count;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    {
+        std::lock_guard<std::mutex> lock(task->mutex);
+        task->notifications++;
+    }
+    task->cv.notify_all();
+    return pdPASS;
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task) {
+    return (task ? task : xTaskGetCurrentTaskHandle())->priority;
+}
+
+void vTaskPrioritySet(TaskHandle_t task, UBaseType_t priority) {
+    (task ? task : xTaskGetCurrentTaskHandle())->priority = priority;
+}
+
+EventGroupHandle_t xEventGroupCreate() {
+    return new EventGroupDef_t;
+}
+
+void vEventGroupDelete(EventGroupHandle_t group) {
+    delete group;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+    std::lock_guard<std::mutex> lock(group->mutex);
+    group->bits |= bits;
+    group->cv.notify_all();
+    return group->bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+    std::lock_guard<std::mutex> lock(group->mutex);
+    EventBits_t previous = group->bits;
+    group->bits &= ~bits;
+    return previous;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group) {
+    std::lock_guard<std::mutex> lock(group->mutex);
+    return group->bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+    BaseType_t wait_for_all, TickType_t ticks_to_wait) {
+    std::unique_lock<std::mutex> lock(group->mutex);
+    auto ready = [group, bits, wait_for_all]() {
+        return wait_for_all ? (group->bits & bits) == bits : (group->bits & bits) != 0;
+    };
+    bool done = WaitFor(group->cv, lock, ticks_to_wait, ready);
+    EventBits_t result = group->bits;
+    if (done && clear_on_exit) {
+        group->bits &= ~bits;
+    }
+    return result;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    auto queue = new QueueDefinition;
+    queue->items.resize((size_t)length * item_size);
+    queue->item_size = item_size;
+    queue->length = length;
+    return queue;
+}
+
+QueueHandle_t xQueueCreateCounting(UBaseType_t max_count, UBaseType_t initial_count) {
+    auto queue = xQueueCreate(max_count, 0);
+    queue->count = initial_count;
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    delete queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks_to_wait) {
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    if (!WaitFor(queue->cv, lock, ticks_to_wait, [queue]() { return queue->count < queue->length; })) {
+        return pdFALSE;
+    }
+    size_t tail = (queue->head + queue->count) % queue->length;
+    if (queue->item_size > 0) {
+        memcpy(queue->items.data() + tail * queue->item_size, item, queue->item_size);
+    }
+    queue->count++;
+    queue->cv.notify_all();
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks_to_wait) {
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    if (!WaitFor(queue->cv, lock, ticks_to_wait, [queue]() { return queue->count > 0; })) {
+        return pdFALSE;
+    }
+    if (queue->item_size > 0) {
+        memcpy(item, queue->items.data() + queue->head * queue->item_size, queue->item_size);
+    }
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    queue->cv.notify_all();
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    return queue->count;
+}
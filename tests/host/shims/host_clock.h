@@ -0,0 +1,21 @@
+#ifndef HOST_CLOCK_H
+#define HOST_CLOCK_H
+
+#include <chrono>
+#include <cstdint>
+
+/*
+ * Clock of the FreeRTOS and esp_timer shims. It runs host_time_scale times faster than the wall
+ * clock, so ticks, delays, timeouts and esp_timer_get_time() keep their proportions when a test
+ * runs the pipeline faster than real time. Set the scale before the first task starts.
+ */
+extern double host_time_scale;
+
+int64_t HostClockUs();
+
+// Wall clock duration of a span of host clock time
+inline std::chrono::microseconds HostWallDuration(int64_t us) {
+    return std::chrono::microseconds((int64_t)(us / host_time_scale));
+}
+
+#endif // HOST_CLOCK_H
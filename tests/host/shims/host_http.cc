@@ -0,0 +1,189 @@
+#include "network_interface.h"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <netdb.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/*
+ * A blocking HTTP/1.1 client for the local test servers: one request per connection, bodies
+ * with a Content-Length or up to the end of the connection. Header names are matched without
+ * regard to case.
+ */
+class HostHttp : public Http {
+public:
+    ~HostHttp() override {
+        Close();
+    }
+
+    void SetTimeout(int timeout_ms) override {
+        timeout_ms_ = timeout_ms;
+    }
+
+    void SetHeader(const std::string& key, const std::string& value) override {
+        request_headers_[key] = value;
+    }
+
+    void SetContent(std::string&& content) override {
+        content_ = std::move(content);
+    }
+
+    bool Open(const std::string& method, const std::string& url) override {
+        Close();
+        if (url.compare(0, 7, "http://") != 0) {
+            return false;
+        }
+        size_t host_end = url.find('/', 7);
+        std::string authority = url.substr(7, host_end == std::string::npos ? std::string::npos : host_end - 7);
+        std::string path = host_end == std::string::npos ? "/" : url.substr(host_end);
+        size_t colon = authority.find(':');
+        std::string host = authority.substr(0, colon);
+        std::string port = colon == std::string::npos ? "80" : authority.substr(colon + 1);
+
+        addrinfo hints = {};
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* address;
+        if (getaddrinfo(host.c_str(), port.c_str(), &hints, &address) != 0) {
+            return false;
+        }
+        fd_ = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        bool connected = fd_ >= 0 && connect(fd_, address->ai_addr, address->ai_addrlen) == 0;
+        freeaddrinfo(address);
+        if (!connected) {
+            Close();
+            return false;
+        }
+        timeval timeout = {timeout_ms_ / 1000, timeout_ms_ % 1000 * 1000};
+        setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        std::string request = method + " " + path + " HTTP/1.1\r\nHost: " + authority + "\r\nConnection: close\r\n";
+        for (auto& [key, value] : request_headers_) {
+            request += key + ": " + value + "\r\n";
+        }
+        if (!content_.empty()) {
+            request += "Content-Length: " + std::to_string(content_.size()) + "\r\n";
+        }
+        request += "\r\n" + content_;
+        if (send(fd_, request.data(), request.size(), MSG_NOSIGNAL) != (ssize_t)request.size()) {
+            Close();
+            return false;
+        }
+        return ReadResponseHeaders();
+    }
+
+    void Close() override {
+        if (fd_ >= 0) {
+            close(fd_);
+            fd_ = -1;
+        }
+    }
+
+    int Read(char* buffer, size_t buffer_size) override {
+        if (body_remaining_ == 0) {
+            return 0;
+        }
+        size_t size = std::min(buffer_size, body_remaining_);
+        if (!pending_.empty()) {
+            size = std::min(size, pending_.size());
+            memcpy(buffer, pending_.data(), size);
+            pending_.erase(0, size);
+        } else {
+            ssize_t ret = recv(fd_, buffer, size, 0);
+            if (ret <= 0) {
+                // The connection ended before the body did
+                return body_remaining_ == SIZE_MAX && ret == 0 ? 0 : -1;
+            }
+            size = ret;
+        }
+        if (body_remaining_ != SIZE_MAX) {
+            body_remaining_ -= size;
+        }
+        return size;
+    }
+
+    int Write(const char* buffer, size_t buffer_size) override {
+        return send(fd_, buffer, buffer_size, MSG_NOSIGNAL);
+    }
+
+    int GetStatusCode() override {
+        return status_code_;
+    }
+
+    std::string GetResponseHeader(const std::string& key) const override {
+        auto it = response_headers_.find(Lower(key));
+        return it == response_headers_.end() ? std::string() : it->second;
+    }
+
+    size_t GetBodyLength() override {
+        return body_length_;
+    }
+
+    std::string ReadAll() override {
+        std::string body;
+        char buffer[4096];
+        int ret;
+        while ((ret = Read(buffer, sizeof(buffer))) > 0) {
+            body.append(buffer, ret);
+        }
+        return body;
+    }
+
+private:
+    int fd_ = -1;
+    int timeout_ms_ = 10000;
+    std::map<std::string, std::string> request_headers_;
+    std::string content_;
+    int status_code_ = 0;
+    std::map<std::string, std::string> response_headers_;
+    size_t body_length_ = 0;
+    size_t body_remaining_ = 0;
+    std::string pending_;
+
+    static std::string Lower(std::string text) {
+        std::transform(text.begin(), text.end(), text.begin(), ::tolower);
+        return text;
+    }
+
+    bool ReadResponseHeaders() {
+        std::string head;
+        size_t head_end;
+        char buffer[1024];
+        while ((head_end = head.find("\r\n\r\n")) == std::string::npos) {
+            ssize_t ret = recv(fd_, buffer, sizeof(buffer), 0);
+            if (ret <= 0) {
+                Close();
+                return false;
+            }
+            head.append(buffer, ret);
+        }
+        pending_ = head.substr(head_end + 4);
+        head.resize(head_end);
+
+        status_code_ = 0;
+        response_headers_.clear();
+        size_t line_end = head.find("\r\n");
+        sscanf(head.c_str(), "HTTP/%*s %d", &status_code_);
+        while (line_end != std::string::npos) {
+            size_t start = line_end + 2;
+            line_end = head.find("\r\n", start);
+            std::string line = head.substr(start, line_end == std::string::npos ? std::string::npos : line_end - start);
+            size_t colon = line.find(':');
+            if (colon != std::string::npos) {
+                size_t value = line.find_first_not_of(' ', colon + 1);
+                response_headers_[Lower(line.substr(0, colon))] = value == std::string::npos ? "" : line.substr(value);
+            }
+        }
+        auto length = GetResponseHeader("Content-Length");
+        body_length_ = length.empty() ? 0 : std::stoull(length);
+        body_remaining_ = length.empty() ? SIZE_MAX : body_length_;
+        return status_code_ > 0;
+    }
+};
+
+std::unique_ptr<Http> HostNetwork::CreateHttp(int) {
+    return std::make_unique<HostHttp>();
+}
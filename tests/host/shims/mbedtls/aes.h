@@ -0,0 +1,22 @@
+#ifndef MBEDTLS_AES_H
+#define MBEDTLS_AES_H
+
+/* The mbedtls AES calls of the firmware over OpenSSL, see mbedtls_shim.cc */
+#include <cstddef>
+#include <cstdint>
+
+#define MBEDTLS_ERR_AES_INVALID_KEY_LENGTH -0x0020
+
+typedef struct evp_cipher_ctx_st EVP_CIPHER_CTX;
+
+typedef struct {
+    EVP_CIPHER_CTX* ecb;
+} mbedtls_aes_context;
+
+void mbedtls_aes_init(mbedtls_aes_context* ctx);
+void mbedtls_aes_free(mbedtls_aes_context* ctx);
+int mbedtls_aes_setkey_enc(mbedtls_aes_context* ctx, const unsigned char* key, unsigned int keybits);
+int mbedtls_aes_crypt_ctr(mbedtls_aes_context* ctx, size_t length, size_t* nc_off, unsigned char nonce_counter[16],
+    unsigned char stream_block[16], const unsigned char* input, unsigned char* output);
+
+#endif // MBEDTLS_AES_H
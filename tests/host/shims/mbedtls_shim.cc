@@ -0,0 +1,40 @@
+#include "mbedtls/aes.h"
+
+#include <openssl/evp.h>
+
+void mbedtls_aes_init(mbedtls_aes_context* ctx) {
+    ctx->ecb = EVP_CIPHER_CTX_new();
+}
+
+void mbedtls_aes_free(mbedtls_aes_context* ctx) {
+    EVP_CIPHER_CTX_free(ctx->ecb);
+    ctx->ecb = nullptr;
+}
+
+int mbedtls_aes_setkey_enc(mbedtls_aes_context* ctx, const unsigned char* key, unsigned int keybits) {
+    const EVP_CIPHER* cipher = keybits == 128 ? EVP_aes_128_ecb() :
+        keybits == 192 ? EVP_aes_192_ecb() : keybits == 256 ? EVP_aes_256_ecb() : nullptr;
+    if (cipher == nullptr || EVP_EncryptInit_ex(ctx->ecb, cipher, nullptr, key, nullptr) != 1) {
+        return MBEDTLS_ERR_AES_INVALID_KEY_LENGTH;
+    }
+    EVP_CIPHER_CTX_set_padding(ctx->ecb, 0);
+    return 0;
+}
+
+// The same block by block loop as the software mbedtls, one AES block per 16 bytes
+int mbedtls_aes_crypt_ctr(mbedtls_aes_context* ctx, size_t length, size_t* nc_off, unsigned char nonce_counter[16],
+    unsigned char stream_block[16], const unsigned char* input, unsigned char* output) {
+    size_t n = *nc_off;
+    for (size_t i = 0; i < length; i++) {
+        if (n == 0) {
+            int written;
+            EVP_EncryptUpdate(ctx->ecb, stream_block, &written, nonce_counter, 16);
+            for (int j = 15; j >= 0 && ++nonce_counter[j] == 0; j--) {
+            }
+        }
+        output[i] = input[i] ^ stream_block[n];
+        n = (n + 1) & 15;
+    }
+    *nc_off = n;
+    return 0;
+}
@@ -0,0 +1,74 @@
+#ifndef ROM_MINIZ_H
+#define ROM_MINIZ_H
+
+/*
+ * The tinfl calls of the ROM on top of zlib, only for image_inflater_benchmark: the output goes to
+ * the buffer given at the position given, with tinfl's status codes. zlib keeps its own window, so
+ * the wrapping buffer is not read back as the ROM does, and the timings are those of zlib.
+ */
+#include <zlib.h>
+#include <cstdint>
+#include <cstddef>
+
+typedef uint8_t mz_uint8;
+typedef uint32_t mz_uint32;
+
+enum tinfl_status {
+    TINFL_STATUS_FAILED_CANNOT_MAKE_PROGRESS = -4,
+    TINFL_STATUS_BAD_PARAM = -3,
+    TINFL_STATUS_ADLER32_MISMATCH = -2,
+    TINFL_STATUS_FAILED = -1,
+    TINFL_STATUS_DONE = 0,
+    TINFL_STATUS_NEEDS_MORE_INPUT = 1,
+    TINFL_STATUS_HAS_MORE_OUTPUT = 2,
+};
+
+#define TINFL_FLAG_PARSE_ZLIB_HEADER 1
+#define TINFL_FLAG_HAS_MORE_INPUT 2
+#define TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF 4
+#define TINFL_FLAG_COMPUTE_ADLER32 8
+
+struct tinfl_decompressor_tag {
+    int state;
+    z_stream stream;
+};
+typedef tinfl_decompressor_tag tinfl_decompressor;
+
+#define tinfl_init(r) do { (r)->state = 0; } while (0)
+
+inline tinfl_status tinfl_decompress(tinfl_decompressor* r, const mz_uint8* in, size_t* in_size, mz_uint8* start,
+    mz_uint8* next, size_t* out_size, mz_uint32 flags) {
+    (void)start;
+    (void)flags;
+    if (r->state == 0) {
+        r->stream = {};
+        if (inflateInit2(&r->stream, MAX_WBITS) != Z_OK) {
+            return TINFL_STATUS_FAILED;
+        }
+        r->state = 1;
+    } else if (r->state != 1) {
+        *in_size = 0;
+        *out_size = 0;
+        return r->state == 2 ? TINFL_STATUS_DONE : TINFL_STATUS_FAILED;
+    }
+    r->stream.next_in = (Bytef*)in;
+    r->stream.avail_in = *in_size;
+    r->stream.next_out = next;
+    r->stream.avail_out = *out_size;
+    int ret = inflate(&r->stream, Z_NO_FLUSH);
+    *in_size -= r->stream.avail_in;
+    *out_size -= r->stream.avail_out;
+    if (ret == Z_STREAM_END) {
+        inflateEnd(&r->stream);
+        r->state = 2;
+        return TINFL_STATUS_DONE;
+    }
+    if (ret != Z_OK && ret != Z_BUF_ERROR) {
+        inflateEnd(&r->stream);
+        r->state = 3;
+        return TINFL_STATUS_FAILED;
+    }
+    return r->stream.avail_out == 0 ? TINFL_STATUS_HAS_MORE_OUTPUT : TINFL_STATUS_NEEDS_MORE_INPUT;
+}
+
+#endif // ROM_MINIZ_H
@@ -0,0 +1,19 @@
+#ifndef MODEL_PATH_H
+#define MODEL_PATH_H
+
+// No speech models on the host
+typedef struct {
+    int num;
+    char** model_name;
+    char** model_data;
+} srmodel_list_t;
+
+#define ESP_MN_PREFIX "mn"
+#define ESP_WN_PREFIX "wn"
+#define ESP_NSNET_PREFIX "nsnet"
+#define ESP_VADN_PREFIX "vadnet"
+
+inline char* esp_srmodel_filter(srmodel_list_t*, const char*, const char*) { return nullptr; }
+inline srmodel_list_t* esp_srmodel_init(const char*) { return nullptr; }
+
+#endif // MODEL_PATH_H
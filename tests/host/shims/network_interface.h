@@ -0,0 +1,20 @@
+#ifndef NETWORK_INTERFACE_H
+#define NETWORK_INTERFACE_H
+
+#include <memory>
+#include "http.h"
+
+// The part of the network component the host builds use
+class NetworkInterface {
+public:
+    virtual ~NetworkInterface() = default;
+    virtual std::unique_ptr<Http> CreateHttp(int connect_id = -1) = 0;
+};
+
+// HTTP/1.1 over plain sockets, http:// URLs only
+class HostNetwork : public NetworkInterface {
+public:
+    std::unique_ptr<Http> CreateHttp(int connect_id = -1) override;
+};
+
+#endif // NETWORK_INTERFACE_H
@@ -0,0 +1,34 @@
+#ifndef OPUS_DECODER_H
+#define OPUS_DECODER_H
+
+#include <vector>
+#include <cstdint>
+
+// Stand-in for the esp-opus-encoder wrapper, see opus_encoder.h. An empty packet conceals with silence.
+class OpusDecoderWrapper {
+public:
+    OpusDecoderWrapper(int sample_rate, int channels, int duration_ms = 60)
+        : sample_rate_(sample_rate), channels_(channels), duration_ms_(duration_ms) {}
+
+    bool Decode(std::vector<uint8_t>&& opus, std::vector<int16_t>& pcm) {
+        size_t frame_size = (size_t)sample_rate_ * duration_ms_ / 1000 * channels_;
+        pcm.resize(frame_size);
+        size_t count = opus.size() / sizeof(int16_t);
+        auto in = reinterpret_cast<const int16_t*>(opus.data());
+        for (size_t i = 0; i < frame_size; i++) {
+            pcm[i] = count ? in[i * count / frame_size] : 0;
+        }
+        return true;
+    }
+
+    void ResetState() {}
+    inline int sample_rate() const { return sample_rate_; }
+    inline int duration_ms() const { return duration_ms_; }
+
+private:
+    int sample_rate_;
+    int channels_;
+    int duration_ms_;
+};
+
+#endif // OPUS_DECODER_H
@@ -0,0 +1,45 @@
+#ifndef OPUS_ENCODER_H
+#define OPUS_ENCODER_H
+
+#include <vector>
+#include <cstdint>
+
+/*
+ * Stand-in for the esp-opus-encoder wrapper, libopus is not part of the tree. It keeps every
+ * OPUS_STAND_IN_DECIMATION-th sample, which gives packets of the size of 32 kbps Opus, so the
+ * pipeline moves the same amount of data. The CPU time of Opus itself is not measured.
+ */
+#define OPUS_STAND_IN_DECIMATION 8
+
+class OpusEncoderWrapper {
+public:
+    OpusEncoderWrapper(int sample_rate, int channels, int duration_ms = 60)
+        : sample_rate_(sample_rate), channels_(channels), duration_ms_(duration_ms) {}
+
+    bool Encode(std::vector<int16_t>&& pcm, std::vector<uint8_t>& opus) {
+        size_t frame_size = (size_t)sample_rate_ * duration_ms_ / 1000 * channels_;
+        if (pcm.size() != frame_size) {
+            return false;
+        }
+        opus.resize(frame_size / OPUS_STAND_IN_DECIMATION * sizeof(int16_t));
+        auto out = reinterpret_cast<int16_t*>(opus.data());
+        for (size_t i = 0; i < frame_size / OPUS_STAND_IN_DECIMATION; i++) {
+            out[i] = pcm[i * OPUS_STAND_IN_DECIMATION];
+        }
+        return true;
+    }
+
+    void SetComplexity(int complexity) { complexity_ = complexity; }
+    void SetDtx(bool) {}
+    void ResetState() {}
+    inline int sample_rate() const { return sample_rate_; }
+    inline int duration_ms() const { return duration_ms_; }
+
+private:
+    int sample_rate_;
+    int channels_;
+    int duration_ms_;
+    int complexity_ = 0;
+};
+
+#endif // OPUS_ENCODER_H
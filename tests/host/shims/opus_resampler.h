@@ -0,0 +1,36 @@
+#ifndef OPUS_RESAMPLER_H
+#define OPUS_RESAMPLER_H
+
+#include <cstdint>
+
+// Stand-in for the esp-opus-encoder resampler, linear interpolation
+class OpusResampler {
+public:
+    void Configure(int input_sample_rate, int output_sample_rate) {
+        input_sample_rate_ = input_sample_rate;
+        output_sample_rate_ = output_sample_rate;
+    }
+
+    void Process(const int16_t* input, int input_samples, int16_t* output) {
+        int output_samples = GetOutputSamples(input_samples);
+        for (int i = 0; i < output_samples; i++) {
+            int64_t position = (int64_t)i * input_sample_rate_ * 256 / output_sample_rate_;
+            int index = position >> 8;
+            int next = index + 1 < input_samples ? index + 1 : index;
+            output[i] = (int16_t)((input[index] * (256 - (position & 255)) + input[next] * (position & 255)) >> 8);
+        }
+    }
+
+    int GetOutputSamples(int input_samples) const {
+        return (int)((int64_t)input_samples * output_sample_rate_ / input_sample_rate_);
+    }
+
+    inline int input_sample_rate() const { return input_sample_rate_; }
+    inline int output_sample_rate() const { return output_sample_rate_; }
+
+private:
+    int input_sample_rate_ = 16000;
+    int output_sample_rate_ = 16000;
+};
+
+#endif // OPUS_RESAMPLER_H
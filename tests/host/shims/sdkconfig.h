@@ -0,0 +1,7 @@
+#ifndef SDKCONFIG_H
+#define SDKCONFIG_H
+
+// Host builds have no target: no audio processor, wake word, debugger or PSRAM.
+// Options are set per test with compile definitions.
+
+#endif // SDKCONFIG_H
@@ -0,0 +1,24 @@
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include <string>
+
+// Settings in memory, nothing is kept between runs
+class Settings {
+public:
+    Settings(const std::string& ns, bool read_write = false) : ns_(ns) { (void)read_write; }
+
+    std::string GetString(const std::string& key, const std::string& default_value = "") { return default_value; }
+    void SetString(const std::string&, const std::string&) {}
+    int32_t GetInt(const std::string& key, int32_t default_value = 0) { return default_value; }
+    void SetInt(const std::string&, int32_t) {}
+    bool GetBool(const std::string& key, bool default_value = false) { return default_value; }
+    void SetBool(const std::string&, bool) {}
+    void EraseKey(const std::string&) {}
+    void EraseAll() {}
+
+private:
+    std::string ns_;
+};
+
+#endif // SETTINGS_H
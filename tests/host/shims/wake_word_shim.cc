@@ -0,0 +1,29 @@
+#include "wake_words/esp_wake_word.h"
+
+// The wake word does not run on the host, there are no models for it
+EspWakeWord::EspWakeWord() {
+}
+
+EspWakeWord::~EspWakeWord() {
+}
+
+bool EspWakeWord::Initialize(AudioCodec*, srmodel_list_t*) {
+    return false;
+}
+
+void EspWakeWord::Feed(const std::vector<int16_t>&) {
+}
+
+void EspWakeWord::OnWakeWordDetected(std::function<void(const std::string& wake_word)> callback) {
+    wake_word_detected_callback_ = callback;
+}
+
+void EspWakeWord::Start() {
+}
+
+void EspWakeWord::Stop() {
+}
+
+size_t EspWakeWord::GetFeedSize() {
+    return 0;
+}